@@ -0,0 +1,516 @@
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      batch.c                                                              */
+/*                                                                           */
+/*      Implementation file for the batch driver, "comp2 --batch".           */
+/*                                                                           */
+/*      A manifest names any number of programs to compile, one per line,    */
+/*      as three whitespace separated fields:                                */
+/*                                                                           */
+/*          <source file>  <listing file>  <code file>                       */
+/*                                                                           */
+/*      Blank lines and lines starting with '#' are ignored.  The programs   */
+/*      are compiled in one process by a pool of worker threads, so each     */
+/*      pays neither process startup nor anything but its own three fopen    */
+/*      calls.  Each worker has its own COMPILER (see "NewCompiler"), so     */
+/*      the workers share nothing but the job table, and the diagnostics     */
+/*      writer if the errors are to be written as diagnostics.               */
+/*                                                                           */
+/*      Work is shared out by work stealing.  The jobs are dealt out in      */
+/*      contiguous runs, one run per worker, and each run is held as a       */
+/*      deque of job indices [top, bottom).  A worker takes jobs from the    */
+/*      bottom of its own deque; when that is empty it steals from the top   */
+/*      of another worker's.  Since no jobs are added once the pool starts,  */
+/*      a worker which finds every deque empty is finished.                  */
+/*                                                                           */
+/*      A program which cannot be compiled at all, e.g., one too large for   */
+/*      the code table, is reported as a program with errors (see            */
+/*      "FatalError" in comp2.c), so it fails only its own job.              */
+/*                                                                           */
+/*      When the pool is done, the programs with errors are listed in        */
+/*      manifest order, followed by the number of programs compiled per      */
+/*      second and the 50th, 90th and 99th percentile and maximum time       */
+/*      taken to compile one program, including opening and closing its      */
+/*      files.                                                               */
+/*                                                                           */
+/*      This module uses POSIX threads, so comp2 must be linked with         */
+/*      -lpthread.                                                           */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "global.h"
+#include "comp2.h"
+#include "batch.h"
+
+#define  MAX_WORKERS         64     /*  Upper limit on the pool size.        */
+#define  MANIFEST_LINE     4096     /*  Longest manifest line accepted.      */
+
+#define  JOB_VALID            0     /*  Compiled without errors.             */
+#define  JOB_INVALID          1     /*  Compiled, errors detected.           */
+#define  JOB_NOFILE           2     /*  A file could not be opened.          */
+
+typedef struct  {
+    char *source;
+    char *listing;
+    char *code;
+    int status;                     /*  JOB_VALID, JOB_INVALID, JOB_NOFILE.  */
+    double latency;                 /*  Seconds taken to compile.            */
+}
+    JOB;
+
+typedef struct  {
+    pthread_mutex_t lock;
+    int top;                        /*  Next job a thief takes.              */
+    int bottom;                     /*  One past the next job the owner      */
+}                                   /*  takes.                               */
+    DEQUE;
+
+typedef struct  {
+    JOB *jobs;
+    DEQUE deques[MAX_WORKERS];
+    int workers;
+    DIAGWRITER *diagnostics;        /*  Shared by the workers, or NULL.      */
+}
+    POOL;
+
+typedef struct  {
+    POOL *pool;
+    int id;                         /*  Index of this worker's own deque.    */
+}
+    WORKER;
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      Declarations of routines private to this module.                     */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE int    ReadManifest( char *manifest, JOB **jobs, int *count );
+PRIVATE int    SplitFields( char *line, char *fields[], int max );
+PRIVATE char  *CopyString( char *s );
+PRIVATE void   FreeJobs( JOB *jobs, int count );
+PRIVATE void  *Worker( void *arg );
+PRIVATE int    TakeJob( POOL *pool, int id );
+PRIVATE void   CompileJob( COMPILER *compiler, POOL *pool, JOB *job );
+PRIVATE double Now( void );
+PRIVATE int    CompareLatency( const void *a, const void *b );
+PRIVATE double Percentile( double *sorted, int count, int percent );
+PRIVATE void   ReportBatch( FILE *reportfile, JOB *jobs, int count,
+                            int workers, double elapsed );
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      Public routines (globally accessable).                               */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      CompileBatch                                                         */
+/*                                                                           */
+/*      Compiles every program named in a manifest file on a pool of         */
+/*      worker threads, then reports the results.                            */
+/*                                                                           */
+/*      Input(s):                                                            */
+/*                                                                           */
+/*          manifest     name of the manifest file.                          */
+/*                                                                           */
+/*          threads      number of worker threads, or 0 or less for one      */
+/*                       per online processor.                               */
+/*                                                                           */
+/*          reportfile   where the programs with errors and the summary      */
+/*                       are written.                                        */
+/*                                                                           */
+/*          diagnostics  where the errors of every program are written, in   */
+/*                       place of being echoed to stderr, or NULL (see       */
+/*                       SetCompilerDiagnostics).                            */
+/*                                                                           */
+/*      Output(s):       None                                                */
+/*                                                                           */
+/*      Returns:         1 if the manifest was read and every program in it  */
+/*                       compiled without errors, 0 otherwise.               */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PUBLIC int CompileBatch( char *manifest, int threads, FILE *reportfile,
+                         DIAGWRITER *diagnostics )
+{
+    POOL pool;
+    WORKER workers[MAX_WORKERS];
+    pthread_t tids[MAX_WORKERS];
+    int started[MAX_WORKERS];
+    JOB *jobs;
+    int count, i, first, ok;
+    double start, elapsed;
+
+    if ( !ReadManifest( manifest, &jobs, &count ) )  return 0;
+
+    if ( threads <= 0 )  threads = (int) sysconf( _SC_NPROCESSORS_ONLN );
+    if ( threads <= 0 )  threads = 1;
+    if ( threads > MAX_WORKERS )  threads = MAX_WORKERS;
+    if ( threads > count && count > 0 )  threads = count;
+
+    pool.jobs = jobs;
+    pool.workers = threads;
+    pool.diagnostics = diagnostics;
+    for ( i = 0, first = 0; i < threads; i++ )  {
+        pthread_mutex_init( &pool.deques[i].lock, NULL );
+        pool.deques[i].top = first;
+        first += count / threads + ( i < count % threads );
+        pool.deques[i].bottom = first;
+        workers[i].pool = &pool;
+        workers[i].id = i;
+    }
+
+    /*  The calling thread is worker 0.  If a thread can't be started its  */
+    /*  run is simply stolen by the others.                                */
+
+    start = Now();
+    for ( i = 1; i < threads; i++ )
+        started[i] = !pthread_create( &tids[i], NULL, Worker, &workers[i] );
+    Worker( &workers[0] );
+    for ( i = 1; i < threads; i++ )
+        if ( started[i] )  pthread_join( tids[i], NULL );
+    elapsed = Now() - start;
+
+    for ( i = 0; i < threads; i++ )
+        pthread_mutex_destroy( &pool.deques[i].lock );
+
+    ReportBatch( reportfile, jobs, count, threads, elapsed );
+
+    for ( i = 0, ok = 1; i < count; i++ )
+        if ( jobs[i].status != JOB_VALID )  ok = 0;
+    FreeJobs( jobs, count );
+    return ok;
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      Private routines (only accessable within this module).               */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      ReadManifest                                                         */
+/*                                                                           */
+/*      Reads a manifest file into a newly allocated job table.              */
+/*                                                                           */
+/*      Input(s):        manifest, name of the manifest file                 */
+/*                                                                           */
+/*      Output(s):       *jobs, the job table, *count, the number of jobs    */
+/*                                                                           */
+/*      Returns:         1 if successful, 0 if the manifest couldn't be      */
+/*                       opened or a line in it was malformed, in which      */
+/*                       case a message has been written to stderr.          */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE int ReadManifest( char *manifest, JOB **jobs, int *count )
+{
+    FILE *fp;
+    char line[MANIFEST_LINE], *fields[4];
+    JOB *table = NULL, *bigger;
+    int size = 0, n = 0, linenum = 0, nfields;
+
+    if ( NULL == ( fp = fopen( manifest, "r" ) ) )  {
+        fprintf( stderr, "cannot open \"%s\" for input\n", manifest );
+        return 0;
+    }
+
+    while ( fgets( line, MANIFEST_LINE, fp ) != NULL )  {
+        linenum++;
+        if ( strchr( line, '\n' ) == NULL && !feof( fp ) )  {
+            fprintf( stderr, "%s:%d: line too long\n", manifest, linenum );
+            break;
+        }
+        nfields = SplitFields( line, fields, 4 );
+        if ( nfields == 0 || fields[0][0] == '#' )  continue;
+        if ( nfields != 3 )  {
+            fprintf( stderr, "%s:%d: expected <source> <listing> <code>\n",
+                     manifest, linenum );
+            break;
+        }
+        if ( n == size )  {
+            size = size ? 2 * size : 64;
+            if ( NULL == ( bigger = realloc( table, size * sizeof( JOB ) ) ) )
+            {
+                fprintf( stderr, "Fatal error, cannot allocate job table\n" );
+                break;
+            }
+            table = bigger;
+        }
+        table[n].source = CopyString( fields[0] );
+        table[n].listing = CopyString( fields[1] );
+        table[n].code = CopyString( fields[2] );
+        table[n].status = JOB_NOFILE;
+        table[n].latency = 0.0;
+        n++;
+        if ( table[n-1].source == NULL || table[n-1].listing == NULL ||
+             table[n-1].code == NULL )  {
+            fprintf( stderr, "Fatal error, cannot allocate job table\n" );
+            break;
+        }
+    }
+
+    if ( !feof( fp ) )  {
+        fclose( fp );
+        FreeJobs( table, n );
+        return 0;
+    }
+    fclose( fp );
+    *jobs = table;
+    *count = n;
+    return 1;
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      SplitFields                                                          */
+/*                                                                           */
+/*      Splits a line into whitespace separated fields in place.             */
+/*                                                                           */
+/*      Input(s):        line, the line to split (modified), max, the        */
+/*                       size of fields[]                                    */
+/*                                                                           */
+/*      Output(s):       fields[], pointers to the first max fields          */
+/*                                                                           */
+/*      Returns:         Number of fields found, at most max.                */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE int SplitFields( char *line, char *fields[], int max )
+{
+    int n = 0;
+
+    while ( n < max )  {
+        while ( isspace( (unsigned char) *line ) )  line++;
+        if ( *line == '\0' )  break;
+        fields[n++] = line;
+        while ( *line != '\0' && !isspace( (unsigned char) *line ) )  line++;
+        if ( *line != '\0' )  *line++ = '\0';
+    }
+    return n;
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      CopyString                                                           */
+/*                                                                           */
+/*      Returns a malloc'd copy of a string, or NULL if out of memory.       */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE char *CopyString( char *s )
+{
+    char *copy;
+
+    if ( NULL == ( copy = malloc( strlen( s ) + 1 ) ) )  return NULL;
+    return strcpy( copy, s );
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      FreeJobs                                                             */
+/*                                                                           */
+/*      Frees a job table and the file names in it.                          */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE void FreeJobs( JOB *jobs, int count )
+{
+    int i;
+
+    for ( i = 0; i < count; i++ )  {
+        free( jobs[i].source );
+        free( jobs[i].listing );
+        free( jobs[i].code );
+    }
+    free( jobs );
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      Worker                                                               */
+/*                                                                           */
+/*      Thread body: compiles jobs until there are none left to take or      */
+/*      steal.  The worker keeps one COMPILER for all its jobs, so its       */
+/*      tables stay allocated from one program to the next.                  */
+/*                                                                           */
+/*      Input(s):        arg, pointer to this worker's WORKER                */
+/*                                                                           */
+/*      Returns:         NULL                                                */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE void *Worker( void *arg )
+{
+    WORKER *worker = arg;
+    COMPILER *compiler;
+    int job;
+
+    if ( NULL == ( compiler = NewCompiler() ) )  return NULL;
+    while ( ( job = TakeJob( worker->pool, worker->id ) ) >= 0 )
+        CompileJob( compiler, worker->pool, &worker->pool->jobs[job] );
+    FreeCompiler( compiler );
+    return NULL;
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      TakeJob                                                              */
+/*                                                                           */
+/*      Takes the next job from the bottom of a worker's own deque or, if    */
+/*      that is empty, steals one from the top of the first other deque,     */
+/*      in round-robin order, which still has work.                          */
+/*                                                                           */
+/*      Input(s):        pool, the pool, id, the worker's deque index        */
+/*                                                                           */
+/*      Returns:         Index of the job taken, or -1 if every deque is     */
+/*                       empty.                                              */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE int TakeJob( POOL *pool, int id )
+{
+    DEQUE *deque = &pool->deques[id];
+    int i, job = -1;
+
+    pthread_mutex_lock( &deque->lock );
+    if ( deque->bottom > deque->top )  job = --deque->bottom;
+    pthread_mutex_unlock( &deque->lock );
+
+    for ( i = 1; job < 0 && i < pool->workers; i++ )  {
+        deque = &pool->deques[( id + i ) % pool->workers];
+        pthread_mutex_lock( &deque->lock );
+        if ( deque->bottom > deque->top )  job = deque->top++;
+        pthread_mutex_unlock( &deque->lock );
+    }
+    return job;
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      CompileJob                                                           */
+/*                                                                           */
+/*      Opens one job's files, compiles it with the worker's COMPILER and    */
+/*      records the outcome and the time taken in the job.                   */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE void CompileJob( COMPILER *compiler, POOL *pool, JOB *job )
+{
+    FILE *InputFile, *ListFile = NULL, *CodeFile = NULL;
+    double start = Now();
+
+    if ( NULL == ( InputFile = fopen( job->source, "r" ) ) )
+        fprintf( stderr, "cannot open \"%s\" for input\n", job->source );
+    else if ( NULL == ( ListFile = fopen( job->listing, "w" ) ) )
+        fprintf( stderr, "cannot open \"%s\" for output\n", job->listing );
+    else if ( NULL == ( CodeFile = fopen( job->code, "w" ) ) )
+        fprintf( stderr, "cannot open \"%s\" for output\n", job->code );
+    else  {
+        SetCompilerDiagnostics( compiler, pool->diagnostics, job->source );
+        job->status = RunCompiler( compiler, InputFile, ListFile, CodeFile,
+                                   stderr, NULL ) ? JOB_VALID : JOB_INVALID;
+    }
+
+    if ( CodeFile != NULL )  fclose( CodeFile );
+    if ( ListFile != NULL )  fclose( ListFile );
+    if ( InputFile != NULL )  fclose( InputFile );
+    job->latency = Now() - start;
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      Now                                                                  */
+/*                                                                           */
+/*      Returns the time in seconds on the monotonic clock.                  */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE double Now( void )
+{
+    struct timespec ts;
+
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      CompareLatency                                                       */
+/*                                                                           */
+/*      qsort comparison function for an array of doubles.                   */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE int CompareLatency( const void *a, const void *b )
+{
+    double x = *(const double *) a, y = *(const double *) b;
+
+    return ( x > y ) - ( x < y );
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      Percentile                                                           */
+/*                                                                           */
+/*      Nearest-rank percentile of a sorted, non-empty array.                */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE double Percentile( double *sorted, int count, int percent )
+{
+    int rank = ( count * percent + 99 ) / 100;
+
+    return sorted[rank > 0 ? rank - 1 : 0];
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      ReportBatch                                                          */
+/*                                                                           */
+/*      Lists the programs with errors in manifest order, then summarises    */
+/*      the batch: counts, throughput and latency percentiles.               */
+/*                                                                           */
+/*      Input(s):        reportfile, where to write the report, jobs and     */
+/*                       count, the finished job table, workers, the pool    */
+/*                       size, elapsed, the wall-clock time in seconds       */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE void ReportBatch( FILE *reportfile, JOB *jobs, int count,
+                          int workers, double elapsed )
+{
+    double *latency;
+    int i, valid = 0, invalid = 0, nofile = 0;
+
+    for ( i = 0; i < count; i++ )  {
+        if ( jobs[i].status == JOB_VALID )  valid++;
+        else if ( jobs[i].status == JOB_INVALID )  {
+            invalid++;
+            fprintf( reportfile, "%s: Syntax Error Detected\n",
+                     jobs[i].source );
+        }
+        else  nofile++;
+    }
+
+    fprintf( reportfile, "Batch: %d programs, %d valid, %d with errors, "
+             "%d not opened\n", count, valid, invalid, nofile );
+    fprintf( reportfile, "Batch: %d threads, %.3f s, %.1f programs/sec\n",
+             workers, elapsed, elapsed > 0.0 ? count / elapsed : 0.0 );
+
+    if ( count == 0 )  return;
+    if ( NULL == ( latency = malloc( count * sizeof( double ) ) ) )  return;
+    for ( i = 0; i < count; i++ )  latency[i] = jobs[i].latency * 1000.0;
+    qsort( latency, count, sizeof( double ), CompareLatency );
+    fprintf( reportfile, "Batch: latency (ms) p50 %.3f, p90 %.3f, "
+             "p99 %.3f, max %.3f\n", Percentile( latency, count, 50 ),
+             Percentile( latency, count, 90 ),
+             Percentile( latency, count, 99 ), latency[count - 1] );
+    free( latency );
+}
@@ -0,0 +1,21 @@
+#ifndef  BATCHHEADER
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      batch.h                                                              */
+/*                                                                           */
+/*      Header file for "batch.c", containing the function prototype of the  */
+/*      batch driver, which compiles every program named in a manifest on a  */
+/*      pool of worker threads.                                              */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+#define  BATCHHEADER
+
+#include <stdio.h>
+#include "global.h"
+#include "diagnose.h"
+
+PUBLIC int    CompileBatch( char *manifest, int threads, FILE *reportfile,
+                            DIAGWRITER *diagnostics );
+
+#endif
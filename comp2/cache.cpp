@@ -0,0 +1,803 @@
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      cache.c                                                              */
+/*                                                                           */
+/*      Implementation file for the content-addressed compilation cache,     */
+/*      "comp2 --cache=<dir>".                                               */
+/*                                                                           */
+/*      The output of comp2 depends only on the source text, the compiler    */
+/*      and its options, so a compilation is identified by the SHA-256 of    */
+/*      those three, its key. The cache directory holds one entry per key    */
+/*      with everything the compilation produced: the listing, the code,     */
+/*      the report written to stdout, the error messages written to stderr   */
+/*      and whether it was valid. On a hit these are copied to where the     */
+/*      compiler would have written them, which costs a hash of the source   */
+/*      and the reading of one file instead of a compile.                    */
+/*                                                                           */
+/*      Layout of the cache directory:                                       */
+/*                                                                           */
+/*          <xx>/<rest of key>   an entry, sharded on the first two hex      */
+/*                               digits of its key                           */
+/*          <xx>/tmpXXXXXX       an entry being written                      */
+/*          stats                running totals (see UpdateStats)            */
+/*                                                                           */
+/*      An entry is written to a temporary file and renamed into place, so   */
+/*      readers never see a partial entry, and concurrent compilers of the   */
+/*      same program at worst both store the same bytes. An entry's file is  */
+/*      "CPLCACHE1 <valid> <n1> <n2> <n3> <n4>\n" followed by the four       */
+/*      parts of n1 .. n4 bytes; anything else is treated as a miss.         */
+/*                                                                           */
+/*      The cache is bounded by size with least-recently-used eviction. A    */
+/*      hit sets its entry's modification time to now, and the "stats" file  */
+/*      keeps a running total of the bytes stored. When a store takes that   */
+/*      total over the limit, the entries are listed and the oldest removed  */
+/*      until the cache is down to three quarters of the limit, so the cost  */
+/*      of the scan is shared among many stores. The scan also recounts the  */
+/*      bytes, correcting the total for entries stored twice by concurrent   */
+/*      compilers or removed by hand. The "stats" file is updated under      */
+/*      flock and also counts hits, misses and evictions (see                */
+/*      "comp2 --cache=<dir> --cache-stats").                                */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+#include "global.h"
+#include "comp2.h"
+#include "cache.h"
+
+/*  Part of every key. COMPILER_VERSION must be bumped by any change which   */
+/*  alters what the compiler writes for some program and options, e.g., to   */
+/*  code generation, the optimiser, the listing or the messages, so that a   */
+/*  changed compiler is never served entries made by an old one. A rebuild   */
+/*  of the same compiler keeps the cache.                                    */
+
+#define  COMPILER_VERSION    "1"
+#define  COMPILER_ID         "comp2 version " COMPILER_VERSION
+
+#define  SHA256_SIZE         32         /* bytes in a digest                 */
+#define  KEY_SIZE            (2*SHA256_SIZE+1)  /* hex digest + '\0'         */
+#define  PATH_SIZE           4096       /* longest path to an entry          */
+#define  ENTRY_MAGIC         "CPLCACHE1"
+#define  HEADER_SIZE         128        /* longest entry header              */
+#define  STALE_TEMPORARY     3600       /* seconds before a leftover         */
+                                        /* temporary file is removed         */
+
+#define  PART_LISTING        0          /* the parts of an entry             */
+#define  PART_CODE           1
+#define  PART_REPORT         2
+#define  PART_ERRORS         3
+#define  PARTS               4
+
+typedef struct  {
+    uint32_t state[8];
+    uint64_t length;                    /* bytes hashed so far               */
+    unsigned char block[64];
+    int used;                           /* bytes waiting in block            */
+}
+    SHA256;
+
+typedef struct  {
+    int  valid;
+    char *data;                         /* the whole entry file              */
+    char *part[PARTS];                  /* the parts, within data            */
+    size_t size[PARTS];
+}
+    ENTRY;
+
+typedef struct  {                       /* one entry found by ListEntries    */
+    char *path;
+    long size;
+    struct timespec used;               /* modification time                 */
+}
+    ENTRYFILE;
+
+typedef struct  {                       /* contents of the "stats" file      */
+    long bytes;
+    long hits;
+    long misses;
+    long evictions;
+}
+    STATS;
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      Declarations of routines private to this module.                     */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE int    ReadAll( FILE *fp, char **text, size_t *length );
+PRIVATE void   MakeKey( char *settings, char *source, size_t length,
+                        char *key );
+PRIVATE void   EntryPath( char *cachedir, char *key, char *path, int shard );
+PRIVATE int    FetchEntry( char *cachedir, char *key, ENTRY *entry );
+PRIVATE long   StoreEntry( char *cachedir, char *key, ENTRY *entry );
+PRIVATE void   ReplayEntry( ENTRY *entry, FILE *listfile, FILE *codefile,
+                            FILE *reportfile );
+PRIVATE int    CompileEntry( char *source, size_t length, ENTRY *entry );
+PRIVATE void   UpdateStats( char *cachedir, long hits, long misses,
+                            long added, long maxbytes );
+PRIVATE void   ReadStats( FILE *fp, STATS *stats );
+PRIVATE long   Evict( char *cachedir, long target, long *evictions );
+PRIVATE int    ListEntries( char *cachedir, ENTRYFILE **files, int *count,
+                            long *total );
+PRIVATE void   FreeEntries( ENTRYFILE *files, int count );
+PRIVATE int    CompareUse( const void *a, const void *b );
+PRIVATE void   SHA256Init( SHA256 *sha );
+PRIVATE void   SHA256Update( SHA256 *sha, const void *data, size_t length );
+PRIVATE void   SHA256Final( SHA256 *sha, unsigned char *digest );
+PRIVATE void   SHA256Block( SHA256 *sha, const unsigned char *block );
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      Public routines (globally accessable).                               */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      CompileCached                                                        */
+/*                                                                           */
+/*      Compiles one program through the cache: serves its outputs from the  */
+/*      cache if they are there, otherwise compiles it and stores them.      */
+/*      The effect on the files, stdout and stderr is the same as "Compile". */
+/*                                                                           */
+/*      Input(s):                                                            */
+/*                                                                           */
+/*          cachedir     the cache directory, created if it doesn't exist.   */
+/*                                                                           */
+/*          maxbytes     the size the cache is kept within.                  */
+/*                                                                           */
+/*          settings     a string describing every option which affects the  */
+/*                       compiler's output; part of the key.                 */
+/*                                                                           */
+/*          inputfile, listfile, codefile, reportfile                        */
+/*                       as for "Compile".                                   */
+/*                                                                           */
+/*      Output(s):       None                                                */
+/*                                                                           */
+/*      Returns:         1 if the program was free of errors, 0 otherwise.   */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PUBLIC int CompileCached( char *cachedir, long maxbytes, char *settings,
+                          FILE *inputfile, FILE *listfile, FILE *codefile,
+                          FILE *reportfile )
+{
+    ENTRY entry;
+    char *source, key[KEY_SIZE];
+    size_t length;
+    long added;
+
+    if ( !ReadAll( inputfile, &source, &length ) )  {
+        fprintf( stderr, "Fatal error, cannot read the source into memory\n" );
+        return 0;
+    }
+    MakeKey( settings, source, length, key );
+    if ( mkdir( cachedir, 0777 ) < 0 && errno != EEXIST )
+        fprintf( stderr, "cannot create cache \"%s\": %s\n", cachedir,
+                 strerror( errno ) );
+
+    if ( FetchEntry( cachedir, key, &entry ) )  {
+        ReplayEntry( &entry, listfile, codefile, reportfile );
+        free( entry.data );
+        UpdateStats( cachedir, 1, 0, 0, maxbytes );
+    }
+    else if ( CompileEntry( source, length, &entry ) )  {
+        ReplayEntry( &entry, listfile, codefile, reportfile );
+        added = StoreEntry( cachedir, key, &entry );
+        free( entry.data );
+        UpdateStats( cachedir, 0, 1, added, maxbytes );
+    }
+    else  entry.valid = 0;
+
+    free( source );
+    return entry.valid;
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      ReportCache                                                          */
+/*                                                                           */
+/*      Writes the statistics of a cache directory: hits, misses and         */
+/*      evictions since it was created, and the entries now in it.           */
+/*                                                                           */
+/*      Input(s):        cachedir, the cache directory, reportfile, where    */
+/*                       the statistics are written.                         */
+/*                                                                           */
+/*      Output(s):       None                                                */
+/*                                                                           */
+/*      Returns:         1 if successful, 0 if the cache couldn't be read.   */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PUBLIC int ReportCache( char *cachedir, FILE *reportfile )
+{
+    ENTRYFILE *files;
+    STATS stats;
+    char path[PATH_SIZE];
+    FILE *fp;
+    long total, lookups;
+    int count;
+
+    snprintf( path, sizeof( path ), "%s/stats", cachedir );
+    memset( &stats, 0, sizeof( stats ) );
+    if ( NULL != ( fp = fopen( path, "r" ) ) )  {
+        flock( fileno( fp ), LOCK_SH );
+        ReadStats( fp, &stats );
+        fclose( fp );
+    }
+    if ( !ListEntries( cachedir, &files, &count, &total ) )  {
+        fprintf( stderr, "cannot read cache \"%s\": %s\n", cachedir,
+                 strerror( errno ) );
+        return 0;
+    }
+    FreeEntries( files, count );
+
+    lookups = stats.hits + stats.misses;
+    fprintf( reportfile, "Cache: %ld hits, %ld misses, %.1f%% hit rate\n",
+             stats.hits, stats.misses,
+             lookups > 0 ? 100.0 * stats.hits / lookups : 0.0 );
+    fprintf( reportfile, "Cache: %d entries, %ld bytes, %ld evictions\n",
+             count, total, stats.evictions );
+    return 1;
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      Private routines (only accessable within this module).               */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      ReadAll                                                              */
+/*                                                                           */
+/*      Reads the rest of a file into a malloc'd buffer.                     */
+/*                                                                           */
+/*      Returns:         1 if successful, 0 if out of memory.                */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE int ReadAll( FILE *fp, char **text, size_t *length )
+{
+    char *buffer = NULL, *bigger;
+    size_t size = 0, used = 0, n;
+
+    do  {
+        if ( used == size )  {
+            size = size ? 2 * size : 4096;
+            if ( NULL == ( bigger = realloc( buffer, size ) ) )  {
+                free( buffer );
+                return 0;
+            }
+            buffer = bigger;
+        }
+        n = fread( buffer + used, 1, size - used, fp );
+        used += n;
+    }  while ( n > 0 );
+
+    *text = buffer;
+    *length = used;
+    return 1;
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      MakeKey                                                              */
+/*                                                                           */
+/*      Computes the key of a compilation: the SHA-256 of the compiler's     */
+/*      identity, the settings and the source, as 64 hex digits.             */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE void MakeKey( char *settings, char *source, size_t length, char *key )
+{
+    SHA256 sha;
+    unsigned char digest[SHA256_SIZE];
+    int i;
+
+    SHA256Init( &sha );
+    SHA256Update( &sha, COMPILER_ID, strlen( COMPILER_ID ) + 1 );
+    SHA256Update( &sha, settings, strlen( settings ) + 1 );
+    SHA256Update( &sha, source, length );
+    SHA256Final( &sha, digest );
+    for ( i = 0; i < SHA256_SIZE; i++ )
+        sprintf( key + 2 * i, "%02x", digest[i] );
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      EntryPath                                                            */
+/*                                                                           */
+/*      Builds the path of an entry, or with "shard" true, of the directory  */
+/*      holding it.                                                          */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE void EntryPath( char *cachedir, char *key, char *path, int shard )
+{
+    if ( shard )
+        snprintf( path, PATH_SIZE, "%s/%.2s", cachedir, key );
+    else
+        snprintf( path, PATH_SIZE, "%s/%.2s/%s", cachedir, key, key + 2 );
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      FetchEntry                                                           */
+/*                                                                           */
+/*      Looks up a key and reads its entry, marking it as recently used.     */
+/*                                                                           */
+/*      Output(s):       *entry, if found. Free entry->data when done.       */
+/*                                                                           */
+/*      Returns:         1 on a hit, 0 on a miss or an unreadable entry.     */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE int FetchEntry( char *cachedir, char *key, ENTRY *entry )
+{
+    char path[PATH_SIZE], *p;
+    struct stat st;
+    unsigned long size[PARTS], total;
+    int fd, header, i, ok;
+
+    EntryPath( cachedir, key, path, 0 );
+    if ( ( fd = open( path, O_RDONLY ) ) < 0 )  return 0;
+    if ( fstat( fd, &st ) < 0 ||
+         NULL == ( entry->data = malloc( st.st_size + 1 ) ) )  {
+        close( fd );
+        return 0;
+    }
+    ok = read( fd, entry->data, st.st_size ) == st.st_size;
+    if ( ok )  futimens( fd, NULL );
+    close( fd );
+    entry->data[ok ? st.st_size : 0] = '\0';
+
+    ok = ok && sscanf( entry->data, ENTRY_MAGIC " %d %lu %lu %lu %lu%n",
+                       &entry->valid, &size[0], &size[1], &size[2],
+                       &size[3], &header ) == 5 &&
+         entry->data[header] == '\n';
+    if ( ok )  {
+        p = entry->data + header + 1;
+        for ( i = 0, total = 0; i < PARTS; i++ )  {
+            entry->part[i] = p + total;
+            entry->size[i] = size[i];
+            total += size[i];
+        }
+        ok = (unsigned long)( p - entry->data ) + total ==
+             (unsigned long) st.st_size;
+    }
+    if ( !ok )  {
+        free( entry->data );
+        unlink( path );
+    }
+    return ok;
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      StoreEntry                                                           */
+/*                                                                           */
+/*      Writes an entry to a temporary file and renames it into place.       */
+/*                                                                           */
+/*      Returns:         The size of the entry, or 0 if it wasn't stored.    */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE long StoreEntry( char *cachedir, char *key, ENTRY *entry )
+{
+    char path[PATH_SIZE], temporary[PATH_SIZE+16], header[HEADER_SIZE];
+    FILE *fp;
+    long size;
+    int fd, i, ok;
+
+    EntryPath( cachedir, key, path, 1 );
+    mkdir( path, 0777 );
+    snprintf( temporary, sizeof( temporary ), "%s/tmpXXXXXX", path );
+    if ( ( fd = mkstemp( temporary ) ) < 0 )  return 0;
+    if ( NULL == ( fp = fdopen( fd, "w" ) ) )  {
+        close( fd );
+        unlink( temporary );
+        return 0;
+    }
+
+    size = snprintf( header, sizeof( header ), ENTRY_MAGIC " %d %lu %lu "
+                     "%lu %lu\n", entry->valid,
+                     (unsigned long) entry->size[0],
+                     (unsigned long) entry->size[1],
+                     (unsigned long) entry->size[2],
+                     (unsigned long) entry->size[3] );
+    ok = fputs( header, fp ) != EOF;
+    for ( i = 0; i < PARTS; i++ )  {
+        ok = ok && fwrite( entry->part[i], 1, entry->size[i], fp ) ==
+                   entry->size[i];
+        size += entry->size[i];
+    }
+    ok = fclose( fp ) == 0 && ok;
+
+    EntryPath( cachedir, key, path, 0 );
+    if ( !ok || rename( temporary, path ) < 0 )  {
+        unlink( temporary );
+        return 0;
+    }
+    return size;
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      ReplayEntry                                                          */
+/*                                                                           */
+/*      Writes the parts of an entry where the compiler would have written   */
+/*      them: the listing and code files, the report and stderr.             */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE void ReplayEntry( ENTRY *entry, FILE *listfile, FILE *codefile,
+                          FILE *reportfile )
+{
+    if ( listfile != NULL )
+        fwrite( entry->part[PART_LISTING], 1, entry->size[PART_LISTING],
+                listfile );
+    fwrite( entry->part[PART_CODE], 1, entry->size[PART_CODE], codefile );
+    if ( reportfile != NULL )
+        fwrite( entry->part[PART_REPORT], 1, entry->size[PART_REPORT],
+                reportfile );
+    fwrite( entry->part[PART_ERRORS], 1, entry->size[PART_ERRORS], stderr );
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      CompileEntry                                                         */
+/*                                                                           */
+/*      Compiles a program held in memory, gathering everything it writes    */
+/*      into a new entry laid out as it will be stored.                      */
+/*                                                                           */
+/*      Output(s):       *entry. Free entry->data when done.                 */
+/*                                                                           */
+/*      Returns:         1 if successful, 0 if out of memory.                */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE int CompileEntry( char *source, size_t length, ENTRY *entry )
+{
+    COMPILER *compiler;
+    FILE *InputFile, *streams[PARTS];
+    char *text[PARTS], *p;
+    size_t size[PARTS], total = 0;
+    int i, ok;
+
+    compiler = NewCompiler();
+    InputFile = fmemopen( source, length, "r" );
+    ok = compiler != NULL && InputFile != NULL;
+    for ( i = 0; i < PARTS; i++ )  {
+        text[i] = NULL;
+        streams[i] = open_memstream( &text[i], &size[i] );
+        ok = ok && streams[i] != NULL;
+    }
+    if ( ok )
+        entry->valid = RunCompiler( compiler, InputFile, streams[PART_LISTING],
+                                    streams[PART_CODE], streams[PART_ERRORS],
+                                    streams[PART_REPORT] );
+    if ( compiler != NULL )  FreeCompiler( compiler );
+    if ( InputFile != NULL )  fclose( InputFile );
+    for ( i = 0; i < PARTS; i++ )  {
+        if ( streams[i] != NULL )  fclose( streams[i] );
+        else  size[i] = 0;
+        total += size[i];
+    }
+
+    /*  One block for all the parts, so the entry is freed like a fetched  */
+    /*  one.                                                               */
+
+    if ( ok && NULL != ( entry->data = p = malloc( total + 1 ) ) )  {
+        for ( i = 0; i < PARTS; i++ )  {
+            memcpy( p, text[i], size[i] );
+            entry->part[i] = p;
+            entry->size[i] = size[i];
+            p += size[i];
+        }
+    }
+    else  ok = 0;
+    for ( i = 0; i < PARTS; i++ )  free( text[i] );
+    return ok;
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      UpdateStats                                                          */
+/*                                                                           */
+/*      Adds to the running totals in the "stats" file, under an exclusive   */
+/*      lock, and evicts entries if the cache has grown too large.           */
+/*                                                                           */
+/*      Input(s):        cachedir, the cache, hits, misses and added, the    */
+/*                       increments, maxbytes, the limit on the cache size.  */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE void UpdateStats( char *cachedir, long hits, long misses,
+                          long added, long maxbytes )
+{
+    char path[PATH_SIZE];
+    STATS stats;
+    FILE *fp;
+    int fd;
+
+    snprintf( path, sizeof( path ), "%s/stats", cachedir );
+    if ( ( fd = open( path, O_RDWR | O_CREAT, 0666 ) ) < 0 )  return;
+    if ( NULL == ( fp = fdopen( fd, "r+" ) ) )  {
+        close( fd );
+        return;
+    }
+    flock( fd, LOCK_EX );
+    ReadStats( fp, &stats );
+    stats.hits += hits;
+    stats.misses += misses;
+    stats.bytes += added;
+    if ( stats.bytes > maxbytes )
+        stats.bytes = Evict( cachedir, maxbytes / 4 * 3, &stats.evictions );
+
+    rewind( fp );
+    fprintf( fp, "%ld %ld %ld %ld\n", stats.bytes, stats.hits,
+             stats.misses, stats.evictions );
+    fflush( fp );
+    ftruncate( fd, ftell( fp ) );
+    fclose( fp );                       /* releases the lock                 */
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      ReadStats                                                            */
+/*                                                                           */
+/*      Reads the "stats" file; missing or damaged totals read as zero.      */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE void ReadStats( FILE *fp, STATS *stats )
+{
+    if ( fscanf( fp, "%ld %ld %ld %ld", &stats->bytes, &stats->hits,
+                 &stats->misses, &stats->evictions ) != 4 )
+        memset( stats, 0, sizeof( STATS ) );
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      Evict                                                                */
+/*                                                                           */
+/*      Removes the least recently used entries until the cache holds no     */
+/*      more than "target" bytes. Called with the "stats" file locked.       */
+/*                                                                           */
+/*      Output(s):       *evictions is increased by the entries removed.     */
+/*                                                                           */
+/*      Returns:         The bytes left in the cache.                        */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE long Evict( char *cachedir, long target, long *evictions )
+{
+    ENTRYFILE *files;
+    long total;
+    int count, i;
+
+    if ( !ListEntries( cachedir, &files, &count, &total ) )  return 0;
+    qsort( files, count, sizeof( ENTRYFILE ), CompareUse );
+    for ( i = 0; i < count && total > target; i++ )  {
+        if ( unlink( files[i].path ) == 0 )  {
+            total -= files[i].size;
+            (*evictions)++;
+        }
+    }
+    FreeEntries( files, count );
+    return total;
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      ListEntries                                                          */
+/*                                                                           */
+/*      Lists every entry in the cache, removing on the way any temporary    */
+/*      file old enough to have been left by a compiler which died.          */
+/*                                                                           */
+/*      Output(s):       *files and *count, the entries (free with           */
+/*                       FreeEntries), *total, the sum of their sizes.       */
+/*                                                                           */
+/*      Returns:         1 if successful, 0 if the cache can't be read.      */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE int ListEntries( char *cachedir, ENTRYFILE **files, int *count,
+                         long *total )
+{
+    DIR *top, *shard;
+    struct dirent *d, *e;
+    struct stat st;
+    char path[PATH_SIZE];
+    ENTRYFILE *list = NULL, *bigger;
+    int n = 0, size = 0;
+    time_t now = time( NULL );
+
+    *total = 0;
+    if ( NULL == ( top = opendir( cachedir ) ) )  return 0;
+    while ( NULL != ( d = readdir( top ) ) )  {
+        if ( strlen( d->d_name ) != 2 || !isxdigit( d->d_name[0] ) ||
+             !isxdigit( d->d_name[1] ) )  continue;
+        snprintf( path, sizeof( path ), "%s/%s", cachedir, d->d_name );
+        if ( NULL == ( shard = opendir( path ) ) )  continue;
+        while ( NULL != ( e = readdir( shard ) ) )  {
+            if ( e->d_name[0] == '.' )  continue;
+            snprintf( path, sizeof( path ), "%s/%s/%s", cachedir, d->d_name,
+                      e->d_name );
+            if ( stat( path, &st ) < 0 || !S_ISREG( st.st_mode ) )  continue;
+            if ( strncmp( e->d_name, "tmp", 3 ) == 0 )  {
+                if ( now - st.st_mtime > STALE_TEMPORARY )  unlink( path );
+                continue;
+            }
+            if ( n == size )  {
+                size = size ? 2 * size : 256;
+                bigger = realloc( list, size * sizeof( ENTRYFILE ) );
+                if ( bigger == NULL )  break;
+                list = bigger;
+            }
+            if ( NULL == ( list[n].path = malloc( strlen( path ) + 1 ) ) )
+                break;
+            strcpy( list[n].path, path );
+            list[n].size = (long) st.st_size;
+            list[n].used = st.st_mtim;
+            *total += list[n].size;
+            n++;
+        }
+        closedir( shard );
+    }
+    closedir( top );
+    *files = list;
+    *count = n;
+    return 1;
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      FreeEntries                                                          */
+/*                                                                           */
+/*      Frees a list made by ListEntries.                                    */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE void FreeEntries( ENTRYFILE *files, int count )
+{
+    int i;
+
+    for ( i = 0; i < count; i++ )  free( files[i].path );
+    free( files );
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      CompareUse                                                           */
+/*                                                                           */
+/*      qsort comparison function putting the least recently used entry      */
+/*      first.                                                               */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE int CompareUse( const void *a, const void *b )
+{
+    const struct timespec *x = &((const ENTRYFILE *) a)->used;
+    const struct timespec *y = &((const ENTRYFILE *) b)->used;
+
+    if ( x->tv_sec != y->tv_sec )  return x->tv_sec < y->tv_sec ? -1 : 1;
+    return ( x->tv_nsec > y->tv_nsec ) - ( x->tv_nsec < y->tv_nsec );
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      SHA-256 (FIPS 180-4).                                                */
+/*                                                                           */
+/*      SHA256Init starts a digest, SHA256Update adds data to it and         */
+/*      SHA256Final pads it and writes the 32-byte digest.                   */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+#define  ROTR(x,n)   ( ( (x) >> (n) ) | ( (x) << ( 32 - (n) ) ) )
+
+PRIVATE const uint32_t K256[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+    0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+    0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+    0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+    0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+    0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+    0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+    0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+PRIVATE void SHA256Init( SHA256 *sha )
+{
+    static const uint32_t initial[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+        0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+    };
+
+    memcpy( sha->state, initial, sizeof( initial ) );
+    sha->length = 0;
+    sha->used = 0;
+}
+
+PRIVATE void SHA256Update( SHA256 *sha, const void *data, size_t length )
+{
+    const unsigned char *p = data;
+    size_t n;
+
+    sha->length += length;
+    while ( length > 0 )  {
+        n = 64 - sha->used;
+        if ( n > length )  n = length;
+        memcpy( sha->block + sha->used, p, n );
+        sha->used += (int) n;
+        p += n;
+        length -= n;
+        if ( sha->used == 64 )  {
+            SHA256Block( sha, sha->block );
+            sha->used = 0;
+        }
+    }
+}
+
+PRIVATE void SHA256Final( SHA256 *sha, unsigned char *digest )
+{
+    uint64_t bits = sha->length * 8;
+    int i;
+
+    sha->block[sha->used++] = 0x80;
+    if ( sha->used > 56 )  {
+        memset( sha->block + sha->used, 0, 64 - sha->used );
+        SHA256Block( sha, sha->block );
+        sha->used = 0;
+    }
+    memset( sha->block + sha->used, 0, 56 - sha->used );
+    for ( i = 0; i < 8; i++ )
+        sha->block[63 - i] = (unsigned char)( bits >> ( 8 * i ) );
+    SHA256Block( sha, sha->block );
+
+    for ( i = 0; i < 32; i++ )
+        digest[i] = (unsigned char)
+                    ( sha->state[i / 4] >> ( 24 - 8 * ( i % 4 ) ) );
+}
+
+PRIVATE void SHA256Block( SHA256 *sha, const unsigned char *block )
+{
+    uint32_t w[64], a, b, c, d, e, f, g, h, s0, s1, t1, t2;
+    int i;
+
+    for ( i = 0; i < 16; i++ )
+        w[i] = (uint32_t) block[4*i] << 24 | (uint32_t) block[4*i+1] << 16 |
+               (uint32_t) block[4*i+2] << 8 | (uint32_t) block[4*i+3];
+    for ( ; i < 64; i++ )  {
+        s0 = ROTR( w[i-15], 7 ) ^ ROTR( w[i-15], 18 ) ^ ( w[i-15] >> 3 );
+        s1 = ROTR( w[i-2], 17 ) ^ ROTR( w[i-2], 19 ) ^ ( w[i-2] >> 10 );
+        w[i] = w[i-16] + s0 + w[i-7] + s1;
+    }
+
+    a = sha->state[0];  b = sha->state[1];  c = sha->state[2];
+    d = sha->state[3];  e = sha->state[4];  f = sha->state[5];
+    g = sha->state[6];  h = sha->state[7];
+    for ( i = 0; i < 64; i++ )  {
+        t1 = h + ( ROTR( e, 6 ) ^ ROTR( e, 11 ) ^ ROTR( e, 25 ) ) +
+             ( ( e & f ) ^ ( ~e & g ) ) + K256[i] + w[i];
+        t2 = ( ROTR( a, 2 ) ^ ROTR( a, 13 ) ^ ROTR( a, 22 ) ) +
+             ( ( a & b ) ^ ( a & c ) ^ ( b & c ) );
+        h = g;  g = f;  f = e;  e = d + t1;
+        d = c;  c = b;  b = a;  a = t1 + t2;
+    }
+    sha->state[0] += a;  sha->state[1] += b;  sha->state[2] += c;
+    sha->state[3] += d;  sha->state[4] += e;  sha->state[5] += f;
+    sha->state[6] += g;  sha->state[7] += h;
+}
@@ -0,0 +1,23 @@
+#ifndef  CACHEHEADER
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      cache.h                                                              */
+/*                                                                           */
+/*      Header file for "cache.c", containing constant declarations and      */
+/*      function prototypes for the content-addressed compilation cache.     */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+#define  CACHEHEADER
+
+#include <stdio.h>
+#include "global.h"
+
+#define  CACHE_DEFAULT_SIZE   (64L*1024*1024)   /* bytes, see --cache-size   */
+
+PUBLIC int    CompileCached( char *cachedir, long maxbytes, char *settings,
+                             FILE *inputfile, FILE *listfile, FILE *codefile,
+                             FILE *reportfile );
+PUBLIC int    ReportCache( char *cachedir, FILE *reportfile );
+
+#endif
@@ -6,17 +6,21 @@
 /*                                                                           */
 /*      Code is stored in an array "CodeTable", and written out on a call    */
 /*      to "WriteCodeFile". Since the code is all stored in memory, it is    */
-/*      possible to perform backpatching of branch addresses. However, the   */
-/*      finite size of the "CodeTable" array means that there is a limit on  */
-/*      the size of program which may be generated.                          */
+/*      possible to perform backpatching of branch addresses. The array      */
+/*      grows as code is emitted, doubling each time it fills, up to         */
+/*      CODE_LIMIT instructions.                                             */
 /*                                                                           */ 
-/*      Six routines and one macro are provided by this module.              */
+/*      Seventeen routines and one macro are provided by this module.        */
 /*                                                                           */ 
 /*          "InitCodeGenerator"  -- this is used to prepare the code         */
 /*          generator by establishing the output file where the assembly     */
 /*          code is to be written and by setting up various internal code    */
 /*          generator structures.                                            */
 /*                                                                           */ 
+/*          "ResetCodeGenerator" prepares a code generator which has been    */
+/*          used before for more code, keeping its code table, and           */
+/*          "FreeCodeGenerator" releases the table.                          */
+/*                                                                           */ 
 /*          "WriteCodeFile" -- this is used to output the contents of the    */ 
 /*          code array as an ASCII assembly language file for the stack      */ 
 /*          computer.                                                        */ 
@@ -28,6 +32,10 @@
 /*          "ErrorsInProgram". If this variable is set by this routine, no   */ 
 /*          code can be output to the assembly file.                         */ 
 /*                                                                           */ 
+/*          "SetCodeTimer" has the time taken by "Emit" charged to a phase   */
+/*          timer (see "timing.c"), and "SetCodeTrap" has the fatal errors   */
+/*          below returned to the compiler through a trap (see "fatal.c").   */
+/*                                                                           */ 
 /*          "Emit" is the call which outputs instructions. "Emit" is         */
 /*          designed to work with "1-address" instructions, i.e., those      */
 /*          which have an "address" field. For convenience a macro,          */
@@ -37,6 +45,10 @@
 /*          expands into a call to "Emit" with the address field zeroed.     */
 /*          This macro is defined in the header file.                        */
 /*                                                                           */ 
+/*          "EmitDataAddress" emits a "Load #<datum>" of the address of a    */
+/*          global variable, marked so that an object file can relocate it   */
+/*          (see "object.c").                                                */
+/*                                                                           */ 
 /*          "CurrentCodeAddress" is a routine which returns the address of   */ 
 /*          the next loaction available in code memory. It is used by        */ 
 /*          routines which need to backpatch the code array.                 */ 
@@ -44,48 +56,47 @@
 /*          "BackPatch" is a routine which actually backpatches the code     */ 
 /*          array.                                                           */ 
 /*                                                                           */ 
+/*          "GetInstruction", "InsertCode" and "DeleteCode" allow the        */
+/*          optimiser to inspect and rewrite code which has already been     */
+/*          emitted. Insertions and deletions relocate the targets of all    */
+/*          branch and call instructions so that they remain valid.          */
+/*          "RewriteCode" makes many such changes to the code of one         */
+/*          procedure at once, moving and relocating it only once, while     */
+/*          "RemoveCode" drops code just emitted and "SwapCode" exchanges    */
+/*          two runs of it, relocating nothing.                              */
+/*                                                                           */ 
 /*---------------------------------------------------------------------------*/
 
 #include <stdio.h>
 #include <stdlib.h>
 #include "code.h"
-
-/*---------------------------------------------------------------------------*/
-/*                                                                           */
-/*      Definitions of constants local to the module                         */
-/*                                                                           */
-/*---------------------------------------------------------------------------*/
-
-#define  CODETABLESIZE                 1024 
+#include "memory.h"
 
 /*---------------------------------------------------------------------------*/
 /*                                                                           */
 /*      Data Structures for this module                                      */
 /*                                                                           */
+/*      The code table, its current position, the output file and the        */
+/*      "ErrorsInProgram" flag make up a CODEGEN (see "code.h"), passed as   */
+/*      the first argument of every routine.                                 */
+/*                                                                           */
 /*---------------------------------------------------------------------------*/
 
-typedef struct  {       /* definition of an instruction in the internal code */
-    int opcode;         /* array.                                            */
-    int address;
-}
-    INSTRUCTION;
-
-PRIVATE FILE         *CodeFile = NULL;
-PRIVATE INSTRUCTION  CodeTable[CODETABLESIZE];
-PRIVATE int          CodePosition = 0;
-PRIVATE int          ErrorsInProgram = 0;
-
 /*---------------------------------------------------------------------------*/
 /*                                                                           */
 /*      Function Prototypes for private routines                             */
 /*                                                                           */
 /*---------------------------------------------------------------------------*/
 
-PRIVATE void  Output( int i );
-PRIVATE void  OutputControlInst( char *s, int i );
-PRIVATE void  OutputDataInst( char *s, int i );
-PRIVATE void  OutputFPInst( char *s, int i );
-PRIVATE void  OutputSPInst( char *s, int i );
+PRIVATE void  Output( CODEGEN *cg, int i );
+PRIVATE void  OutputControlInst( CODEGEN *cg, char *s, int i );
+PRIVATE void  OutputDataInst( CODEGEN *cg, char *s, int i );
+PRIVATE void  OutputFPInst( CODEGEN *cg, char *s, int i );
+PRIVATE void  OutputSPInst( CODEGEN *cg, char *s, int i );
+PRIVATE int   IsControlInst( int opcode );
+PRIVATE void  CheckCodeAddress( CODEGEN *cg, char *routine, int codeaddr );
+PRIVATE int   GrowCodeTable( CODEGEN *cg );
+PRIVATE void  ReverseCode( CODEGEN *cg, int low, int high );
 
 /*---------------------------------------------------------------------------*/
 /*                                                                           */
@@ -99,8 +110,12 @@ PRIVATE void  OutputSPInst( char *s, int i );
 /*                                                                           */
 /*      Input(s):                                                            */
 /*                                                                           */
+/*          cg         pointer to the CODEGEN to initialise.                 */
+/*                                                                           */
 /*          codefile   pointer to a FILE structure, this is the file to      */
-/*                     which the assembly code will be written.              */
+/*                     which the assembly code will be written, or NULL if   */
+/*                     the code is only wanted in memory, when               */
+/*                     "WriteCodeFile" must not be called.                   */
 /*                                                                           */
 /*      Output(s):     None                                                  */
 /*                                                                           */
@@ -108,25 +123,71 @@ PRIVATE void  OutputSPInst( char *s, int i );
 /*                                                                           */
 /*---------------------------------------------------------------------------*/
 
-PUBLIC void   InitCodeGenerator( FILE *codefile )
+PUBLIC void   InitCodeGenerator( CODEGEN *cg, FILE *codefile )
 {
-    if ( codefile == NULL ) {
-      fprintf( stderr, "Fatal Error: InitCodeGenerator: attempt to\n");
-      fprintf( stderr, "use an invalid file handle (NULL) for output\n");
-      exit( EXIT_FAILURE );
-    }
-    CodeFile = codefile;
-    CodePosition = 0;
-    ErrorsInProgram = 0;
+    cg->CodeTable = NULL;
+    cg->CodeSpace = 0;
+    ResetCodeGenerator( cg, codefile );
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      ResetCodeGenerator                                                   */
+/*                                                                           */
+/*      Prepares a code generator, which has been initialised before, for a  */
+/*      new program, as "InitCodeGenerator", but keeping the code table,     */
+/*      so that a generator used over and over stops allocating once it      */
+/*      has held the largest program.                                        */
+/*                                                                           */
+/*      Input(s):      cg, the code generator.                               */
+/*                     codefile, as for "InitCodeGenerator".                 */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*      Returns:       Nothing                                               */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PUBLIC void   ResetCodeGenerator( CODEGEN *cg, FILE *codefile )
+{
+    cg->CodeFile = codefile;
+    cg->CodePosition = 0;
+    cg->ErrorsInProgram = 0;
+    cg->Timer = NULL;
+    cg->Trap = NULL;
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      FreeCodeGenerator                                                    */
+/*                                                                           */
+/*      Releases the code table of a code generator, which must be           */
+/*      initialised again before it is used.                                 */
+/*                                                                           */
+/*      Input(s):      cg, the code generator.                               */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*      Returns:       Nothing                                               */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PUBLIC void   FreeCodeGenerator( CODEGEN *cg )
+{
+    MemFree( MEM_CODE, cg->CodeTable, cg->CodeSpace * sizeof( INSTRUCTION ) );
+    cg->CodeTable = NULL;
+    cg->CodeSpace = 0;
+    cg->CodePosition = 0;
 }
 
 /*---------------------------------------------------------------------------*/
 /*                                                                           */
 /*      WriteCodeFile                                                        */
 /*                                                                           */
-/*      Outputs the contents of the CodeTable to the file.                   */
+/*      Outputs the contents of the CodeTable to the file. The file is       */
+/*      flushed but not closed; it belongs to the caller.                    */
 /*                                                                           */
-/*      Input(s):      None                                                  */
+/*      Input(s):      cg, the code generator.                               */
 /*                                                                           */
 /*      Output(s):     None                                                  */
 /*                                                                           */
@@ -134,23 +195,21 @@ PUBLIC void   InitCodeGenerator( FILE *codefile )
 /*                                                                           */
 /*---------------------------------------------------------------------------*/
 
-PUBLIC void   WriteCodeFile( void )
+PUBLIC void   WriteCodeFile( CODEGEN *cg )
 {
     int i;
 
-    if ( CodeFile == NULL ) {
-      fprintf( stderr, "Fatal Error: WriteCodeFile: attempt to\n");
-      fprintf( stderr, "use an invalid file handle (NULL) for output\n");
-      exit( EXIT_FAILURE );
-    }
+    if ( cg->CodeFile == NULL )
+      Fatal( cg->Trap, "Fatal Error: WriteCodeFile: attempt to "
+                       "use an invalid file handle (NULL) for output" );
 
-    if ( !ErrorsInProgram )
-        for ( i = 0; i < CodePosition; i++ )  Output( i );
+    if ( !cg->ErrorsInProgram )
+        for ( i = 0; i < cg->CodePosition; i++ )  Output( cg, i );
     else  {
-        fprintf( CodeFile, ";; Errors detected in input file, no code\n" );
-        fprintf( CodeFile, ";; generated\n" );
+        fprintf( cg->CodeFile, ";; Errors detected in input file, no code\n" );
+        fprintf( cg->CodeFile, ";; generated\n" );
     }
-    fclose( CodeFile );
+    fflush( cg->CodeFile );
 }
 
 /*---------------------------------------------------------------------------*/
@@ -169,9 +228,52 @@ PUBLIC void   WriteCodeFile( void )
 /*                                                                           */
 /*---------------------------------------------------------------------------*/
 
-PUBLIC void   KillCodeGeneration( void )
+PUBLIC void   KillCodeGeneration( CODEGEN *cg )
+{
+    cg->ErrorsInProgram = 1;
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      SetCodeTimer                                                         */
+/*                                                                           */
+/*      Has the time taken by each "Emit" charged to a timer as PHASE_EMIT,  */
+/*      until the code generator is next initialised.                        */
+/*                                                                           */
+/*      Input(s):      cg, the code generator.                               */
+/*                     timer, the PHASETIMER, or NULL for none.              */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*      Returns:       Nothing                                               */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PUBLIC void   SetCodeTimer( CODEGEN *cg, PHASETIMER *timer )
 {
-    ErrorsInProgram = 1;
+    cg->Timer = timer;
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      SetCodeTrap                                                          */
+/*                                                                           */
+/*      Has the fatal errors of the code generator, such as a code table     */
+/*      overflow, sprung on a trap (see "fatal.c") rather than ending the    */
+/*      process, until the code generator is next initialised.               */
+/*                                                                           */
+/*      Input(s):      cg, the code generator.                               */
+/*                     trap, the FATALTRAP, or NULL for none.                */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*      Returns:       Nothing                                               */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PUBLIC void   SetCodeTrap( CODEGEN *cg, FATALTRAP *trap )
+{
+    cg->Trap = trap;
 }
 
 /*---------------------------------------------------------------------------*/
@@ -180,8 +282,9 @@ PUBLIC void   KillCodeGeneration( void )
 /*                                                                           */
 /*      Places an instruction opcode/address pair in the current location    */
 /*      in the CodeTable (indexed by CodePosition) and increments this       */
-/*      location. If the CodeTable overflows, issues an error message to     */
-/*      stderrr and forces program exit.                                     */
+/*      location, making the CodeTable larger if it is full. If the program  */
+/*      exceeds CODE_LIMIT instructions, or there is no store for a larger   */
+/*      table, the error is fatal (see "SetCodeTrap").                       */
 /*                                                                           */
 /*      Input(s):                                                            */
 /*                                                                           */
@@ -197,19 +300,47 @@ PUBLIC void   KillCodeGeneration( void )
 /*                                                                           */
 /*---------------------------------------------------------------------------*/
 
-PUBLIC void   Emit( int opcode, int offset )
+PUBLIC void   Emit( CODEGEN *cg, int opcode, int offset )
 {
-    if ( CodePosition >= CODETABLESIZE )  {
-        fprintf( stderr, "Fatal compiler error, code table overflow\n" );
-        fprintf( stderr, "(max allowed code size is %d instructions\n",
-                 CODETABLESIZE );
-        exit( EXIT_FAILURE );
-    }
+    int phase = EnterPhase( cg->Timer, PHASE_EMIT );
+
+    if ( cg->CodePosition == cg->CodeSpace && !GrowCodeTable( cg ) )
+        Fatal( cg->Trap, "Fatal compiler error, code table overflow "
+                         "(max allowed code size is %d instructions)",
+               CODE_LIMIT );
     else  {
-        CodeTable[CodePosition].opcode = opcode;
-        CodeTable[CodePosition].address = offset;
-        CodePosition++;
+        cg->CodeTable[cg->CodePosition].opcode = opcode;
+        cg->CodeTable[cg->CodePosition].address = offset;
+        cg->CodeTable[cg->CodePosition].data = 0;
+        cg->CodePosition++;
     }
+    LeavePhase( cg->Timer, phase );
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      EmitDataAddress                                                      */
+/*                                                                           */
+/*      Emits a "Load #<datum>" pushing the address of a global variable.    */
+/*      The code is the same as "Emit( cg, I_LOADI, address )", but the      */
+/*      instruction is marked as holding a data address, which the object    */
+/*      file writer must relocate along with the address fields of "Load"    */
+/*      and "Store <addr>".                                                  */
+/*                                                                           */
+/*      Input(s):                                                            */
+/*                                                                           */
+/*          address   integer, absolute address of the global variable.      */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*      Returns:       Nothing                                               */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PUBLIC void   EmitDataAddress( CODEGEN *cg, int address )
+{
+    Emit( cg, I_LOADI, address );
+    cg->CodeTable[cg->CodePosition-1].data = 1;
 }
 
 /*---------------------------------------------------------------------------*/
@@ -229,9 +360,9 @@ PUBLIC void   Emit( int opcode, int offset )
 /*                                                                           */
 /*---------------------------------------------------------------------------*/
 
-PUBLIC int    CurrentCodeAddress( void )
+PUBLIC int    CurrentCodeAddress( CODEGEN *cg )
 {
-    return CodePosition;
+    return cg->CodePosition;
 }
 
 /*---------------------------------------------------------------------------*/
@@ -257,16 +388,296 @@ PUBLIC int    CurrentCodeAddress( void )
 /*                                                                           */
 /*---------------------------------------------------------------------------*/
 
-PUBLIC void   BackPatch( int codeaddr, int value )
+PUBLIC void   BackPatch( CODEGEN *cg, int codeaddr, int value )
+{
+    CheckCodeAddress( cg, "BackPatch", codeaddr );
+    cg->CodeTable[codeaddr].address = value;
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      GetInstruction                                                       */
+/*                                                                           */
+/*      Retrieves the opcode and address field of an instruction which has   */
+/*      already been placed in the CodeTable.                                */
+/*                                                                           */
+/*      Input(s):                                                            */
+/*                                                                           */
+/*          codeaddr  integer, location in code memory of the instruction.   */
+/*                                                                           */
+/*      Output(s):                                                           */
+/*                                                                           */
+/*          opcode    pointer to an integer which receives the opcode.       */
+/*          value     pointer to an integer which receives the address       */
+/*                    field. Either pointer may be NULL.                     */
+/*                                                                           */
+/*      Returns:       Nothing                                               */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PUBLIC void   GetInstruction( CODEGEN *cg, int codeaddr, int *opcode,
+                              int *value )
+{
+    CheckCodeAddress( cg, "GetInstruction", codeaddr );
+    if ( opcode != NULL )  *opcode = cg->CodeTable[codeaddr].opcode;
+    if ( value != NULL )  *value = cg->CodeTable[codeaddr].address;
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      InsertCode                                                           */
+/*                                                                           */
+/*      Inserts an instruction in front of the instruction currently at      */
+/*      "codeaddr", moving that instruction and all those following it up    */
+/*      by one location. Every branch or call whose target is at or beyond   */
+/*      "codeaddr" is relocated, so a branch to the old instruction at       */
+/*      "codeaddr" still reaches it, not the new one.                        */
+/*                                                                           */
+/*      Input(s):                                                            */
+/*                                                                           */
+/*          codeaddr  integer, location at which to insert, in the range     */
+/*                    0 .. CurrentCodeAddress().                             */
+/*                                                                           */
+/*          opcode    integer, instruction opcode.                           */
+/*                                                                           */
+/*          value     integer, instruction address, offset or value field.   */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*      Returns:       Nothing                                               */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PUBLIC void   InsertCode( CODEGEN *cg, int codeaddr, int opcode, int value )
 {
-    if ( codeaddr < 0 || codeaddr >= CODETABLESIZE )  {
-        fprintf( stderr, "Fatal internal error, attempt to BackPatch to " );
-        fprintf( stderr, "location %d\n", codeaddr );
-        fprintf( stderr, "This location is outside the valid set of code " );
-        fprintf( stderr, "addresses, 0 .. %d\n", CODETABLESIZE-1 );
-        exit( EXIT_FAILURE );
+    int i;
+
+    if ( codeaddr != cg->CodePosition )
+        CheckCodeAddress( cg, "InsertCode", codeaddr );
+    Emit( cg, opcode, value );  /* grows the table, checks for overflow      */
+
+    for ( i = cg->CodePosition-1; i > codeaddr; i-- )
+        cg->CodeTable[i] = cg->CodeTable[i-1];
+    cg->CodeTable[codeaddr].opcode = opcode;
+    cg->CodeTable[codeaddr].address = value;
+    cg->CodeTable[codeaddr].data = 0;
+
+    for ( i = 0; i < cg->CodePosition; i++ )
+        if ( i != codeaddr && IsControlInst( cg->CodeTable[i].opcode ) &&
+             cg->CodeTable[i].address >= codeaddr )
+            cg->CodeTable[i].address++;
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      DeleteCode                                                           */
+/*                                                                           */
+/*      Removes "count" instructions starting at "codeaddr", moving the      */
+/*      instructions which follow them down. Branches and calls into the     */
+/*      deleted range are redirected to "codeaddr" (i.e., to whatever        */
+/*      instruction now follows the deleted range), those beyond it are      */
+/*      relocated downwards.                                                 */
+/*                                                                           */
+/*      Input(s):                                                            */
+/*                                                                           */
+/*          codeaddr  integer, location of the first instruction to delete.  */
+/*                                                                           */
+/*          count     integer, number of instructions to delete.             */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*      Returns:       Nothing                                               */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PUBLIC void   DeleteCode( CODEGEN *cg, int codeaddr, int count )
+{
+    int i, target;
+
+    if ( count <= 0 )  return;
+    CheckCodeAddress( cg, "DeleteCode", codeaddr );
+    CheckCodeAddress( cg, "DeleteCode", codeaddr+count-1 );
+
+    for ( i = codeaddr; i+count < cg->CodePosition; i++ )
+        cg->CodeTable[i] = cg->CodeTable[i+count];
+    cg->CodePosition -= count;
+
+    for ( i = 0; i < cg->CodePosition; i++ )  {
+        if ( IsControlInst( cg->CodeTable[i].opcode ) )  {
+            target = cg->CodeTable[i].address;
+            if ( target >= codeaddr+count )  cg->CodeTable[i].address -= count;
+            else if ( target > codeaddr )  cg->CodeTable[i].address = codeaddr;
+        }
+    }
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      RemoveCode                                                           */
+/*                                                                           */
+/*      Removes "count" instructions starting at "codeaddr" from the code    */
+/*      just emitted, e.g., an operand of an expression being simplified,    */
+/*      moving any which follow them down. Unlike "DeleteCode" nothing is    */
+/*      relocated, as no branch can reach past the start of code which is    */
+/*      still being emitted, so when the instructions are the last in the    */
+/*      table the code pointer is simply stepped back.                       */
+/*                                                                           */
+/*      Input(s):                                                            */
+/*                                                                           */
+/*          codeaddr  integer, location of the first instruction to remove.  */
+/*                                                                           */
+/*          count     integer, number of instructions to remove.             */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*      Returns:       Nothing                                               */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PUBLIC void   RemoveCode( CODEGEN *cg, int codeaddr, int count )
+{
+    int i;
+
+    if ( count <= 0 )  return;
+    CheckCodeAddress( cg, "RemoveCode", codeaddr );
+    CheckCodeAddress( cg, "RemoveCode", codeaddr+count-1 );
+
+    for ( i = codeaddr; i+count < cg->CodePosition; i++ )
+        cg->CodeTable[i] = cg->CodeTable[i+count];
+    cg->CodePosition -= count;
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      SwapCode                                                             */
+/*                                                                           */
+/*      Exchanges the "first" instructions from "codeaddr" with the          */
+/*      "second" which follow them, in place. Nothing is relocated, so no    */
+/*      branch may lead into either run, nor out of it.                      */
+/*                                                                           */
+/*      Input(s):                                                            */
+/*                                                                           */
+/*          codeaddr  integer, location of the first instruction of the      */
+/*                    first run.                                             */
+/*                                                                           */
+/*          first     integer, number of instructions in the first run.      */
+/*                                                                           */
+/*          second    integer, number of instructions in the second run.     */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*      Returns:       Nothing                                               */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PUBLIC void   SwapCode( CODEGEN *cg, int codeaddr, int first, int second )
+{
+    if ( first <= 0 || second <= 0 )  return;
+    CheckCodeAddress( cg, "SwapCode", codeaddr );
+    CheckCodeAddress( cg, "SwapCode", codeaddr+first+second-1 );
+
+    /*  Reversing each run and then the two together rotates them.        */
+
+    ReverseCode( cg, codeaddr, codeaddr+first-1 );
+    ReverseCode( cg, codeaddr+first, codeaddr+first+second-1 );
+    ReverseCode( cg, codeaddr, codeaddr+first+second-1 );
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      RewriteCode                                                          */
+/*                                                                           */
+/*      Makes a list of changes to the code from "start" to the end of the   */
+/*      table in a single pass, so that however many there are, each         */
+/*      instruction is moved once and each branch relocated once. An edit    */
+/*      with a "count" of 0 inserts its instruction in front of the one at   */
+/*      "codeaddr", and a branch to that one still reaches it, as with       */
+/*      "InsertCode". Any other edit replaces the "count" instructions from  */
+/*      "codeaddr", and a branch to any of them reaches the new one.         */
+/*                                                                           */
+/*      Only the branches and calls from "start" on are relocated, so the    */
+/*      code before it must not branch past "start", as is the case when     */
+/*      "start" is where the block of the procedure being compiled begins.   */
+/*      The new instructions are not relocated, so must not be branches.     */
+/*                                                                           */
+/*      Input(s):                                                            */
+/*                                                                           */
+/*          start     integer, the first location which may change.          */
+/*                                                                           */
+/*          edits     pointer to the changes, in ascending order of          */
+/*                    "codeaddr", with insertions in front of a              */
+/*                    replacement at the same location. Replacements must    */
+/*                    not overlap.                                           */
+/*                                                                           */
+/*          count     integer, the number of edits.                          */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*      Returns:       1 if the changes were made, 0 if there was no store   */
+/*                     for them, when the code is unchanged.                 */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PUBLIC int    RewriteCode( CODEGEN *cg, int start, CODEEDIT *edits,
+                           int count )
+{
+    INSTRUCTION *code;
+    int *moved, length, i, e, n, k, target;
+
+    for ( e = 0; e < count; e++ )
+        if ( edits[e].codeaddr < ( e > 0 ? edits[e-1].codeaddr +
+                                           edits[e-1].count : start ) ||
+             edits[e].codeaddr + edits[e].count > cg->CodePosition )
+            Fatal( cg->Trap, "Fatal internal error, RewriteCode: edit of "
+                             "locations %d .. %d out of order or outside "
+                             "%d .. %d", edits[e].codeaddr,
+                   edits[e].codeaddr + edits[e].count - 1, start,
+                   cg->CodePosition - 1 );
+    if ( count <= 0 )  return 1;
+    length = cg->CodePosition - start;
+
+    code = malloc( ( length + count ) * sizeof( INSTRUCTION ) );
+    moved = malloc( ( length + 1 ) * sizeof( int ) );
+    if ( code == NULL || moved == NULL )  {
+        free( code );
+        free( moved );
+        return 0;
+    }
+
+    /*  "moved" gives the new location of each old one, and of the end.    */
+
+    for ( i = start, e = n = 0; i <= cg->CodePosition; )  {
+        if ( e < count && edits[e].codeaddr == i )  {
+            for ( k = 0; k < edits[e].count; k++ )
+                moved[i - start + k] = start + n;
+            code[n++] = edits[e].instruction;
+            i += edits[e++].count;
+        }
+        else  {
+            moved[i - start] = start + n;
+            if ( i < cg->CodePosition )  code[n++] = cg->CodeTable[i];
+            i++;
+        }
+    }
+    while ( start + n > cg->CodeSpace )
+        if ( !GrowCodeTable( cg ) )  {
+            free( code );
+            free( moved );
+            return 0;
+        }
+    for ( i = 0; i < n; i++ )  {
+        if ( IsControlInst( code[i].opcode ) )  {
+            target = code[i].address;
+            if ( target >= start && target <= cg->CodePosition )
+                code[i].address = moved[target - start];
+        }
+        cg->CodeTable[start + i] = code[i];
     }
-    else  CodeTable[codeaddr].address = value;
+    cg->CodePosition = start + n;
+
+    free( code );
+    free( moved );
+    return 1;
 }
 
 /*---------------------------------------------------------------------------*/
@@ -292,52 +703,50 @@ PUBLIC void   BackPatch( int codeaddr, int value )
 /*                                                                           */
 /*---------------------------------------------------------------------------*/
 
-PRIVATE void  Output( int i )
+PRIVATE void  Output( CODEGEN *cg, int i )
 {
-    if ( ErrorsInProgram )  return;
-
-    fprintf( CodeFile, "%3d  ", i );
-    switch ( CodeTable[i].opcode )  {
-        case  I_ADD      :  fprintf( CodeFile, "Add\n" );         break;
-        case  I_SUB      :  fprintf( CodeFile, "Sub\n" );         break;
-        case  I_MULT     :  fprintf( CodeFile, "Mult\n" );        break;
-        case  I_DIV      :  fprintf( CodeFile, "Div\n" );         break;
-        case  I_NEG      :  fprintf( CodeFile, "Neg\n" );         break;
-        case  I_RET      :  fprintf( CodeFile, "Ret\n" );         break;
-        case  I_BSF      :  fprintf( CodeFile, "Bsf\n" );         break;
-        case  I_RSF      :  fprintf( CodeFile, "Rsf\n" );         break;
-        case  I_PUSHFP   :  fprintf( CodeFile, "Push  FP\n" );    break;
-        case  I_READ     :  fprintf( CodeFile, "Read\n" );        break;
-        case  I_WRITE    :  fprintf( CodeFile, "Write\n" );       break;
-        case  I_HALT     :  fprintf( CodeFile, "Halt\n" );        break;
-        case  I_BR       :  OutputControlInst( "Br  ", i );       break;
-        case  I_BGZ      :  OutputControlInst( "Bgz ", i );       break;
-        case  I_BG       :  OutputControlInst( "Bg  ", i );       break;
-        case  I_BLZ      :  OutputControlInst( "Blz ", i );       break;
-        case  I_BL       :  OutputControlInst( "Bl  ", i );       break;
-        case  I_BZ       :  OutputControlInst( "Bz  ", i );       break;
-        case  I_BNZ      :  OutputControlInst( "Bnz ", i );       break;
-        case  I_CALL     :  OutputControlInst( "Call", i );       break;
-        case  I_LDP      :  OutputControlInst( "Ldp ", i );       break;
-        case  I_RDP      :  OutputControlInst( "Rdp ", i );       break;
-        case  I_INC      :  OutputControlInst( "Inc ", i );       break;
-        case  I_DEC      :  OutputControlInst( "Dec ", i );       break;
-        case  I_LOADI    :  fprintf( CodeFile, "Load  #%-4d\n",
-                                     CodeTable[i].address );      break;
-        case  I_LOADA    :  OutputDataInst( "Load ", i );         break;
-        case  I_LOADFP   :  OutputFPInst( "Load ", i );           break;
-        case  I_LOADSP   :  OutputSPInst( "Load ", i );           break;
-        case  I_STOREA   :  OutputDataInst( "Store", i );         break;
-        case  I_STOREFP  :  OutputFPInst( "Store", i );           break;
-        case  I_STORESP  :  OutputSPInst( "Store", i );           break;
+    if ( cg->ErrorsInProgram )  return;
+
+    fprintf( cg->CodeFile, "%3d  ", i );
+    switch ( cg->CodeTable[i].opcode )  {
+        case  I_ADD      :  fprintf( cg->CodeFile, "Add\n" );         break;
+        case  I_SUB      :  fprintf( cg->CodeFile, "Sub\n" );         break;
+        case  I_MULT     :  fprintf( cg->CodeFile, "Mult\n" );        break;
+        case  I_DIV      :  fprintf( cg->CodeFile, "Div\n" );         break;
+        case  I_NEG      :  fprintf( cg->CodeFile, "Neg\n" );         break;
+        case  I_RET      :  fprintf( cg->CodeFile, "Ret\n" );         break;
+        case  I_BSF      :  fprintf( cg->CodeFile, "Bsf\n" );         break;
+        case  I_RSF      :  fprintf( cg->CodeFile, "Rsf\n" );         break;
+        case  I_PUSHFP   :  fprintf( cg->CodeFile, "Push  FP\n" );    break;
+        case  I_READ     :  fprintf( cg->CodeFile, "Read\n" );        break;
+        case  I_WRITE    :  fprintf( cg->CodeFile, "Write\n" );       break;
+        case  I_HALT     :  fprintf( cg->CodeFile, "Halt\n" );        break;
+        case  I_BR       :  OutputControlInst( cg, "Br  ", i );       break;
+        case  I_BGZ      :  OutputControlInst( cg, "Bgz ", i );       break;
+        case  I_BG       :  OutputControlInst( cg, "Bg  ", i );       break;
+        case  I_BLZ      :  OutputControlInst( cg, "Blz ", i );       break;
+        case  I_BL       :  OutputControlInst( cg, "Bl  ", i );       break;
+        case  I_BZ       :  OutputControlInst( cg, "Bz  ", i );       break;
+        case  I_BNZ      :  OutputControlInst( cg, "Bnz ", i );       break;
+        case  I_CALL     :  OutputControlInst( cg, "Call", i );       break;
+        case  I_LDP      :  OutputControlInst( cg, "Ldp ", i );       break;
+        case  I_RDP      :  OutputControlInst( cg, "Rdp ", i );       break;
+        case  I_INC      :  OutputControlInst( cg, "Inc ", i );       break;
+        case  I_DEC      :  OutputControlInst( cg, "Dec ", i );       break;
+        case  I_LOADI    :  fprintf( cg->CodeFile, "Load  #%-4d\n",
+                                     cg->CodeTable[i].address );      break;
+        case  I_LOADA    :  OutputDataInst( cg, "Load ", i );         break;
+        case  I_LOADFP   :  OutputFPInst( cg, "Load ", i );           break;
+        case  I_LOADSP   :  OutputSPInst( cg, "Load ", i );           break;
+        case  I_STOREA   :  OutputDataInst( cg, "Store", i );         break;
+        case  I_STOREFP  :  OutputFPInst( cg, "Store", i );           break;
+        case  I_STORESP  :  OutputSPInst( cg, "Store", i );           break;
         default:
-            fprintf( CodeFile, "Fatal compiler error, unknown opcode %d\n",
-                               CodeTable[i].opcode );
-            fclose( CodeFile );
-            fprintf( stderr, "Fatal compiler error, unknown opcode %d\n",
-                             CodeTable[i].opcode );
-            fprintf( stderr, "Code address %d\n", i );
-            exit( EXIT_FAILURE );
+            fprintf( cg->CodeFile, "Fatal compiler error, unknown opcode %d\n",
+                               cg->CodeTable[i].opcode );
+            Fatal( cg->Trap, "Fatal compiler error, unknown opcode %d "
+                             "at code address %d", cg->CodeTable[i].opcode,
+                   i );
             break;
     }
 }
@@ -376,36 +785,145 @@ PRIVATE void  Output( int i )
 /*                                                                           */
 /*---------------------------------------------------------------------------*/
 
-PRIVATE void  OutputControlInst( char *s, int i )
+PRIVATE void  OutputControlInst( CODEGEN *cg, char *s, int i )
 {
-    fprintf( CodeFile, "%s  %-4d\n", s, CodeTable[i].address );
+    fprintf( cg->CodeFile, "%s  %-4d\n", s, cg->CodeTable[i].address );
 }
 
-PRIVATE void  OutputDataInst( char *s, int i )
+PRIVATE void  OutputDataInst( CODEGEN *cg, char *s, int i )
 {
-    fprintf( CodeFile, "%s %-4d\n", s, CodeTable[i].address );
+    fprintf( cg->CodeFile, "%s %-4d\n", s, cg->CodeTable[i].address );
 }
 
-PRIVATE void  OutputFPInst( char *s, int i )
+PRIVATE void  OutputFPInst( CODEGEN *cg, char *s, int i )
 {
     int offset;
 
-    offset = CodeTable[i].address;
-    fprintf( CodeFile, "%s FP", s );
-    if ( offset == 0 )  fputc( '\n', CodeFile );
-    else if ( offset > 0 )  fprintf( CodeFile, "+%-4d\n", offset );
-    else  fprintf( CodeFile, "%-4d\n", offset );
+    offset = cg->CodeTable[i].address;
+    fprintf( cg->CodeFile, "%s FP", s );
+    if ( offset == 0 )  fputc( '\n', cg->CodeFile );
+    else if ( offset > 0 )  fprintf( cg->CodeFile, "+%-4d\n", offset );
+    else  fprintf( cg->CodeFile, "%-4d\n", offset );
 }
 
-PRIVATE void  OutputSPInst( char *s, int i )
+PRIVATE void  OutputSPInst( CODEGEN *cg, char *s, int i )
 {
     int offset;
 
-    offset = CodeTable[i].address;
-    fprintf( CodeFile, "%s [SP]", s );
-    if ( offset == 0 )  fputc( '\n', CodeFile );
-    else if ( offset > 0 )  fprintf( CodeFile, "+%-4d\n", offset );
-    else  fprintf( CodeFile, "%-4d\n", offset );
+    offset = cg->CodeTable[i].address;
+    fprintf( cg->CodeFile, "%s [SP]", s );
+    if ( offset == 0 )  fputc( '\n', cg->CodeFile );
+    else if ( offset > 0 )  fprintf( cg->CodeFile, "+%-4d\n", offset );
+    else  fprintf( cg->CodeFile, "%-4d\n", offset );
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      IsControlInst                                                        */
+/*                                                                           */
+/*      Determines whether an instruction's address field is a code address  */
+/*      (i.e., it is a branch or a call), and so must be relocated when      */
+/*      code is inserted or deleted.                                         */
+/*                                                                           */
+/*      Input(s):                                                            */
+/*                                                                           */
+/*          opcode    integer, instruction opcode.                           */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*      Returns:       1 if the address field is a code address, else 0.     */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE int   IsControlInst( int opcode )
+{
+    return  opcode >= I_BR && opcode <= I_CALL;
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      CheckCodeAddress                                                     */
+/*                                                                           */
+/*      Reports a fatal internal error (see "SetCodeTrap") if "codeaddr"     */
+/*      does not refer to an instruction which has already been emitted.     */
+/*                                                                           */
+/*      Input(s):                                                            */
+/*                                                                           */
+/*          routine   pointer to a character string, the name of the         */
+/*                    calling routine, for the error report.                 */
+/*          codeaddr  integer, location in code memory to check.             */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*      Returns:       Nothing                                               */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE void  CheckCodeAddress( CODEGEN *cg, char *routine, int codeaddr )
+{
+    if ( codeaddr < 0 || codeaddr >= cg->CodePosition )
+        Fatal( cg->Trap, "Fatal internal error, %s: attempt to access "
+                         "location %d, outside the generated code, "
+                         "addresses 0 .. %d", routine,
+               codeaddr, cg->CodePosition-1 );
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      GrowCodeTable                                                        */
+/*                                                                           */
+/*      Doubles the room in the CodeTable, which is full.                    */
+/*                                                                           */
+/*      Input(s):      None                                                  */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*      Returns:       1 if there is room for another instruction, 0 if the  */
+/*                     table holds CODE_LIMIT instructions or there is no    */
+/*                     store for a larger one, when it is unchanged.         */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE int   GrowCodeTable( CODEGEN *cg )
+{
+    INSTRUCTION *table;
+    int space;
+
+    if ( cg->CodeSpace >= CODE_LIMIT )  return 0;
+    space = cg->CodeSpace > 0 ? 2 * cg->CodeSpace : CODE_TABLE_START;
+    if ( space > CODE_LIMIT )  space = CODE_LIMIT;
+    if ( NULL == ( table = MemRealloc( MEM_CODE, cg->CodeTable,
+                                       cg->CodeSpace * sizeof( INSTRUCTION ),
+                                       space * sizeof( INSTRUCTION ) ) ) )
+        return 0;
+    cg->CodeTable = table;
+    cg->CodeSpace = space;
+    return 1;
 }
 
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      ReverseCode                                                          */
+/*                                                                           */
+/*      Reverses the order of the instructions from "low" to "high".         */
+/*                                                                           */
+/*      Input(s):                                                            */
+/*                                                                           */
+/*          low, high  integers, the first and last locations reversed.      */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*      Returns:       Nothing                                               */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
 
+PRIVATE void  ReverseCode( CODEGEN *cg, int low, int high )
+{
+    INSTRUCTION t;
+
+    for ( ; low < high; low++, high-- )  {
+        t = cg->CodeTable[low];
+        cg->CodeTable[low] = cg->CodeTable[high];
+        cg->CodeTable[high] = t;
+    }
+}
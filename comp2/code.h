@@ -12,6 +12,8 @@
 
 #include <stdio.h>
 #include "global.h"
+#include "timing.h"
+#include "fatal.h"
 
 #define  I_ADD           0      /* 0-"address" instructions                  */
 #define  I_SUB           1      /* Sub                                       */
@@ -46,12 +48,55 @@
 #define  I_STOREFP      29      /* Store FP+<offset>                         */
 #define  I_STORESP      30      /* Store [SP]+<offset>                       */
 
-PUBLIC void   InitCodeGenerator( FILE *codefile );
-PUBLIC void   WriteCodeFile( void );
-PUBLIC void   KillCodeGeneration( void );
-PUBLIC void   Emit( int opcode, int offset );
-PUBLIC int    CurrentCodeAddress( void );
-PUBLIC void   BackPatch( int codeaddr, int value );
+#define  CODE_TABLE_START     1024      /* instructions room is first made   */
+                                        /* for; the code table grows         */
+#define  CODE_LIMIT       (1 << 24)     /* most instructions a program may   */
+                                        /* have                              */
 
-#define _Emit(opcode)  Emit((opcode),0)
+typedef struct  {       /* definition of an instruction in the internal code */
+    int opcode;         /* array. "data" is set on a "Load #<datum>" whose   */
+    int address;        /* datum is the address of a global variable, so     */
+    int data;           /* that it can be relocated (see "EmitDataAddress"). */
+}
+    INSTRUCTION;
+
+typedef struct  {       /* one change made by "RewriteCode" (see "code.c")   */
+    int         codeaddr;               /* "instruction" replaces "count"    */
+    int         count;                  /* instructions at "codeaddr", or if */
+    INSTRUCTION instruction;            /* "count" is 0 goes in front of it  */
+}
+    CODEEDIT;
+
+typedef struct  {       /* the state of one code generator; each compilation */
+    FILE        *CodeFile;              /* owns its own (see "code.c").      */
+    INSTRUCTION *CodeTable;             /* "CodeSpace" entries, of which     */
+    int         CodeSpace;              /* the first "CodePosition" are in   */
+    int         CodePosition;           /* use                               */
+    int         ErrorsInProgram;
+    PHASETIMER  *Timer;                 /* times PHASE_EMIT, or NULL         */
+    FATALTRAP   *Trap;                  /* sprung by a fatal error, or NULL  */
+}
+    CODEGEN;
+
+PUBLIC void   InitCodeGenerator( CODEGEN *cg, FILE *codefile );
+PUBLIC void   ResetCodeGenerator( CODEGEN *cg, FILE *codefile );
+PUBLIC void   FreeCodeGenerator( CODEGEN *cg );
+PUBLIC void   WriteCodeFile( CODEGEN *cg );
+PUBLIC void   KillCodeGeneration( CODEGEN *cg );
+PUBLIC void   SetCodeTimer( CODEGEN *cg, PHASETIMER *timer );
+PUBLIC void   SetCodeTrap( CODEGEN *cg, FATALTRAP *trap );
+PUBLIC void   Emit( CODEGEN *cg, int opcode, int offset );
+PUBLIC void   EmitDataAddress( CODEGEN *cg, int address );
+PUBLIC int    CurrentCodeAddress( CODEGEN *cg );
+PUBLIC void   BackPatch( CODEGEN *cg, int codeaddr, int value );
+PUBLIC void   GetInstruction( CODEGEN *cg, int codeaddr, int *opcode,
+                              int *value );
+PUBLIC void   InsertCode( CODEGEN *cg, int codeaddr, int opcode, int value );
+PUBLIC void   DeleteCode( CODEGEN *cg, int codeaddr, int count );
+PUBLIC void   RemoveCode( CODEGEN *cg, int codeaddr, int count );
+PUBLIC void   SwapCode( CODEGEN *cg, int codeaddr, int first, int second );
+PUBLIC int    RewriteCode( CODEGEN *cg, int start, CODEEDIT *edits,
+                           int count );
+
+#define _Emit(cg,opcode)  Emit((cg),(opcode),0)
 #endif
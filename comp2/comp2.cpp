@@ -17,6 +17,10 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <setjmp.h>
 #include "global.h"
 #include "scanner.h"
 #include "line.h"
@@ -25,119 +29,678 @@
 #include "sets.h"
 #include "strtab.h"
 #include "symbol.h"
+#include "opt.h"
+#include "fragment.h"
+#include "comp2.h"
+#include "batch.h"
+#include "server.h"
+#include "cache.h"
+#include "object.h"
+#include "pipeline.h"
+#include "lister.h"
+#include "diagnose.h"
+#include "timing.h"
+#include "memory.h"
+#include "fatal.h"
 
 /*--------------------------------------------------------------------------*/
 /*                                                                          */
-/*  Global variables used by this parser.                                   */
+/*  Run-time organisation.                                                  */
+/*                                                                          */
+/*  Global variables live at absolute addresses 0, 1, ... and are reserved  */
+/*  by an "Inc" at the start of the main program (in a program linked by    */
+/*  cpllink, by its startup code, see CompileObject).  A procedure call     */
+/*  pushes the actual parameters (values, or addresses for REF              */
+/*  parameters) and then the static link, i.e., the frame of the            */
+/*  procedure's declaring scope.  "Bsf" then saves FP and points FP at the  */
+/*  saved copy, "Call" pushes the return address, and the callee reserves   */
+/*  its locals with "Inc".  A frame therefore looks like:                   */
+/*                                                                          */
+/*          FP+2 ..      local variables                                    */
+/*          FP+1         return address                                     */
+/*          FP           saved FP                                           */
+/*          FP-1         static link                                        */
+/*          FP-1-n ..    parameters 1 .. n                                  */
+/*                                                                          */
+/*  Variables of enclosing procedures are reached by following the static   */
+/*  links with "Load [SP]-1".                                               */
+/*                                                                          */
+/*  The optimiser may add temporaries after the declared variables, so the  */
+/*  "Inc" and "Dec" are emitted as placeholders and their size patched in   */
+/*  once the block has been compiled.                                       */
 /*                                                                          */
 /*--------------------------------------------------------------------------*/
 
-PRIVATE FILE *InputFile;           /*  CPL source comes from here.          */
-PRIVATE FILE *ListFile;            /*  For nicely-formatted syntax errors.  */
-PRIVATE FILE *CodeFile;			   /* machine code output file */
+#define  FRAME_LOCALS       2      /*  FP offset of first local variable.   */
+#define  FRAME_STATICLINK  -1      /*  FP offset of the static link.        */
+#define  MAX_PARAMETERS    31      /*  One "ptypes" bit per parameter.      */
+#define  MAX_TAIL_CALLS   256      /*  Self-calls tracked per procedure.    */
+#define  MAX_THREADS       64      /*  Upper limit on SetCompilerThreads    */
+                                   /*  and SetCompilerLexers.               */
+#define  BENCH_COUNT     1000      /*  Default compilations for --bench.    */
 
-PRIVATE TOKEN  CurrentToken;       /*  Parser lookahead token.  Updated by  */
-                                   /*  routine Accept (below).  Must be     */
-                                   /*  initialised before parser starts.    */
-PRIVATE int Read;
-PRIVATE int scope;			   
-PRIVATE int Write;                 
-PRIVATE int VarLctn;			   
-PRIVATE int FlagError; 
+#define  DEPTH_LINE  "Maximum operand stack depth of %s: %d\n"
 
+/*--------------------------------------------------------------------------*/
+/*                                                                          */
+/*  Tail call candidates: the code generated for each self-recursive call   */
+/*  in the procedure currently being compiled.  "start" is the address of   */
+/*  the static link push, "end" the address just past the call sequence.    */
+/*                                                                          */
+/*--------------------------------------------------------------------------*/
 
-/*---------------------------------------------------------------------------
+typedef struct  {
+    int start;
+    int end;
+}
+    TAILCALL;
 
-	Declare Sets
+/*--------------------------------------------------------------------------*/
+/*                                                                          */
+/*  Where a procedure declaration began, recorded by MarkProcedure so that  */
+/*  StoreProcedure can save its code as a fragment (see fragment.c).        */
+/*                                                                          */
+/*--------------------------------------------------------------------------*/
 
-----------------------------------------------------------------------------*/
+typedef struct  {
+    long offset;                   /*  Source offset just after the name.   */
+    int  scope;                    /*  Scope the procedure is declared at.  */
+    int  code;                     /*  First code address.                  */
+    int  references;               /*  Start of its entries in References.  */
+    int  errors;                   /*  Errors reported before it.           */
+    int  CseRemoved;
+    int  depths;                   /*  Length of Depths before it.          */
+}
+    FRAGMENTMARK;
 
-PRIVATE SET StatementFS_aug, StatementFBS, ProgProcDecSet1, ProgProcDecSet2;
-PRIVATE SET BlockSet1;
-PRIVATE SET FB_Prog, FB_ProcDec, FB_Block;
-PRIVATE SET StatementFS_aug2, StatementFBS2;
+/*--------------------------------------------------------------------------*/
+/*                                                                          */
+/*  The outline of a program, found by OutlineProgram: its name, global     */
+/*  variables and outermost procedures in the order they are declared,      */
+/*  which is all a worker needs to compile one of the procedures on its     */
+/*  own (see CompileProcedures).  A procedure's "address" is a stand-in,    */
+/*  -2, -3, ..., by which its calls are told apart until the fragment is    */
+/*  placed.  It is below every code address, so InsertCode, DeleteCode      */
+/*  and RewriteCode, which move only the targets after a change, leave it   */
+/*  alone.                                                                  */
+/*                                                                          */
+/*--------------------------------------------------------------------------*/
 
+typedef struct  {
+    char *name;
+    int  type;                     /*  STYPE_PROGRAM, VARIABLE or           */
+    int  address;                  /*  PROCEDURE.                           */
+    int  pcount;
+    int  ptypes;
+    long start;                    /*  Source of a procedure declaration,   */
+    long end;                      /*  from the end of the token before     */
+}                                  /*  "PROCEDURE" to just after its ";".   */
+    OUTLINE;
+
+typedef struct  {                  /*  Shared by CompileProcedures' workers.*/
+    struct parser *parser;         /*  The compilation they work for.       */
+    OUTLINE *outline;
+    int count;                     /*  Entries in outline.                  */
+    int next;                      /*  Next entry to look at.               */
+    pthread_mutex_t lock;          /*  Guards next and parser->fragments.   */
+}
+    PROCEDUREPOOL;
 
 /*--------------------------------------------------------------------------*/
 /*                                                                          */
-/*  Function prototypes                                                     */
+/*  PARSER:  The complete state of one compilation.  Every routine below    */
+/*  takes a pointer to it, so that any number of programs can be compiled   */
+/*  in one process, one after another or concurrently.  Clients see it as   */
+/*  the opaque COMPILER of comp2.h.                                         */
 /*                                                                          */
 /*--------------------------------------------------------------------------*/
 
+typedef struct parser  {
+    SCANNER scanner;               /*  Source, listing and string table.    */
+    SYMBOLTABLE symbols;
+    CODEGEN code;                  /*  Code table and machine code file.    */
+    FILE *ReportFile;              /*  Stack depths and summary, or NULL.   */
+    int StackDepths;               /*  See SetCompilerStackDepths.          */
+
+    TOKEN  CurrentToken;           /*  Parser lookahead token.  Updated by  */
+                                   /*  routine Accept (below).  Must be     */
+                                   /*  initialised before parser starts.    */
+    int scope;                     /*  Current scope (nesting) level, 1 is  */
+                                   /*  the main program.                    */
+    int VarLctn;                   /*  Next free global or local slot.      */
+    int FlagError;                 /*  Set when a syntax error is found.    */
+    int Recovering;                /*  Accept is resynchronising after a    */
+                                   /*  syntax error.                        */
+    int Runs;                      /*  Programs compiled with this state.   */
+    SYMBOL *CurrentProcedure;      /*  Procedure whose block is being       */
+                                   /*  compiled, NULL in the main program.  */
+    int BlockAddr;                 /*  Code address where the block being   */
+                                   /*  compiled begins.                     */
+    int CseRemoved;                /*  Instructions saved by common         */
+                                   /*  subexpression elimination.           */
+
+    TAILCALL TailCalls[MAX_TAIL_CALLS];
+    int TailCallCount;
+    int FrameRef;                  /*  A REF actual of the call being       */
+                                   /*  parsed is in the current frame.      */
+
+    char *Source;                  /*  Program text, when compiled from     */
+    size_t SourceLength;           /*  memory, else NULL.                   */
+    FRAGMENTCACHE fragments;       /*  Procedures compiled by earlier runs, */
+                                   /*  see ReuseProcedure.                  */
+    FRAGMENTREF *References;       /*  Declarations found by LookupSymbol   */
+    int ReferenceCount;            /*  in this run, see StoreProcedure.     */
+    int ReferenceSpace;
+
+    int Object;                    /*  Writing an object file for cpllink,  */
+                                   /*  not a program (SetCompilerObject).   */
+    SYMBOL *Program;               /*  The program name.                    */
+    int BodyAddr;                  /*  Code address of the main block.      */
+    SYMBOL **Linkage;              /*  Globals and outermost procedures,    */
+    int LinkageCount;              /*  the symbols of an object file.       */
+    int LinkageSpace;
+    int ImportCount;               /*  EXTERNAL procedures declared.        */
+
+    int Threads;                   /*  Threads compiling outermost          */
+                                   /*  procedures, see SetCompilerThreads.  */
+    char *Depths;                  /*  Stack depth lines of this run, kept  */
+    int DepthsLength;              /*  if KeepDepths is set until the run   */
+    int DepthsSpace;               /*  is known to be valid, and so that    */
+    int KeepDepths;                /*  each fragment can replay its own,    */
+                                   /*  see ReportStackDepth.                */
+
+    int Pipelined;                 /*  See SetCompilerPipeline.             */
+    int Lexers;                    /*  See SetCompilerLexers.               */
+    int Listing;                   /*  See SetCompilerListing.              */
+    int ListThread;                /*  See SetCompilerListThread.           */
+    LISTER lister;
+    DIAGWRITER *Diagnostics;       /*  See SetCompilerDiagnostics.          */
+    char *DiagnosticSource;
+    int MaxErrors;                 /*  See SetCompilerErrorLimits.          */
+    int MaxLineErrors;
+    PHASETIMER *Timer;             /*  See SetCompilerTimer, and the timer  */
+    PHASETIMER *Timing;            /*  of this run, NULL if not timed.      */
+    TRACER *Tracer;                /*  See SetCompilerTracer.               */
+    SCANNER reader;                /*  The pipeline's scanner, and the      */
+    int ReaderRuns;                /*  number of runs which have used it.   */
+    PIPELINE pipe;
+    PIPELINE *Pipe;                /*  &pipe while the pipeline runs.       */
+    FATALTRAP Trap;                /*  Armed by Run, see FatalError.        */
+    int Failed;                    /*  Set once the trap has been sprung.   */
+
+    /*  Sets for S-Algol error recovery, see SetupSets.                     */
+    SET StatementFS_aug, StatementFBS, ProgProcDecSet1, ProgProcDecSet2;
+    SET BlockSet1;
+    SET FB_Prog, FB_ProcDec, FB_Block;
+    SET StatementFS_aug2, StatementFBS2;
+    SET RelOpSet;
+}
+    PARSER;
+
+
 
-PRIVATE void ParseProgram( void );
-PRIVATE int ParseDeclarations( void );
-PRIVATE void ParseProcDeclaration( void );
-PRIVATE void ParseParameterList( void );
-PRIVATE void ParseFormalParameter( void );
-PRIVATE void ParseBlock( void );
-PRIVATE void ParseStatement( void );
-PRIVATE void ParseSimpleStatement( void );
-PRIVATE void ParseRestOfStatement( SYMBOL *target );
-PRIVATE void ParseProcCallList( void );
-PRIVATE void ParseAssignment( void );
-PRIVATE void ParseActualParameter( void );
-PRIVATE void ParseWhileStatement( void );
-PRIVATE void ParseIfStatement( void );
-PRIVATE void ParseReadStatement( void );
-PRIVATE void ParseWriteStatement( void );
-PRIVATE void ParseExpression( void );
-PRIVATE void ParseCompoundTerm( void );
-PRIVATE void ParseTerm( void );
-PRIVATE void ParseSubTerm( void );
-PRIVATE void ParseAddOp( void );
-PRIVATE void ParseMultOp( void );
-PRIVATE void SetupSets( void );
-PRIVATE void Synchronise( SET *F, SET*FB );
-PRIVATE void Accept( int code );
-PRIVATE void ReadToEndOfFile( void );
-PRIVATE void ParseIntConst(void); 
-PRIVATE void ParseIdentifier(void);
-PRIVATE void ParseVariable(void);
 
-PRIVATE int ParseBooleanExpression( void );
-PRIVATE int ParseRelOp( void );
-PRIVATE int OpenFiles( int argc, char *argv[] );
 
-PRIVATE void MakeSymbolTableEntry(int symtype);
-PRIVATE SYMBOL *LookupSymbol();
+/*--------------------------------------------------------------------------*/
+/*                                                                          */
+/*  Function prototypes                                                     */
+/*                                                                          */
+/*--------------------------------------------------------------------------*/
+
+
+PRIVATE void ParseProgram( PARSER *parser );
+PRIVATE int ParseDeclarations( PARSER *parser );
+PRIVATE void ParseProcDeclaration( PARSER *parser );
+PRIVATE void ParseParameterList( PARSER *parser, SYMBOL *procedure );
+PRIVATE SYMBOL *ParseFormalParameter( PARSER *parser );
+PRIVATE void ParseBlock( PARSER *parser );
+PRIVATE void ParseStatement( PARSER *parser );
+PRIVATE void ParseSimpleStatement( PARSER *parser );
+PRIVATE void ParseRestOfStatement( PARSER *parser, SYMBOL *target );
+PRIVATE int  ParseProcCallList( PARSER *parser, SYMBOL *procedure );
+PRIVATE void ParseAssignment( PARSER *parser );
+PRIVATE void ParseActualParameter( PARSER *parser, SYMBOL *procedure,
+                                   int index );
+PRIVATE void ParseWhileStatement( PARSER *parser );
+PRIVATE void ParseIfStatement( PARSER *parser );
+PRIVATE void ParseReadStatement( PARSER *parser );
+PRIVATE void ParseWriteStatement( PARSER *parser );
+PRIVATE void ParseExpression( PARSER *parser );
+PRIVATE void ParseCompoundTerm( PARSER *parser );
+PRIVATE void ParseTerm( PARSER *parser );
+PRIVATE void ParseSubTerm( PARSER *parser );
+PRIVATE void ParseAddOp( PARSER *parser );
+PRIVATE void ParseMultOp( PARSER *parser );
+PRIVATE void SetupSets( PARSER *parser );
+PRIVATE void Synchronise( PARSER *parser, SET *F, SET*FB );
+PRIVATE void Accept( PARSER *parser, int code );
+PRIVATE void ParseIntConst(PARSER *parser); 
+PRIVATE void ParseIdentifier(PARSER *parser);
+PRIVATE void ParseVariable(PARSER *parser);
+PRIVATE void ParseReadVariable( PARSER *parser );
+
+PRIVATE int ParseBooleanExpression( PARSER *parser );
+PRIVATE int ParseRelOp( PARSER *parser );
+PRIVATE int OpenFiles( int argc, char *argv[], FILE **InputFile,
+                      FILE **ListFile, FILE **CodeFile );
+
+PRIVATE SYMBOL *MakeSymbolTableEntry(PARSER *parser, int symtype);
+PRIVATE SYMBOL *LookupSymbol(PARSER *parser);
+
+PRIVATE int  IsVariable( SYMBOL *var );
+PRIVATE int  IsRefParameter( SYMBOL *procedure, int index );
+PRIVATE void LoadFrame( PARSER *parser, int level );
+PRIVATE void LoadVariable( PARSER *parser, SYMBOL *var );
+PRIVATE void LoadAddress( PARSER *parser, SYMBOL *var );
+PRIVATE void StoreVariable( PARSER *parser, SYMBOL *var );
+PRIVATE void EmitProcCall( PARSER *parser, SYMBOL *procedure, int ArgCount );
+PRIVATE void EliminateTailCalls( PARSER *parser, int BodyAddr, int ExitAddr );
+PRIVATE int  ReachesExit( PARSER *parser, int codeaddr, int ExitAddr );
+PRIVATE int  NewTemporary( void *context );
+PRIVATE int  Run( PARSER *parser, FILE *inputfile, char *source,
+                  size_t length, FILE *listfile, FILE *codefile,
+                  FILE *errorfile, FILE *reportfile, COMPILATION *result );
+PRIVATE void StartRun( PARSER *parser, FILE *inputfile, char *source,
+                       size_t length, FILE *listfile, FILE *codefile,
+                       FILE *errorfile, FILE *reportfile );
+PRIVATE void StartPipe( PARSER *parser, FILE *inputfile, FILE *listfile,
+                        FILE *errorfile, FILE *reportfile );
+PRIVATE TOKEN NextToken( PARSER *parser );
+PRIVATE void FatalError( PARSER *parser );
+PRIVATE void RecordDiagnostic( void *context, int line, int column,
+                               char *message );
+PRIVATE void WriteReport( void *context, ERRORREPORT *report );
+PRIVATE void SemanticError( PARSER *parser, int code, char *message );
+PRIVATE void FinishFrame( PARSER *parser, int IncAddr, int DecAddr );
+PRIVATE void ReportStackDepth( PARSER *parser, SYMBOL *sym, int start,
+                               int end );
+PRIVATE int  CanReuse( PARSER *parser );
+PRIVATE int  ReuseProcedure( PARSER *parser, SYMBOL *procedure );
+PRIVATE void MarkProcedure( PARSER *parser, FRAGMENTMARK *mark );
+PRIVATE void StoreProcedure( PARSER *parser, SYMBOL *procedure,
+                             FRAGMENTMARK *mark );
+PRIVATE void NoteReference( PARSER *parser, SYMBOL *sym );
+PRIVATE void NoteLinkage( PARSER *parser, SYMBOL *sym );
+PRIVATE void DeclareExternal( PARSER *parser, SYMBOL *procedure );
+PRIVATE int  ReserveDepths( PARSER *parser, size_t n );
+PRIVATE void CompileProcedures( PARSER *parser );
+PRIVATE int  OutlineProgram( PARSER *skim, FILE *inputfile,
+                             OUTLINE **outline );
+PRIVATE long SkimToken( PARSER *skim );
+PRIVATE OUTLINE *AddOutline( OUTLINE **outline, int *count, int *space );
+PRIVATE void *ProcedureWorker( void *arg );
+PRIVATE void CompileOutlined( PARSER *worker, PROCEDUREPOOL *pool,
+                              int index );
+PRIVATE void DeclareOutline( PARSER *worker, OUTLINE *entry );
+PRIVATE int  CompileFile( COMPILER *compiler, FILE *inputfile,
+                         FILE *listfile, FILE *codefile, FILE *reportfile );
+PRIVATE int  ReadSource( FILE *inputfile, char **source, size_t *length );
+PRIVATE long ParseSize( char *text );
+PRIVATE int  CloseTrace( TRACER *tracer, FILE *file );
+PRIVATE int  Bench( char *source, int count );
+PRIVATE double Now( void );
+PRIVATE int  CompareTimes( const void *a, const void *b );
 
 
 /*--------------------------------------------------------------------------*/
 /*                                                                          */
-/*  Main: Smallparser entry point.  Sets up parser globals (opens input and */
-/*        output files, initialises current lookahead), then calls          */
-/*        "ParseProgram" to start the parse.                                */
+/*  Main: Smallparser entry point.  Opens the input, listing and code       */
+/*        files named on the command line and compiles the program,         */
+/*        reporting to stdout.                                              */
+/*                                                                          */
+/*        "comp2 --batch <manifest> [<threads>]" instead compiles every     */
+/*        program named in the manifest, see batch.c, and                   */
+/*        "comp2 --server <socket>" serves compile requests on a Unix       */
+/*        domain socket, see server.c, and "comp2 --bench <source>          */
+/*        [<count>]" times <count> compilations (default 1000) of the       */
+/*        program with and without the pipeline, see Bench.  Of the         */
+/*        options below, only --diagnostics and --mem-report may precede    */
+/*        --batch.                                                          */
+/*                                                                          */
+/*        Options may precede the file names:                               */
+/*                                                                          */
+/*          --cache=<dir>       serve the compilation from, and store it    */
+/*                              in, the cache in <dir>, see cache.c.        */
+/*          --cache-size=<n>    keep the cache within <n> bytes, with an    */
+/*                              optional K, M or G suffix.                  */
+/*          --cache-stats       report the cache's hits, misses and size,   */
+/*                              after compiling if files are named.         */
+/*          --object            write an object file for cpllink in place   */
+/*                              of the code file, see SetCompilerObject.    */
+/*          --jobs=<n>          compile the procedures on <n> threads, or   */
+/*                              one per processor if <n> is 0, see          */
+/*                              SetCompilerThreads.                         */
+/*          --pipeline          scan the program and write the listing and  */
+/*                              code on threads of their own, see           */
+/*                              SetCompilerPipeline.                        */
+/*          --lex-jobs=<n>      as --pipeline, but scan a large program in  */
+/*                              chunks on <n> threads, or one per           */
+/*                              processor if <n> is 0.                      */
+/*          --listing=<mode>    list every line ("full", the default), only */
+/*                              the lines with errors ("errors"), or        */
+/*                              nothing ("none"), leaving the listing file  */
+/*                              empty, see SetCompilerListing.              */
+/*          --diagnostics=<format>                                          */
+/*                              write the errors to stderr as JSON Lines    */
+/*                              ("jsonl"), or as a SARIF log ("sarif"), in  */
+/*                              place of echoing their messages, see        */
+/*                              diagnose.c.                                 */
+/*          --max-errors=<n>    report at most <n> errors, then only count  */
+/*                              the rest, see SetCompilerErrorLimits; 0,    */
+/*                              the default, for no limit.                  */
+/*          --max-errors-per-line=<n>                                       */
+/*                              report at most <n> errors on one line, 0    */
+/*                              for no limit.                               */
+/*          --stack-depth       report the maximum operand stack depth of   */
+/*                              each procedure and the main program, if it  */
+/*                              compiles, see SetCompilerStackDepths.       */
+/*          --time-report       time each phase of the compilation and      */
+/*                              print a table of them, with the number of   */
+/*                              instructions removed as common              */
+/*                              subexpressions, to stdout at the end, see   */
+/*                              timing.c.                                   */
+/*          --time-report=json  as --time-report, but print the figures as  */
+/*                              one line of JSON, to be kept and compared.  */
+/*          --mem-report        count the store taken by the string and     */
+/*                              symbol tables, the lines and the sets, and  */
+/*                              print it, the peak resident size, how full  */
+/*                              the string table was and what leaked, to    */
+/*                              stdout at the end, see memory.c.            */
+/*          --mem-report=json   as --mem-report, as one line of JSON.       */
+/*          --symbol-stats      count the lookups in the symbol table and   */
+/*                              the length of its chains, and print them    */
+/*                              to stdout at the end, see symbol.c.         */
+/*          --symbol-stats=json as --symbol-stats, as one line of JSON.     */
+/*          --trace=<file>      write a Chrome trace of the compilation,    */
+/*                              its procedures, optimisation passes,        */
+/*                              scanning and file handling, to <file>, see  */
+/*                              trace.c.                                    */
 /*                                                                          */
 /*--------------------------------------------------------------------------*/
 
 PUBLIC int main ( int argc, char *argv[] )
 {
-    Write=0;
-    Read = 0;
-    scope = 1;
-    FlagError=0;
-    VarLctn = 0;
-    if ( OpenFiles( argc, argv ) )
-    {
-        InitCharProcessor( InputFile, ListFile );
-        InitCodeGenerator(CodeFile); /*Initialize code generation*/
-        CurrentToken = GetToken();
-        SetupSets();
-        ParseProgram();
-        WriteCodeFile();  /*Write out assembly to file*/
+    FILE *InputFile, *ListFile, *CodeFile;
+    COMPILER *compiler;
+    char *CacheDir = NULL;
+    long CacheSize = CACHE_DEFAULT_SIZE;
+    int valid, CacheStats = 0, Object = 0, Jobs = 1, Pipeline = 0;
+    int Lexers = 1, Listing = LISTING_FULL, Format = 0;
+    int MaxErrors = 0, MaxLineErrors = 0, TimeReport = 0, MemReport = 0, i;
+    int SymbolReport = 0, StackDepths = 0;
+    char *TraceName = NULL;
+    FILE *TraceFile = NULL;
+    DIAGWRITER diagnostics;
+    PHASETIMER timer;
+    SYMBOLSTATS stats;
+    TRACER tracer;
+    double start;
+
+    for ( i = 1; i < argc && ( strncmp( argv[i], "--diagnostics=", 14 ) == 0 ||
+                               strncmp( argv[i], "--mem-report", 12 ) == 0 );
+          i++ )  ;
+    if ( i < argc && strcmp( argv[i], "--batch" ) == 0 )
+    {
+        for ( ; i > 1; i-- )
+        {
+            if ( strcmp( argv[1], "--diagnostics=jsonl" ) == 0 )
+                Format = DIAG_JSONL;
+            else if ( strcmp( argv[1], "--diagnostics=sarif" ) == 0 )
+                Format = DIAG_SARIF;
+            else if ( strcmp( argv[1], "--mem-report" ) == 0 )
+                MemReport = MEM_TABLE;
+            else if ( strcmp( argv[1], "--mem-report=json" ) == 0 )
+                MemReport = MEM_JSON;
+            else
+            {
+                fprintf( stderr, "%s: bad option \"%s\"\n", argv[0],
+                         argv[1] );
+                return EXIT_FAILURE;
+            }
+            argv[1] = argv[0];
+            argv++;
+            argc--;
+        }
+    }
+    if ( argc >= 2 && strcmp( argv[1], "--batch" ) == 0 )
+    {
+        if ( argc != 3 && argc != 4 )
+        {
+            fprintf( stderr, "%s [--diagnostics=<format>] [--mem-report[=json]]"
+                     " --batch <manifest> [<threads>]\n", argv[0] );
+            return EXIT_FAILURE;
+        }
+        if ( MemReport != 0 )  StartMemoryAccounting();
+        if ( Format != 0 )  StartDiagnostics( &diagnostics, stderr, Format,
+                                              NULL );
+        valid = CompileBatch( argv[2], argc == 4 ? atoi( argv[3] ) : 0,
+                              stdout, Format != 0 ? &diagnostics : NULL );
+        if ( Format != 0 )  StopDiagnostics( &diagnostics );
+        if ( MemReport != 0 )  WriteMemoryReport( stdout, MemReport );
+        return valid ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    if ( argc >= 2 && strcmp( argv[1], "--server" ) == 0 )
+    {
+        if ( argc != 3 )
+        {
+            fprintf( stderr, "%s --server <socket>\n", argv[0] );
+            return EXIT_FAILURE;
+        }
+        return RunServer( argv[2] ) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    if ( argc >= 2 && strcmp( argv[1], "--bench" ) == 0 )
+    {
+        if ( argc != 3 && argc != 4 )
+        {
+            fprintf( stderr, "%s --bench <source> [<count>]\n", argv[0] );
+            return EXIT_FAILURE;
+        }
+        valid = Bench( argv[2], argc == 4 ? atoi( argv[3] ) : BENCH_COUNT );
+        return valid ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    /*  Consume the options, keeping the program name in argv[0] so that  */
+    /*  OpenFiles sees the usual argument list.                            */
+
+    while ( argc >= 2 && strncmp( argv[1], "--", 2 ) == 0 )
+    {
+        if ( strncmp( argv[1], "--cache=", 8 ) == 0 && argv[1][8] != '\0' )
+            CacheDir = argv[1] + 8;
+        else if ( strncmp( argv[1], "--cache-size=", 13 ) == 0 &&
+                  ( CacheSize = ParseSize( argv[1] + 13 ) ) > 0 )
+            ;
+        else if ( strcmp( argv[1], "--cache-stats" ) == 0 )
+            CacheStats = 1;
+        else if ( strcmp( argv[1], "--object" ) == 0 )
+            Object = 1;
+        else if ( strncmp( argv[1], "--jobs=", 7 ) == 0 && argv[1][7] != '\0' )
+            Jobs = atoi( argv[1] + 7 );
+        else if ( strcmp( argv[1], "--pipeline" ) == 0 )
+            Pipeline = 1;
+        else if ( strncmp( argv[1], "--lex-jobs=", 11 ) == 0 &&
+                  argv[1][11] != '\0' )
+        {
+            Pipeline = 1;
+            Lexers = atoi( argv[1] + 11 );
+        }
+        else if ( strcmp( argv[1], "--listing=none" ) == 0 )
+            Listing = LISTING_NONE;
+        else if ( strcmp( argv[1], "--listing=errors" ) == 0 )
+            Listing = LISTING_ERRORS;
+        else if ( strcmp( argv[1], "--listing=full" ) == 0 )
+            Listing = LISTING_FULL;
+        else if ( strcmp( argv[1], "--diagnostics=jsonl" ) == 0 )
+            Format = DIAG_JSONL;
+        else if ( strcmp( argv[1], "--diagnostics=sarif" ) == 0 )
+            Format = DIAG_SARIF;
+        else if ( strncmp( argv[1], "--max-errors=", 13 ) == 0 &&
+                  ( MaxErrors = atoi( argv[1] + 13 ) ) >= 0 )
+            ;
+        else if ( strncmp( argv[1], "--max-errors-per-line=", 22 ) == 0 &&
+                  ( MaxLineErrors = atoi( argv[1] + 22 ) ) >= 0 )
+            ;
+        else if ( strcmp( argv[1], "--stack-depth" ) == 0 )
+            StackDepths = 1;
+        else if ( strcmp( argv[1], "--time-report" ) == 0 )
+            TimeReport = TIME_TABLE;
+        else if ( strcmp( argv[1], "--time-report=json" ) == 0 )
+            TimeReport = TIME_JSON;
+        else if ( strcmp( argv[1], "--mem-report" ) == 0 )
+            MemReport = MEM_TABLE;
+        else if ( strcmp( argv[1], "--mem-report=json" ) == 0 )
+            MemReport = MEM_JSON;
+        else if ( strcmp( argv[1], "--symbol-stats" ) == 0 )
+            SymbolReport = STATS_TABLE;
+        else if ( strcmp( argv[1], "--symbol-stats=json" ) == 0 )
+            SymbolReport = STATS_JSON;
+        else if ( strncmp( argv[1], "--trace=", 8 ) == 0 &&
+                  argv[1][8] != '\0' )
+            TraceName = argv[1] + 8;
+        else
+        {
+            fprintf( stderr, "%s: bad option \"%s\"\n", argv[0], argv[1] );
+            return EXIT_FAILURE;
+        }
+        argv[1] = argv[0];
+        argv++;
+        argc--;
+    }
+    if ( CacheStats && CacheDir == NULL )
+    {
+        fprintf( stderr, "%s: --cache-stats needs --cache=<dir>\n", argv[0] );
+        return EXIT_FAILURE;
+    }
+    if ( Object && CacheDir != NULL )
+    {
+        fprintf( stderr, "%s: --object cannot be used with --cache\n",
+                 argv[0] );
+        return EXIT_FAILURE;
+    }
+    if ( Jobs != 1 && ( Object || CacheDir != NULL ) )
+    {
+        fprintf( stderr, "%s: --jobs cannot be used with --object or --cache\n",
+                 argv[0] );
+        return EXIT_FAILURE;
+    }
+    if ( Pipeline && ( Object || CacheDir != NULL || Jobs != 1 ) )
+    {
+        fprintf( stderr, "%s: --pipeline and --lex-jobs cannot be used with "
+                 "--object, --cache or --jobs\n", argv[0] );
+        return EXIT_FAILURE;
+    }
+    if ( Listing == LISTING_ERRORS && CacheDir != NULL )
+    {
+        fprintf( stderr, "%s: --listing=errors cannot be used with --cache\n",
+                 argv[0] );
+        return EXIT_FAILURE;
+    }
+    if ( Format != 0 && CacheDir != NULL )
+    {
+        fprintf( stderr, "%s: --diagnostics cannot be used with --cache\n",
+                 argv[0] );
+        return EXIT_FAILURE;
+    }
+    if ( ( MaxErrors != 0 || MaxLineErrors != 0 ) && CacheDir != NULL )
+    {
+        fprintf( stderr, "%s: --max-errors cannot be used with --cache\n",
+                 argv[0] );
+        return EXIT_FAILURE;
+    }
+    if ( StackDepths && CacheDir != NULL )
+    {
+        fprintf( stderr, "%s: --stack-depth cannot be used with --cache\n",
+                 argv[0] );
+        return EXIT_FAILURE;
+    }
+    if ( TimeReport != 0 && ( CacheDir != NULL || Jobs != 1 || Pipeline ) )
+    {
+        fprintf( stderr, "%s: --time-report cannot be used with --cache, "
+                 "--jobs, --pipeline or --lex-jobs\n", argv[0] );
+        return EXIT_FAILURE;
+    }
+    if ( SymbolReport != 0 && ( CacheDir != NULL || Jobs != 1 ) )
+    {
+        fprintf( stderr, "%s: --symbol-stats cannot be used with --cache or "
+                 "--jobs\n", argv[0] );
+        return EXIT_FAILURE;
+    }
+    if ( TraceName != NULL && CacheDir != NULL )
+    {
+        fprintf( stderr, "%s: --trace cannot be used with --cache\n",
+                 argv[0] );
+        return EXIT_FAILURE;
+    }
+    if ( CacheStats && argc == 1 )
+        return ReportCache( CacheDir, stdout ) ? EXIT_SUCCESS : EXIT_FAILURE;
+    if ( MemReport != 0 )  StartMemoryAccounting();
+    if ( TraceName != NULL )
+    {
+        if ( NULL == ( TraceFile = fopen( TraceName, "w" ) ) )
+        {
+            fprintf( stderr, "%s: cannot open \"%s\"\n", argv[0],
+                     TraceName );
+            return EXIT_FAILURE;
+        }
+        InitTracer( &tracer );
+    }
+
+    start = StartSpan( TraceFile != NULL ? &tracer : NULL );
+    valid = OpenFiles( argc, argv, &InputFile, &ListFile, &CodeFile );
+    EndSpan( TraceFile != NULL ? &tracer : NULL, TRACE_OPEN, start, NULL );
+    if ( valid )
+    {
+        if ( Format != 0 )
+            StartDiagnostics( &diagnostics, stderr, Format, argv[1] );
+        if ( TimeReport != 0 )  InitPhaseTimer( &timer );
+        if ( SymbolReport != 0 )  InitSymbolStats( &stats );
+        if ( CacheDir != NULL )
+            valid = CompileCached( CacheDir, CacheSize, "", InputFile,
+                                   Listing == LISTING_NONE ? NULL : ListFile,
+                                   CodeFile, stdout );
+        else if ( NULL == ( compiler = NewCompiler() ) )
+            valid = 0;
+        else
+        {
+            SetCompilerObject( compiler, Object );
+            SetCompilerThreads( compiler, Jobs );
+            SetCompilerPipeline( compiler, Pipeline );
+            SetCompilerLexers( compiler, Lexers );
+            SetCompilerListing( compiler, Listing );
+            SetCompilerListThread( compiler, 1 );
+            SetCompilerDiagnostics( compiler,
+                                    Format != 0 ? &diagnostics : NULL, NULL );
+            SetCompilerErrorLimits( compiler, MaxErrors, MaxLineErrors );
+            SetCompilerStackDepths( compiler, StackDepths );
+            SetCompilerTimer( compiler, TimeReport != 0 ? &timer : NULL );
+            SetCompilerSymbolStats( compiler,
+                                    SymbolReport != 0 ? &stats : NULL );
+            SetCompilerTracer( compiler, TraceFile != NULL ? &tracer : NULL );
+            valid = CompileFile( compiler, InputFile, ListFile, CodeFile,
+                                 stdout );
+            FreeCompiler( compiler );
+        }
+        if ( Format != 0 )  StopDiagnostics( &diagnostics );
+        if ( TimeReport != 0 )  WriteTimeReport( &timer, stdout, TimeReport );
+        if ( SymbolReport != 0 )
+            WriteSymbolStats( &stats, stdout, SymbolReport );
         fclose( InputFile );
         fclose( ListFile );
-        if(FlagError) 
+        fclose( CodeFile );
+        if ( CacheStats )  ReportCache( CacheDir, stdout );
+        if ( MemReport != 0 )  WriteMemoryReport( stdout, MemReport );
+        if ( TraceFile != NULL && !CloseTrace( &tracer, TraceFile ) )
         {
-            printf("Syntax Error Detected\n");
-            return EXIT_FAILURE;
+            fprintf( stderr, "%s: cannot write \"%s\"\n", argv[0],
+                     TraceName );
+            valid = 0;
         }
-        printf("Valid, No Errors Detected\n");
-        return  EXIT_SUCCESS;
+        return valid ? EXIT_SUCCESS : EXIT_FAILURE;
     }
     else
     {
+        if ( TraceFile != NULL )  CloseTrace( &tracer, TraceFile );
         printf("Syntax Error Dectected\n"); 
         return EXIT_FAILURE;
     }
@@ -145,756 +708,971 @@ PUBLIC int main ( int argc, char *argv[] )
 
 /*--------------------------------------------------------------------------*/
 /*                                                                          */
-/* SetupSets: This function serves the purpose of initializing all         */
-/* the sets used for the Primary Augmented S-Algol Error recovery          */
-/* and resync                                                              */
-/*                                                                         */
-/* Inputs: None                                                            */
-/*                                                                         */
-/* Outputs: None                                                           */
-/*                                                                         */
-/* Returns: Nothing                                                   */
+/*  Compile: Compiles one CPL program.  All the state of the compilation    */
+/*           lives in a COMPILER allocated here, so Compile may be called   */
+/*           any number of times, and from several threads at once.         */
+/*           Error messages are echoed to stderr, and the listing is        */
+/*           written on a thread of its own (see SetCompilerListThread).    */
+/*           For any other settings, use NewCompiler, the SetCompiler       */
+/*           routines and RunCompiler.                                      */
+/*                                                                          */
+/*    Inputs:       inputfile, the CPL source, open for reading             */
+/*                  listfile, where the listing is written, or NULL         */
+/*                  codefile, where the machine code is written             */
+/*                  reportfile, where the summary is written, or NULL       */
+/*                                                                          */
+/*    Outputs:      None.  The files are written but not closed.            */
+/*                                                                          */
+/*    Returns:      1 if the program was free of errors, 0 otherwise        */
 /*                                                                          */
 /*--------------------------------------------------------------------------*/
 
-PRIVATE void SetupSets(void){
-
- 	InitSet(&StatementFS_aug, 6, IDENTIFIER, WHILE, IF, READ, WRITE, END );
-	InitSet(&StatementFBS, 4, SEMICOLON, ELSE, ENDOFPROGRAM, ENDOFINPUT );
-	InitSet(&ProgProcDecSet1, 3, VAR, PROCEDURE, BEGIN );
-	InitSet(&ProgProcDecSet2, 2, PROCEDURE, BEGIN );
-	InitSet(&BlockSet1, 6, IDENTIFIER, WHILE, IF, READ, WRITE, END);
-	
-	InitSet(&FB_Prog, 3, ENDOFPROGRAM, ENDOFINPUT, END);
-	InitSet(&FB_ProcDec, 3, ENDOFPROGRAM, ENDOFINPUT, END);
-	InitSet(&FB_Block, 4, ENDOFINPUT, ELSE, SEMICOLON, ENDOFPROGRAM );
-    InitSet(&StatementFS_aug2, 6, IDENTIFIER, WHILE, IF, READ, WRITE, END );
-	InitSet(&StatementFBS2, 4, SEMICOLON, ELSE, ENDOFPROGRAM, ENDOFINPUT );
-
+PUBLIC int Compile( FILE *inputfile, FILE *listfile, FILE *codefile,
+                    FILE *reportfile )
+{
+    COMPILER *compiler;
+    int valid;
+
+    if ( NULL == ( compiler = NewCompiler() ) )  return 0;
+    SetCompilerListThread( compiler, 1 );
+    valid = RunCompiler( compiler, inputfile, listfile, codefile, stderr,
+                         reportfile );
+    FreeCompiler( compiler );
+    return valid;
 }
 
 /*--------------------------------------------------------------------------*/
 /*                                                                          */
-/* Synchronise Function: Once the parser encounters a syntax error          */
-/* this will skip over the error and resync, allowing the parser to         */
-/* continue parsing the program                                             */
-/*                                                                          */
-/* Inputs: F = Augmented First Set                                          */
-/*         FB = Follow Set union Beacons Set                                */
+/*  CompileObject: As Compile, but writes a relocatable object file, for    */
+/*                 cpllink to combine with others into one program, in      */
+/*                 place of the machine code (see SetCompilerObject).       */
 /*                                                                          */
-/* Outputs: S = F union FB                                                  */
+/*    Inputs:       inputfile, listfile and reportfile, as for Compile      */
+/*                  objectfile, where the object file is written            */
 /*                                                                          */
-/*    Returns:      Nothing                                                 */
+/*    Outputs:      None.  The files are written but not closed.            */
 /*                                                                          */
-/*    Side Effects: Lookahead token advanced.                               */
+/*    Returns:      1 if the program was free of errors, 0 otherwise        */
 /*                                                                          */
 /*--------------------------------------------------------------------------*/
 
-PRIVATE void Synchronise(SET *F, SET *FB){
-
-    SET S;
-
-   S = Union( 2, F, FB );
-	if( !InSet( F, CurrentToken.code ) )
-	{
-    	SyntaxError2( *F, CurrentToken );
-		while( !InSet( &S, CurrentToken.code ) )
-			CurrentToken = GetToken();
-	}
+PUBLIC int CompileObject( FILE *inputfile, FILE *listfile, FILE *objectfile,
+                          FILE *reportfile )
+{
+    COMPILER *compiler;
+    int valid;
+
+    if ( NULL == ( compiler = NewCompiler() ) )  return 0;
+    SetCompilerObject( compiler, 1 );
+    SetCompilerListThread( compiler, 1 );
+    valid = RunCompiler( compiler, inputfile, listfile, objectfile, stderr,
+                         reportfile );
+    FreeCompiler( compiler );
+    return valid;
 }
 
 /*--------------------------------------------------------------------------*/
 /*                                                                          */
-/*  Parser routines: Recursive-descent implementaion of the grammar's       */
-/*                   productions.                                           */
+/*  CompileParallel: As Compile, but reads the whole program into memory    */
+/*                   and compiles its outermost procedures on several       */
+/*                   threads at once (see SetCompilerThreads).  The code,   */
+/*                   listing and report are the same as Compile's.          */
 /*                                                                          */
+/*    Inputs:       inputfile, listfile, codefile and reportfile, as for    */
+/*                  Compile                                                 */
+/*                  threads, as for SetCompilerThreads                      */
 /*                                                                          */
-/*  ParseProgram implements:                                                */
+/*    Outputs:      None.  The files are written but not closed.            */
 /*                                                                          */
-/*       <Program>  :==  "PROGRAM" <Identifier> ";"                         */
-/*                       [ <Declarations> ] {<ProcDeclaration>}             */
-/*						 <Block>  "."               */
+/*    Returns:      1 if the program was free of errors, 0 otherwise        */
 /*                                                                          */
-/*    Sync Points before [<Declarations>]                                   */
-/*                before and immediatley after [<ProcDeclarations>]         */
+/*--------------------------------------------------------------------------*/
+
+PUBLIC int CompileParallel( FILE *inputfile, FILE *listfile, FILE *codefile,
+                            FILE *reportfile, int threads )
+{
+    COMPILER *compiler;
+    int valid;
+
+    if ( NULL == ( compiler = NewCompiler() ) )  return 0;
+    SetCompilerThreads( compiler, threads );
+    SetCompilerListThread( compiler, 1 );
+    valid = CompileFile( compiler, inputfile, listfile, codefile,
+                         reportfile );
+    FreeCompiler( compiler );
+    return valid;
+}
+
+/*--------------------------------------------------------------------------*/
 /*                                                                          */
-/*    Inputs:       None                                                    */
+/*  CompilePipelined: As Compile, but scans the program, and writes the     */
+/*                    listing and code, on threads of their own while it    */
+/*                    is parsed (see SetCompilerPipeline).  With more than  */
+/*                    one lexer the whole program is read into memory       */
+/*                    first, so that it can be scanned in chunks (see       */
+/*                    SetCompilerLexers).  The code, listing and report     */
+/*                    are the same as Compile's.                            */
 /*                                                                          */
-/*    Outputs:      None                                                    */
+/*    Inputs:       inputfile, listfile, codefile and reportfile, as for    */
+/*                  Compile                                                 */
+/*                  lexers, as for SetCompilerLexers                        */
 /*                                                                          */
-/*    Returns:      Nothing                                                 */
+/*    Outputs:      None.  The files are written but not closed.            */
 /*                                                                          */
-/*    Side Effects: Lookahead token advanced.                                                          */
+/*    Returns:      1 if the program was free of errors, 0 otherwise        */
 /*                                                                          */
 /*--------------------------------------------------------------------------*/
 
-
-
-PRIVATE void ParseProgram(void)
+PUBLIC int CompilePipelined( FILE *inputfile, FILE *listfile, FILE *codefile,
+                             FILE *reportfile, int lexers )
 {
-
-    Accept(PROGRAM);
-    Accept(IDENTIFIER);
-    Accept(SEMICOLON);
-    
-    MakeSymbolTableEntry(STYPE_PROGRAM);
-
-    /* Synchronise ParseProgramSet1, Followers, Beacons */
-    Synchronise( &ProgProcDecSet1, &FB_Prog );
-    
-    if ( CurrentToken.code == VAR )  ParseDeclarations();
-    	/* Synchronise ParseProgramSet2, Followers, Beacons */
-    	Synchronise( &ProgProcDecSet2, &FB_Prog );
-    
-    /*  Recursive ProcDeclaration                       */
-    while (CurrentToken.code == PROCEDURE )
-    {
-		ParseProcDeclaration();
-    	/* Synchronise ParseProgramSet2, Followers, Beacons */
-		Synchronise( &ProgProcDecSet2, &FB_Prog );
-    }
-    
-    ParseBlock();
-    Accept( ENDOFPROGRAM );
+    COMPILER *compiler;
+    int valid;
+
+    if ( NULL == ( compiler = NewCompiler() ) )  return 0;
+    SetCompilerPipeline( compiler, 1 );
+    SetCompilerLexers( compiler, lexers );
+    valid = CompileFile( compiler, inputfile, listfile, codefile,
+                         reportfile );
+    FreeCompiler( compiler );
+    return valid;
 }
 
 /*--------------------------------------------------------------------------*/
 /*                                                                          */
-/*  ParseDeclararions implements:                                           */
-/*                                                                          */
-/*       <Declarations>  :==  "VAR" <Variable> { "," <Variable> } ";"       */
-/*                                                                          */
+/*  NewCompiler: Allocates the state for a series of compilations.  The     */
+/*               code table, symbols and string table chunks are kept from  */
+/*               one call of RunCompiler to the next, so a long-lived       */
+/*               COMPILER stops allocating memory once it has compiled the  */
+/*               largest program it will see.  A COMPILER must only be used */
+/*               by one thread at a time.                                   */
 /*                                                                          */
 /*    Inputs:       None                                                    */
 /*                                                                          */
 /*    Outputs:      None                                                    */
 /*                                                                          */
-/*    Returns:      Nothing                                                 */
-/*                                                                          */
-/*    Side Effects: Lookahead token advanced.                               */
+/*    Returns:      The new COMPILER, or NULL if out of memory, in which    */
+/*                  case a message has been written to stderr.              */
 /*                                                                          */
 /*--------------------------------------------------------------------------*/
 
-PRIVATE int ParseDeclarations(void)
+PUBLIC COMPILER *NewCompiler( void )
 {
-    int VarCounter = 0;
-    Accept( VAR );
-    MakeSymbolTableEntry(STYPE_VARIABLE);
-    Accept( IDENTIFIER );
+    PARSER *parser;
 
-    ParseVariable();
-    VarCounter++;
-    while (CurrentToken.code == COMMA)
+    if ( NULL == ( parser = malloc( sizeof( PARSER ) ) ) )
     {
-        Accept(COMMA);
-        MakeSymbolTableEntry(STYPE_VARIABLE);
-        Accept( IDENTIFIER );
-        ParseVariable();
-        VarCounter++;
+        fprintf( stderr, "Fatal error, cannot allocate compiler state\n" );
+        return NULL;
     }
-    
-    Accept(SEMICOLON);
-
-return VarCounter; 
+    parser->Runs = 0;
+    parser->References = NULL;
+    parser->ReferenceSpace = 0;
+    parser->Object = 0;
+    parser->Linkage = NULL;
+    parser->LinkageSpace = 0;
+    parser->Threads = 1;
+    parser->StackDepths = 0;
+    parser->Depths = NULL;
+    parser->DepthsSpace = 0;
+    parser->Pipelined = 0;
+    parser->Lexers = 1;
+    parser->Listing = LISTING_FULL;
+    parser->ListThread = 0;
+    parser->Diagnostics = NULL;
+    parser->DiagnosticSource = NULL;
+    parser->MaxErrors = 0;
+    parser->MaxLineErrors = 0;
+    parser->Timer = NULL;
+    parser->Timing = NULL;
+    parser->Tracer = NULL;
+    parser->ReaderRuns = 0;
+    parser->Pipe = NULL;
+    InitFragmentCache( &parser->fragments );
+    InitSymbolTable( &parser->symbols );
+    SetupSets( parser );
+    return parser;
 }
 
 /*--------------------------------------------------------------------------*/
 /*                                                                          */
-/*  ParseProcDeclararion implements:                                        */
-/*                                                                          */
-/*       <ProcDeclaration>  :==  "PROCEDURE" <Identifier>                   */
-/*			      	 [<ParameterList>] ";" [<Declarations>]     */
-/*			     	 {<ProcDeclaration>} <Block> ";"            */
-/*                                                                          */
-/*    Sync Points before [<Declarations>]                                   */
-/*                before and immediatley after [<ProcDeclarations>]         */
+/*  FreeCompiler: Releases a COMPILER and everything it owns.               */
 /*                                                                          */
-/*    Inputs:       None                                                    */
+/*    Inputs:       compiler, from NewCompiler                              */
 /*                                                                          */
 /*    Outputs:      None                                                    */
 /*                                                                          */
 /*    Returns:      Nothing                                                 */
 /*                                                                          */
-/*    Side Effects: Lookahead token advanced.                                                */
-/*                                                                          */
-/*                                                                          */
 /*--------------------------------------------------------------------------*/
 
-PRIVATE void ParseProcDeclaration(void)
+PUBLIC void FreeCompiler( COMPILER *compiler )
 {
-    int VarCounter = 0;
-    int Add;
-    SYMBOL *procedure;
-
-    scope++;
-
-   if ( CurrentToken.code == LEFTPARENTHESIS ) 
+    PARSER *parser = compiler;
+
+    FreeSymbolTable( &parser->symbols );
+    FreeFragmentCache( &parser->fragments );
+    free( parser->References );
+    free( parser->Linkage );
+    free( parser->Depths );
+    if ( parser->Runs > 0 )
     {
-    	ParseParameterList();
+        FreeScanner( &parser->scanner );
+        FreeCodeGenerator( &parser->code );
     }
-    Accept( SEMICOLON );
-    
-    Synchronise( &ProgProcDecSet1, &FB_ProcDec ); 
-    
-    if ( CurrentToken.code == VAR ) 
+    if ( parser->ReaderRuns > 0 )
     {
-    	ParseDeclarations();
+        FreePipeline( &parser->pipe );
+        FreeScanner( &parser->reader );
     }
-    
-    Synchronise( &ProgProcDecSet2, &FB_ProcDec );
-    
-    while ( CurrentToken.code == PROCEDURE )  
-    	ParseProcDeclaration();
-    	
-    Synchronise( &ProgProcDecSet2, &FB_ProcDec );    
-    ParseBlock();
-    
-    Accept( SEMICOLON );
-    
-    RemoveSymbols( scope );
-    scope--;
+    free( parser );
 }
 
 /*--------------------------------------------------------------------------*/
 /*                                                                          */
-/*  ParseParameterList implements:                                          */
-/*                                                                          */
-/*       <ParameterList>  :==  "(" <FormalParameter> { ","                  */
-/*                             <FormalParameter> } ")"                      */
-/*                                                                          */
-/*    Inputs:       None                                                    */
+/*  SetCompilerThreads: Sets the number of threads on which CompileText     */
+/*                      and CompileString compile a program's outermost     */
+/*                      procedures.  A fast pass first outlines the         */
+/*                      program, finding its global variables and the       */
+/*                      parameters of each outermost procedure, so that     */
+/*                      worker threads can compile the procedures           */
+/*                      independently, each as a fragment (see fragment.c). */
+/*                      The program is then compiled as usual, placing the  */
+/*                      fragments in order with their calls fixed up.  A    */
+/*                      procedure whose fragment cannot be used, e.g.,      */
+/*                      because it has an error, is simply parsed again,    */
+/*                      so the results are the same as on one thread.       */
+/*                                                                          */
+/*    Inputs:       compiler, from NewCompiler                              */
+/*                  threads, 1 (the default) to compile on the calling      */
+/*                  thread alone, or 0 or less for one per processor        */
 /*                                                                          */
 /*    Outputs:      None                                                    */
 /*                                                                          */
 /*    Returns:      Nothing                                                 */
 /*                                                                          */
-/*    Side Effects: Lookahead token advanced.                               */
-/*                                                                          */
 /*--------------------------------------------------------------------------*/
 
-PRIVATE void ParseParameterList(void)
+PUBLIC void SetCompilerThreads( COMPILER *compiler, int threads )
 {
-    Accept( LEFTPARENTHESIS );
-    ParseFormalParameter();
-
-    while (CurrentToken.code == COMMA)
-    {
-        Accept(COMMA);
-        ParseFormalParameter();
-    }
-    Accept(RIGHTPARENTHESIS);
+    if ( threads <= 0 )  threads = (int) sysconf( _SC_NPROCESSORS_ONLN );
+    if ( threads <= 0 )  threads = 1;
+    if ( threads > MAX_THREADS )  threads = MAX_THREADS;
+    compiler->Threads = threads;
 }
 
 /*--------------------------------------------------------------------------*/
 /*                                                                          */
-/*  ParseFormalParameter implements:                                        */
-/*                                                                          */
-/*       <FormalParameter>  :==  [ "REF" ] <Variable>   */
-/*                                                                          */
+/*  SetCompilerPipeline: Sets whether later runs of a COMPILER are          */
+/*                       pipelined: the program is scanned on a thread of   */
+/*                       its own, which runs ahead of the parser, and the   */
+/*                       listing and code are written on another, which     */
+/*                       follows behind (see pipeline.c).  Errors are still */
+/*                       reported and listed just as they are when the      */
+/*                       parser does all the work itself.  The writing is   */
+/*                       left to the parser when the listing file is also   */
+/*                       the error or report file.                          */
 /*                                                                          */
-/*    Inputs:       None                                                    */
+/*    Inputs:       compiler, from NewCompiler                              */
+/*                  pipelined, 1 to pipeline, 0 (the default) not to        */
 /*                                                                          */
 /*    Outputs:      None                                                    */
 /*                                                                          */
 /*    Returns:      Nothing                                                 */
 /*                                                                          */
-/*    Side Effects: Lookahead token advanced.                          */
-/*                                                                          */
-/*                                                                          */
 /*--------------------------------------------------------------------------*/
 
-PRIVATE void ParseFormalParameter(void)
+PUBLIC void SetCompilerPipeline( COMPILER *compiler, int pipelined )
 {
-    if(CurrentToken.code == REF){
-        MakeSymbolTableEntry(STYPE_REFPAR); 
-        Accept(REF);
-    }
-
-    MakeSymbolTableEntry(STYPE_VARIABLE);
-
-    ParseVariable(); 
-    Accept( IDENTIFIER );
+    compiler->Pipelined = pipelined;
 }
 
 /*--------------------------------------------------------------------------*/
 /*                                                                          */
-/*  ParseBlock implements:                                                  */
-/*                                                                          */
-/*       <Block>  :==  "BEGIN" { <Statement> ";" } "END"                    */
-/*                                                                          */
-/*    Sync Points  before and immediatley after [<Statement>]               */
+/*  SetCompilerLexers: Sets the number of threads which scan the program    */
+/*                     in a pipelined run.  A program compiled from memory  */
+/*                     (see CompileText and CompileString) which is longer  */
+/*                     than PIPE_CHUNK is split into chunks at line         */
+/*                     boundaries, which the lexers scan at once and the    */
+/*                     parser takes in order (see StartChunkedPipeline).    */
+/*                     The tokens, listing and error positions are the      */
+/*                     same as with a single scanner thread.                */
 /*                                                                          */
-/*    Inputs:       None                                                    */
+/*    Inputs:       compiler, from NewCompiler                              */
+/*                  lexers, 1 (the default) for a single scanner thread,    */
+/*                  or 0 or less for one per processor                      */
 /*                                                                          */
 /*    Outputs:      None                                                    */
 /*                                                                          */
 /*    Returns:      Nothing                                                 */
 /*                                                                          */
-/*    Side Effects: Lookahead token advanced.                               */
-/*                                                                          */
 /*--------------------------------------------------------------------------*/
 
-PRIVATE void ParseBlock(void)
-{
-Accept(BEGIN);
-
-Synchronise(&StatementFS_aug,&StatementFBS);
-Synchronise( &BlockSet1, &FB_Block );
-
-while (CurrentToken.code == IDENTIFIER || CurrentToken.code == WHILE ||
-    CurrentToken.code == IF || CurrentToken.code == READ ||
-    CurrentToken.code == WRITE)
+PUBLIC void SetCompilerLexers( COMPILER *compiler, int lexers )
 {
-    ParseStatement();
-    Accept(SEMICOLON);
-    
-    Synchronise( &StatementFS_aug, &StatementFBS );
-    Synchronise( &BlockSet1, &FB_Block );
-}
-
-
-Accept(END);
+    if ( lexers <= 0 )  lexers = (int) sysconf( _SC_NPROCESSORS_ONLN );
+    if ( lexers <= 0 )  lexers = 1;
+    if ( lexers > MAX_THREADS )  lexers = MAX_THREADS;
+    compiler->Lexers = lexers;
 }
 
 /*--------------------------------------------------------------------------*/
 /*                                                                          */
-/*  ParseStatement implements:                                              */
-/*                                                                          */
-/*       <Statement>  :==  <SimpleStatement> | <WhileStatement>  |          */
-/*                         <IfStatement> | <ReadStatement> |                */
-/*                         <WriteStatement>                                 */
-/*                                                                          */
+/*  SetCompilerListing: Sets what later runs of a COMPILER write to the     */
+/*                      listing file (see SetListingMode).  With            */
+/*                      LISTING_ERRORS only the lines with errors are       */
+/*                      listed, so the listing of a program without errors  */
+/*                      is empty.  With LISTING_NONE the run goes ahead as  */
+/*                      if there were no listing file, and nothing is       */
+/*                      buffered for it, even when pipelined.  The errors   */
+/*                      are still echoed and recorded as usual.             */
 /*                                                                          */
-/*    Inputs:       None                                                    */
+/*    Inputs:       compiler, from NewCompiler                              */
+/*                  listing, LISTING_FULL (the default), LISTING_ERRORS or  */
+/*                  LISTING_NONE                                            */
 /*                                                                          */
 /*    Outputs:      None                                                    */
 /*                                                                          */
 /*    Returns:      Nothing                                                 */
 /*                                                                          */
-/*    Side Effects: Lookahead token advanced.                               */
-/*                                                                          */
 /*--------------------------------------------------------------------------*/
 
-
-PRIVATE void ParseStatement( void )
+PUBLIC void SetCompilerListing( COMPILER *compiler, int listing )
 {
-	if ( CurrentToken.code == IDENTIFIER ) ParseSimpleStatement();
-	
-	else if ( CurrentToken.code == WHILE ) ParseWhileStatement();
-	
-	else if ( CurrentToken.code == IF ) ParseIfStatement();
-	
-	else if ( CurrentToken.code == READ ) ParseReadStatement();
-	
-	else if ( CurrentToken.code == WRITE ) ParseWriteStatement();
+    compiler->Listing = listing;
 }
 
 /*--------------------------------------------------------------------------*/
 /*                                                                          */
-/*  ParseSimpleStatement implements:                                        */
-/*                                                                          */
-/*       <SimpleStatement>  :==  <VarOrProcName> <RestOfStatement>          */
-/*                                                                          */
+/*  SetCompilerListThread: Sets whether later runs of a COMPILER write the  */
+/*                         listing on a thread of its own, so that the      */
+/*                         compiling thread never waits for it (see         */
+/*                         lister.c).  The listing is the same either way.  */
+/*                         A pipelined run has its own writer thread, and   */
+/*                         the writing is left to the compiling thread when */
+/*                         the listing file is also the error or report     */
+/*                         file.                                            */
 /*                                                                          */
-/*    Inputs:       None                                                    */
+/*    Inputs:       compiler, from NewCompiler                              */
+/*                  threaded, 1 to write on a thread, 0 (the default) not   */
+/*                  to                                                      */
 /*                                                                          */
 /*    Outputs:      None                                                    */
 /*                                                                          */
 /*    Returns:      Nothing                                                 */
 /*                                                                          */
-/*    Side Effects: Lookahead token advanced.                               */
-/*                                                                          */
 /*--------------------------------------------------------------------------*/
 
-
-PRIVATE void ParseSimpleStatement( void )
+PUBLIC void SetCompilerListThread( COMPILER *compiler, int threaded )
 {
-	SYMBOL *target;
-	
-	target = LookupSymbol(); 
-	Accept( IDENTIFIER );
-	ParseRestOfStatement( target );
+    compiler->ListThread = threaded;
 }
 
 /*--------------------------------------------------------------------------*/
 /*                                                                          */
-/*  ParseRestOfStatement implements:                                        */
-/*                                                                          */
-/*       <RestOfStatement>  :==  <ProcCallList> | <Assignment> | EPSILON    */
-/*                                                                          */
+/*  SetCompilerObject: Sets whether later runs of a COMPILER write a        */
+/*                     relocatable object file, for cpllink to combine      */
+/*                     with others into one program, in place of the        */
+/*                     machine code (see object.c).  The program may        */
+/*                     declare procedures of the other programs EXTERNAL,   */
+/*                     and shares its global variables with theirs by       */
+/*                     name.  Object files are written by the compiling     */
+/*                     thread, even when pipelined, and the procedures are  */
+/*                     not compiled on several threads.                     */
 /*                                                                          */
-/*    Inputs:       None                                                    */
+/*    Inputs:       compiler, from NewCompiler                              */
+/*                  object, 1 for an object file, 0 (the default) for       */
+/*                  machine code                                            */
 /*                                                                          */
 /*    Outputs:      None                                                    */
 /*                                                                          */
 /*    Returns:      Nothing                                                 */
 /*                                                                          */
-/*    Side Effects: Lookahead token advanced.                               */
-/*                                                                          */
 /*--------------------------------------------------------------------------*/
 
-
-PRIVATE void ParseRestOfStatement( SYMBOL *target )
+PUBLIC void SetCompilerObject( COMPILER *compiler, int object )
 {
-	switch ( CurrentToken.code )
-	{
-		case LEFTPARENTHESIS :
-			ParseProcCallList();
-			
-		case SEMICOLON :
-			if ( target != NULL && target->type == STYPE_PROCEDURE )
-				Emit ( I_CALL, target->address );
-			else
-			{
-				Error( "Not a procedure\n", CurrentToken.pos );
-				KillCodeGeneration();
-			}
-			break;
-		
-		case ASSIGNMENT : 
-		default :
-			ParseAssignment();
-			if ( target != NULL && target->type == STYPE_VARIABLE )
-				Emit ( I_STOREA, target->address );
-			else
-			{
-				Error( "Undeclared variable\n", CurrentToken.pos );
-				KillCodeGeneration();
-			}
-			break;
-	}
+    compiler->Object = object;
 }
 
 /*--------------------------------------------------------------------------*/
 /*                                                                          */
-/*  ParseProcCallList implements:                                           */
-/*                                                                          */
-/*       <ProcCallList>  :==  "(" <ActualParameter> { ","                   */
-/*                            <ActualParameter> } ")"                       */
+/*  SetCompilerDiagnostics: Sets where later runs of a COMPILER write       */
+/*                          their errors for other programs to read (see    */
+/*                          diagnose.c).  The errors are written there in   */
+/*                          place of being echoed to the error file, and    */
+/*                          are still listed as usual.  With the listing    */
+/*                          off (see SetCompilerListing) the messages of    */
+/*                          syntax errors are not even formatted.           */
 /*                                                                          */
-/*    Inputs:       None                                                    */
+/*    Inputs:       compiler, from NewCompiler                              */
+/*                  writer, a DIAGWRITER, which may be shared by several    */
+/*                  COMPILERs, or NULL (the default) to echo the errors     */
+/*                  source, the name of the program, or NULL for the        */
+/*                  writer's own                                            */
 /*                                                                          */
 /*    Outputs:      None                                                    */
 /*                                                                          */
 /*    Returns:      Nothing                                                 */
 /*                                                                          */
-/*    Side Effects: Lookahead token advanced.                               */
-/*                                                                          */
 /*--------------------------------------------------------------------------*/
 
-
-PRIVATE void ParseProcCallList( void )
+PUBLIC void SetCompilerDiagnostics( COMPILER *compiler, DIAGWRITER *writer,
+                                    char *source )
 {
-	Accept( LEFTPARENTHESIS );
-	ParseActualParameter();
-	
-	while ( CurrentToken.code == COMMA ) {
-		Accept( COMMA );
-		ParseActualParameter();
-	}
-	
-	Accept( RIGHTPARENTHESIS );
+    compiler->Diagnostics = writer;
+    compiler->DiagnosticSource = source;
 }
 
 /*--------------------------------------------------------------------------*/
 /*                                                                          */
-/*  ParseAssignment implements:                                             */
+/*  SetCompilerErrorLimits: Limits the errors later runs of a COMPILER      */
+/*                          report, so that a badly broken program takes    */
+/*                          no longer to compile than a correct one (see    */
+/*                          SetErrorLimits).  Once "errors" have been       */
+/*                          reported the rest are only counted, which       */
+/*                          costs no more than parsing, and once "PerLine"  */
+/*                          have been reported on one line the others on    */
+/*                          it are likewise only counted.  The report ends  */
+/*                          by saying how many were left out.               */
+/*                                                                          */
+/*    Inputs:       compiler, from NewCompiler                              */
+/*                  errors, the most errors to report, or 0 (the default)   */
+/*                  for no limit                                            */
+/*                  PerLine, the most to report on one line, or 0 (the      */
+/*                  default) for no limit                                   */
 /*                                                                          */
-/*       <Assignment>  :==  ":=" <Expression>                               */
+/*    Outputs:      None                                                    */
 /*                                                                          */
+/*    Returns:      Nothing                                                 */
 /*                                                                          */
-/*    Inputs:       None                                                    */
+/*--------------------------------------------------------------------------*/
+
+PUBLIC void SetCompilerErrorLimits( COMPILER *compiler, int errors,
+                                    int PerLine )
+{
+    compiler->MaxErrors = errors > 0 ? errors : 0;
+    compiler->MaxLineErrors = PerLine > 0 ? PerLine : 0;
+}
+
+/*--------------------------------------------------------------------------*/
+/*                                                                          */
+/*  SetCompilerStackDepths: Sets whether later runs of a COMPILER report    */
+/*                          the maximum depth of the operand stack in each  */
+/*                          procedure and the main program, one line each,  */
+/*                          before the summary in the report file.  The     */
+/*                          lines are kept until the end of the run, and    */
+/*                          only a program free of errors reports them.     */
+/*                                                                          */
+/*    Inputs:       compiler, from NewCompiler                              */
+/*                  report, 1 to report the depths, 0 (the default) not to  */
 /*                                                                          */
 /*    Outputs:      None                                                    */
 /*                                                                          */
 /*    Returns:      Nothing                                                 */
 /*                                                                          */
-/*    Side Effects: Lookahead token advanced.                               */
-/*                                                                          */
 /*--------------------------------------------------------------------------*/
 
-
-PRIVATE void ParseAssignment(void)
+PUBLIC void SetCompilerStackDepths( COMPILER *compiler, int report )
 {
-    Accept(ASSIGNMENT);
-    ParseExpression();
+    compiler->StackDepths = report;
 }
 
 /*--------------------------------------------------------------------------*/
 /*                                                                          */
-/*  ParseActualParameter implements:                                        */
-/*                                                                          */
-/*       <ActualParameter>  :==  <Variable> | <Expression>                  */
-/*                                                                          */
+/*  SetCompilerTimer: Has later runs of a COMPILER charge the time of each  */
+/*                    phase, reading lines, scanning, parsing, symbol       */
+/*                    lookup, emitting code, optimising it and writing the  */
+/*                    code file, to a timer, which adds them up over any    */
+/*                    number of runs for WriteTimeReport (see timing.c).    */
+/*                    Runs with the pipeline (see SetCompilerPipeline) are  */
+/*                    not timed, as their phases overlap on several         */
+/*                    threads.                                              */
 /*                                                                          */
-/*    Inputs:       None                                                    */
+/*    Inputs:       compiler, from NewCompiler                              */
+/*                  timer, prepared by InitPhaseTimer, or NULL (the         */
+/*                  default) to time nothing                                */
 /*                                                                          */
 /*    Outputs:      None                                                    */
 /*                                                                          */
 /*    Returns:      Nothing                                                 */
 /*                                                                          */
-/*    Side Effects: Lookahead token advanced.                               */
-/*                                                                          */
 /*--------------------------------------------------------------------------*/
 
-PRIVATE void ParseActualParameter( void )
+PUBLIC void SetCompilerTimer( COMPILER *compiler, PHASETIMER *timer )
 {
-    if ( CurrentToken.code == IDENTIFIER ) Accept( IDENTIFIER );
-    
-    else ParseExpression();
+    compiler->Timer = timer;
 }
 
 /*--------------------------------------------------------------------------*/
 /*                                                                          */
-/*  ParseWhileStatement implements:                                         */
-/*                                                                          */
-/*       <WhileStatement>  :==  "WHILE" <BooleanExpression> "DO" <Block>    */
-/*                                                                          */
+/*  SetCompilerSymbolStats: Has the symbol table of a COMPILER add its      */
+/*                          lookups, entries and chain lengths to a set of  */
+/*                          statistics for WriteSymbolStats (see symbol.c)  */
+/*                          from now on.  The procedures compiled on other  */
+/*                          threads (see SetCompilerThreads) have tables    */
+/*                          of their own, which are not counted.            */
 /*                                                                          */
-/*    Inputs:       None                                                    */
+/*    Inputs:       compiler, from NewCompiler                              */
+/*                  stats, prepared by InitSymbolStats, or NULL (the        */
+/*                  default) to count nothing                               */
 /*                                                                          */
 /*    Outputs:      None                                                    */
 /*                                                                          */
 /*    Returns:      Nothing                                                 */
 /*                                                                          */
-/*    Side Effects: Lookahead token advanced.                               */
-/*                                                                          */
 /*--------------------------------------------------------------------------*/
 
-
-PRIVATE void ParseWhileStatement(void)
+PUBLIC void SetCompilerSymbolStats( COMPILER *compiler, SYMBOLSTATS *stats )
 {
-    int Label1, Label2, L2BackPatchLoc;
-    Accept( WHILE );
-	Label1 = CurrentCodeAddress();
-	L2BackPatchLoc = ParseBooleanExpression();
-    Accept( DO );
-    ParseBlock();
-	Emit(I_BR, Label1);
-	Label2 = CurrentCodeAddress();
-	BackPatch(L2BackPatchLoc, Label2);
+    SetSymbolStats( &compiler->symbols, stats );
 }
 
 /*--------------------------------------------------------------------------*/
 /*                                                                          */
-/*  ParseIfStatement implements:                                            */
-/*                                                                          */
-/*       <IfStatement>  :==  "IF" <BooleanExpression> "THEN"                */
-/*                           <Block> [ "ELSE" <Block> ]                     */
-/*                                                                          */
+/*  SetCompilerTracer: Has later runs of a COMPILER give a tracer a span    */
+/*                     for each run, token read, procedure parsed,          */
+/*                     optimisation pass and code file written, on the      */
+/*                     thread which did it, for WriteTrace (see trace.c).   */
+/*                     The threads of the pipeline and the workers of       */
+/*                     SetCompilerThreads are traced too.                   */
 /*                                                                          */
-/*    Inputs:       None                                                    */
+/*    Inputs:       compiler, from NewCompiler                              */
+/*                  tracer, prepared by InitTracer, or NULL (the default)   */
+/*                  to trace nothing                                        */
 /*                                                                          */
 /*    Outputs:      None                                                    */
 /*                                                                          */
 /*    Returns:      Nothing                                                 */
 /*                                                                          */
-/*    Side Effects: Lookahead token advanced.                               */
-/*                                                                          */
 /*--------------------------------------------------------------------------*/
 
-
-PRIVATE void ParseIfStatement(void)
+PUBLIC void SetCompilerTracer( COMPILER *compiler, TRACER *tracer )
 {
-    int L1BackPatchLoc, L2BackPatchLoc;
-    Accept( IF );
-    L1BackPatchLoc = ParseBooleanExpression();
-    Accept( THEN );
-    ParseBlock();
-    if ( CurrentToken.code == ELSE )
-    {
-    	L2BackPatchLoc = CurrentCodeAddress();
-    	Emit( I_BR, 999 );	// Branch to TEMP code address, 
-    						// to be backpatched later
-    	BackPatch( L1BackPatchLoc, CurrentCodeAddress() );
-    	Accept( ELSE );
-    	ParseBlock();
-    	BackPatch( L2BackPatchLoc, CurrentCodeAddress() );
-    }
-    else 
-    	BackPatch( L1BackPatchLoc, CurrentCodeAddress() );
+    compiler->Tracer = tracer;
 }
 
 /*--------------------------------------------------------------------------*/
 /*                                                                          */
-/*  ParseReadStatement implements:                                          */
+/*  RunCompiler: Compiles one CPL program using a COMPILER, which is reset  */
+/*               first, so nothing is carried over from earlier programs.   */
 /*                                                                          */
-/*       <ReadStatement>  :==   "READ" "(" <Variable> { ","                 */
-/*                               <Variable> } ")"                           */
+/*    Inputs:       compiler, from NewCompiler                              */
+/*                  inputfile, listfile, codefile and reportfile, as for    */
+/*                  Compile                                                 */
+/*                  errorfile, where error messages are echoed as they are  */
+/*                  found, or NULL                                          */
 /*                                                                          */
+/*    Outputs:      None.  The files are written but not closed.            */
 /*                                                                          */
-/*    Inputs:       None                                                    */
+/*    Returns:      1 if the program was free of errors, 0 otherwise        */
 /*                                                                          */
-/*    Outputs:      None                                                    */
+/*--------------------------------------------------------------------------*/
+
+PUBLIC int RunCompiler( COMPILER *compiler, FILE *inputfile, FILE *listfile,
+                        FILE *codefile, FILE *errorfile, FILE *reportfile )
+{
+    return Run( compiler, inputfile, NULL, 0, listfile, codefile, errorfile,
+                reportfile, NULL );
+}
+
+/*--------------------------------------------------------------------------*/
 /*                                                                          */
-/*    Returns:      Nothing                                                 */
+/*  CompileText: As RunCompiler, but compiles a program held in memory.     */
+/*               The COMPILER keeps the code of each procedure, and places  */
+/*               it again without parsing the procedure when a later        */
+/*               program contains the same declaration in the same          */
+/*               surroundings (see fragment.c), so recompiling an edited    */
+/*               program only parses the procedures which changed.  Only    */
+/*               here and in CompileString are procedures compiled on       */
+/*               several threads, see SetCompilerThreads.                   */
+/*                                                                          */
+/*    Inputs:       compiler, from NewCompiler                              */
+/*                  source and length, the program text, which need not be  */
+/*                  null terminated                                         */
+/*                  listfile, codefile, errorfile, reportfile, as for       */
+/*                  RunCompiler                                             */
 /*                                                                          */
-/*    Side Effects: Lookahead token advanced.                               */
+/*    Outputs:      None                                                    */
+/*                                                                          */
+/*    Returns:      1 if the program was free of errors, 0 otherwise,       */
+/*                  including if memory ran out or the program was too      */
+/*                  large, which is reported as an error                    */
 /*                                                                          */
 /*--------------------------------------------------------------------------*/
 
+PUBLIC int CompileText( COMPILER *compiler, char *source, size_t length,
+                        FILE *listfile, FILE *codefile, FILE *errorfile,
+                        FILE *reportfile )
+{
+    FILE *InputFile;
+    int valid;
+
+    if ( NULL == ( InputFile = fmemopen( source, length, "r" ) ) )  return 0;
+    valid = Run( compiler, InputFile, source, length, listfile, codefile,
+                 errorfile, reportfile, NULL );
+    fclose( InputFile );
+    return valid;
+}
+
+/*--------------------------------------------------------------------------*/
+/*                                                                          */
+/*  CompileString: Compiles a CPL program held in memory, returning the     */
+/*                 code, the listing and the error messages in memory, so   */
+/*                 no file is read or written.                              */
+/*                                                                          */
+/*    Inputs:       compiler, from NewCompiler, or NULL to use a temporary  */
+/*                  one                                                     */
+/*                  source and length, the program text, which need not be  */
+/*                  null terminated                                         */
+/*                  WantListing, non-zero if the listing is wanted          */
+/*                                                                          */
+/*    Outputs:      *result, the code and listing as null terminated        */
+/*                  strings (listing NULL unless wanted) and one DIAGNOSTIC */
+/*                  per error, in the order they were found.  Release it    */
+/*                  with FreeCompilation.                                   */
+/*                                                                          */
+/*    Returns:      1 if the program was free of errors, 0 otherwise.  A    */
+/*                  fatal error, such as the code table overflowing or      */
+/*                  memory running out while compiling, is one of the       */
+/*                  diagnostics.  If memory ran out before compiling could  */
+/*                  start, result->code is NULL                             */
+/*                                                                          */
+/*--------------------------------------------------------------------------*/
 
-PRIVATE void ParseReadStatement(void)
+PUBLIC int CompileString( COMPILER *compiler, char *source, size_t length,
+                          int WantListing, COMPILATION *result )
 {
-    Accept(READ);
-    Accept( LEFTPARENTHESIS );
-    Accept( IDENTIFIER );
+    FILE *InputFile, *ListFile = NULL, *CodeFile;
+    COMPILER *temporary = NULL;
+    size_t ListLength, CodeLength;
+
+    memset( result, 0, sizeof( COMPILATION ) );
+    if ( compiler == NULL && NULL == ( compiler = temporary = NewCompiler() ) )
+        return 0;
+
+    InputFile = fmemopen( source, length, "r" );
+    CodeFile = open_memstream( &result->code, &CodeLength );
+    if ( WantListing )
+        ListFile = open_memstream( &result->listing, &ListLength );
 
-    Read = 1;
-    ParseProcCallList();
-    Read = 0;
+    if ( InputFile != NULL && CodeFile != NULL &&
+         ( ListFile != NULL || !WantListing ) )
+        result->valid = Run( compiler, InputFile, source, length, ListFile,
+                             CodeFile, NULL, NULL, result );
 
-    while (CurrentToken.code == COMMA )  
+    if ( InputFile != NULL )  fclose( InputFile );
+    if ( ListFile != NULL )  fclose( ListFile );
+    if ( CodeFile != NULL )  fclose( CodeFile );
+    if ( temporary != NULL )  FreeCompiler( temporary );
+
+    if ( InputFile == NULL || CodeFile == NULL ||
+         ( ListFile == NULL && WantListing ) )
     {
-    	Accept( COMMA );
-    	Accept( IDENTIFIER );
+        FreeCompilation( result );
+        return 0;
     }
-    
-    Accept( RIGHTPARENTHESIS );
-	_Emit(I_READ);
+    result->CodeLength = CodeLength;
+    if ( WantListing )  result->ListLength = ListLength;
+    return result->valid;
 }
 
 /*--------------------------------------------------------------------------*/
 /*                                                                          */
-/*  ParseWriteStatement implements:                                         */
-/*                                                                          */
-/*       <WriteStatement>  :==   "WRITE" "(" <Expression> { ","             */
-/*                               <Expression> } ")"                         */
-/*                                                                          */
+/*  FreeCompilation: Releases everything returned in a COMPILATION by       */
+/*                   CompileString.                                         */
 /*                                                                          */
-/*    Inputs:       None                                                    */
+/*    Inputs:       result, filled in by CompileString                      */
 /*                                                                          */
 /*    Outputs:      None                                                    */
 /*                                                                          */
 /*    Returns:      Nothing                                                 */
 /*                                                                          */
-/*    Side Effects: Lookahead token advanced.                               */
-/*                                                                          */
 /*--------------------------------------------------------------------------*/
 
+PUBLIC void FreeCompilation( COMPILATION *result )
+{
+    int i;
+
+    for ( i = 0; i < result->DiagnosticCount; i++ )
+        free( result->diagnostics[i].message );
+    free( result->diagnostics );
+    free( result->listing );
+    free( result->code );
+    memset( result, 0, sizeof( COMPILATION ) );
+}
+
+/*--------------------------------------------------------------------------*/
+/*                                                                          */
+/*  Run: Does the work of RunCompiler, CompileText and CompileString.       */
+/*                                                                          */
+/*    Inputs:       As for RunCompiler                                      */
+/*                  source and length, the text read from inputfile, or     */
+/*                  NULL if it is not in memory, when there is no reuse of  */
+/*                  procedures                                              */
+/*                  result, where each error is recorded as a DIAGNOSTIC,   */
+/*                  or NULL                                                 */
+/*                                                                          */
+/*    Returns:      1 if the program was free of errors, 0 otherwise        */
+/*                                                                          */
+/*--------------------------------------------------------------------------*/
 
-PRIVATE void ParseWriteStatement(void)
+PRIVATE int Run( PARSER *parser, FILE *inputfile, char *source,
+                 size_t length, FILE *listfile, FILE *codefile,
+                 FILE *errorfile, FILE *reportfile, COMPILATION *result )
 {
-    Accept( WRITE );
-    Accept( LEFTPARENTHESIS );
-    ParseExpression();
-    
-    Write = 1;
-    ParseProcCallList();
+    PHASETIMER *timer;
+    double begun = StartSpan( parser->Tracer ), start;
+    int valid, listing = 0, started, phase;
+
+    if ( parser->Listing == LISTING_NONE )  listfile = NULL;
+    if ( parser->Diagnostics != NULL )  errorfile = NULL;
+    StartRun( parser, inputfile, source, length, listfile, codefile,
+              errorfile, reportfile );
+    timer = parser->Timing;
+    started = EnterPhase( timer, PHASE_PARSE );
+    if ( result != NULL )
+        SetErrorHandler( &parser->scanner.chars, RecordDiagnostic, result );
+    if ( parser->Diagnostics != NULL )
+        SetReportHandler( &parser->scanner.chars, WriteReport, parser );
+    if ( parser->Pipelined )
+        StartPipe( parser, inputfile, listfile, errorfile, reportfile );
+    if ( parser->ListThread && parser->Pipe == NULL && listfile != NULL &&
+         listfile != errorfile && listfile != reportfile &&
+         StartLister( &parser->lister, listfile, &parser->Trap ) )
+    {
+        SetListWriter( &parser->scanner.chars, ListerText, &parser->lister );
+        listing = 1;
+    }
+    ArmTrap( &parser->Trap );
+    if ( setjmp( parser->Trap.env ) == 0 )
+    {
+        if ( parser->Threads > 1 && source != NULL && !parser->Object )
+            CompileProcedures( parser );
+        parser->CurrentToken = NextToken( parser );
+        ParseProgram( parser );
+        if ( parser->Pipe != NULL && !parser->Object )
+            PipelineCode( parser->Pipe, &parser->code );
+        else
+        {
+            phase = EnterPhase( timer, PHASE_WRITE );
+            start = StartSpan( parser->Tracer );
+            if ( parser->Object )
+                WriteObjectFile( &parser->code, codefile,
+                                 parser->Program != NULL ?
+                                 parser->Program->s : "?", parser->Linkage,
+                                 parser->LinkageCount, parser->VarLctn,
+                                 parser->BodyAddr );
+            else
+                WriteCodeFile( &parser->code );  /*Write out assembly*/
+            EndSpan( parser->Tracer, TRACE_WRITE, start, NULL );
+            LeavePhase( timer, phase );
+        }
+    }
+    else
+        FatalError( parser );
+    DisarmTrap( &parser->Trap );
+    if ( parser->Pipe != NULL )
+    {
+        StopPipeline( parser->Pipe );
+        parser->Pipe = NULL;
+    }
+    if ( listing )
+    {
+        StopLister( &parser->lister );
+        SetListWriter( &parser->scanner.chars, NULL, NULL );
+    }
+    LeavePhase( timer, started );
+    if ( timer != NULL )  {
+        timer->chars += CurrentCharOffset( &parser->scanner.chars );
+        timer->removed += parser->CseRemoved;
+    }
+    EndSpan( parser->Tracer, TRACE_COMPILE, begun,
+             parser->Program != NULL ? parser->Program->s : NULL );
 
-    while (CurrentToken.code == COMMA )  {
-    	Accept( COMMA );
-    	ParseExpression();
+    valid = !parser->FlagError && !parser->code.ErrorsInProgram;
+    if ( reportfile != NULL )
+    {
+        if ( ErrorLimitReached( &parser->scanner.chars ) )
+            fprintf( reportfile, "Too many errors, stopped after %d, %d "
+                     "more not reported\n", parser->MaxErrors,
+                     ErrorsPastLimit( &parser->scanner.chars ) );
+        if ( ErrorsDropped( &parser->scanner.chars ) > 0 )
+            fprintf( reportfile, "%d more errors not reported, over %d on "
+                     "a line\n", ErrorsDropped( &parser->scanner.chars ),
+                     parser->MaxLineErrors );
+        if ( !valid )  fprintf( reportfile, "Syntax Error Detected\n" );
+        else
+        {
+            if ( parser->StackDepths && parser->KeepDepths &&
+                 parser->DepthsLength > 0 )
+                fputs( parser->Depths, reportfile );
+            fprintf( reportfile, "Valid, No Errors Detected\n" );
+        }
     }
-    
-    Accept( RIGHTPARENTHESIS );
-	_Emit(I_WRITE);
+    return valid;
 }
 
 /*--------------------------------------------------------------------------*/
 /*                                                                          */
-/*  ParseExpression implements:                                             */
-/*                                                                          */
-/*       <Expression>  :==   <CompoundTerm> { <AddOp> <CompoundTerm> }      */
-/*                                                                          */
+/*  StartRun: Resets a PARSER for a new compilation, without reading the    */
+/*            first token.                                                  */
 /*                                                                          */
-/*    Inputs:       None                                                    */
+/*    Inputs:       As for Run                                              */
 /*                                                                          */
 /*    Outputs:      None                                                    */
 /*                                                                          */
 /*    Returns:      Nothing                                                 */
 /*                                                                          */
-/*    Side Effects: Lookahead token advanced.                               */
-/*                                                                          */
 /*--------------------------------------------------------------------------*/
 
-
-PRIVATE void ParseExpression(void)
+PRIVATE void StartRun( PARSER *parser, FILE *inputfile, char *source,
+                       size_t length, FILE *listfile, FILE *codefile,
+                       FILE *errorfile, FILE *reportfile )
 {
-    int op;
-
-    ParseCompoundTerm();
-    while ( (op = CurrentToken.code) == ADD ||		/* ADD: name for "+".  */
-			op == SUBTRACT )						/* SUBTRACT: "-".      */
+    parser->scope = 1;
+    parser->FlagError = 0;
+    parser->Recovering = 0;
+    parser->VarLctn = 0;
+    parser->CseRemoved = 0;
+    parser->CurrentProcedure = NULL;
+    parser->TailCallCount = 0;
+    parser->FrameRef = 0;
+    parser->ReportFile = reportfile;
+    parser->KeepDepths = reportfile != NULL &&
+                         ( source != NULL || parser->StackDepths );
+    parser->DepthsLength = 0;
+    parser->Source = source;
+    parser->SourceLength = length;
+    parser->ReferenceCount = 0;
+    parser->Program = NULL;
+    parser->BodyAddr = 0;
+    parser->BlockAddr = 0;
+    parser->LinkageCount = 0;
+    parser->ImportCount = 0;
+    parser->Failed = 0;
+    memset( &parser->CurrentToken, 0, sizeof( TOKEN ) );
+    if ( source != NULL )  AgeFragmentCache( &parser->fragments );
+
+    if ( parser->Runs++ == 0 )
     {
-        ParseAddOp();
-        ParseCompoundTerm();
-
-        if(op == ADD) _Emit(I_ADD); else _Emit(I_SUB);
+        InitScanner( &parser->scanner, inputfile, listfile );
+        InitCodeGenerator( &parser->code, codefile );
     }
+    else
+    {
+        ResetScanner( &parser->scanner, inputfile, listfile );
+        ResetCodeGenerator( &parser->code, codefile );
+    }
+    SetErrorFile( &parser->scanner.chars, errorfile );
+    SetListingMode( &parser->scanner.chars, parser->Listing );
+    SetErrorLimits( &parser->scanner.chars, parser->MaxErrors,
+                    parser->MaxLineErrors );
+    ResetSymbolTable( &parser->symbols );
+    parser->Timing = parser->Pipelined ? NULL : parser->Timer;
+    SetPhaseTimer( &parser->scanner.chars, parser->Timing );
+    SetCodeTimer( &parser->code, parser->Timing );
+    SetScannerTrap( &parser->scanner, &parser->Trap );
+    SetCodeTrap( &parser->code, &parser->Trap );
 }
 
 /*--------------------------------------------------------------------------*/
 /*                                                                          */
-/*  ParseCompoundTerm implements:                                           */
-/*                                                                          */
-/*       <CompoundTerm>  :==   <Term> { <MultOp> <Term> }                   */
-/*                                                                          */
+/*  StartPipe: Starts the pipeline for a run (see SetCompilerPipeline).     */
+/*             The scanner thread reads the input with the PARSER's         */
+/*             second scanner, or the lexers scan the source in chunks      */
+/*             (see SetCompilerLexers), while the first scanner, which      */
+/*             never reads, lists the program and collects the errors.      */
+/*             The identifiers from the last run's lexers are released.     */
+/*             If the pipeline cannot be started the run goes ahead         */
+/*             without it.                                                  */
 /*                                                                          */
-/*    Inputs:       None                                                    */
+/*    Inputs:       As for Run                                              */
 /*                                                                          */
 /*    Outputs:      None                                                    */
 /*                                                                          */
 /*    Returns:      Nothing                                                 */
 /*                                                                          */
-/*    Side Effects: Lookahead token advanced.                               */
-/*                                                                          */
 /*--------------------------------------------------------------------------*/
 
-
-PRIVATE void ParseCompoundTerm( void )
+PRIVATE void StartPipe( PARSER *parser, FILE *inputfile, FILE *listfile,
+                        FILE *errorfile, FILE *reportfile )
 {
-	int token;
-
-    ParseTerm();
-    
-    while ( (token = CurrentToken.code) == MULTIPLY ||
-            token == DIVIDE ) {
-        ParseMultOp();
-        ParseTerm();
+    int writer = listfile != errorfile && listfile != reportfile, started;
 
-		if(token == MULTIPLY) _Emit( I_MULT ); 
-		else _Emit( I_DIV );
+    if ( parser->ReaderRuns++ == 0 )
+        InitScanner( &parser->reader, inputfile, NULL );
+    else
+    {
+        FreePipeline( &parser->pipe );
+        ResetScanner( &parser->reader, inputfile, NULL );
     }
+    if ( parser->Lexers > 1 && parser->Source != NULL &&
+         parser->SourceLength > PIPE_CHUNK )
+        started = StartChunkedPipeline( &parser->pipe, parser->Source,
+                                        parser->SourceLength, parser->Lexers,
+                                        &parser->scanner.chars, listfile,
+                                        writer, parser->Tracer,
+                                        &parser->Trap );
+    else
+        started = StartPipeline( &parser->pipe, &parser->reader,
+                                 &parser->scanner.chars, listfile, writer,
+                                 parser->Tracer, &parser->Trap );
+    if ( started )  parser->Pipe = &parser->pipe;
 }
 
 /*--------------------------------------------------------------------------*/
 /*                                                                          */
-/*  ParseTerm implements:                                                   */
-/*                                                                          */
-/*       <Term>  :==   ["-"] <SubTerm>                                      */
-/*                                                                          */
+/*  NextToken: Reads the next token, from the pipeline if it is running.    */
+/*             After a fatal error (see FatalError) the rest of the         */
+/*             program is skipped, only being listed, and the end of the    */
+/*             input is returned, so that the parser winds up at once.      */
 /*                                                                          */
 /*    Inputs:       None                                                    */
 /*                                                                          */
 /*    Outputs:      None                                                    */
 /*                                                                          */
-/*    Returns:      Nothing                                                 */
-/*                                                                          */
-/*    Side Effects: Lookahead token advanced.                               */
+/*    Returns:      The token                                               */
 /*                                                                          */
 /*--------------------------------------------------------------------------*/
 
-PRIVATE void ParseTerm( void )
+PRIVATE TOKEN NextToken( PARSER *parser )
 {
-	int negateflag = 0;
+    CHARPROCESSOR *chars = &parser->scanner.chars;
+    TOKEN token;
+    double start;
+    int phase;
 
-    if ( CurrentToken.code == SUBTRACT ) {
-		negateflag = 1;
-		Accept( SUBTRACT );
-	}
-    
-    ParseSubTerm();
-
-	if(negateflag) _Emit(I_NEG);
+    if ( parser->Pipe != NULL )
+    {
+        token = PipelineToken( parser->Pipe );
+        while ( token.code != ENDOFINPUT &&
+                parser->Failed )
+            token = PipelineToken( parser->Pipe );
+        return token;
+    }
+    phase = EnterPhase( parser->Timing, PHASE_SCAN );
+    start = StartSpan( parser->Tracer );
+    if ( parser->Failed )
+        while ( ReadChar( chars ) != EOF )
+            ;
+    token = GetToken( &parser->scanner );
+    EndSpan( parser->Tracer, TRACE_SCAN, start, NULL );
+    LeavePhase( parser->Timing, phase );
+    return token;
 }
 
 /*--------------------------------------------------------------------------*/
 /*                                                                          */
-/*  ParseTerm implements:                                                   */
-/*                                                                          */
-/*       <BooleanExpression>  :==   <Expression> <RelOp> <Expression>       */
-/*                                                                          */
+/*  FatalError: Ends a run whose trap has been sprung by a fatal error,     */
+/*              such as running out of memory or a program too large for    */
+/*              the code table (see fatal.c).  The error is reported at     */
+/*              the current token like any other, though past the error     */
+/*              limits, so that it always reaches the listing and the       */
+/*              COMPILATION's diagnostics; the code is abandoned, and the   */
+/*              rest of the program is listed, so the run goes on to        */
+/*              finish as one with errors would.  A second fatal error      */
+/*              while doing so only cuts the listing short.                 */
 /*                                                                          */
 /*    Inputs:       None                                                    */
 /*                                                                          */
@@ -902,308 +1680,341 @@ PRIVATE void ParseTerm( void )
 /*                                                                          */
 /*    Returns:      Nothing                                                 */
 /*                                                                          */
-/*    Side Effects: Lookahead token advanced.                               */
-/*                                                                          */
 /*--------------------------------------------------------------------------*/
 
-
-PRIVATE int ParseBooleanExpression(void)
+PRIVATE void FatalError( PARSER *parser )
 {
-    int BackPatchAddr, RelOpInstruction;
-    ParseExpression();
-    RelOpInstruction = ParseRelOp();
-    ParseExpression();
-    _Emit(I_SUB);
-    ParseRelOp();
-    BackPatchAddr = CurrentCodeAddress( );
-    Emit( RelOpInstruction, 0 );   // Branch to TEMP code address, 
-    								// to be backpatched later
-    
-    return BackPatchAddr;
+    char message[FATAL_MESSAGE];
+
+    strcpy( message, parser->Trap.message );
+    parser->Failed = 1;
+    parser->FlagError = 1;
+    KillCodeGeneration( &parser->code );
+    ArmTrap( &parser->Trap );
+    if ( setjmp( parser->Trap.env ) == 0 )
+    {
+        SetErrorLimits( &parser->scanner.chars, 0, 0 );
+        SemanticError( parser, DIAG_INTERNAL, message );
+        SetErrorLimits( &parser->scanner.chars, parser->MaxErrors,
+                        parser->MaxLineErrors );
+        if ( parser->CurrentToken.code != ENDOFINPUT )
+            parser->CurrentToken = NextToken( parser );
+    }
+    DisarmTrap( &parser->Trap );
 }
 
 /*--------------------------------------------------------------------------*/
 /*                                                                          */
-/*  ParseSubTerm implements:                                                */
-/*                                                                          */
-/*       <SubTerm>  :==   <Variable> | <IntConst> | "(" <Expression> ")"    */
-/*                                                                          */
+/*  RecordDiagnostic: Error handler (see SetErrorHandler) which appends     */
+/*                    each error to a COMPILATION's diagnostics.  Trailing  */
+/*                    newlines are dropped from the message.                */
 /*                                                                          */
-/*                                                                          */
-/*    Inputs:       None                                                    */
+/*    Inputs:       context, the COMPILATION                                */
+/*                  line, column and message of the error                   */
 /*                                                                          */
 /*    Outputs:      None                                                    */
 /*                                                                          */
 /*    Returns:      Nothing                                                 */
 /*                                                                          */
-/*    Side Effects: Lookahead token advanced.                               */
-/*                                                                          */
 /*--------------------------------------------------------------------------*/
 
-
-PRIVATE void ParseSubTerm(void)
+PRIVATE void RecordDiagnostic( void *context, int line, int column,
+                               char *message )
 {
-    int i, j;
+    COMPILATION *result = context;
+    DIAGNOSTIC *diagnostic, *bigger;
+    size_t n = strlen( message );
+    int size;
 
-    SYMBOL *var;
-    switch(CurrentToken.code)
+    if ( result->DiagnosticCount == result->DiagnosticSpace )
     {
-        case INTCONST:
-            Emit(I_LOADI,CurrentToken.value);
-            ParseIntConst(); 
-            break;
-        case LEFTPARENTHESIS:
-            Accept(LEFTPARENTHESIS);
-            ParseExpression();
-            Accept(RIGHTPARENTHESIS);
-            break;
-        case IDENTIFIER:
-        default:
-            var = LookupSymbol();
-            if(var != NULL && var->type == STYPE_VARIABLE) {
-                if (Write) {
-                    Emit(I_LOADA,var->address); 
-                }
-                else if (Read) {
-                    Emit(I_STOREA,var->address); 
-                }
-                else {
-                    Emit(I_LOADA,var->address);
-                }
-            }
-            else if ( var->type == STYPE_LOCALVAR ) {
-            j = scope - var->scope;
-            if ( j == 0 )
-            Emit( I_LOADFP, var->address );
-            else {
-            _Emit( I_LOADFP );
-
-            for ( i = 0; i < j - 1; i++ )
-                 _Emit( I_LOADSP );
-            Emit( I_LOADSP, var->address );
-            }
-           }
-
-            else printf("Undeclared Name or Variable");
-            ParseVariable(); 
-            break;
+        size = result->DiagnosticSpace ? 2 * result->DiagnosticSpace : 8;
+        if ( NULL == ( bigger = realloc( result->diagnostics,
+                                         size * sizeof( DIAGNOSTIC ) ) ) )
+            return;
+        result->diagnostics = bigger;
+        result->DiagnosticSpace = size;
     }
+    while ( n > 0 && message[n-1] == '\n' )  n--;
+    diagnostic = &result->diagnostics[result->DiagnosticCount];
+    if ( NULL == ( diagnostic->message = malloc( n + 1 ) ) )  return;
+    memcpy( diagnostic->message, message, n );
+    diagnostic->message[n] = '\0';
+    diagnostic->line = line;
+    diagnostic->column = column;
+    result->DiagnosticCount++;
 }
 
-
 /*--------------------------------------------------------------------------*/
 /*                                                                          */
-/*  ParseAddOp implements:                                             */
-/*                                                                          */
-/*       <AddOp>  :==   "+" | "-"      */
-/*                                                                          */
+/*  WriteReport: Report handler (see SetReportHandler) which writes each    */
+/*               error to the compiler's diagnostics writer.                */
 /*                                                                          */
-/*    Inputs:       None                                                    */
+/*    Inputs:       context, the PARSER                                     */
+/*                  report, the error                                       */
 /*                                                                          */
 /*    Outputs:      None                                                    */
 /*                                                                          */
 /*    Returns:      Nothing                                                 */
 /*                                                                          */
-/*    Side Effects: Lookahead token advanced.                               */
-/*                                                                          */
 /*--------------------------------------------------------------------------*/
 
-
-PRIVATE void ParseAddOp( void )
+PRIVATE void WriteReport( void *context, ERRORREPORT *report )
 {
-    if ( CurrentToken.code == ADD ) Accept( ADD );
-    
-    else Accept ( SUBTRACT );
+    PARSER *parser = context;
+
+    WriteDiagnostic( parser->Diagnostics, parser->DiagnosticSource, report );
 }
 
 /*--------------------------------------------------------------------------*/
 /*                                                                          */
-/*  ParseMultOp implements:                                                 */
-/*                                                                          */
-/*       <MultOp>  :==   "*" | "/"                                          */
-/*                                                                          */
+/*  SemanticError: Reports an error found at the current token which is     */
+/*                 not a syntax error.                                      */
 /*                                                                          */
-/*    Inputs:       None                                                    */
+/*    Inputs:       code, the kind of error, a DIAG_ code of diagnose.h     */
+/*                  message, the message                                    */
 /*                                                                          */
 /*    Outputs:      None                                                    */
 /*                                                                          */
 /*    Returns:      Nothing                                                 */
 /*                                                                          */
-/*    Side Effects: Lookahead token advanced.                               */
-/*                                                                          */
 /*--------------------------------------------------------------------------*/
 
-
-PRIVATE void ParseMultOp( void )
+PRIVATE void SemanticError( PARSER *parser, int code, char *message )
 {
-    if ( CurrentToken.code == MULTIPLY ) Accept( MULTIPLY );
-    
-    else Accept ( DIVIDE );
+    ERRORREPORT report;
+
+    report.code = code;
+    report.got = report.expected = -1;
+    report.expects = NULL;
+    ReportError( &parser->scanner.chars, &report, message,
+                 parser->CurrentToken.pos );
 }
 
 /*--------------------------------------------------------------------------*/
 /*                                                                          */
-/*  ParseRelOp implements:                                                  */
-/*                                                                          */
-/*       <RelOp>  :==   "=" | "<=" | ">=" | "<" | ">"                       */
+/* SetupSets: This function serves the purpose of initializing all         */
+/* the sets used for the Primary Augmented S-Algol Error recovery          */
+/* and resync                                                              */
+/*                                                                         */
+/* Inputs: None                                                            */
+/*                                                                         */
+/* Outputs: None                                                           */
+/*                                                                         */
+/* Returns: Nothing                                                   */
+/*                                                                          */
+/*--------------------------------------------------------------------------*/
+
+PRIVATE void SetupSets(PARSER *parser){
+
+ 	InitSet(&parser->StatementFS_aug, 6, IDENTIFIER, WHILE, IF, READ, WRITE,
+ 	        END );
+	InitSet(&parser->StatementFBS, 4, SEMICOLON, ELSE, ENDOFPROGRAM,
+	        ENDOFINPUT );
+	InitSet(&parser->ProgProcDecSet1, 3, VAR, PROCEDURE, BEGIN );
+	InitSet(&parser->ProgProcDecSet2, 2, PROCEDURE, BEGIN );
+	InitSet(&parser->BlockSet1, 6, IDENTIFIER, WHILE, IF, READ, WRITE, END);
+	
+	InitSet(&parser->FB_Prog, 3, ENDOFPROGRAM, ENDOFINPUT, END);
+	InitSet(&parser->FB_ProcDec, 3, ENDOFPROGRAM, ENDOFINPUT, END);
+	InitSet(&parser->FB_Block, 4, ENDOFINPUT, ELSE, SEMICOLON,
+	        ENDOFPROGRAM );
+    InitSet(&parser->StatementFS_aug2, 6, IDENTIFIER, WHILE, IF, READ, WRITE,
+            END );
+	InitSet(&parser->StatementFBS2, 4, SEMICOLON, ELSE, ENDOFPROGRAM,
+	        ENDOFINPUT );
+	InitSet(&parser->RelOpSet, 5, EQUALITY, LESSEQUAL, GREATEREQUAL, LESS,
+	        GREATER );
+
+}
+
+/*--------------------------------------------------------------------------*/
 /*                                                                          */
+/* Synchronise Function: Once the parser encounters a syntax error          */
+/* this will skip over the error and resync, allowing the parser to         */
+/* continue parsing the program                                             */
 /*                                                                          */
-/*    Inputs:       None                                                    */
+/* Inputs: F = Augmented First Set                                          */
+/*         FB = Follow Set union Beacons Set                                */
 /*                                                                          */
-/*    Outputs:      None                                                    */
+/* Outputs: S = F union FB                                                  */
 /*                                                                          */
-/*    Returns:      Int RelOpInstruction                                    */
+/*    Returns:      Nothing                                                 */
 /*                                                                          */
 /*    Side Effects: Lookahead token advanced.                               */
 /*                                                                          */
 /*--------------------------------------------------------------------------*/
 
+PRIVATE void Synchronise(PARSER *parser, SET *F, SET *FB){
 
-PRIVATE int ParseRelOp( void )
-{
-	int RelOpInstruction;
-	switch(CurrentToken.code) {
-		case LESSEQUAL:
-			RelOpInstruction = I_BG; 
-			Accept(LESSEQUAL);
-			break;
-		case GREATEREQUAL:
-			RelOpInstruction = I_BL; 
-			Accept(GREATEREQUAL);
-			break;
-		case LESS:
-			RelOpInstruction = I_BGZ; 
-			Accept(LESS);
-			break;
-		case EQUALITY:
-			RelOpInstruction = I_BZ; 
-			Accept(EQUALITY);
-			break;
-		case GREATER:
-			RelOpInstruction = I_BLZ; 
-			Accept(GREATER);
-			break;
+    SET S;
+
+   S = Union( 2, F, FB );
+	if( !InSet( F, parser->CurrentToken.code ) )
+	{
+    	SyntaxError2( &parser->scanner, *F, parser->CurrentToken );
+		parser->FlagError = 1;
+		while( !InSet( &S, parser->CurrentToken.code ) )
+			parser->CurrentToken = NextToken( parser );
 	}
-	return RelOpInstruction;
 }
 
 /*--------------------------------------------------------------------------*/
 /*                                                                          */
-/*  End of parser.  Support routines follow.                                */
+/*  Parser routines: Recursive-descent implementaion of the grammar's       */
+/*                   productions.                                           */
 /*                                                                          */
-/*--------------------------------------------------------------------------*/
 /*                                                                          */
-/*  Accept:  Takes an expected token name as argument, and if the current   */
-/*           lookahead matches this, advances the lookahead and returns.    */
+/*  ParseProgram implements:                                                */
 /*                                                                          */
-/*           If the expected token fails to match the current lookahead,    */
-/*           this routine reports a syntax error and exits ("crash & burn"  */
-/*           parsing).  Note the use of routine "SyntaxError"               */
-/*           (from "scanner.h") which puts the error message on the         */
-/*           standard output and on the listing file, and the helper        */
-/*           "ReadToEndOfFile" which just ensures that the listing file is  */
-/*           completely generated.                                          */
+/*       <Program>  :==  "PROGRAM" <Identifier> ";"                         */
+/*                       [ <Declarations> ] {<ProcDeclaration>}             */
+/*						 <Block>  "."               */
 /*                                                                          */
+/*    Sync Points before [<Declarations>]                                   */
+/*                before and immediatley after [<ProcDeclarations>]         */
 /*                                                                          */
-/*    Inputs:       Integer code of expected token                          */
+/*    Inputs:       None                                                    */
 /*                                                                          */
 /*    Outputs:      None                                                    */
 /*                                                                          */
 /*    Returns:      Nothing                                                 */
 /*                                                                          */
-/*    Side Effects: If successful, advances the current lookahead token     */
-/*                  "CurrentToken".                                         */
+/*    Side Effects: Lookahead token advanced.                                                          */
 /*                                                                          */
 /*--------------------------------------------------------------------------*/
 
-PRIVATE void Accept( int ExpectedToken )
+
+
+PRIVATE void ParseProgram(PARSER *parser)
 {
-	static int recovering = 0;
-  
-	/* Error re-sync code */
-	if( recovering )
-	{            
-    	while( CurrentToken.code != ExpectedToken &&
-    		   CurrentToken.code != ENDOFINPUT )
-    		CurrentToken = GetToken();
-    	recovering = 0;
-	}
+    int MainBackPatchLoc = -1;
+    int IncAddr, BodyAddr, phase;
+    SYMBOL *program;
+    double pass;
 
-	/* Normal Accept code */
-	if( CurrentToken.code != ExpectedToken )
-	{
-		SyntaxError( ExpectedToken, CurrentToken );
-		recovering = 1;
-	}  
-	else CurrentToken = GetToken();
+    Accept(parser, PROGRAM);
+    program = parser->Program = MakeSymbolTableEntry(parser, STYPE_PROGRAM);
+    Accept(parser, IDENTIFIER);
+    Accept(parser, SEMICOLON);
+
+    /* Synchronise ParseProgramSet1, Followers, Beacons */
+    Synchronise( parser, &parser->ProgProcDecSet1, &parser->FB_Prog );
+    
+    if ( parser->CurrentToken.code == VAR )
+        ParseDeclarations( parser );
+    /* Synchronise ParseProgramSet2, Followers, Beacons */
+    Synchronise( parser, &parser->ProgProcDecSet2, &parser->FB_Prog );
+    
+    /*  Procedure code comes first, so branch over it to the main block. */
+    /*  An object's main block is called by the linker's startup code,   */
+    /*  which also reserves the globals, so it has no branch or "Inc"    */
+    /*  and ends with "Ret".                                              */
+    if ( parser->CurrentToken.code == PROCEDURE && !parser->Object )
+    {
+        MainBackPatchLoc = CurrentCodeAddress( &parser->code );
+        Emit( &parser->code, I_BR, 0 );
+    }
+
+    /*  Recursive ProcDeclaration                       */
+    while (parser->CurrentToken.code == PROCEDURE )
+    {
+		ParseProcDeclaration( parser );
+    	/* Synchronise ParseProgramSet2, Followers, Beacons */
+		Synchronise( parser, &parser->ProgProcDecSet2,
+		             &parser->FB_Prog );
+    }
+    
+    if ( MainBackPatchLoc >= 0 )
+        BackPatch( &parser->code, MainBackPatchLoc,
+                   CurrentCodeAddress( &parser->code ) );
+    IncAddr = CurrentCodeAddress( &parser->code );
+    if ( !parser->Object )  Emit( &parser->code, I_INC, 0 );
+    BodyAddr = CurrentCodeAddress( &parser->code );
+    parser->BlockAddr = BodyAddr;
+
+    ParseBlock( parser );
+    _Emit( &parser->code, parser->Object ? I_RET : I_HALT );
+    phase = EnterPhase( parser->Timing, PHASE_OPTIMISE );
+    pass = StartSpan( parser->Tracer );
+    parser->CseRemoved +=
+        EliminateCommonSubexpressions( &parser->code, BodyAddr,
+                                       CurrentCodeAddress( &parser->code ),
+                                       NewTemporary, parser, 0 );
+    EndSpan( parser->Tracer, TRACE_SUBEXPRESSIONS, pass, NULL );
+    pass = StartSpan( parser->Tracer );
+    OrderOperands( &parser->code, BodyAddr,
+                   CurrentCodeAddress( &parser->code ) );
+    EndSpan( parser->Tracer, TRACE_OPERANDS, pass, NULL );
+    ReportStackDepth( parser, program, BodyAddr,
+                      CurrentCodeAddress( &parser->code ) );
+    LeavePhase( parser->Timing, phase );
+    if ( parser->Object )  parser->BodyAddr = BodyAddr;
+    else  FinishFrame( parser, IncAddr, -1 );
+    Accept( parser, ENDOFPROGRAM );
 }
 
 /*--------------------------------------------------------------------------*/
 /*                                                                          */
-/*  OpenFiles:  Reads strings from the command-line and opens the           */
-/*              associated input and listing files.                         */
+/*  ParseDeclararions implements:                                           */
 /*                                                                          */
-/*    Note that this routine mmodifies the globals "InputFile" and          */
-/*    "ListingFile".  It returns 1 ("true" in C-speak) if the input and     */
-/*    listing files are successfully opened, 0 if not, allowing the caller  */
-/*    to make a graceful exit if the opening process failed.                */
+/*       <Declarations>  :==  "VAR" <Variable> { "," <Variable> } ";"       */
 /*                                                                          */
 /*                                                                          */
-/*    Inputs:       1) Integer argument count (standard C "argc").          */
-/*                  2) Array of pointers to C-strings containing arguments  */
-/*                  (standard C "argv").                                    */
+/*    Inputs:       None                                                    */
 /*                                                                          */
-/*    Outputs:      No direct outputs, but note side effects.               */
+/*    Outputs:      None                                                    */
 /*                                                                          */
-/*    Returns:      Boolean success flag (i.e., an "int":  1 or 0)          */
+/*    Returns:      Number of variables declared                            */
 /*                                                                          */
-/*    Side Effects: If successful, modifies globals "InputFile" and         */
-/*                  "ListingFile".                                          */
+/*    Side Effects: Lookahead token advanced.                               */
 /*                                                                          */
 /*--------------------------------------------------------------------------*/
 
-PRIVATE int  OpenFiles( int argc, char *argv[] )
+PRIVATE int ParseDeclarations(PARSER *parser)
 {
+    int VarCounter = 0;
+    int symtype;
 
-
-    if ( argc != 4 )  {
-        fprintf( stderr, "%s <inputfile> <listfile>\n", argv[0] );
-        return 0;
-    }
-
-    if ( NULL == ( InputFile = fopen( argv[1], "r" ) ) )  {
-        fprintf( stderr, "cannot open \"%s\" for input\n", argv[1] );
-        return 0;
-    }
-
-    if ( NULL == ( ListFile = fopen( argv[2], "w" ) ) )  {
-        fprintf( stderr, "cannot open \"%s\" for output\n", argv[2] );
-        fclose( InputFile );
-        return 0;
-    }
-
-    if ( NULL == ( CodeFile = fopen( argv[3], "w" ) ) )  {
-        fprintf( stderr, "cannot open \"%s\" for output\n", argv[3] );
-        fclose( InputFile );
-        fclose( ListFile );
-        return 0;
+    symtype = ( parser->scope == 1 ) ? STYPE_VARIABLE : STYPE_LOCALVAR;
+    Accept( parser, VAR );
+    MakeSymbolTableEntry(parser, symtype);
+    ParseVariable( parser );
+    VarCounter++;
+    while (parser->CurrentToken.code == COMMA)
+    {
+        Accept(parser, COMMA);
+        MakeSymbolTableEntry(parser, symtype);
+        ParseVariable( parser );
+        VarCounter++;
     }
+    
+    Accept(parser, SEMICOLON);
 
-    return 1;
+return VarCounter; 
 }
 
 /*--------------------------------------------------------------------------*/
 /*                                                                          */
-/*  ReadToEndOfFile:  Reads all remaining tokens from the input file.       */
-/*              associated input and listing files.                         */
+/*  ParseProcDeclararion implements:                                        */
+/*                                                                          */
+/*       <ProcDeclaration>  :==  "PROCEDURE" <Identifier>                   */
+/*			      	 [<ParameterList>] ";" [<Declarations>]     */
+/*			     	 {<ProcDeclaration>} <Block> ";"            */
+/*                                                                          */
+/*    Sync Points before [<Declarations>]                                   */
+/*                before and immediatley after [<ProcDeclarations>]         */
 /*                                                                          */
-/*    This is used to ensure that the listing file refects the entire       */
-/*    input, even after a syntax error (because of crash & burn parsing,    */
-/*    if a routine like this is not used, the listing file will not be      */
-/*    complete.  Note that this routine also reports in the listing file    */
-/*    exactly where the parsing stopped.  Note that this routine is         */
-/*    superfluous in a parser that performs error-recovery.                 */
+/*    The procedure's entry point is its "Inc" (or a branch over any        */
+/*    nested procedures).  Self-calls in tail position are rewritten once   */
+/*    the block has been compiled, see EliminateTailCalls.                  */
 /*                                                                          */
+/*    When the object file of a separately compiled program is being        */
+/*    written, an outermost procedure may instead be declared               */
+/*                                                                          */
+/*           "PROCEDURE" <Identifier> [<ParameterList>] ";" "EXTERNAL" ";"  */
+/*                                                                          */
+/*    to call a procedure of another program, see DeclareExternal.          */
 /*                                                                          */
 /*    Inputs:       None                                                    */
 /*                                                                          */
@@ -1211,167 +2022,2597 @@ PRIVATE int  OpenFiles( int argc, char *argv[] )
 /*                                                                          */
 /*    Returns:      Nothing                                                 */
 /*                                                                          */
-/*    Side Effects: Reads all remaining tokens from the input.  There won't */
-/*                  be any more available input after this routine returns. */
+/*    Side Effects: Lookahead token advanced.                               */
+/*                                                                          */
 /*                                                                          */
 /*--------------------------------------------------------------------------*/
 
-
-PRIVATE void ReadToEndOfFile( void )
+PRIVATE void ParseProcDeclaration(PARSER *parser)
 {
-    if ( CurrentToken.code != ENDOFINPUT )  
+    int SavedVarLctn, NestedBackPatchLoc = -1, BodyAddr, ExitAddr, IncAddr;
+    int phase;
+    SYMBOL *procedure, *SavedProcedure;
+    FRAGMENTMARK mark;
+    double start = StartSpan( parser->Tracer ), pass;
+
+    Accept( parser, PROCEDURE );
+    procedure = MakeSymbolTableEntry( parser, STYPE_PROCEDURE );
+    if ( procedure != NULL && ReuseProcedure( parser, procedure ) )
+    {
+        EndSpan( parser->Tracer, TRACE_PROCEDURE, start, procedure->s );
+        return;
+    }
+    MarkProcedure( parser, &mark );
+    Accept( parser, IDENTIFIER );
+
+    parser->scope++;
+    SavedProcedure = parser->CurrentProcedure;
+    parser->CurrentProcedure = procedure;
+    SavedVarLctn = parser->VarLctn;
+    parser->VarLctn = 0;
+
+    if ( procedure != NULL )
+    {
+        procedure->pcount = 0;
+        procedure->ptypes = 0;
+    }
+
+   if ( parser->CurrentToken.code == LEFTPARENTHESIS ) 
+    {
+    	ParseParameterList( parser, procedure );
+    }
+    Accept( parser, SEMICOLON );
+
+    if ( parser->CurrentToken.code == EXTERNAL )
+    {
+        DeclareExternal( parser, procedure );
+        Accept( parser, EXTERNAL );
+        Accept( parser, SEMICOLON );
+        RemoveSymbols( &parser->symbols, parser->scope );
+        parser->scope--;
+        parser->VarLctn = SavedVarLctn;
+        parser->CurrentProcedure = SavedProcedure;
+        EndSpan( parser->Tracer, TRACE_PROCEDURE, start,
+                 procedure != NULL ? procedure->s : NULL );
+        return;
+    }
+    
+    if ( procedure != NULL )
+        procedure->address = CurrentCodeAddress( &parser->code );
+
+    Synchronise( parser, &parser->ProgProcDecSet1, &parser->FB_ProcDec ); 
+    
+    if ( parser->CurrentToken.code == VAR ) 
     {
-        Error( "Parsing ends here in this program\n", CurrentToken.pos );
-        while ( CurrentToken.code != ENDOFINPUT )  CurrentToken = GetToken();
+    	ParseDeclarations( parser );
     }
+    
+    Synchronise( parser, &parser->ProgProcDecSet2, &parser->FB_ProcDec );
+    
+    if ( parser->CurrentToken.code == PROCEDURE )
+    {
+        NestedBackPatchLoc = CurrentCodeAddress( &parser->code );
+        Emit( &parser->code, I_BR, 0 );
+    }
+
+    while ( parser->CurrentToken.code == PROCEDURE )  
+    	ParseProcDeclaration( parser );
+    	
+    if ( NestedBackPatchLoc >= 0 )
+        BackPatch( &parser->code, NestedBackPatchLoc,
+                   CurrentCodeAddress( &parser->code ) );
+
+    Synchronise( parser, &parser->ProgProcDecSet2, &parser->FB_ProcDec );    
+
+    IncAddr = CurrentCodeAddress( &parser->code );
+    Emit( &parser->code, I_INC, 0 );
+    BodyAddr = CurrentCodeAddress( &parser->code );
+    parser->BlockAddr = BodyAddr;
+    parser->TailCallCount = 0;
+
+    ParseBlock( parser );
+
+    ExitAddr = CurrentCodeAddress( &parser->code );
+    Emit( &parser->code, I_DEC, 0 );
+    _Emit( &parser->code, I_RET );
+    phase = EnterPhase( parser->Timing, PHASE_OPTIMISE );
+    pass = StartSpan( parser->Tracer );
+    EliminateTailCalls( parser, BodyAddr, ExitAddr );
+    EndSpan( parser->Tracer, TRACE_TAIL_CALLS, pass, NULL );
+    pass = StartSpan( parser->Tracer );
+    parser->CseRemoved +=
+        EliminateCommonSubexpressions( &parser->code, BodyAddr,
+                                       CurrentCodeAddress( &parser->code ),
+                                       NewTemporary, parser, 1 );
+    EndSpan( parser->Tracer, TRACE_SUBEXPRESSIONS, pass, NULL );
+    pass = StartSpan( parser->Tracer );
+    OrderOperands( &parser->code, BodyAddr,
+                   CurrentCodeAddress( &parser->code ) );
+    EndSpan( parser->Tracer, TRACE_OPERANDS, pass, NULL );
+    ReportStackDepth( parser, procedure, BodyAddr,
+                      CurrentCodeAddress( &parser->code ) - 2 );
+    LeavePhase( parser->Timing, phase );
+    FinishFrame( parser, IncAddr, CurrentCodeAddress( &parser->code ) - 2 );
+    if ( procedure != NULL )  StoreProcedure( parser, procedure, &mark );
+    
+    Accept( parser, SEMICOLON );
+    
+    RemoveSymbols( &parser->symbols, parser->scope );
+    parser->scope--;
+    parser->VarLctn = SavedVarLctn;
+    parser->CurrentProcedure = SavedProcedure;
+    EndSpan( parser->Tracer, TRACE_PROCEDURE, start,
+             procedure != NULL ? procedure->s : NULL );
 }
 
 /*--------------------------------------------------------------------------*/
 /*                                                                          */
-/*  ParseVariable implements:                                               */
+/*  ParseParameterList implements:                                          */
 /*                                                                          */
-/*       <Variable> :== <Identifier>                                        */
+/*       <ParameterList>  :==  "(" <FormalParameter> { ","                  */
+/*                             <FormalParameter> } ")"                      */
+/*                                                                          */
+/*    Once the list is complete, the parameters are given their frame       */
+/*    offsets and the procedure's "pcount" and "ptypes" (bit i set for a    */
+/*    REF parameter i) are filled in.                                       */
+/*                                                                          */
+/*    Inputs:       Procedure SYMBOL (may be NULL)                          */
+/*                                                                          */
+/*    Outputs:      None                                                    */
+/*                                                                          */
+/*    Returns:      Nothing                                                 */
+/*                                                                          */
+/*    Side Effects: Lookahead token advanced.                               */
 /*                                                                          */
 /*--------------------------------------------------------------------------*/
 
-
-PRIVATE void ParseVariable(void)
+PRIVATE void ParseParameterList( PARSER *parser, SYMBOL *procedure )
 {
-    ParseIdentifier();
+    SYMBOL *params[MAX_PARAMETERS];
+    SYMBOL *param;
+    int i, ParamCount = 0;
+
+    Accept( parser, LEFTPARENTHESIS );
+    param = ParseFormalParameter( parser );
+    params[ParamCount++] = param;
+
+    while (parser->CurrentToken.code == COMMA)
+    {
+        Accept(parser, COMMA);
+        param = ParseFormalParameter( parser );
+        if ( ParamCount < MAX_PARAMETERS )  params[ParamCount] = param;
+        else if ( ParamCount == MAX_PARAMETERS )
+        {
+            SemanticError( parser, DIAG_TOO_MANY_PARAMETERS,
+                           "Too many parameters" );
+            KillCodeGeneration( &parser->code );
+        }
+        ParamCount++;
+    }
+    Accept(parser, RIGHTPARENTHESIS);
+
+    if ( ParamCount > MAX_PARAMETERS )  ParamCount = MAX_PARAMETERS;
+    for ( i = 0; i < ParamCount; i++ )
+    {
+        if ( params[i] == NULL )  continue;
+        params[i]->address = FRAME_STATICLINK - ParamCount + i;
+        if ( procedure != NULL && params[i]->type == STYPE_REFPAR )
+            procedure->ptypes |= 1 << i;
+    }
+    if ( procedure != NULL )  procedure->pcount = ParamCount;
 }
 
 /*--------------------------------------------------------------------------*/
 /*                                                                          */
-/*  ParseIntConst implements:                                               */
+/*  ParseFormalParameter implements:                                        */
+/*                                                                          */
+/*       <FormalParameter>  :==  [ "REF" ] <Variable>   */
+/*                                                                          */
+/*                                                                          */
+/*    Inputs:       None                                                    */
+/*                                                                          */
+/*    Outputs:      None                                                    */
+/*                                                                          */
+/*    Returns:      SYMBOL of the parameter (NULL if it was not entered)    */
+/*                                                                          */
+/*    Side Effects: Lookahead token advanced.                          */
 /*                                                                          */
-/*       <IntConst> :== <Digit> { <Digit> }                                 */
 /*                                                                          */
 /*--------------------------------------------------------------------------*/
 
-
-PRIVATE void ParseIntConst(void)
+PRIVATE SYMBOL *ParseFormalParameter(PARSER *parser)
 {
-    Accept(INTCONST);
+    SYMBOL *param;
+    int symtype = STYPE_VALUEPAR;
+
+    if(parser->CurrentToken.code == REF){
+        symtype = STYPE_REFPAR;
+        Accept(parser, REF);
+    }
+
+    param = MakeSymbolTableEntry(parser, symtype);
+    ParseVariable( parser ); 
+
+    return param;
 }
 
 /*--------------------------------------------------------------------------*/
 /*                                                                          */
-/*  ParseIdentifier implements:                                             */
+/*  ParseBlock implements:                                                  */
 /*                                                                          */
-/*       <Identifier> :== <Alpha> { <AlphaNum> }                            */
+/*       <Block>  :==  "BEGIN" { <Statement> ";" } "END"                    */
+/*                                                                          */
+/*    Sync Points  before and immediatley after [<Statement>]               */
+/*                                                                          */
+/*    Inputs:       None                                                    */
+/*                                                                          */
+/*    Outputs:      None                                                    */
+/*                                                                          */
+/*    Returns:      Nothing                                                 */
+/*                                                                          */
+/*    Side Effects: Lookahead token advanced.                               */
 /*                                                                          */
 /*--------------------------------------------------------------------------*/
 
+PRIVATE void ParseBlock(PARSER *parser)
+{
+Accept(parser, BEGIN);
+
+Synchronise(parser, &parser->StatementFS_aug,&parser->StatementFBS);
+Synchronise( parser, &parser->BlockSet1, &parser->FB_Block );
 
-PRIVATE void ParseIdentifier(void)
+while (parser->CurrentToken.code == IDENTIFIER ||
+       parser->CurrentToken.code == WHILE ||
+    parser->CurrentToken.code == IF || parser->CurrentToken.code == READ ||
+    parser->CurrentToken.code == WRITE)
 {
-    Accept(IDENTIFIER);
+    ParseStatement( parser );
+    Accept(parser, SEMICOLON);
+    
+    Synchronise( parser, &parser->StatementFS_aug, &parser->StatementFBS );
+    Synchronise( parser, &parser->BlockSet1, &parser->FB_Block );
 }
 
 
+Accept(parser, END);
+}
+
 /*--------------------------------------------------------------------------*/
 /*                                                                          */
-/*  LookupSymbol:  Gets 's' field from item in lookahead                    */
-/*              (i.e.: CurrentToken.s), and then searches for               */
-/*               a SYMBOL in Symbol Table which has this name.              */
-/*                                                                          */
+/*  ParseStatement implements:                                              */
 /*                                                                          */
+/*       <Statement>  :==  <SimpleStatement> | <WhileStatement>  |          */
+/*                         <IfStatement> | <ReadStatement> |                */
+/*                         <WriteStatement>                                 */
 /*                                                                          */
 /*                                                                          */
 /*    Inputs:       None                                                    */
 /*                                                                          */
 /*    Outputs:      None                                                    */
 /*                                                                          */
-/*    Returns:      Stack Pointer variable, sptr                            */
+/*    Returns:      Nothing                                                 */
 /*                                                                          */
+/*    Side Effects: Lookahead token advanced.                               */
 /*                                                                          */
 /*--------------------------------------------------------------------------*/
 
 
-PRIVATE SYMBOL *LookupSymbol ( void )
+PRIVATE void ParseStatement( PARSER *parser )
 {
-	SYMBOL *sptr;
+	if ( parser->CurrentToken.code == IDENTIFIER ) ParseSimpleStatement( parser );
 	
-	if ( CurrentToken.code == IDENTIFIER )
-	{
-		sptr = Probe ( CurrentToken.s, NULL );
-		if ( sptr == NULL )
-		{
-			Error ( "Identifier not declared", CurrentToken.pos );
-			KillCodeGeneration();
-		}
-	}
-	else sptr = NULL;
+	else if ( parser->CurrentToken.code == WHILE ) ParseWhileStatement( parser );
 	
-	return sptr;
+	else if ( parser->CurrentToken.code == IF ) ParseIfStatement( parser );
+	
+	else if ( parser->CurrentToken.code == READ ) ParseReadStatement( parser );
+	
+	else if ( parser->CurrentToken.code == WRITE ) ParseWriteStatement( parser );
 }
 
-
 /*--------------------------------------------------------------------------*/
 /*                                                                          */
-/*  MakeSymbolTableEntry:   Creates symbol table entry for either a         */
-/*                          program, variable or procedure                  */
+/*  ParseSimpleStatement implements:                                        */
 /*                                                                          */
+/*       <SimpleStatement>  :==  <VarOrProcName> <RestOfStatement>          */
 /*                                                                          */
 /*                                                                          */
+/*    Inputs:       None                                                    */
 /*                                                                          */
+/*    Outputs:      None                                                    */
 /*                                                                          */
-/*    Inputs:       symtype                                                 */
+/*    Returns:      Nothing                                                 */
+/*                                                                          */
+/*    Side Effects: Lookahead token advanced.                               */
+/*                                                                          */
+/*--------------------------------------------------------------------------*/
+
+
+PRIVATE void ParseSimpleStatement( PARSER *parser )
+{
+	SYMBOL *target;
+	
+	target = LookupSymbol( parser ); 
+	Accept( parser, IDENTIFIER );
+	ParseRestOfStatement( parser, target );
+}
+
+/*--------------------------------------------------------------------------*/
+/*                                                                          */
+/*  ParseRestOfStatement implements:                                        */
+/*                                                                          */
+/*       <RestOfStatement>  :==  <ProcCallList> | <Assignment> | EPSILON    */
+/*                                                                          */
+/*                                                                          */
+/*    Inputs:       None                                                    */
 /*                                                                          */
 /*    Outputs:      None                                                    */
 /*                                                                          */
-/*    Returns:      None                                                    */
+/*    Returns:      Nothing                                                 */
 /*                                                                          */
+/*    Side Effects: Lookahead token advanced.                               */
 /*                                                                          */
 /*--------------------------------------------------------------------------*/
 
 
-PRIVATE void MakeSymbolTableEntry ( int symtype )
+PRIVATE void ParseRestOfStatement( PARSER *parser, SYMBOL *target )
 {
-	SYMBOL *oldsptr, *newsptr;
-	char *cptr;
-	int hashindex;
-    static int VarLctn = 0;
-	
-	if ( CurrentToken.code == IDENTIFIER )
+	int ArgCount = 0;
+
+	parser->FrameRef = 0;
+	switch ( parser->CurrentToken.code )
 	{
-		if ( NULL == ( oldsptr = Probe ( CurrentToken.s, &hashindex )) 
-			 ||  oldsptr -> scope < scope )
-		{
-		 	if ( oldsptr == NULL )
-		 		cptr = CurrentToken.s;
-		 	else 
-		 		cptr = oldsptr -> s;
-		 	
-		 	if ( NULL == ( newsptr = EnterSymbol ( cptr, hashindex )))
-		 	{
-		 		Error("Fatal error in EnterSymbol", CurrentToken.pos );
-		 		printf("Fatal error in EnterSymbol. ");
-		 		printf("Compiler must exit immediately\n");
-		 		exit(EXIT_FAILURE);
-		 	}
-		 	else
+		case LEFTPARENTHESIS :
+			ArgCount = ParseProcCallList( parser, target );
+			/* fall through */
+		case SEMICOLON :
+			if ( target != NULL && target->type == STYPE_PROCEDURE )
+				EmitProcCall( parser, target, ArgCount );
+			else
 			{
-				if ( oldsptr == NULL )
-					PreserveString();
-				
-				newsptr -> scope = scope;
-				newsptr -> type = symtype;
-				
-				if ( symtype == STYPE_VARIABLE )
-				{
-					newsptr -> address = VarLctn;
-					VarLctn++;
-				}
-				else 
-					newsptr -> address = -1;
+				SemanticError( parser, DIAG_NOT_PROCEDURE,
+				               "Not a procedure\n" );
+				KillCodeGeneration( &parser->code );
 			}
-		}
+			break;
 		
-		else
-		{
-			Error("Error! Variable already declared", CurrentToken.pos );
-			KillCodeGeneration();
-		}	
+		case ASSIGNMENT : 
+		default :
+			ParseAssignment( parser );
+			if ( IsVariable( target ) )
+				StoreVariable( parser, target );
+			else
+			{
+				SemanticError( parser, DIAG_NOT_VARIABLE,
+				               "Undeclared variable\n" );
+				KillCodeGeneration( &parser->code );
+			}
+			break;
+	}
+}
+
+/*--------------------------------------------------------------------------*/
+/*                                                                          */
+/*  ParseProcCallList implements:                                           */
+/*                                                                          */
+/*       <ProcCallList>  :==  "(" <ActualParameter> { ","                   */
+/*                            <ActualParameter> } ")"                       */
+/*                                                                          */
+/*    Inputs:       Procedure SYMBOL being called (may be NULL)             */
+/*                                                                          */
+/*    Outputs:      None                                                    */
+/*                                                                          */
+/*    Returns:      Number of actual parameters                             */
+/*                                                                          */
+/*    Side Effects: Lookahead token advanced.                               */
+/*                                                                          */
+/*--------------------------------------------------------------------------*/
+
+
+PRIVATE int ParseProcCallList( PARSER *parser, SYMBOL *procedure )
+{
+	int ArgCount = 0;
+
+	Accept( parser, LEFTPARENTHESIS );
+	ParseActualParameter( parser, procedure, ArgCount++ );
+	
+	while ( parser->CurrentToken.code == COMMA ) {
+		Accept( parser, COMMA );
+		ParseActualParameter( parser, procedure, ArgCount++ );
 	}
-}
\ No newline at end of file
+	
+	Accept( parser, RIGHTPARENTHESIS );
+	return ArgCount;
+}
+
+/*--------------------------------------------------------------------------*/
+/*                                                                          */
+/*  ParseAssignment implements:                                             */
+/*                                                                          */
+/*       <Assignment>  :==  ":=" <Expression>                               */
+/*                                                                          */
+/*                                                                          */
+/*    Inputs:       None                                                    */
+/*                                                                          */
+/*    Outputs:      None                                                    */
+/*                                                                          */
+/*    Returns:      Nothing                                                 */
+/*                                                                          */
+/*    Side Effects: Lookahead token advanced.                               */
+/*                                                                          */
+/*--------------------------------------------------------------------------*/
+
+
+PRIVATE void ParseAssignment(PARSER *parser)
+{
+    Accept(parser, ASSIGNMENT);
+    ParseExpression( parser );
+}
+
+/*--------------------------------------------------------------------------*/
+/*                                                                          */
+/*  ParseActualParameter implements:                                        */
+/*                                                                          */
+/*       <ActualParameter>  :==  <Variable> | <Expression>                  */
+/*                                                                          */
+/*    A REF parameter must be a <Variable>, whose address is passed.        */
+/*    Anything else is passed by value.  Passing the address of a           */
+/*    parameter or local of the current frame sets FrameRef, as the call    */
+/*    cannot then reuse the frame (see EmitProcCall).                       */
+/*                                                                          */
+/*    Inputs:       Procedure SYMBOL being called (may be NULL), index of   */
+/*                  the parameter                                           */
+/*                                                                          */
+/*    Outputs:      None                                                    */
+/*                                                                          */
+/*    Returns:      Nothing                                                 */
+/*                                                                          */
+/*    Side Effects: Lookahead token advanced.                               */
+/*                                                                          */
+/*--------------------------------------------------------------------------*/
+
+PRIVATE void ParseActualParameter( PARSER *parser, SYMBOL *procedure,
+                                   int index )
+{
+    SYMBOL *var;
+
+    if ( IsRefParameter( procedure, index ) )
+    {
+        if ( parser->CurrentToken.code == IDENTIFIER )
+        {
+            var = LookupSymbol( parser );
+            if ( IsVariable( var ) )
+            {
+                LoadAddress( parser, var );
+                if ( var->type != STYPE_VARIABLE &&
+                     var->type != STYPE_REFPAR &&
+                     var->scope == parser->scope )
+                    parser->FrameRef = 1;
+            }
+            else if ( var != NULL )
+            {
+                SemanticError( parser, DIAG_REF_NOT_VARIABLE,
+                               "REF parameter must be a variable" );
+                KillCodeGeneration( &parser->code );
+            }
+            ParseVariable( parser );
+        }
+        else
+        {
+            SemanticError( parser, DIAG_REF_NOT_VARIABLE,
+                           "REF parameter must be a variable" );
+            KillCodeGeneration( &parser->code );
+            ParseExpression( parser );
+        }
+    }
+    else ParseExpression( parser );
+}
+
+/*--------------------------------------------------------------------------*/
+/*                                                                          */
+/*  ParseWhileStatement implements:                                         */
+/*                                                                          */
+/*       <WhileStatement>  :==  "WHILE" <BooleanExpression> "DO" <Block>    */
+/*                                                                          */
+/*                                                                          */
+/*    Inputs:       None                                                    */
+/*                                                                          */
+/*    Outputs:      None                                                    */
+/*                                                                          */
+/*    Returns:      Nothing                                                 */
+/*                                                                          */
+/*    Side Effects: Lookahead token advanced.                               */
+/*                                                                          */
+/*--------------------------------------------------------------------------*/
+
+
+PRIVATE void ParseWhileStatement(PARSER *parser)
+{
+    int Label1, Label2, L2BackPatchLoc, phase;
+    double pass;
+
+    Accept( parser, WHILE );
+	Label1 = CurrentCodeAddress( &parser->code );
+	L2BackPatchLoc = ParseBooleanExpression( parser );
+    Accept( parser, DO );
+    ParseBlock( parser );
+	Emit(&parser->code, I_BR, Label1);
+	Label2 = CurrentCodeAddress( &parser->code );
+	BackPatch(&parser->code, L2BackPatchLoc, Label2);
+
+	/*  A self-call inside a loop is never a tail call, and hoisting would  */
+	/*  leave its recorded addresses stale.                                 */
+	while ( parser->TailCallCount > 0 &&
+	        parser->TailCalls[parser->TailCallCount-1].start >= Label1 )
+		parser->TailCallCount--;
+	phase = EnterPhase( parser->Timing, PHASE_OPTIMISE );
+	pass = StartSpan( parser->Tracer );
+	HoistLoopInvariants( &parser->code, parser->BlockAddr, Label1, Label2,
+	                     NewTemporary, parser, parser->scope > 1 );
+	EndSpan( parser->Tracer, TRACE_INVARIANTS, pass, NULL );
+	LeavePhase( parser->Timing, phase );
+}
+
+/*--------------------------------------------------------------------------*/
+/*                                                                          */
+/*  ParseIfStatement implements:                                            */
+/*                                                                          */
+/*       <IfStatement>  :==  "IF" <BooleanExpression> "THEN"                */
+/*                           <Block> [ "ELSE" <Block> ]                     */
+/*                                                                          */
+/*                                                                          */
+/*    Inputs:       None                                                    */
+/*                                                                          */
+/*    Outputs:      None                                                    */
+/*                                                                          */
+/*    Returns:      Nothing                                                 */
+/*                                                                          */
+/*    Side Effects: Lookahead token advanced.                               */
+/*                                                                          */
+/*--------------------------------------------------------------------------*/
+
+
+PRIVATE void ParseIfStatement(PARSER *parser)
+{
+    int L1BackPatchLoc, L2BackPatchLoc;
+    Accept( parser, IF );
+    L1BackPatchLoc = ParseBooleanExpression( parser );
+    Accept( parser, THEN );
+    ParseBlock( parser );
+    if ( parser->CurrentToken.code == ELSE )
+    {
+    	L2BackPatchLoc = CurrentCodeAddress( &parser->code );
+    	Emit( &parser->code, I_BR, 999 );	// Branch to TEMP code address, 
+    						// to be backpatched later
+    	BackPatch( &parser->code, L1BackPatchLoc,
+    	           CurrentCodeAddress( &parser->code ) );
+    	Accept( parser, ELSE );
+    	ParseBlock( parser );
+    	BackPatch( &parser->code, L2BackPatchLoc,
+    	           CurrentCodeAddress( &parser->code ) );
+    }
+    else 
+    	BackPatch( &parser->code, L1BackPatchLoc,
+    	           CurrentCodeAddress( &parser->code ) );
+}
+
+/*--------------------------------------------------------------------------*/
+/*                                                                          */
+/*  ParseReadStatement implements:                                          */
+/*                                                                          */
+/*       <ReadStatement>  :==   "READ" "(" <Variable> { ","                 */
+/*                               <Variable> } ")"                           */
+/*                                                                          */
+/*                                                                          */
+/*    Inputs:       None                                                    */
+/*                                                                          */
+/*    Outputs:      None                                                    */
+/*                                                                          */
+/*    Returns:      Nothing                                                 */
+/*                                                                          */
+/*    Side Effects: Lookahead token advanced.                               */
+/*                                                                          */
+/*--------------------------------------------------------------------------*/
+
+
+PRIVATE void ParseReadStatement(PARSER *parser)
+{
+    Accept(parser, READ);
+    Accept( parser, LEFTPARENTHESIS );
+    ParseReadVariable( parser );
+
+    while (parser->CurrentToken.code == COMMA )  
+    {
+    	Accept( parser, COMMA );
+    	ParseReadVariable( parser );
+    }
+    
+    Accept( parser, RIGHTPARENTHESIS );
+}
+
+/*--------------------------------------------------------------------------*/
+/*                                                                          */
+/*  ParseReadVariable: Compiles one <Variable> of a READ statement, i.e.,   */
+/*                     a "Read" followed by a store into the variable.      */
+/*                                                                          */
+/*    Inputs:       None                                                    */
+/*                                                                          */
+/*    Outputs:      None                                                    */
+/*                                                                          */
+/*    Returns:      Nothing                                                 */
+/*                                                                          */
+/*    Side Effects: Lookahead token advanced.                               */
+/*                                                                          */
+/*--------------------------------------------------------------------------*/
+
+
+PRIVATE void ParseReadVariable( PARSER *parser )
+{
+    SYMBOL *var;
+
+    var = LookupSymbol( parser );
+    if ( IsVariable( var ) )
+    {
+        _Emit( &parser->code, I_READ );
+        StoreVariable( parser, var );
+    }
+    else if ( var != NULL )
+    {
+        SemanticError( parser, DIAG_NOT_VARIABLE, "Not a variable" );
+        KillCodeGeneration( &parser->code );
+    }
+    ParseVariable( parser );
+}
+
+/*--------------------------------------------------------------------------*/
+/*                                                                          */
+/*  ParseWriteStatement implements:                                         */
+/*                                                                          */
+/*       <WriteStatement>  :==   "WRITE" "(" <Expression> { ","             */
+/*                               <Expression> } ")"                         */
+/*                                                                          */
+/*                                                                          */
+/*    Inputs:       None                                                    */
+/*                                                                          */
+/*    Outputs:      None                                                    */
+/*                                                                          */
+/*    Returns:      Nothing                                                 */
+/*                                                                          */
+/*    Side Effects: Lookahead token advanced.                               */
+/*                                                                          */
+/*--------------------------------------------------------------------------*/
+
+
+PRIVATE void ParseWriteStatement(PARSER *parser)
+{
+    Accept( parser, WRITE );
+    Accept( parser, LEFTPARENTHESIS );
+    ParseExpression( parser );
+	_Emit(&parser->code, I_WRITE);
+
+    while (parser->CurrentToken.code == COMMA )  {
+    	Accept( parser, COMMA );
+    	ParseExpression( parser );
+    	_Emit(&parser->code, I_WRITE);
+    }
+    
+    Accept( parser, RIGHTPARENTHESIS );
+}
+
+/*--------------------------------------------------------------------------*/
+/*                                                                          */
+/*  ParseExpression implements:                                             */
+/*                                                                          */
+/*       <Expression>  :==   <CompoundTerm> { <AddOp> <CompoundTerm> }      */
+/*                                                                          */
+/*    Operations are emitted through EmitOperation, which simplifies them   */
+/*    using the code of their operands.                                     */
+/*                                                                          */
+/*    Inputs:       None                                                    */
+/*                                                                          */
+/*    Outputs:      None                                                    */
+/*                                                                          */
+/*    Returns:      Nothing                                                 */
+/*                                                                          */
+/*    Side Effects: Lookahead token advanced.                               */
+/*                                                                          */
+/*--------------------------------------------------------------------------*/
+
+
+PRIVATE void ParseExpression(PARSER *parser)
+{
+    int op, LeftStart, RightStart;
+
+    LeftStart = CurrentCodeAddress( &parser->code );
+    ParseCompoundTerm( parser );
+    while ( (op = parser->CurrentToken.code) == ADD ||		/* ADD: name for "+".  */
+			op == SUBTRACT )						/* SUBTRACT: "-".      */
+    {
+        ParseAddOp( parser );
+        RightStart = CurrentCodeAddress( &parser->code );
+        ParseCompoundTerm( parser );
+
+        EmitOperation( &parser->code, op == ADD ? I_ADD : I_SUB, LeftStart,
+                       RightStart );
+    }
+}
+
+/*--------------------------------------------------------------------------*/
+/*                                                                          */
+/*  ParseCompoundTerm implements:                                           */
+/*                                                                          */
+/*       <CompoundTerm>  :==   <Term> { <MultOp> <Term> }                   */
+/*                                                                          */
+/*                                                                          */
+/*    Inputs:       None                                                    */
+/*                                                                          */
+/*    Outputs:      None                                                    */
+/*                                                                          */
+/*    Returns:      Nothing                                                 */
+/*                                                                          */
+/*    Side Effects: Lookahead token advanced.                               */
+/*                                                                          */
+/*--------------------------------------------------------------------------*/
+
+
+PRIVATE void ParseCompoundTerm( PARSER *parser )
+{
+	int token, LeftStart, RightStart;
+
+    LeftStart = CurrentCodeAddress( &parser->code );
+    ParseTerm( parser );
+    
+    while ( (token = parser->CurrentToken.code) == MULTIPLY ||
+            token == DIVIDE ) {
+        ParseMultOp( parser );
+        RightStart = CurrentCodeAddress( &parser->code );
+        ParseTerm( parser );
+
+		EmitOperation( &parser->code,
+		               token == MULTIPLY ? I_MULT : I_DIV,
+		               LeftStart, RightStart );
+    }
+}
+
+/*--------------------------------------------------------------------------*/
+/*                                                                          */
+/*  ParseTerm implements:                                                   */
+/*                                                                          */
+/*       <Term>  :==   ["-"] <SubTerm>                                      */
+/*                                                                          */
+/*                                                                          */
+/*    Inputs:       None                                                    */
+/*                                                                          */
+/*    Outputs:      None                                                    */
+/*                                                                          */
+/*    Returns:      Nothing                                                 */
+/*                                                                          */
+/*    Side Effects: Lookahead token advanced.                               */
+/*                                                                          */
+/*--------------------------------------------------------------------------*/
+
+PRIVATE void ParseTerm( PARSER *parser )
+{
+	int negateflag = 0, OperandStart;
+
+    if ( parser->CurrentToken.code == SUBTRACT ) {
+		negateflag = 1;
+		Accept( parser, SUBTRACT );
+	}
+    
+    OperandStart = CurrentCodeAddress( &parser->code );
+    ParseSubTerm( parser );
+
+	if(negateflag) EmitNegation( &parser->code, OperandStart );
+}
+
+/*--------------------------------------------------------------------------*/
+/*                                                                          */
+/*  ParseTerm implements:                                                   */
+/*                                                                          */
+/*       <BooleanExpression>  :==   <Expression> <RelOp> <Expression>       */
+/*                                                                          */
+/*                                                                          */
+/*    Inputs:       None                                                    */
+/*                                                                          */
+/*    Outputs:      None                                                    */
+/*                                                                          */
+/*    Returns:      Nothing                                                 */
+/*                                                                          */
+/*    Side Effects: Lookahead token advanced.                               */
+/*                                                                          */
+/*--------------------------------------------------------------------------*/
+
+
+PRIVATE int ParseBooleanExpression(PARSER *parser)
+{
+    int BackPatchAddr, RelOpInstruction, LeftStart, RightStart;
+    LeftStart = CurrentCodeAddress( &parser->code );
+    ParseExpression( parser );
+    RelOpInstruction = ParseRelOp( parser );
+    RightStart = CurrentCodeAddress( &parser->code );
+    ParseExpression( parser );
+    EmitOperation( &parser->code, I_SUB, LeftStart, RightStart );
+    BackPatchAddr = CurrentCodeAddress( &parser->code );
+    Emit( &parser->code, RelOpInstruction, 0 );   // Branch to TEMP code address, 
+    								// to be backpatched later
+    
+    return BackPatchAddr;
+}
+
+/*--------------------------------------------------------------------------*/
+/*                                                                          */
+/*  ParseSubTerm implements:                                                */
+/*                                                                          */
+/*       <SubTerm>  :==   <Variable> | <IntConst> | "(" <Expression> ")"    */
+/*                                                                          */
+/*                                                                          */
+/*                                                                          */
+/*    Inputs:       None                                                    */
+/*                                                                          */
+/*    Outputs:      None                                                    */
+/*                                                                          */
+/*    Returns:      Nothing                                                 */
+/*                                                                          */
+/*    Side Effects: Lookahead token advanced.                               */
+/*                                                                          */
+/*--------------------------------------------------------------------------*/
+
+
+PRIVATE void ParseSubTerm(PARSER *parser)
+{
+    SYMBOL *var;
+    switch(parser->CurrentToken.code)
+    {
+        case INTCONST:
+            Emit(&parser->code, I_LOADI,parser->CurrentToken.value);
+            ParseIntConst( parser ); 
+            break;
+        case LEFTPARENTHESIS:
+            Accept(parser, LEFTPARENTHESIS);
+            ParseExpression( parser );
+            Accept(parser, RIGHTPARENTHESIS);
+            break;
+        case IDENTIFIER:
+        default:
+            var = LookupSymbol( parser );
+            if ( IsVariable( var ) )  LoadVariable( parser, var );
+            else if ( var != NULL ) {
+                SemanticError( parser, DIAG_NOT_VARIABLE, "Not a variable" );
+                KillCodeGeneration( &parser->code );
+            }
+            ParseVariable( parser ); 
+            break;
+    }
+}
+
+
+/*--------------------------------------------------------------------------*/
+/*                                                                          */
+/*  ParseAddOp implements:                                             */
+/*                                                                          */
+/*       <AddOp>  :==   "+" | "-"      */
+/*                                                                          */
+/*                                                                          */
+/*    Inputs:       None                                                    */
+/*                                                                          */
+/*    Outputs:      None                                                    */
+/*                                                                          */
+/*    Returns:      Nothing                                                 */
+/*                                                                          */
+/*    Side Effects: Lookahead token advanced.                               */
+/*                                                                          */
+/*--------------------------------------------------------------------------*/
+
+
+PRIVATE void ParseAddOp( PARSER *parser )
+{
+    if ( parser->CurrentToken.code == ADD ) Accept( parser, ADD );
+    
+    else Accept ( parser, SUBTRACT );
+}
+
+/*--------------------------------------------------------------------------*/
+/*                                                                          */
+/*  ParseMultOp implements:                                                 */
+/*                                                                          */
+/*       <MultOp>  :==   "*" | "/"                                          */
+/*                                                                          */
+/*                                                                          */
+/*    Inputs:       None                                                    */
+/*                                                                          */
+/*    Outputs:      None                                                    */
+/*                                                                          */
+/*    Returns:      Nothing                                                 */
+/*                                                                          */
+/*    Side Effects: Lookahead token advanced.                               */
+/*                                                                          */
+/*--------------------------------------------------------------------------*/
+
+
+PRIVATE void ParseMultOp( PARSER *parser )
+{
+    if ( parser->CurrentToken.code == MULTIPLY ) Accept( parser, MULTIPLY );
+    
+    else Accept ( parser, DIVIDE );
+}
+
+/*--------------------------------------------------------------------------*/
+/*                                                                          */
+/*  ParseRelOp implements:                                                  */
+/*                                                                          */
+/*       <RelOp>  :==   "=" | "<=" | ">=" | "<" | ">"                       */
+/*                                                                          */
+/*                                                                          */
+/*    Inputs:       None                                                    */
+/*                                                                          */
+/*    Outputs:      None                                                    */
+/*                                                                          */
+/*    Returns:      Int RelOpInstruction                                    */
+/*                                                                          */
+/*    Side Effects: Lookahead token advanced.                               */
+/*                                                                          */
+/*--------------------------------------------------------------------------*/
+
+
+PRIVATE int ParseRelOp( PARSER *parser )
+{
+	int RelOpInstruction;
+	switch(parser->CurrentToken.code) {
+		case LESSEQUAL:
+			RelOpInstruction = I_BG; 
+			Accept(parser, LESSEQUAL);
+			break;
+		case GREATEREQUAL:
+			RelOpInstruction = I_BL; 
+			Accept(parser, GREATEREQUAL);
+			break;
+		case LESS:
+			RelOpInstruction = I_BGZ; 
+			Accept(parser, LESS);
+			break;
+		case EQUALITY:
+			RelOpInstruction = I_BNZ; 
+			Accept(parser, EQUALITY);
+			break;
+		case GREATER:
+			RelOpInstruction = I_BLZ; 
+			Accept(parser, GREATER);
+			break;
+		default:
+			RelOpInstruction = I_BNZ;
+			SyntaxError2( &parser->scanner, parser->RelOpSet,
+			              parser->CurrentToken );
+			parser->FlagError = 1;
+			break;
+	}
+	return RelOpInstruction;
+}
+
+/*--------------------------------------------------------------------------*/
+/*                                                                          */
+/*  End of parser.  Support routines follow.                                */
+/*                                                                          */
+/*--------------------------------------------------------------------------*/
+/*                                                                          */
+/*  Accept:  Takes an expected token name as argument, and if the current   */
+/*           lookahead matches this, advances the lookahead and returns.    */
+/*                                                                          */
+/*           If the expected token fails to match the current lookahead,    */
+/*           this routine reports a syntax error, using "SyntaxError"       */
+/*           (from "scanner.h") which puts the error message on the         */
+/*           standard output and on the listing file, and sets the parser   */
+/*           recovering, so that the next call skips to its token.          */
+/*                                                                          */
+/*                                                                          */
+/*    Inputs:       Integer code of expected token                          */
+/*                                                                          */
+/*    Outputs:      None                                                    */
+/*                                                                          */
+/*    Returns:      Nothing                                                 */
+/*                                                                          */
+/*    Side Effects: If successful, advances the current lookahead token     */
+/*                  "CurrentToken".                                         */
+/*                                                                          */
+/*--------------------------------------------------------------------------*/
+
+PRIVATE void Accept( PARSER *parser, int ExpectedToken )
+{
+	/* Error re-sync code */
+	if( parser->Recovering )
+	{            
+    	while( parser->CurrentToken.code != ExpectedToken &&
+    		   parser->CurrentToken.code != ENDOFINPUT )
+    		parser->CurrentToken = NextToken( parser );
+    	parser->Recovering = 0;
+	}
+
+	/* Normal Accept code */
+	if( parser->CurrentToken.code != ExpectedToken )
+	{
+		SyntaxError( &parser->scanner, ExpectedToken,
+		             parser->CurrentToken );
+		parser->FlagError = 1;
+		parser->Recovering = 1;
+	}  
+	else parser->CurrentToken = NextToken( parser );
+}
+
+/*--------------------------------------------------------------------------*/
+/*                                                                          */
+/*  OpenFiles:  Reads strings from the command-line and opens the           */
+/*              associated input and listing files.                         */
+/*                                                                          */
+/*    Note that this routine mmodifies the globals "InputFile" and          */
+/*    "ListingFile".  It returns 1 ("true" in C-speak) if the input and     */
+/*    listing files are successfully opened, 0 if not, allowing the caller  */
+/*    to make a graceful exit if the opening process failed.                */
+/*                                                                          */
+/*                                                                          */
+/*    Inputs:       1) Integer argument count (standard C "argc").          */
+/*                  2) Array of pointers to C-strings containing arguments  */
+/*                  (standard C "argv").                                    */
+/*                                                                          */
+/*    Outputs:      No direct outputs, but note side effects.               */
+/*                                                                          */
+/*    Returns:      Boolean success flag (i.e., an "int":  1 or 0)          */
+/*                                                                          */
+/*    Side Effects: If successful, sets "InputFile", "ListFile" and         */
+/*                  "CodeFile" to the open files.                           */
+/*                                                                          */
+/*--------------------------------------------------------------------------*/
+
+PRIVATE int  OpenFiles( int argc, char *argv[], FILE **InputFile,
+                        FILE **ListFile, FILE **CodeFile )
+{
+
+
+    if ( argc != 4 )  {
+        fprintf( stderr, "%s <inputfile> <listfile>\n", argv[0] );
+        return 0;
+    }
+
+    if ( NULL == ( *InputFile = fopen( argv[1], "r" ) ) )  {
+        fprintf( stderr, "cannot open \"%s\" for input\n", argv[1] );
+        return 0;
+    }
+
+    if ( NULL == ( *ListFile = fopen( argv[2], "w" ) ) )  {
+        fprintf( stderr, "cannot open \"%s\" for output\n", argv[2] );
+        fclose( *InputFile );
+        return 0;
+    }
+
+    if ( NULL == ( *CodeFile = fopen( argv[3], "w" ) ) )  {
+        fprintf( stderr, "cannot open \"%s\" for output\n", argv[3] );
+        fclose( *InputFile );
+        fclose( *ListFile );
+        return 0;
+    }
+
+    return 1;
+}
+
+/*--------------------------------------------------------------------------*/
+/*                                                                          */
+/*  ParseSize:  Converts a size given on the command line, a number with    */
+/*              an optional K, M or G suffix, to bytes.                     */
+/*                                                                          */
+/*    Inputs:       The text of the size.                                   */
+/*                                                                          */
+/*    Outputs:      None                                                    */
+/*                                                                          */
+/*    Returns:      The size in bytes, or 0 if the text is not a size.      */
+/*                                                                          */
+/*--------------------------------------------------------------------------*/
+
+PRIVATE long ParseSize( char *text )
+{
+    char *end;
+    long size = strtol( text, &end, 10 );
+
+    if ( end == text || size <= 0 )  return 0;
+    switch ( *end )  {
+        case 'G':  case 'g':  size *= 1024;  /* fall through */
+        case 'M':  case 'm':  size *= 1024;  /* fall through */
+        case 'K':  case 'k':  size *= 1024;  end++;
+        default:  break;
+    }
+    return *end == '\0' ? size : 0;
+}
+
+/*--------------------------------------------------------------------------*/
+/*                                                                          */
+/*  CloseTrace:  Writes the trace asked for by --trace, closes its file     */
+/*               and releases the tracer.                                   */
+/*                                                                          */
+/*    Inputs:       tracer, from InitTracer                                 */
+/*                  file, the trace file, open for writing                  */
+/*                                                                          */
+/*    Outputs:      None                                                    */
+/*                                                                          */
+/*    Returns:      1 if the trace was written, 0 otherwise                 */
+/*                                                                          */
+/*--------------------------------------------------------------------------*/
+
+PRIVATE int CloseTrace( TRACER *tracer, FILE *file )
+{
+    int written = WriteTrace( tracer, file );
+
+    if ( fclose( file ) != 0 )  written = 0;
+    FreeTracer( tracer );
+    return written;
+}
+
+/*--------------------------------------------------------------------------*/
+/*                                                                          */
+/*  Bench:  Times repeated compilations of one program by a warm COMPILER,  */
+/*          first without and then with the pipeline, and reports the 50th  */
+/*          and 99th percentile and maximum times of each, and the          */
+/*          speed-up at the 50th percentile.  The listing and code are      */
+/*          written to /dev/null.  No procedure is reused from one          */
+/*          compilation to the next (see CompileText).                      */
+/*                                                                          */
+/*    Inputs:       source, the name of the program                         */
+/*                  count, the number of compilations each way              */
+/*                                                                          */
+/*    Outputs:      None                                                    */
+/*                                                                          */
+/*    Returns:      1 if the program could be compiled, 0 otherwise         */
+/*                                                                          */
+/*--------------------------------------------------------------------------*/
+
+PRIVATE int Bench( char *source, int count )
+{
+    static char *names[2] = { "one thread", "pipelined" };
+    FILE *InputFile, *ListFile, *CodeFile;
+    COMPILER *compiler;
+    char *text;
+    size_t length;
+    double *times, start, p50[2];
+    int pipelined, i, ok = 0;
+
+    if ( count <= 0 )  count = BENCH_COUNT;
+    if ( NULL == ( InputFile = fopen( source, "r" ) ) )
+    {
+        fprintf( stderr, "cannot open \"%s\" for input\n", source );
+        return 0;
+    }
+    i = ReadSource( InputFile, &text, &length );
+    fclose( InputFile );
+    if ( !i )  return 0;
+
+    ListFile = fopen( "/dev/null", "w" );
+    CodeFile = fopen( "/dev/null", "w" );
+    times = malloc( count * sizeof( double ) );
+    if ( ListFile != NULL && CodeFile != NULL && times != NULL )
+        for ( ok = 1, pipelined = 0; pipelined < 2 && ok; pipelined++ )
+        {
+            if ( NULL == ( compiler = NewCompiler() ) )
+            {
+                ok = 0;
+                break;
+            }
+            SetCompilerPipeline( compiler, pipelined );
+            for ( i = 0; i < count && ok; i++ )
+            {
+                if ( NULL == ( InputFile = fmemopen( text, length, "r" ) ) )
+                    ok = 0;
+                else
+                {
+                    start = Now();
+                    RunCompiler( compiler, InputFile, ListFile, CodeFile,
+                                 NULL, NULL );
+                    times[i] = ( Now() - start ) * 1e6;
+                    fclose( InputFile );
+                }
+            }
+            FreeCompiler( compiler );
+            if ( ok )
+            {
+                qsort( times, count, sizeof( double ), CompareTimes );
+                p50[pipelined] = times[( count * 50 + 99 ) / 100 - 1];
+                printf( "%-10s  %d compilations, (us) p50 %.1f, p99 %.1f, "
+                        "max %.1f\n", names[pipelined], count,
+                        p50[pipelined], times[( count * 99 + 99 ) / 100 - 1],
+                        times[count - 1] );
+            }
+        }
+    if ( ok )  printf( "speed-up at p50: %.2f\n",
+                       p50[1] > 0.0 ? p50[0] / p50[1] : 0.0 );
+    else  fprintf( stderr, "cannot run the benchmark\n" );
+
+    if ( ListFile != NULL )  fclose( ListFile );
+    if ( CodeFile != NULL )  fclose( CodeFile );
+    free( times );
+    free( text );
+    return ok;
+}
+
+/*--------------------------------------------------------------------------*/
+/*                                                                          */
+/*  Now:  Returns a monotonic time in seconds, for Bench.                   */
+/*                                                                          */
+/*--------------------------------------------------------------------------*/
+
+PRIVATE double Now( void )
+{
+    struct timespec ts;
+
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*--------------------------------------------------------------------------*/
+/*                                                                          */
+/*  CompareTimes:  qsort comparison of two doubles, for Bench.              */
+/*                                                                          */
+/*--------------------------------------------------------------------------*/
+
+PRIVATE int CompareTimes( const void *a, const void *b )
+{
+    double x = *(const double *) a, y = *(const double *) b;
+
+    return ( x > y ) - ( x < y );
+}
+
+/*--------------------------------------------------------------------------*/
+/*                                                                          */
+/*  ParseVariable implements:                                               */
+/*                                                                          */
+/*       <Variable> :== <Identifier>                                        */
+/*                                                                          */
+/*--------------------------------------------------------------------------*/
+
+
+PRIVATE void ParseVariable(PARSER *parser)
+{
+    ParseIdentifier( parser );
+}
+
+/*--------------------------------------------------------------------------*/
+/*                                                                          */
+/*  ParseIntConst implements:                                               */
+/*                                                                          */
+/*       <IntConst> :== <Digit> { <Digit> }                                 */
+/*                                                                          */
+/*--------------------------------------------------------------------------*/
+
+
+PRIVATE void ParseIntConst(PARSER *parser)
+{
+    Accept(parser, INTCONST);
+}
+
+/*--------------------------------------------------------------------------*/
+/*                                                                          */
+/*  ParseIdentifier implements:                                             */
+/*                                                                          */
+/*       <Identifier> :== <Alpha> { <AlphaNum> }                            */
+/*                                                                          */
+/*--------------------------------------------------------------------------*/
+
+
+PRIVATE void ParseIdentifier(PARSER *parser)
+{
+    Accept(parser, IDENTIFIER);
+}
+
+
+/*--------------------------------------------------------------------------*/
+/*                                                                          */
+/*  LookupSymbol:  Gets 's' field from item in lookahead                    */
+/*              (i.e.: CurrentToken.s), and then searches for               */
+/*               a SYMBOL in Symbol Table which has this name.              */
+/*                                                                          */
+/*                                                                          */
+/*                                                                          */
+/*                                                                          */
+/*    Inputs:       None                                                    */
+/*                                                                          */
+/*    Outputs:      None                                                    */
+/*                                                                          */
+/*    Returns:      Stack Pointer variable, sptr                            */
+/*                                                                          */
+/*                                                                          */
+/*--------------------------------------------------------------------------*/
+
+
+PRIVATE SYMBOL *LookupSymbol ( PARSER *parser )
+{
+	SYMBOL *sptr;
+	int phase;
+	
+	if ( parser->CurrentToken.code == IDENTIFIER )
+	{
+		phase = EnterPhase( parser->Timing, PHASE_SYMBOLS );
+		sptr = Probe ( &parser->symbols, parser->CurrentToken.s, NULL );
+		LeavePhase( parser->Timing, phase );
+		if ( sptr == NULL )
+		{
+			SemanticError( parser, DIAG_UNDECLARED,
+			               "Identifier not declared" );
+			KillCodeGeneration( &parser->code );
+		}
+		else if ( parser->Source != NULL )
+			NoteReference( parser, sptr );
+	}
+	else sptr = NULL;
+	
+	return sptr;
+}
+
+
+/*--------------------------------------------------------------------------*/
+/*                                                                          */
+/*  MakeSymbolTableEntry:   Creates symbol table entry for either a         */
+/*                          program, variable or procedure                  */
+/*                                                                          */
+/*                                                                          */
+/*                                                                          */
+/*                                                                          */
+/*                                                                          */
+/*    Inputs:       symtype                                                 */
+/*                                                                          */
+/*    Outputs:      None                                                    */
+/*                                                                          */
+/*    Returns:      The new SYMBOL, or NULL if none was entered             */
+/*                                                                          */
+/*                                                                          */
+/*--------------------------------------------------------------------------*/
+
+
+PRIVATE SYMBOL *MakeSymbolTableEntry ( PARSER *parser, int symtype )
+{
+	SYMBOL *oldsptr, *newsptr = NULL;
+	char *cptr;
+	int hashindex, phase;
+	
+	if ( parser->CurrentToken.code == IDENTIFIER )
+	{
+		phase = EnterPhase( parser->Timing, PHASE_SYMBOLS );
+		oldsptr = Probe ( &parser->symbols, parser->CurrentToken.s,
+		                  &hashindex );
+		LeavePhase( parser->Timing, phase );
+		if ( oldsptr == NULL ||  oldsptr -> scope < parser->scope )
+		{
+		 	if ( oldsptr == NULL )
+		 		cptr = parser->CurrentToken.s;
+		 	else 
+		 		cptr = oldsptr -> s;
+		 	
+		 	phase = EnterPhase( parser->Timing, PHASE_SYMBOLS );
+		 	newsptr = EnterSymbol ( &parser->symbols, cptr, hashindex );
+		 	LeavePhase( parser->Timing, phase );
+		 	if ( newsptr == NULL )
+		 		Fatal( &parser->Trap, "Fatal error in EnterSymbol" );
+		 	else
+			{
+				if ( oldsptr == NULL )
+					PreserveString( &parser->scanner.strings );
+				
+				newsptr -> scope = parser->scope;
+				newsptr -> type = symtype;
+				
+				if ( symtype == STYPE_VARIABLE )
+				{
+					newsptr -> address = parser->VarLctn;
+					parser->VarLctn++;
+				}
+				else if ( symtype == STYPE_LOCALVAR )
+				{
+					newsptr -> address = FRAME_LOCALS + parser->VarLctn;
+					parser->VarLctn++;
+				}
+				else 
+					newsptr -> address = -1;
+
+				if ( parser->Object && parser->scope == 1 &&
+				     ( symtype == STYPE_VARIABLE ||
+				       symtype == STYPE_PROCEDURE ) )
+					NoteLinkage( parser, newsptr );
+			}
+		}
+		
+		else
+		{
+			SemanticError( parser, DIAG_REDECLARED,
+			               "Error! Variable already declared" );
+			KillCodeGeneration( &parser->code );
+		}	
+	}
+	return newsptr;
+}
+
+
+/*--------------------------------------------------------------------------*/
+/*                                                                          */
+/*  IsVariable:  Determines whether a SYMBOL names something which can be   */
+/*               loaded and stored, i.e., a global or local variable or a   */
+/*               parameter.                                                 */
+/*                                                                          */
+/*    Inputs:       var, SYMBOL pointer (may be NULL)                       */
+/*                                                                          */
+/*    Outputs:      None                                                    */
+/*                                                                          */
+/*    Returns:      1 if "var" is a variable, 0 if not                      */
+/*                                                                          */
+/*--------------------------------------------------------------------------*/
+
+
+PRIVATE int IsVariable( SYMBOL *var )
+{
+	if ( var == NULL )  return 0;
+
+	return var->type == STYPE_VARIABLE || var->type == STYPE_LOCALVAR ||
+	       var->type == STYPE_VALUEPAR || var->type == STYPE_REFPAR;
+}
+
+
+/*--------------------------------------------------------------------------*/
+/*                                                                          */
+/*  IsRefParameter:  Determines whether parameter "index" of a procedure    */
+/*                   is a REF parameter.                                    */
+/*                                                                          */
+/*    Inputs:       procedure, SYMBOL pointer (may be NULL)                 */
+/*                  index, zero-based parameter number                      */
+/*                                                                          */
+/*    Outputs:      None                                                    */
+/*                                                                          */
+/*    Returns:      1 if the parameter is passed by reference, 0 if not     */
+/*                                                                          */
+/*--------------------------------------------------------------------------*/
+
+
+PRIVATE int IsRefParameter( SYMBOL *procedure, int index )
+{
+	if ( procedure == NULL || procedure->type != STYPE_PROCEDURE ||
+	     index >= procedure->pcount )
+		return 0;
+
+	return ( procedure->ptypes >> index ) & 1;
+}
+
+
+/*--------------------------------------------------------------------------*/
+/*                                                                          */
+/*  LoadFrame:  Emits code to push the frame pointer of the activation of   */
+/*              an enclosing scope, by following static links.              */
+/*                                                                          */
+/*    Inputs:       level, scope level of the frame (less than "scope")     */
+/*                                                                          */
+/*    Outputs:      None                                                    */
+/*                                                                          */
+/*    Returns:      Nothing                                                 */
+/*                                                                          */
+/*--------------------------------------------------------------------------*/
+
+
+PRIVATE void LoadFrame( PARSER *parser, int level )
+{
+	int i;
+
+	Emit( &parser->code, I_LOADFP, FRAME_STATICLINK );
+	for ( i = level; i < parser->scope - 1; i++ )
+		Emit( &parser->code, I_LOADSP, FRAME_STATICLINK );
+}
+
+
+/*--------------------------------------------------------------------------*/
+/*                                                                          */
+/*  LoadVariable:   Emits code to push the value of a variable.             */
+/*  LoadAddress:    Emits code to push the address of a variable (used      */
+/*                  for REF actual parameters).                             */
+/*  StoreVariable:  Emits code to pop the top of stack into a variable.     */
+/*                                                                          */
+/*    Inputs:       var, SYMBOL pointer of a variable (see IsVariable)      */
+/*                                                                          */
+/*    Outputs:      None                                                    */
+/*                                                                          */
+/*    Returns:      Nothing                                                 */
+/*                                                                          */
+/*--------------------------------------------------------------------------*/
+
+
+PRIVATE void LoadVariable( PARSER *parser, SYMBOL *var )
+{
+	switch ( var->type )
+	{
+		case STYPE_VARIABLE :
+			Emit( &parser->code, I_LOADA, var->address );
+			break;
+		case STYPE_REFPAR :
+			LoadAddress( parser, var );
+			_Emit( &parser->code, I_LOADSP );
+			break;
+		default :
+			if ( var->scope == parser->scope )  Emit( &parser->code,
+			                                          I_LOADFP, var->address );
+			else
+			{
+				LoadFrame( parser, var->scope );
+				Emit( &parser->code, I_LOADSP, var->address );
+			}
+			break;
+	}
+}
+
+PRIVATE void LoadAddress( PARSER *parser, SYMBOL *var )
+{
+	switch ( var->type )
+	{
+		case STYPE_VARIABLE :
+			EmitDataAddress( &parser->code, var->address );
+			break;
+		case STYPE_REFPAR :            /* the parameter holds an address    */
+			if ( var->scope == parser->scope )  Emit( &parser->code,
+			                                          I_LOADFP, var->address );
+			else
+			{
+				LoadFrame( parser, var->scope );
+				Emit( &parser->code, I_LOADSP, var->address );
+			}
+			break;
+		default :
+			if ( var->scope == parser->scope )  _Emit( &parser->code, I_PUSHFP );
+			else  LoadFrame( parser, var->scope );
+			Emit( &parser->code, I_LOADI, var->address );
+			_Emit( &parser->code, I_ADD );
+			break;
+	}
+}
+
+PRIVATE void StoreVariable( PARSER *parser, SYMBOL *var )
+{
+	switch ( var->type )
+	{
+		case STYPE_VARIABLE :
+			Emit( &parser->code, I_STOREA, var->address );
+			break;
+		case STYPE_REFPAR :
+			LoadAddress( parser, var );
+			_Emit( &parser->code, I_STORESP );
+			break;
+		default :
+			if ( var->scope == parser->scope )  Emit( &parser->code,
+			                                          I_STOREFP, var->address );
+			else
+			{
+				LoadFrame( parser, var->scope );
+				Emit( &parser->code, I_STORESP, var->address );
+			}
+			break;
+	}
+}
+
+
+/*--------------------------------------------------------------------------*/
+/*                                                                          */
+/*  EmitProcCall:  Emits the call sequence for a procedure whose actual     */
+/*                 parameters have already been pushed: the static link,    */
+/*                 then "Bsf", "Call", "Rsf" and a "Dec" to pop the         */
+/*                 parameters and static link.  A call of the procedure     */
+/*                 currently being compiled is recorded as a tail call      */
+/*                 candidate, unless a REF actual is in the current frame,  */
+/*                 which the new parameters would overwrite (see            */
+/*                 ParseActualParameter).                                   */
+/*                                                                          */
+/*    Inputs:       procedure, SYMBOL pointer of the procedure              */
+/*                  ArgCount, number of actual parameters pushed            */
+/*                                                                          */
+/*    Outputs:      None                                                    */
+/*                                                                          */
+/*    Returns:      Nothing                                                 */
+/*                                                                          */
+/*--------------------------------------------------------------------------*/
+
+
+PRIVATE void EmitProcCall( PARSER *parser, SYMBOL *procedure, int ArgCount )
+{
+	int CallStart;
+
+	if ( ArgCount != procedure->pcount )
+	{
+		SemanticError( parser, DIAG_PARAMETER_COUNT,
+		               "Wrong number of parameters" );
+		KillCodeGeneration( &parser->code );
+	}
+
+	CallStart = CurrentCodeAddress( &parser->code );
+	if ( procedure->scope == 1 || procedure->scope == parser->scope )
+		_Emit( &parser->code, I_PUSHFP );
+	else
+		LoadFrame( parser, procedure->scope );
+	_Emit( &parser->code, I_BSF );
+	Emit( &parser->code, I_CALL, procedure->address );
+	_Emit( &parser->code, I_RSF );
+	Emit( &parser->code, I_DEC, ArgCount + 1 );
+
+	if ( procedure == parser->CurrentProcedure && !parser->FrameRef &&
+	     parser->TailCallCount < MAX_TAIL_CALLS )
+	{
+		parser->TailCalls[parser->TailCallCount].start = CallStart;
+		parser->TailCalls[parser->TailCallCount].end =
+		    CurrentCodeAddress( &parser->code );
+		parser->TailCallCount++;
+	}
+}
+
+
+/*--------------------------------------------------------------------------*/
+/*                                                                          */
+/*  EliminateTailCalls:  Rewrites each self-call of the procedure just      */
+/*                       compiled which is in tail position, i.e., after    */
+/*                       which control can only reach the procedure's       */
+/*                       exit.  The static link push and call sequence is   */
+/*                       replaced by stores of the new actual parameters    */
+/*                       (already on the stack) into the parameter slots,   */
+/*                       followed by a branch back to the start of the      */
+/*                       block.  The frame, and its locals, are reused, so  */
+/*                       the recursion runs in constant stack space.        */
+/*                                                                          */
+/*    Inputs:       BodyAddr, address of the first instruction of the       */
+/*                  block (after the "Inc" reserving locals)                */
+/*                  ExitAddr, address of the procedure's exit code          */
+/*                                                                          */
+/*    Outputs:      None                                                    */
+/*                                                                          */
+/*    Returns:      Nothing                                                 */
+/*                                                                          */
+/*--------------------------------------------------------------------------*/
+
+
+PRIVATE void EliminateTailCalls( PARSER *parser, int BodyAddr, int ExitAddr )
+{
+	int i, j, tail[MAX_TAIL_CALLS];
+
+	if ( parser->CurrentProcedure == NULL )  return;
+
+	/* Decide first, rewriting moves the exit code. */
+	for ( i = 0; i < parser->TailCallCount; i++ )
+		tail[i] = ReachesExit( parser, parser->TailCalls[i].end,
+		                       ExitAddr );
+
+	/* Work backwards so that earlier candidates keep their addresses. */
+	for ( i = parser->TailCallCount - 1; i >= 0; i-- )
+	{
+		if ( !tail[i] )  continue;
+		for ( j = 0; j < parser->CurrentProcedure->pcount; j++ )
+			InsertCode( &parser->code, parser->TailCalls[i].end + j,
+			            I_STOREFP, 
+			            FRAME_STATICLINK - 1 - j );
+		InsertCode( &parser->code, parser->TailCalls[i].end + j, I_BR,
+		            BodyAddr );
+		DeleteCode( &parser->code, parser->TailCalls[i].start,
+		            parser->TailCalls[i].end - parser->TailCalls[i].start );
+	}
+	parser->TailCallCount = 0;
+}
+
+
+/*--------------------------------------------------------------------------*/
+/*                                                                          */
+/*  ReachesExit:  Determines whether execution starting at "codeaddr"       */
+/*                goes straight to the procedure exit, possibly through a   */
+/*                chain of unconditional branches.                          */
+/*                                                                          */
+/*    Inputs:       codeaddr, address to start from                         */
+/*                  ExitAddr, address of the procedure's exit code          */
+/*                                                                          */
+/*    Outputs:      None                                                    */
+/*                                                                          */
+/*    Returns:      1 if the exit is reached, 0 if not                      */
+/*                                                                          */
+/*--------------------------------------------------------------------------*/
+
+
+PRIVATE int ReachesExit( PARSER *parser, int codeaddr, int ExitAddr )
+{
+	int opcode, target, hops;
+
+	for ( hops = 0; hops < MAX_TAIL_CALLS; hops++ )
+	{
+		if ( codeaddr == ExitAddr )  return 1;
+		if ( codeaddr >= CurrentCodeAddress( &parser->code ) )  return 0;
+		GetInstruction( &parser->code, codeaddr, &opcode, &target );
+		if ( opcode != I_BR )  return 0;
+		codeaddr = target;
+	}
+	return 0;
+}
+
+
+/*--------------------------------------------------------------------------*/
+/*                                                                          */
+/*  NewTemporary:  Allocates a compiler temporary in the current scope,     */
+/*                 after its declared variables.  Passed to the optimiser.  */
+/*                                                                          */
+/*    Inputs:       None                                                    */
+/*                                                                          */
+/*    Outputs:      None                                                    */
+/*                                                                          */
+/*    Returns:      Absolute address (main program) or FP offset of the     */
+/*                  temporary                                               */
+/*                                                                          */
+/*--------------------------------------------------------------------------*/
+
+
+PRIVATE int NewTemporary( void *context )
+{
+	PARSER *parser = context;
+
+	if ( parser->scope == 1 )  return parser->VarLctn++;
+	return FRAME_LOCALS + parser->VarLctn++;
+}
+
+
+/*--------------------------------------------------------------------------*/
+/*                                                                          */
+/*  FinishFrame:  Patches the size of the current scope's variables and     */
+/*                temporaries into its placeholder "Inc" and "Dec", or      */
+/*                removes them if there are none.                           */
+/*                                                                          */
+/*    Inputs:       IncAddr, address of the placeholder "Inc"               */
+/*                  DecAddr, address of the placeholder "Dec", -1 for the   */
+/*                  main program                                            */
+/*                                                                          */
+/*    Outputs:      None                                                    */
+/*                                                                          */
+/*    Returns:      Nothing                                                 */
+/*                                                                          */
+/*--------------------------------------------------------------------------*/
+
+
+PRIVATE void FinishFrame( PARSER *parser, int IncAddr, int DecAddr )
+{
+	if ( parser->VarLctn > 0 )
+	{
+		BackPatch( &parser->code, IncAddr, parser->VarLctn );
+		if ( DecAddr >= 0 )  BackPatch( &parser->code, DecAddr,
+		                                parser->VarLctn );
+	}
+	else
+	{
+		if ( DecAddr >= 0 )  DeleteCode( &parser->code, DecAddr, 1 );
+		DeleteCode( &parser->code, IncAddr, 1 );
+	}
+}
+
+
+/*--------------------------------------------------------------------------*/
+/*                                                                          */
+/*  ReportStackDepth:  Finds the maximum depth of the operand stack in a    */
+/*                     procedure or main program body, above its local      */
+/*                     variables, so that a machine can size its stack.     */
+/*                     When KeepDepths is set the line is added to Depths,  */
+/*                     for StoreProcedure, and to be printed at the end of  */
+/*                     a valid run (see SetCompilerStackDepths).            */
+/*                                                                          */
+/*    Inputs:       sym, the procedure or program (may be NULL after a      */
+/*                  syntax error)                                           */
+/*                  start, end, the range of code addresses of the body     */
+/*                                                                          */
+/*    Outputs:      None                                                    */
+/*                                                                          */
+/*    Returns:      Nothing                                                 */
+/*                                                                          */
+/*--------------------------------------------------------------------------*/
+
+
+PRIVATE void ReportStackDepth( PARSER *parser, SYMBOL *sym, int start, int end )
+{
+	char *name = sym != NULL ? sym->s : "?";
+	int depth;
+
+	if ( !parser->KeepDepths )  return;
+	depth = MaxStackDepth( &parser->code, start, end );
+	if ( ReserveDepths( parser, snprintf( NULL, 0, DEPTH_LINE, name, depth ) ) )
+		parser->DepthsLength += sprintf( parser->Depths + parser->DepthsLength,
+		                                 DEPTH_LINE, name, depth );
+}
+
+
+/*--------------------------------------------------------------------------*/
+/*                                                                          */
+/*  CanReuse:  Whether procedures may be reused or stored as fragments at   */
+/*             this point of the run: the source must be in memory and no   */
+/*             error has been found yet.                                    */
+/*                                                                          */
+/*    Inputs:       None                                                    */
+/*                                                                          */
+/*    Outputs:      None                                                    */
+/*                                                                          */
+/*    Returns:      1 if so, 0 if not                                       */
+/*                                                                          */
+/*--------------------------------------------------------------------------*/
+
+PRIVATE int CanReuse( PARSER *parser )
+{
+    return parser->Source != NULL &&
+           !parser->FlagError && !parser->code.ErrorsInProgram &&
+           ErrorsReported( &parser->scanner.chars ) == 0;
+}
+
+
+/*--------------------------------------------------------------------------*/
+/*                                                                          */
+/*  ReuseProcedure:  Called with the lookahead on a procedure's name, just  */
+/*                   entered in the symbol table.  If the source from here  */
+/*                   on starts with the text of a fragment of the same      */
+/*                   procedure at the same scope, and every declaration     */
+/*                   outside it which the fragment looked up is unchanged,  */
+/*                   the fragment's code is placed and its text skipped,    */
+/*                   leaving the parser as ParseProcDeclaration would.      */
+/*                   Its stack depths are kept again, so a fragment         */
+/*                   stored without them is not used when keeping them.     */
+/*                                                                          */
+/*    Inputs:       procedure, the SYMBOL just entered                      */
+/*                                                                          */
+/*    Outputs:      None                                                    */
+/*                                                                          */
+/*    Returns:      1 if the procedure was reused, 0 if it must be parsed   */
+/*                                                                          */
+/*    Side Effects: On reuse, lookahead advanced past the declaration.      */
+/*                                                                          */
+/*--------------------------------------------------------------------------*/
+
+PRIVATE int ReuseProcedure( PARSER *parser, SYMBOL *procedure )
+{
+    CHARPROCESSOR *chars = &parser->scanner.chars;
+    FRAGMENT *fragment;
+    FRAGMENTREF *ref;
+    SYMBOL *sym[FRAGMENT_MAX_REFS];
+    int addresses[FRAGMENT_MAX_REFS];
+    int base, i;
+    long offset, end;
+
+    if ( !CanReuse( parser ) || parser->CurrentToken.code != IDENTIFIER )
+        return 0;
+    offset = CurrentCharOffset( chars );
+    if ( offset > (long) parser->SourceLength )  return 0;
+    fragment = FindFragment( &parser->fragments, procedure->s, parser->scope,
+                             parser->Source + offset,
+                             parser->SourceLength - offset );
+    if ( fragment == NULL ||
+         ( parser->KeepDepths && fragment->depths == NULL ) )
+        return 0;
+
+    for ( i = 0; i < fragment->RefCount; i++ )
+    {
+        ref = &fragment->refs[i];
+        sym[i] = Probe( &parser->symbols, ref->name, NULL );
+        if ( sym[i] == NULL || sym[i]->scope != ref->scope ||
+             sym[i]->type != ref->type || sym[i]->pcount != ref->pcount ||
+             sym[i]->ptypes != ref->ptypes ||
+             ( ref->type != STYPE_PROCEDURE &&
+               sym[i]->address != ref->address ) )
+            return 0;
+        addresses[i] = sym[i]->address;
+    }
+
+    base = CurrentCodeAddress( &parser->code );
+    if ( !PlaceFragment( &parser->code, fragment, addresses ) )  return 0;
+    procedure->address = base + fragment->entry;
+    procedure->pcount = fragment->pcount;
+    procedure->ptypes = fragment->ptypes;
+    parser->CseRemoved += fragment->CseRemoved;
+    if ( parser->KeepDepths &&
+         ReserveDepths( parser, strlen( fragment->depths ) ) )
+    {
+        strcpy( parser->Depths + parser->DepthsLength, fragment->depths );
+        parser->DepthsLength += strlen( fragment->depths );
+    }
+
+    /*  An enclosing procedure being stored depends on what this one       */
+    /*  looked up, as if it had been parsed.                               */
+
+    for ( i = 0; i < fragment->RefCount; i++ )
+        NoteReference( parser, sym[i] );
+
+    /*  Read the text through the closing ";", which still has to be       */
+    /*  listed, and the token after it.  The pipeline has already read     */
+    /*  the text as tokens.                                                */
+
+    end = offset + (long) fragment->length;
+    if ( parser->Pipe != NULL )
+        while ( CurrentCharOffset( chars ) < end &&
+                PipelineToken( parser->Pipe ).code != ENDOFINPUT )
+            ;
+    else
+        while ( CurrentCharOffset( chars ) < end && ReadChar( chars ) != EOF )
+            ;
+    parser->CurrentToken = NextToken( parser );
+    return 1;
+}
+
+
+/*--------------------------------------------------------------------------*/
+/*                                                                          */
+/*  MarkProcedure:  Records where a procedure declaration starts, with the  */
+/*                  lookahead on its name, for StoreProcedure.              */
+/*                                                                          */
+/*    Inputs:       None                                                    */
+/*                                                                          */
+/*    Outputs:      *mark                                                   */
+/*                                                                          */
+/*    Returns:      Nothing                                                 */
+/*                                                                          */
+/*--------------------------------------------------------------------------*/
+
+PRIVATE void MarkProcedure( PARSER *parser, FRAGMENTMARK *mark )
+{
+    mark->offset = CurrentCharOffset( &parser->scanner.chars );
+    mark->scope = parser->scope;
+    mark->code = CurrentCodeAddress( &parser->code );
+    mark->references = parser->ReferenceCount;
+    mark->errors = ErrorsReported( &parser->scanner.chars );
+    mark->CseRemoved = parser->CseRemoved;
+    mark->depths = parser->DepthsLength;
+}
+
+
+/*--------------------------------------------------------------------------*/
+/*                                                                          */
+/*  StoreProcedure:  Saves the code of a procedure just compiled as a       */
+/*                   fragment, with the lookahead on its closing ";".       */
+/*                   Nothing is stored if an error has been found.  The     */
+/*                   fragment's refs are the declarations looked up since   */
+/*                   the procedure began which belong to its surroundings,  */
+/*                   i.e., are at its own scope or outside, less itself.    */
+/*                                                                          */
+/*    Inputs:       procedure, its SYMBOL                                   */
+/*                  mark, from MarkProcedure                                */
+/*                                                                          */
+/*    Outputs:      None                                                    */
+/*                                                                          */
+/*    Returns:      Nothing                                                 */
+/*                                                                          */
+/*--------------------------------------------------------------------------*/
+
+PRIVATE void StoreProcedure( PARSER *parser, SYMBOL *procedure,
+                             FRAGMENTMARK *mark )
+{
+    FRAGMENTREF refs[FRAGMENT_MAX_REFS], *ref;
+    FRAGMENT proto;
+    int count = 0, i, j;
+
+    if ( !CanReuse( parser ) || parser->CurrentToken.code != SEMICOLON )
+        return;
+
+    for ( i = mark->references; i < parser->ReferenceCount; i++ )
+    {
+        ref = &parser->References[i];
+        if ( ref->scope > mark->scope ||
+             ( ref->scope == mark->scope && ref->type == STYPE_PROCEDURE &&
+               strcmp( ref->name, procedure->s ) == 0 ) )
+            continue;
+        for ( j = 0; j < count; j++ )
+            if ( refs[j].scope == ref->scope &&
+                 strcmp( refs[j].name, ref->name ) == 0 )  break;
+        if ( j < count )  continue;
+        if ( count == FRAGMENT_MAX_REFS )  return;
+        refs[count++] = *ref;
+    }
+
+    proto.name = procedure->s;
+    proto.scope = mark->scope;
+    proto.text = parser->Source + mark->offset;
+    proto.length = CurrentCharOffset( &parser->scanner.chars ) - mark->offset;
+    proto.entry = procedure->address - mark->code;
+    proto.pcount = procedure->pcount;
+    proto.ptypes = procedure->ptypes;
+    proto.CseRemoved = parser->CseRemoved - mark->CseRemoved;
+    proto.depths = parser->KeepDepths && parser->Depths != NULL ?
+                   parser->Depths + mark->depths : NULL;
+    proto.refs = refs;
+    proto.RefCount = count;
+    StoreFragment( &parser->fragments, &proto, &parser->code, mark->code,
+                   CurrentCodeAddress( &parser->code ) );
+}
+
+
+/*--------------------------------------------------------------------------*/
+/*                                                                          */
+/*  NoteReference:  Adds a declaration found by LookupSymbol to the run's   */
+/*                  References, as it is now.  A reference which cannot be  */
+/*                  recorded for lack of memory turns reuse off for the     */
+/*                  rest of the run, since a fragment missing it could be   */
+/*                  wrongly reused.                                         */
+/*                                                                          */
+/*    Inputs:       sym, the declaration                                    */
+/*                                                                          */
+/*    Outputs:      None                                                    */
+/*                                                                          */
+/*    Returns:      Nothing                                                 */
+/*                                                                          */
+/*--------------------------------------------------------------------------*/
+
+PRIVATE void NoteReference( PARSER *parser, SYMBOL *sym )
+{
+    FRAGMENTREF *ref, *bigger;
+    int size;
+
+    if ( parser->ReferenceCount == parser->ReferenceSpace )
+    {
+        size = parser->ReferenceSpace ? 2 * parser->ReferenceSpace : 64;
+        if ( NULL == ( bigger = realloc( parser->References,
+                                         size * sizeof( FRAGMENTREF ) ) ) )
+        {
+            parser->Source = NULL;
+            return;
+        }
+        parser->References = bigger;
+        parser->ReferenceSpace = size;
+    }
+    ref = &parser->References[parser->ReferenceCount++];
+    ref->name = sym->s;
+    ref->type = sym->type;
+    ref->scope = sym->scope;
+    ref->address = sym->address;
+    ref->pcount = sym->pcount;
+    ref->ptypes = sym->ptypes;
+}
+
+
+/*--------------------------------------------------------------------------*/
+/*                                                                          */
+/*  NoteLinkage:  Records a global variable or outermost procedure for the  */
+/*                symbol table of an object file.                           */
+/*                                                                          */
+/*    Inputs:       sym, the declaration                                    */
+/*                                                                          */
+/*    Outputs:      None                                                    */
+/*                                                                          */
+/*    Returns:      Nothing                                                 */
+/*                                                                          */
+/*--------------------------------------------------------------------------*/
+
+PRIVATE void NoteLinkage( PARSER *parser, SYMBOL *sym )
+{
+    SYMBOL **bigger;
+    int size;
+
+    if ( parser->LinkageCount == parser->LinkageSpace )
+    {
+        size = parser->LinkageSpace ? 2 * parser->LinkageSpace : 64;
+        if ( NULL == ( bigger = realloc( parser->Linkage,
+                                         size * sizeof( SYMBOL * ) ) ) )
+        {
+            fprintf( stderr, "Fatal error, cannot allocate symbols of the "
+                             "object file\n" );
+            KillCodeGeneration( &parser->code );
+            return;
+        }
+        parser->Linkage = bigger;
+        parser->LinkageSpace = size;
+    }
+    parser->Linkage[parser->LinkageCount++] = sym;
+}
+
+
+/*--------------------------------------------------------------------------*/
+/*                                                                          */
+/*  DeclareExternal:  Makes a procedure declared EXTERNAL the next import   */
+/*                    of the object file, numbered from 0.  Its calls are   */
+/*                    "Call"s of address -1-n until cpllink resolves them   */
+/*                    (see object.c).  Only an outermost procedure can be   */
+/*                    EXTERNAL, and only in an object file.                 */
+/*                                                                          */
+/*    Inputs:       procedure, its SYMBOL (may be NULL)                     */
+/*                                                                          */
+/*    Outputs:      None                                                    */
+/*                                                                          */
+/*    Returns:      Nothing                                                 */
+/*                                                                          */
+/*--------------------------------------------------------------------------*/
+
+PRIVATE void DeclareExternal( PARSER *parser, SYMBOL *procedure )
+{
+    if ( !parser->Object )
+    {
+        SemanticError( parser, DIAG_EXTERNAL,
+                       "EXTERNAL needs separate compilation (--object)" );
+        KillCodeGeneration( &parser->code );
+    }
+    else if ( parser->scope != 2 )
+    {
+        SemanticError( parser, DIAG_EXTERNAL,
+                       "Only outermost procedures can be EXTERNAL" );
+        KillCodeGeneration( &parser->code );
+    }
+    else if ( procedure != NULL )
+        procedure->address = -1 - parser->ImportCount++;
+}
+
+
+/*--------------------------------------------------------------------------*/
+/*                                                                          */
+/*  ReserveDepths:  Makes room in Depths for n more characters and a null.  */
+/*                  If memory runs out reuse is turned off for the rest of  */
+/*                  the run, as in NoteReference, since a fragment must     */
+/*                  not be stored without its lines.                        */
+/*                                                                          */
+/*    Inputs:       n, the number of characters to be added                 */
+/*                                                                          */
+/*    Outputs:      None                                                    */
+/*                                                                          */
+/*    Returns:      1 if there is room, 0 if not                            */
+/*                                                                          */
+/*--------------------------------------------------------------------------*/
+
+PRIVATE int ReserveDepths( PARSER *parser, size_t n )
+{
+    char *bigger;
+    size_t size = parser->DepthsSpace;
+
+    if ( parser->DepthsLength + n + 1 <= size )  return 1;
+    while ( size < parser->DepthsLength + n + 1 )  size = size ? 2 * size : 256;
+    if ( NULL == ( bigger = realloc( parser->Depths, size ) ) )
+    {
+        parser->Source = NULL;
+        parser->KeepDepths = 0;
+        return 0;
+    }
+    parser->Depths = bigger;
+    parser->DepthsSpace = size;
+    return 1;
+}
+
+
+/*--------------------------------------------------------------------------*/
+/*                                                                          */
+/*  CompileProcedures:  Called at the start of a run whose source is in     */
+/*                      memory, before the first token is read.  Outlines   */
+/*                      the program, then compiles each outermost           */
+/*                      procedure on a pool of worker threads, the calling  */
+/*                      thread among them.  Each worker has a COMPILER of   */
+/*                      its own, and moves the fragment of each procedure   */
+/*                      it compiles into the run's fragment cache, where    */
+/*                      ReuseProcedure finds it as the program is parsed.   */
+/*                                                                          */
+/*                      Nothing here is trusted: ReuseProcedure checks      */
+/*                      every declaration a fragment looked up against the  */
+/*                      real one, and parses the procedure itself if the    */
+/*                      outline was wrong or the worker found an error.     */
+/*                                                                          */
+/*    Inputs:       None                                                    */
+/*                                                                          */
+/*    Outputs:      None                                                    */
+/*                                                                          */
+/*    Returns:      Nothing                                                 */
+/*                                                                          */
+/*--------------------------------------------------------------------------*/
+
+PRIVATE void CompileProcedures( PARSER *parser )
+{
+    PROCEDUREPOOL pool;
+    pthread_t tids[MAX_THREADS];
+    int started[MAX_THREADS];
+    PARSER *skim;
+    FILE *InputFile;
+    int i, threads, procedures;
+
+    if ( NULL == ( skim = NewCompiler() ) )  return;
+    pool.parser = parser;
+    pool.next = 0;
+    pool.count = 0;
+    pool.outline = NULL;
+    if ( NULL != ( InputFile = fmemopen( parser->Source,
+                                         parser->SourceLength, "r" ) ) )
+    {
+        ArmTrap( &skim->Trap );
+        if ( setjmp( skim->Trap.env ) == 0 )
+            pool.count = OutlineProgram( skim, InputFile, &pool.outline );
+        DisarmTrap( &skim->Trap );
+        fclose( InputFile );
+    }
+    procedures = 0;
+    for ( i = 0; i < pool.count; i++ )
+        if ( pool.outline[i].type == STYPE_PROCEDURE )  procedures++;
+
+    threads = parser->Threads < procedures ? parser->Threads : procedures;
+    if ( threads > 1 )
+    {
+        pthread_mutex_init( &pool.lock, NULL );
+        for ( i = 1; i < threads; i++ )
+            started[i] = !pthread_create( &tids[i], NULL, ProcedureWorker,
+                                          &pool );
+        ProcedureWorker( &pool );
+        for ( i = 1; i < threads; i++ )
+            if ( started[i] )  pthread_join( tids[i], NULL );
+        pthread_mutex_destroy( &pool.lock );
+    }
+    free( pool.outline );
+    FreeCompiler( skim );
+}
+
+
+/*--------------------------------------------------------------------------*/
+/*                                                                          */
+/*  OutlineProgram:  Finds the name, global variables and outermost         */
+/*                   procedures of a program with a skim through its        */
+/*                   tokens, which only looks at the headings of the        */
+/*                   procedures and skips their bodies by counting          */
+/*                   "BEGIN"s and "END"s.  It stops at the main program's   */
+/*                   block, or at anything unexpected, in which case the    */
+/*                   outline is just shorter.  A fatal error, such as       */
+/*                   running out of memory, springs the skim's trap.        */
+/*                                                                          */
+/*    Inputs:       skim, a spare PARSER, which holds the names until it    */
+/*                  is freed or reused                                      */
+/*                  inputfile, the program text                             */
+/*                                                                          */
+/*    Outputs:      *outline, a malloc'd array of the entries (NULL if      */
+/*                  there are none), in the order they are declared         */
+/*                                                                          */
+/*    Returns:      The number of entries                                   */
+/*                                                                          */
+/*--------------------------------------------------------------------------*/
+
+PRIVATE int OutlineProgram( PARSER *skim, FILE *inputfile,
+                            OUTLINE **outline )
+{
+    OUTLINE *entry;
+    int count = 0, space = 0, address = 0, procedures = 0;
+    int n, pending, depth;
+    long start;
+
+    *outline = NULL;
+    StartRun( skim, inputfile, NULL, 0, NULL, NULL, NULL, NULL );
+
+    SkimToken( skim );
+    if ( skim->CurrentToken.code != PROGRAM )  goto done;
+    SkimToken( skim );
+    if ( skim->CurrentToken.code != IDENTIFIER ||
+         NULL == ( entry = AddOutline( outline, &count, &space ) ) )
+        goto done;
+    PreserveString( &skim->scanner.strings );
+    entry->name = skim->CurrentToken.s;
+    entry->type = STYPE_PROGRAM;
+    entry->address = -1;
+    SkimToken( skim );
+    if ( skim->CurrentToken.code != SEMICOLON )  goto done;
+    start = SkimToken( skim );
+
+    if ( skim->CurrentToken.code == VAR )
+    {
+        do
+        {
+            SkimToken( skim );
+            if ( skim->CurrentToken.code != IDENTIFIER ||
+                 NULL == ( entry = AddOutline( outline, &count, &space ) ) )
+                goto done;
+            PreserveString( &skim->scanner.strings );
+            entry->name = skim->CurrentToken.s;
+            entry->type = STYPE_VARIABLE;
+            entry->address = address++;
+            SkimToken( skim );
+        }
+        while ( skim->CurrentToken.code == COMMA );
+        if ( skim->CurrentToken.code != SEMICOLON )  goto done;
+        start = SkimToken( skim );
+    }
+
+    while ( skim->CurrentToken.code == PROCEDURE )
+    {
+        SkimToken( skim );
+        if ( skim->CurrentToken.code != IDENTIFIER ||
+             NULL == ( entry = AddOutline( outline, &count, &space ) ) )
+            goto done;
+        PreserveString( &skim->scanner.strings );
+        entry->name = skim->CurrentToken.s;
+        entry->type = STYPE_PROCEDURE;
+        entry->address = -2 - procedures++;
+        entry->start = start;
+        SkimToken( skim );
+        if ( skim->CurrentToken.code == LEFTPARENTHESIS )
+        {
+            do
+            {
+                SkimToken( skim );
+                if ( skim->CurrentToken.code == REF )
+                {
+                    if ( entry->pcount < MAX_PARAMETERS )
+                        entry->ptypes |= 1 << entry->pcount;
+                    SkimToken( skim );
+                }
+                if ( skim->CurrentToken.code != IDENTIFIER )  break;
+                entry->pcount++;
+                SkimToken( skim );
+            }
+            while ( skim->CurrentToken.code == COMMA );
+            if ( skim->CurrentToken.code != RIGHTPARENTHESIS )  break;
+            SkimToken( skim );
+        }
+        if ( skim->CurrentToken.code != SEMICOLON ||
+             entry->pcount > MAX_PARAMETERS )
+            break;
+
+        /*  Each "PROCEDURE" from here on, nested or not, owes one block,  */
+        /*  which ends when its "END" brings the depth back to 0.          */
+
+        for ( pending = 1, depth = 0; pending > 0; )
+        {
+            SkimToken( skim );
+            n = skim->CurrentToken.code;
+            if ( n == ENDOFINPUT || n == EXTERNAL )  break;
+            if ( n == PROCEDURE )  pending++;
+            else if ( n == BEGIN )  depth++;
+            else if ( n == END && --depth == 0 )  pending--;
+        }
+        SkimToken( skim );
+        if ( pending > 0 || skim->CurrentToken.code != SEMICOLON )  break;
+        entry->end = CurrentCharOffset( &skim->scanner.chars );
+        start = SkimToken( skim );
+    }
+
+done:
+    /*  A procedure whose end was not found is dropped.                    */
+
+    if ( count > 0 && ( *outline )[count-1].type == STYPE_PROCEDURE &&
+         ( *outline )[count-1].end <= ( *outline )[count-1].start )
+        count--;
+    return count;
+}
+
+
+/*--------------------------------------------------------------------------*/
+/*                                                                          */
+/*  SkimToken:  Reads the next token for OutlineProgram.                    */
+/*                                                                          */
+/*    Inputs:       None                                                    */
+/*                                                                          */
+/*    Outputs:      None                                                    */
+/*                                                                          */
+/*    Returns:      The source offset just after the previous token         */
+/*                                                                          */
+/*    Side Effects: Lookahead token advanced.                               */
+/*                                                                          */
+/*--------------------------------------------------------------------------*/
+
+PRIVATE long SkimToken( PARSER *skim )
+{
+    long offset = CurrentCharOffset( &skim->scanner.chars );
+
+    skim->CurrentToken = GetToken( &skim->scanner );
+    return offset;
+}
+
+
+/*--------------------------------------------------------------------------*/
+/*                                                                          */
+/*  AddOutline:  Appends a zeroed entry to an outline, growing it as        */
+/*               needed.                                                    */
+/*                                                                          */
+/*    Inputs:       outline, count and space, the array, its entries and    */
+/*                  its allocated size, all updated                         */
+/*                                                                          */
+/*    Outputs:      None                                                    */
+/*                                                                          */
+/*    Returns:      The new entry, or NULL if out of memory                 */
+/*                                                                          */
+/*--------------------------------------------------------------------------*/
+
+PRIVATE OUTLINE *AddOutline( OUTLINE **outline, int *count, int *space )
+{
+    OUTLINE *bigger;
+    int size;
+
+    if ( *count == *space )
+    {
+        size = *space ? 2 * *space : 64;
+        if ( NULL == ( bigger = realloc( *outline,
+                                         size * sizeof( OUTLINE ) ) ) )
+            return NULL;
+        *outline = bigger;
+        *space = size;
+    }
+    memset( &( *outline )[*count], 0, sizeof( OUTLINE ) );
+    return &( *outline )[( *count )++];
+}
+
+
+/*--------------------------------------------------------------------------*/
+/*                                                                          */
+/*  ProcedureWorker:  One thread of CompileProcedures.  Takes the outlined  */
+/*                    procedures one at a time, in order, until none are    */
+/*                    left.                                                 */
+/*                                                                          */
+/*    Inputs:       arg, the PROCEDUREPOOL                                  */
+/*                                                                          */
+/*    Outputs:      None                                                    */
+/*                                                                          */
+/*    Returns:      NULL                                                    */
+/*                                                                          */
+/*--------------------------------------------------------------------------*/
+
+PRIVATE void *ProcedureWorker( void *arg )
+{
+    PROCEDUREPOOL *pool = arg;
+    PARSER *worker;
+    int index;
+
+    if ( NULL == ( worker = NewCompiler() ) )  return NULL;
+    worker->Tracer = pool->parser->Tracer;
+    for ( ;; )
+    {
+        pthread_mutex_lock( &pool->lock );
+        while ( pool->next < pool->count &&
+                pool->outline[pool->next].type != STYPE_PROCEDURE )
+            pool->next++;
+        index = pool->next < pool->count ? pool->next++ : -1;
+        pthread_mutex_unlock( &pool->lock );
+        if ( index < 0 )  break;
+
+        CompileOutlined( worker, pool, index );
+
+        pthread_mutex_lock( &pool->lock );
+        MoveFragments( &pool->parser->fragments, &worker->fragments );
+        pthread_mutex_unlock( &pool->lock );
+    }
+    FreeCompiler( worker );
+    return NULL;
+}
+
+
+/*--------------------------------------------------------------------------*/
+/*                                                                          */
+/*  CompileOutlined:  Compiles one outlined procedure declaration on its    */
+/*                    own, with the declarations before it in the outline   */
+/*                    entered at scope 1, leaving its fragment (if it had   */
+/*                    no errors) in the worker's fragment cache.  Nothing   */
+/*                    is listed or reported, and a fatal error only means   */
+/*                    the procedure is left to the parser.                  */
+/*                                                                          */
+/*    Inputs:       worker, the thread's PARSER                             */
+/*                  pool, the outline and the PARSER of the run             */
+/*                  index, the procedure's outline entry                    */
+/*                                                                          */
+/*    Outputs:      None                                                    */
+/*                                                                          */
+/*    Returns:      Nothing                                                 */
+/*                                                                          */
+/*--------------------------------------------------------------------------*/
+
+PRIVATE void CompileOutlined( PARSER *worker, PROCEDUREPOOL *pool, int index )
+{
+    OUTLINE *procedure = &pool->outline[index];
+    char *text = pool->parser->Source + procedure->start;
+    size_t length = procedure->end - procedure->start;
+    FILE *InputFile;
+    int i;
+
+    if ( NULL == ( InputFile = fmemopen( text, length, "r" ) ) )  return;
+    StartRun( worker, InputFile, text, length, NULL, NULL, NULL, NULL );
+    worker->KeepDepths = pool->parser->KeepDepths;
+    ArmTrap( &worker->Trap );
+    if ( setjmp( worker->Trap.env ) == 0 )
+    {
+        for ( i = 0; i < index; i++ )
+            DeclareOutline( worker, &pool->outline[i] );
+
+        worker->CurrentToken = GetToken( &worker->scanner );
+        if ( worker->CurrentToken.code == PROCEDURE )
+            ParseProcDeclaration( worker );
+    }
+    DisarmTrap( &worker->Trap );
+    fclose( InputFile );
+}
+
+
+/*--------------------------------------------------------------------------*/
+/*                                                                          */
+/*  DeclareOutline:  Enters an outline entry in a worker's symbol table at  */
+/*                   scope 1, as MakeSymbolTableEntry would have.  A name   */
+/*                   already declared is left alone; the program has an     */
+/*                   error which the worker cannot see.                     */
+/*                                                                          */
+/*    Inputs:       entry, the outline entry                                */
+/*                                                                          */
+/*    Outputs:      None                                                    */
+/*                                                                          */
+/*    Returns:      Nothing                                                 */
+/*                                                                          */
+/*--------------------------------------------------------------------------*/
+
+PRIVATE void DeclareOutline( PARSER *worker, OUTLINE *entry )
+{
+    SYMBOL *sym;
+    int hashindex;
+
+    if ( Probe( &worker->symbols, entry->name, &hashindex ) != NULL ||
+         NULL == ( sym = EnterSymbol( &worker->symbols, entry->name,
+                                      hashindex ) ) )
+        return;
+    sym->scope = 1;
+    sym->type = entry->type;
+    sym->address = entry->address;
+    if ( entry->type == STYPE_PROCEDURE )
+    {
+        sym->pcount = entry->pcount;
+        sym->ptypes = entry->ptypes;
+    }
+    else if ( entry->type == STYPE_VARIABLE )
+        worker->VarLctn = entry->address + 1;
+}
+
+
+/*--------------------------------------------------------------------------*/
+/*                                                                          */
+/*  CompileFile: Compiles a program from a file with a COMPILER which has   */
+/*               been set up, echoing error messages to stderr.  When the   */
+/*               settings need the program in memory, i.e., with more than  */
+/*               one thread (see SetCompilerThreads) or lexer (see          */
+/*               SetCompilerLexers), it is read in and given to             */
+/*               CompileText, otherwise the file is given to RunCompiler.   */
+/*                                                                          */
+/*    Inputs:       compiler, from NewCompiler                              */
+/*                  inputfile, listfile, codefile and reportfile, as for    */
+/*                  RunCompiler                                             */
+/*                                                                          */
+/*    Outputs:      None.  The files are written but not closed.            */
+/*                                                                          */
+/*    Returns:      1 if the program was free of errors, 0 otherwise        */
+/*                                                                          */
+/*--------------------------------------------------------------------------*/
+
+PRIVATE int CompileFile( COMPILER *compiler, FILE *inputfile,
+                         FILE *listfile, FILE *codefile, FILE *reportfile )
+{
+    char *source;
+    size_t length;
+    int valid;
+
+    if ( compiler->Threads == 1 &&
+         ( !compiler->Pipelined || compiler->Lexers == 1 ) )
+        return RunCompiler( compiler, inputfile, listfile, codefile, stderr,
+                            reportfile );
+    if ( !ReadSource( inputfile, &source, &length ) )
+    {
+        fprintf( stderr, "Fatal error, cannot read the program into memory\n" );
+        return 0;
+    }
+    valid = CompileText( compiler, source, length, listfile, codefile, stderr,
+                         reportfile );
+    free( source );
+    return valid;
+}
+
+/*--------------------------------------------------------------------------*/
+/*                                                                          */
+/*  ReadSource:  Reads the rest of a file into a malloc'd buffer.           */
+/*                                                                          */
+/*    Inputs:       inputfile, open for reading                             */
+/*                                                                          */
+/*    Outputs:      *source and *length, the text, not null terminated      */
+/*                                                                          */
+/*    Returns:      1 if successful, 0 if out of memory                     */
+/*                                                                          */
+/*--------------------------------------------------------------------------*/
+
+PRIVATE int ReadSource( FILE *inputfile, char **source, size_t *length )
+{
+    char *buffer = NULL, *bigger;
+    size_t size = 0, used = 0, n;
+
+    do
+    {
+        if ( used == size )
+        {
+            size = size ? 2 * size : 4096;
+            if ( NULL == ( bigger = realloc( buffer, size ) ) )
+            {
+                free( buffer );
+                return 0;
+            }
+            buffer = bigger;
+        }
+        n = fread( buffer + used, 1, size - used, inputfile );
+        used += n;
+    }
+    while ( n > 0 );
+
+    *source = buffer;
+    *length = used;
+    return 1;
+}
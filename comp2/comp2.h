@@ -0,0 +1,79 @@
+#ifndef  COMP2HEADER
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      comp2.h                                                              */
+/*                                                                           */
+/*      Header file for "comp2.c", containing the function prototypes of     */
+/*      the compiler's entry points for programs which compile CPL           */
+/*      themselves.                                                          */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+#define  COMP2HEADER
+
+#include <stdio.h>
+#include "global.h"
+#include "diagnose.h"
+#include "timing.h"
+#include "symbol.h"
+#include "trace.h"
+
+typedef struct parser COMPILER;     /*  Opaque, see NewCompiler.         */
+
+typedef struct  {                   /*  One error found by CompileString.   */
+    int  line;                      /*  Source line, from 1.                */
+    int  column;                    /*  Position in the line, from 1.       */
+    char *message;
+}
+    DIAGNOSTIC;
+
+typedef struct  {                   /*  Everything CompileString returns.   */
+    int  valid;                     /*  1 if no errors were found.          */
+    char *code;                     /*  Machine code, null terminated.      */
+    size_t CodeLength;
+    char *listing;                  /*  Listing, NULL unless asked for.     */
+    size_t ListLength;
+    DIAGNOSTIC *diagnostics;        /*  The errors, in the order found.     */
+    int  DiagnosticCount;
+    int  DiagnosticSpace;           /*  Allocated size of diagnostics[].    */
+}
+    COMPILATION;
+
+PUBLIC int    Compile( FILE *inputfile, FILE *listfile, FILE *codefile,
+                       FILE *reportfile );
+PUBLIC int    CompileObject( FILE *inputfile, FILE *listfile,
+                             FILE *objectfile, FILE *reportfile );
+PUBLIC int    CompileParallel( FILE *inputfile, FILE *listfile,
+                               FILE *codefile, FILE *reportfile,
+                               int threads );
+PUBLIC int    CompilePipelined( FILE *inputfile, FILE *listfile,
+                                FILE *codefile, FILE *reportfile,
+                                int lexers );
+PUBLIC COMPILER *NewCompiler( void );
+PUBLIC void   FreeCompiler( COMPILER *compiler );
+PUBLIC void   SetCompilerThreads( COMPILER *compiler, int threads );
+PUBLIC void   SetCompilerPipeline( COMPILER *compiler, int pipelined );
+PUBLIC void   SetCompilerLexers( COMPILER *compiler, int lexers );
+PUBLIC void   SetCompilerListing( COMPILER *compiler, int listing );
+PUBLIC void   SetCompilerListThread( COMPILER *compiler, int threaded );
+PUBLIC void   SetCompilerObject( COMPILER *compiler, int object );
+PUBLIC void   SetCompilerDiagnostics( COMPILER *compiler, DIAGWRITER *writer,
+                                      char *source );
+PUBLIC void   SetCompilerErrorLimits( COMPILER *compiler, int errors,
+                                      int PerLine );
+PUBLIC void   SetCompilerStackDepths( COMPILER *compiler, int report );
+PUBLIC void   SetCompilerTimer( COMPILER *compiler, PHASETIMER *timer );
+PUBLIC void   SetCompilerSymbolStats( COMPILER *compiler,
+                                      SYMBOLSTATS *stats );
+PUBLIC void   SetCompilerTracer( COMPILER *compiler, TRACER *tracer );
+PUBLIC int    RunCompiler( COMPILER *compiler, FILE *inputfile,
+                           FILE *listfile, FILE *codefile, FILE *errorfile,
+                           FILE *reportfile );
+PUBLIC int    CompileText( COMPILER *compiler, char *source, size_t length,
+                           FILE *listfile, FILE *codefile, FILE *errorfile,
+                           FILE *reportfile );
+PUBLIC int    CompileString( COMPILER *compiler, char *source, size_t length,
+                             int WantListing, COMPILATION *result );
+PUBLIC void   FreeCompilation( COMPILATION *result );
+
+#endif
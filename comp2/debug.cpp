@@ -42,6 +42,7 @@
 #define  DOTOKENSTRING                  "DO"
 #define  ELSETOKENSTRING                "ELSE"
 #define  ENDTOKENSTRING                 "END"
+#define  EXTERNALTOKENSTRING            "EXTERNAL"
 #define  IFTOKENSTRING                  "IF"
 #define  PROCEDURETOKENSTRING           "PROCEDURE"
 #define  PROGRAMTOKENSTRING             "PROGRAM"
@@ -78,9 +79,9 @@ PRIVATE char   *TokenNames[] =  {
             MULTIPLYTOKENSTRING, DIVIDETOKENSTRING, EQUALITYTOKENSTRING,
             LESSEQUALTOKENSTRING, GREATEREQUALTOKENSTRING, LESSTOKENSTRING,
             GREATERTOKENSTRING, BEGINTOKENSTRING, DOTOKENSTRING,
-            ELSETOKENSTRING, ENDTOKENSTRING, IFTOKENSTRING, 
-            PROCEDURETOKENSTRING, PROGRAMTOKENSTRING, READTOKENSTRING,
-            REFTOKENSTRING, THENTOKENSTRING, VARTOKENSTRING, 
+            ELSETOKENSTRING, ENDTOKENSTRING, EXTERNALTOKENSTRING,
+            IFTOKENSTRING, PROCEDURETOKENSTRING, PROGRAMTOKENSTRING,
+            READTOKENSTRING, REFTOKENSTRING, THENTOKENSTRING, VARTOKENSTRING,
             WHILETOKENSTRING, WRITETOKENSTRING, IDENTIFIERTOKENSTRING,
             INTCONSTTOKENSTRING
        };
@@ -0,0 +1,488 @@
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      diagnose.c                                                           */
+/*                                                                           */
+/*      Implementation file for the diagnostics writer, which writes each    */
+/*      error reported by a compilation (see SetReportHandler) in a form     */
+/*      other programs can read without picking apart the messages in the    */
+/*      listing.                                                             */
+/*                                                                           */
+/*      With DIAG_JSONL each error is written as one JSON object on a line   */
+/*      of its own, e.g.,                                                    */
+/*                                                                           */
+/*          {"file":"t.prog","line":7,"column":12,"code":"CPL001",           */
+/*           "rule":"expected-token",                                        */
+/*           "message":"Syntax: Expected ;, got END",                        */
+/*           "expected":[";"],"got":"END"}                                   */
+/*                                                                           */
+/*      so the output of any number of runs may simply be concatenated.      */
+/*      "expected" and "got" are only given for syntax errors. With          */
+/*      DIAG_SARIF the errors are written as the results of a single run in  */
+/*      a SARIF 2.1.0 log, which also describes each rule.                   */
+/*                                                                           */
+/*      The messages of syntax errors are made up here from the tokens, so   */
+/*      the compiler need not format them when nothing else will read them   */
+/*      (see WantsMessage). Each error is made up in the writer's buffer     */
+/*      and written with a single fwrite under the writer's lock, so several */
+/*      compilations may share one writer, and an unbuffered file such as    */
+/*      stderr costs one write per error rather than one per character.      */
+/*                                                                           */
+/*      This module uses POSIX threads, so comp2 must be linked with         */
+/*      -lpthread.                                                           */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "scanner.h"
+#include "diagnose.h"
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      Data Structures for this module                                      */
+/*                                                                           */
+/*      LISTING_PREFIX begins some messages in the listing, where it marks   */
+/*      them as errors; it is left out of the diagnostics, which say so      */
+/*      otherwise.                                                           */
+/*                                                                           */
+/*      "Rules" describes each kind of error, indexed by its DIAG_ code:     */
+/*      the code written for it, its name and a description of it.           */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+#define  LISTING_PREFIX  "Error! "
+
+typedef struct  {
+    char *id;
+    char *name;
+    char *description;
+}
+    RULE;
+
+PRIVATE RULE Rules[DIAG_CODES] =  {
+    { "CPL000", "error", "Error" },
+    { "CPL001", "expected-token", "A particular token was expected" },
+    { "CPL002", "expected-one-of", "One of several tokens was expected" },
+    { "CPL003", "parsing-ends", "Text follows the end of the program" },
+    { "CPL004", "undeclared", "Identifier not declared" },
+    { "CPL005", "redeclared", "Variable already declared" },
+    { "CPL006", "not-procedure", "Called, but not a procedure" },
+    { "CPL007", "not-variable", "Used as a variable, but not one" },
+    { "CPL008", "ref-not-variable", "REF parameter must be a variable" },
+    { "CPL009", "parameter-count", "Wrong number of parameters" },
+    { "CPL010", "too-many-parameters", "Too many parameters" },
+    { "CPL011", "external", "EXTERNAL procedure not allowed here" },
+    { "CPL012", "internal", "The compiler failed" }
+};
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      Function Prototypes for private routines                             */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE void  PutMessage( DIAGWRITER *writer, ERRORREPORT *report );
+PRIVATE void  PutExpected( DIAGWRITER *writer, ERRORREPORT *report );
+PRIVATE void  PutString( DIAGWRITER *writer, char *s );
+PRIVATE void  PutUri( DIAGWRITER *writer, char *path );
+PRIVATE void  PutText( DIAGWRITER *writer, char *s, size_t length );
+PRIVATE void  PutNumber( DIAGWRITER *writer, int n );
+PRIVATE void  PutChars( DIAGWRITER *writer, char *s );
+PRIVATE void  PutChar( DIAGWRITER *writer, int c );
+PRIVATE void  Flush( DIAGWRITER *writer );
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      Public routines (globally accessable).                               */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      StartDiagnostics                                                     */
+/*                                                                           */
+/*      Prepares a writer, and for DIAG_SARIF writes the start of the log.   */
+/*                                                                           */
+/*      Input(s):                                                            */
+/*                                                                           */
+/*          writer     the DIAGWRITER to prepare.                            */
+/*          file       where the diagnostics are written.                    */
+/*          format     DIAG_JSONL or DIAG_SARIF.                             */
+/*          source     the name of the program, for the errors of a          */
+/*                     compilation not given one of its own (see             */
+/*                     SetCompilerDiagnostics).                              */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*      Returns:       Nothing                                               */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PUBLIC void   StartDiagnostics( DIAGWRITER *writer, FILE *file, int format,
+                                char *source )
+{
+    int i;
+
+    writer->file = file;
+    writer->format = format;
+    writer->source = source;
+    writer->count = 0;
+    writer->used = 0;
+    pthread_mutex_init( &writer->lock, NULL );
+    if ( format != DIAG_SARIF )  return;
+
+    PutChars( writer, "{\"version\":\"2.1.0\",\"$schema\":"
+              "\"https://json.schemastore.org/sarif-2.1.0.json\",\n"
+              "\"runs\":[{\"tool\":{\"driver\":{\"name\":\"comp2\","
+              "\"rules\":[" );
+    for ( i = 0; i < DIAG_CODES; i++ )  {
+        PutChars( writer, i == 0 ? "\n{\"id\":" : ",\n{\"id\":" );
+        PutString( writer, Rules[i].id );
+        PutChars( writer, ",\"name\":" );
+        PutString( writer, Rules[i].name );
+        PutChars( writer, ",\"shortDescription\":{\"text\":" );
+        PutString( writer, Rules[i].description );
+        PutChars( writer, "}}" );
+    }
+    PutChars( writer, "]}},\n\"results\":[" );
+    Flush( writer );
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      WriteDiagnostic                                                      */
+/*                                                                           */
+/*      Writes one error.                                                    */
+/*                                                                           */
+/*      Input(s):                                                            */
+/*                                                                           */
+/*          writer     a DIAGWRITER prepared by "StartDiagnostics".          */
+/*          source     the name of the program, or NULL for the writer's.    */
+/*          report     the error, as given to a report handler.              */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*      Returns:       Nothing                                               */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PUBLIC void   WriteDiagnostic( DIAGWRITER *writer, char *source,
+                               ERRORREPORT *report )
+{
+    int code = report->code;
+
+    if ( code < 0 || code >= DIAG_CODES )  code = DIAG_ERROR;
+    if ( source == NULL )  source = writer->source;
+    if ( source == NULL )  source = "";
+
+    pthread_mutex_lock( &writer->lock );
+    if ( writer->format == DIAG_SARIF )  {
+        PutChars( writer, writer->count == 0 ? "\n{\"ruleId\":"
+                                             : ",\n{\"ruleId\":" );
+        PutString( writer, Rules[code].id );
+        PutChars( writer, ",\"level\":\"error\",\"message\":{\"text\":" );
+        PutMessage( writer, report );
+        PutChars( writer, "},\"locations\":[{\"physicalLocation\":"
+                          "{\"artifactLocation\":{\"uri\":" );
+        PutUri( writer, source );
+        PutChars( writer, "},\"region\":{\"startLine\":" );
+        PutNumber( writer, report->line );
+        PutChars( writer, ",\"startColumn\":" );
+        PutNumber( writer, report->column );
+        PutChars( writer, "}}}]" );
+        if ( report->got >= 0 )  {
+            PutChars( writer, ",\"properties\":{" );
+            PutExpected( writer, report );
+            PutChars( writer, "}" );
+        }
+        PutChars( writer, "}" );
+    }
+    else  {
+        PutChars( writer, "{\"file\":" );
+        PutString( writer, source );
+        PutChars( writer, ",\"line\":" );
+        PutNumber( writer, report->line );
+        PutChars( writer, ",\"column\":" );
+        PutNumber( writer, report->column );
+        PutChars( writer, ",\"code\":" );
+        PutString( writer, Rules[code].id );
+        PutChars( writer, ",\"rule\":" );
+        PutString( writer, Rules[code].name );
+        PutChars( writer, ",\"message\":" );
+        PutMessage( writer, report );
+        if ( report->got >= 0 )  {
+            PutChars( writer, "," );
+            PutExpected( writer, report );
+        }
+        PutChars( writer, "}\n" );
+    }
+    Flush( writer );
+    writer->count++;
+    pthread_mutex_unlock( &writer->lock );
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      StopDiagnostics                                                      */
+/*                                                                           */
+/*      Finishes a writer's diagnostics, for DIAG_SARIF by writing the end   */
+/*      of the log, and flushes them. The file is not closed. No more        */
+/*      errors may be written.                                               */
+/*                                                                           */
+/*      Input(s):      writer, a DIAGWRITER prepared by "StartDiagnostics".  */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*      Returns:       Nothing                                               */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PUBLIC void   StopDiagnostics( DIAGWRITER *writer )
+{
+    if ( writer->format == DIAG_SARIF )  PutChars( writer, "]}]}\n" );
+    Flush( writer );
+    fflush( writer->file );
+    pthread_mutex_destroy( &writer->lock );
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      Private routines (only accessable within this module).               */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      PutMessage                                                           */
+/*                                                                           */
+/*      Writes the message of an error as a JSON string. That of a syntax    */
+/*      error is made up from its tokens, listing every token expected, and  */
+/*      an error without a message is described by its rule. A trailing      */
+/*      newline is dropped, and so is LISTING_PREFIX.                        */
+/*                                                                           */
+/*      Input(s):      writer, where it is written.                          */
+/*                     report, the error.                                    */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*      Returns:       Nothing                                               */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE void  PutMessage( DIAGWRITER *writer, ERRORREPORT *report )
+{
+    char *message = report->message, *name;
+    size_t length;
+    int i, first = 1;
+
+    if ( report->code == DIAG_EXPECTED ||
+         report->code == DIAG_EXPECTED_ONE_OF )  {
+        PutChars( writer, report->code == DIAG_EXPECTED
+                              ? "\"Syntax: Expected "
+                              : "\"Syntax: Expected one of: " );
+        if ( report->expected >= 0 )
+            PutText( writer, TokenName( report->expected ),
+                     strlen( TokenName( report->expected ) ) );
+        else if ( report->expects != NULL )
+            for ( i = 0; i < SET_SIZE; i++ )
+                if ( InSet( report->expects, i ) &&
+                     NULL != ( name = TokenName( i ) ) )  {
+                    if ( !first )  PutChar( writer, ' ' );
+                    PutText( writer, name, strlen( name ) );
+                    first = 0;
+                }
+        PutChars( writer,
+                  report->code == DIAG_EXPECTED ? ", got " : " : got " );
+        if ( NULL != ( name = TokenName( report->got ) ) )
+            PutText( writer, name, strlen( name ) );
+        PutChar( writer, '"' );
+        return;
+    }
+    if ( message == NULL )  message = Rules[report->code].description;
+    if ( strncmp( message, LISTING_PREFIX, strlen( LISTING_PREFIX ) ) == 0 )
+        message += strlen( LISTING_PREFIX );
+    length = strlen( message );
+    if ( length > 0 && message[length-1] == '\n' )  length--;
+    PutChar( writer, '"' );
+    PutText( writer, message, length );
+    PutChar( writer, '"' );
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      PutExpected                                                          */
+/*                                                                           */
+/*      Writes the "expected" and "got" members of a syntax error.           */
+/*                                                                           */
+/*      Input(s):      writer, where they are written.                       */
+/*                     report, the error.                                    */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*      Returns:       Nothing                                               */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE void  PutExpected( DIAGWRITER *writer, ERRORREPORT *report )
+{
+    char *name;
+    int i, first = 1;
+
+    PutChars( writer, "\"expected\":[" );
+    if ( report->expected >= 0 )
+        PutString( writer, TokenName( report->expected ) );
+    else if ( report->expects != NULL )
+        for ( i = 0; i < SET_SIZE; i++ )
+            if ( InSet( report->expects, i ) &&
+                 NULL != ( name = TokenName( i ) ) )  {
+                if ( !first )  PutChar( writer, ',' );
+                PutString( writer, name );
+                first = 0;
+            }
+    PutChars( writer, "],\"got\":" );
+    PutString( writer, TokenName( report->got ) );
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      PutString                                                            */
+/*                                                                           */
+/*      Writes a string as a quoted JSON string, or null if it is NULL.      */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE void  PutString( DIAGWRITER *writer, char *s )
+{
+    if ( s == NULL )  {
+        PutChars( writer, "null" );
+        return;
+    }
+    PutChar( writer, '"' );
+    PutText( writer, s, strlen( s ) );
+    PutChar( writer, '"' );
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      PutUri                                                               */
+/*                                                                           */
+/*      Writes a file name as a quoted relative URI reference, for SARIF,    */
+/*      with every byte but the unreserved characters and "/" percent-       */
+/*      encoded, so that, e.g., a space or "#" stays part of the path.       */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE void  PutUri( DIAGWRITER *writer, char *path )
+{
+    char *hex = "0123456789ABCDEF";
+    unsigned char c;
+
+    PutChar( writer, '"' );
+    for ( ; *path != '\0'; path++ )  {
+        c = (unsigned char) *path;
+        if ( ( c >= 'A' && c <= 'Z' ) || ( c >= 'a' && c <= 'z' ) ||
+             ( c >= '0' && c <= '9' ) || strchr( "-._~/", c ) != NULL )
+            PutChar( writer, c );
+        else  {
+            PutChar( writer, '%' );
+            PutChar( writer, hex[c >> 4] );
+            PutChar( writer, hex[c & 15] );
+        }
+    }
+    PutChar( writer, '"' );
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      PutText                                                              */
+/*                                                                           */
+/*      Writes "length" characters of a string, escaped as the inside of a   */
+/*      JSON string.                                                         */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE void  PutText( DIAGWRITER *writer, char *s, size_t length )
+{
+    char *hex = "0123456789abcdef";
+    unsigned char c;
+    size_t i;
+
+    for ( i = 0; i < length; i++ )  {
+        c = (unsigned char) s[i];
+        if ( c == '"' || c == '\\' )  {
+            PutChar( writer, '\\' );
+            PutChar( writer, c );
+        }
+        else if ( c == '\n' )  PutChars( writer, "\\n" );
+        else if ( c == '\t' )  PutChars( writer, "\\t" );
+        else if ( c < 0x20 )  {
+            PutChars( writer, "\\u00" );
+            PutChar( writer, hex[c >> 4] );
+            PutChar( writer, hex[c & 15] );
+        }
+        else  PutChar( writer, c );
+    }
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      PutNumber                                                            */
+/*                                                                           */
+/*      Writes a number in decimal.                                          */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE void  PutNumber( DIAGWRITER *writer, int n )
+{
+    char digits[12];
+    unsigned u = n < 0 ? 0u - (unsigned) n : (unsigned) n;
+    int i = 0;
+
+    if ( n < 0 )  PutChar( writer, '-' );
+    do  {
+        digits[i++] = (char)( '0' + u % 10 );
+        u /= 10;
+    }  while ( u != 0 );
+    while ( i > 0 )  PutChar( writer, digits[--i] );
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      PutChars                                                             */
+/*                                                                           */
+/*      Adds a string, as it is, to the writer's buffer.                     */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE void  PutChars( DIAGWRITER *writer, char *s )
+{
+    while ( *s != '\0' )  PutChar( writer, *s++ );
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      PutChar                                                              */
+/*                                                                           */
+/*      Adds a character to the writer's buffer, writing the buffer first    */
+/*      if it is full.                                                       */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE void  PutChar( DIAGWRITER *writer, int c )
+{
+    if ( writer->used == DIAG_BUFFER )  Flush( writer );
+    writer->text[writer->used++] = (char) c;
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      Flush                                                                */
+/*                                                                           */
+/*      Writes out, and empties, the writer's buffer.                        */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE void  Flush( DIAGWRITER *writer )
+{
+    if ( writer->used > 0 )  fwrite( writer->text, 1, writer->used,
+                                     writer->file );
+    writer->used = 0;
+}
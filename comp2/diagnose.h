@@ -0,0 +1,58 @@
+#ifndef  DIAGNOSEHEADER
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      diagnose.h                                                           */
+/*                                                                           */
+/*      Header file for "diagnose.c", containing the error codes given to    */
+/*      "ReportError" and the type definitions and function prototypes for   */
+/*      a diagnostics writer, which writes each error for other programs     */
+/*      to read, as JSON Lines or as a SARIF log.                            */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+#define  DIAGNOSEHEADER
+
+#include <stdio.h>
+#include <pthread.h>
+#include "global.h"
+#include "line.h"
+
+#define  DIAG_ERROR              0      /* not classified, see Error         */
+#define  DIAG_EXPECTED           1      /* a token was expected              */
+#define  DIAG_EXPECTED_ONE_OF    2      /* one of a set of tokens was        */
+                                        /* expected                          */
+#define  DIAG_PARSING_ENDS       3      /* text follows the program          */
+#define  DIAG_UNDECLARED         4      /* identifier not declared           */
+#define  DIAG_REDECLARED         5      /* variable already declared         */
+#define  DIAG_NOT_PROCEDURE      6      /* called, but not a procedure       */
+#define  DIAG_NOT_VARIABLE       7      /* used as, but not a variable       */
+#define  DIAG_REF_NOT_VARIABLE   8      /* REF parameter is not a variable   */
+#define  DIAG_PARAMETER_COUNT    9      /* wrong number of parameters        */
+#define  DIAG_TOO_MANY_PARAMETERS 10    /* more than a procedure may have    */
+#define  DIAG_EXTERNAL          11      /* EXTERNAL not allowed here         */
+#define  DIAG_INTERNAL          12      /* the compiler failed               */
+#define  DIAG_CODES             13
+
+#define  DIAG_BUFFER           1024     /* bytes made up before a write      */
+
+#define  DIAG_JSONL              1      /* formats of a DIAGWRITER           */
+#define  DIAG_SARIF              2
+
+typedef struct  {               /* one stream of diagnostics                 */
+    FILE *file;
+    int  format;                /* DIAG_JSONL or DIAG_SARIF                  */
+    char *source;               /* the program, for errors given no other    */
+    int  count;                 /* errors written so far                     */
+    pthread_mutex_t lock;       /* held while an error is written            */
+    size_t used;                /* bytes in "text"                           */
+    char text[DIAG_BUFFER];     /* the error being made up                   */
+}
+    DIAGWRITER;
+
+PUBLIC void   StartDiagnostics( DIAGWRITER *writer, FILE *file, int format,
+                                char *source );
+PUBLIC void   WriteDiagnostic( DIAGWRITER *writer, char *source,
+                               ERRORREPORT *report );
+PUBLIC void   StopDiagnostics( DIAGWRITER *writer );
+
+#endif
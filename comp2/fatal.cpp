@@ -0,0 +1,104 @@
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      fatal.c                                                              */
+/*                                                                           */
+/*      Implementation file for fatal errors, those after which a            */
+/*      compilation cannot go on: running out of memory, a program too       */
+/*      large for the code table, or an internal error. Each module which    */
+/*      can meet one is given a FATALTRAP (see "SetCodeTrap" and             */
+/*      "SetScannerTrap"), and calls "Fatal" with it. The compiler arms      */
+/*      the trap while a program is compiled, so the error is reported       */
+/*      against the program and the compiler carries on with the next one,   */
+/*      which matters to a server or a batch of programs. A module used on   */
+/*      its own, with no trap, ends the process as it always did.            */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include "fatal.h"
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      Public routines (globally accessable).                               */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      ArmTrap                                                              */
+/*                                                                           */
+/*      Arms a trap for the calling thread. The caller must call             */
+/*      "setjmp( trap->env )" at once, and disarm the trap before the        */
+/*      routine which called "setjmp" returns.                               */
+/*                                                                           */
+/*      Input(s):      trap, the trap.                                       */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*      Returns:       Nothing                                               */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PUBLIC void   ArmTrap( FATALTRAP *trap )
+{
+    trap->owner = pthread_self();
+    trap->armed = 1;
+    trap->message[0] = '\0';
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      DisarmTrap                                                           */
+/*                                                                           */
+/*      Disarms a trap, so that "Fatal" ends the process again. The message  */
+/*      of a trap which was sprung is kept.                                  */
+/*                                                                           */
+/*      Input(s):      trap, the trap.                                       */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*      Returns:       Nothing                                               */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PUBLIC void   DisarmTrap( FATALTRAP *trap )
+{
+    trap->armed = 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      Fatal                                                                */
+/*                                                                           */
+/*      Reports a fatal error. If the trap is armed by the calling thread    */
+/*      it is disarmed, and control returns from its "setjmp" with the       */
+/*      message in the trap. Otherwise the message is written to stderr and  */
+/*      the process ends.                                                    */
+/*                                                                           */
+/*      Input(s):      trap, the trap, or NULL.                              */
+/*                     format, and what follows, as for "printf".            */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*      Returns:       Does not return.                                      */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PUBLIC void   Fatal( FATALTRAP *trap, char *format, ... )
+{
+    char message[FATAL_MESSAGE];
+    va_list args;
+
+    va_start( args, format );
+    vsnprintf( message, sizeof( message ), format, args );
+    va_end( args );
+    if ( trap != NULL && trap->armed &&
+         pthread_equal( trap->owner, pthread_self() ) )  {
+        strcpy( trap->message, message );
+        trap->armed = 0;
+        longjmp( trap->env, 1 );
+    }
+    fprintf( stderr, "%s\n", message );
+    exit( EXIT_FAILURE );
+}
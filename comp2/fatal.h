@@ -0,0 +1,43 @@
+#ifndef  FATALHEADER
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      fatal.h                                                              */
+/*                                                                           */
+/*      Header file for "fatal.c", containing the type definition and        */
+/*      function prototypes for the traps which carry a fatal error, such    */
+/*      as running out of memory, back to the routine compiling the          */
+/*      program, in place of ending the process.                             */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+#define  FATALHEADER
+
+#include <setjmp.h>
+#include <pthread.h>
+#include "global.h"
+
+#define  FATAL_MESSAGE         256      /* longest message kept by a trap    */
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      A FATALTRAP is armed by the thread which sets it, with "ArmTrap"     */
+/*      followed at once by "setjmp( trap.env )" in the routine which is     */
+/*      to regain control. "Fatal" returns there on that thread with the     */
+/*      message in "message"; on any other thread, or once the trap has      */
+/*      been sprung or disarmed, it ends the process as before.              */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+typedef struct  {
+    jmp_buf env;
+    pthread_t owner;            /* the thread which armed it                 */
+    int  armed;
+    char message[FATAL_MESSAGE];
+}
+    FATALTRAP;
+
+PUBLIC void   ArmTrap( FATALTRAP *trap );
+PUBLIC void   DisarmTrap( FATALTRAP *trap );
+PUBLIC void   Fatal( FATALTRAP *trap, char *format, ... );
+
+#endif
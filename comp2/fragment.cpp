@@ -0,0 +1,449 @@
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      fragment.c                                                           */
+/*                                                                           */
+/*      Implementation file for the fragment cache, which lets a long-lived  */
+/*      COMPILER (the compile server, or a client of "CompileText" or        */
+/*      "CompileString") skip procedures which have not changed since the    */
+/*      last program it compiled.                                            */
+/*                                                                           */
+/*      A fragment is the finished code of one procedure declaration,        */
+/*      nested procedures included, saved together with what it was          */
+/*      compiled from: the declaration's source text, the scope it was       */
+/*      declared at, and every declaration outside it which the code looked  */
+/*      up (its FRAGMENTREFs). If the same text appears at the same scope    */
+/*      and those declarations are unchanged, the code generated for it      */
+/*      would be the same apart from its position, so the parser places the  */
+/*      fragment instead of parsing the declaration (see ReuseProcedure in   */
+/*      comp2.c).                                                            */
+/*                                                                           */
+/*      Code addresses are the only thing which depends on position. When a  */
+/*      fragment is stored each instruction is given a relocation:           */
+/*                                                                           */
+/*          RELOC_INTERNAL   a branch or call to an address inside the       */
+/*                           fragment, kept relative to its start.           */
+/*                                                                           */
+/*          n >= 0           a "Call" of a procedure declared outside it,    */
+/*                           refs[n], given that procedure's address when    */
+/*                           the fragment is placed.                         */
+/*                                                                           */
+/*          RELOC_ABSOLUTE   anything else (data addresses, frame offsets,   */
+/*                           constants), which the checks on refs make       */
+/*                           position independent.                           */
+/*                                                                           */
+/*      Fragments are found by procedure name. Each run of the COMPILER      */
+/*      ages the cache, and a fragment neither stored nor found in the last  */
+/*      FRAGMENT_KEEP_RUNS runs is dropped, so the cache holds roughly the   */
+/*      procedures of the programs recently compiled.                        */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "code.h"
+#include "symbol.h"
+#include "fragment.h"
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      Function Prototypes for private routines                             */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE unsigned Bucket( char *name );
+PRIVATE void  Insert( FRAGMENTCACHE *cache, FRAGMENT *fragment );
+PRIVATE int   Classify( FRAGMENT *fragment, int start, int end );
+PRIVATE char *CopyOf( char *s, size_t length );
+PRIVATE void  FreeFragment( FRAGMENT *fragment );
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      Public routines (globally accessable).                               */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      InitFragmentCache                                                    */
+/*                                                                           */
+/*      Makes an empty fragment cache.                                       */
+/*                                                                           */
+/*      Input(s):      cache, the cache to initialise.                       */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*      Returns:       Nothing                                               */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PUBLIC void   InitFragmentCache( FRAGMENTCACHE *cache )
+{
+    int i;
+
+    for ( i = 0; i < FRAGMENT_BUCKETS; i++ )  cache->buckets[i] = NULL;
+    cache->run = 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      FreeFragmentCache                                                    */
+/*                                                                           */
+/*      Releases every fragment in a cache, leaving it empty.                */
+/*                                                                           */
+/*      Input(s):      cache, the cache to empty.                            */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*      Returns:       Nothing                                               */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PUBLIC void   FreeFragmentCache( FRAGMENTCACHE *cache )
+{
+    FRAGMENT *fragment, *next;
+    int i;
+
+    for ( i = 0; i < FRAGMENT_BUCKETS; i++ )  {
+        fragment = cache->buckets[i];
+        while ( fragment != NULL )  {
+            next = fragment->next;
+            FreeFragment( fragment );
+            fragment = next;
+        }
+        cache->buckets[i] = NULL;
+    }
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      AgeFragmentCache                                                     */
+/*                                                                           */
+/*      Starts a new run, dropping the fragments which have not been used    */
+/*      in the last FRAGMENT_KEEP_RUNS runs.                                 */
+/*                                                                           */
+/*      Input(s):      cache, the cache of the COMPILER starting a run.      */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*      Returns:       Nothing                                               */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PUBLIC void   AgeFragmentCache( FRAGMENTCACHE *cache )
+{
+    FRAGMENT **link, *fragment;
+    int i;
+
+    cache->run++;
+    for ( i = 0; i < FRAGMENT_BUCKETS; i++ )  {
+        link = &cache->buckets[i];
+        while ( NULL != ( fragment = *link ) )  {
+            if ( cache->run - fragment->used > FRAGMENT_KEEP_RUNS )  {
+                *link = fragment->next;
+                FreeFragment( fragment );
+            }
+            else  link = &fragment->next;
+        }
+    }
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      FindFragment                                                         */
+/*                                                                           */
+/*      Looks for a fragment of a procedure declaration whose text starts    */
+/*      the source still to be compiled.                                     */
+/*                                                                           */
+/*      Input(s):      cache, the COMPILER's fragments.                      */
+/*                                                                           */
+/*                     name and scope, the procedure and the scope level it  */
+/*                     is being declared at.                                 */
+/*                                                                           */
+/*                     text and available, the source which follows the      */
+/*                     procedure's name, to the end of the program.          */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*      Returns:       The fragment, marked as used in this run, or NULL.    */
+/*                     The caller must still check its refs.                 */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PUBLIC FRAGMENT *FindFragment( FRAGMENTCACHE *cache, char *name, int scope,
+                               char *text, size_t available )
+{
+    FRAGMENT *fragment;
+
+    for ( fragment = cache->buckets[Bucket( name )]; fragment != NULL;
+          fragment = fragment->next )  {
+        if ( fragment->scope == scope && fragment->length <= available &&
+             strcmp( fragment->name, name ) == 0 &&
+             memcmp( fragment->text, text, fragment->length ) == 0 )  {
+            fragment->used = cache->run;
+            return fragment;
+        }
+    }
+    return NULL;
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      StoreFragment                                                        */
+/*                                                                           */
+/*      Saves the code of a procedure declaration just compiled. A fragment  */
+/*      of the same procedure with the same text is replaced.                */
+/*                                                                           */
+/*      Input(s):      cache, the COMPILER's fragments.                      */
+/*                                                                           */
+/*                     proto, the fragment's name, scope, text, length,      */
+/*                     entry, pcount, ptypes, CseRemoved, depths, refs and   */
+/*                     RefCount (all copied; its other fields are ignored).  */
+/*                                                                           */
+/*                     cg, start and end, the code of the declaration.       */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*      Returns:       1 if the fragment was stored, 0 if it could not be    */
+/*                     (out of memory, or code which cannot be relocated).   */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PUBLIC int    StoreFragment( FRAGMENTCACHE *cache, FRAGMENT *proto,
+                             CODEGEN *cg, int start, int end )
+{
+    FRAGMENT *fragment;
+    int i, ok;
+
+    if ( NULL == ( fragment = calloc( 1, sizeof( FRAGMENT ) ) ) )  return 0;
+    *fragment = *proto;
+    fragment->size = end - start;
+    fragment->name = CopyOf( proto->name, strlen( proto->name ) );
+    fragment->text = CopyOf( proto->text, proto->length );
+    if ( proto->depths != NULL )
+        fragment->depths = CopyOf( proto->depths, strlen( proto->depths ) );
+    fragment->code = malloc( ( fragment->size + 1 ) * sizeof( INSTRUCTION ) );
+    fragment->reloc = malloc( ( fragment->size + 1 ) * sizeof( int ) );
+    fragment->refs = malloc( ( proto->RefCount + 1 ) * sizeof( FRAGMENTREF ) );
+    ok = fragment->name != NULL && fragment->text != NULL &&
+         fragment->code != NULL && fragment->reloc != NULL &&
+         fragment->refs != NULL &&
+         ( fragment->depths != NULL || proto->depths == NULL );
+
+    for ( i = 0; ok && i < proto->RefCount; i++ )  {
+        fragment->refs[i] = proto->refs[i];
+        fragment->refs[i].name = CopyOf( proto->refs[i].name,
+                                         strlen( proto->refs[i].name ) );
+        if ( fragment->refs[i].name == NULL )  ok = 0;
+    }
+    fragment->RefCount = i;
+
+    for ( i = 0; ok && i < fragment->size; i++ )
+        GetInstruction( cg, start + i, &fragment->code[i].opcode,
+                        &fragment->code[i].address );
+    if ( !ok || !Classify( fragment, start, end ) )  {
+        FreeFragment( fragment );
+        return 0;
+    }
+    Insert( cache, fragment );
+    return 1;
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      PlaceFragment                                                        */
+/*                                                                           */
+/*      Emits the code of a fragment at the current code address,            */
+/*      relocating its addresses.                                            */
+/*                                                                           */
+/*      Input(s):      cg, the code generator.                               */
+/*                                                                           */
+/*                     fragment, the fragment, whose refs have been checked. */
+/*                                                                           */
+/*                     addresses, the current address of each procedure in   */
+/*                     the fragment's refs (other entries are not used).     */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*      Returns:       1 if the code was placed, 0 if it would not fit in    */
+/*                     CODE_LIMIT instructions, when nothing is emitted.     */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PUBLIC int    PlaceFragment( CODEGEN *cg, FRAGMENT *fragment,
+                             int *addresses )
+{
+    int base = CurrentCodeAddress( cg ), address, i;
+
+    if ( fragment->size > CODE_LIMIT - base )  return 0;
+    for ( i = 0; i < fragment->size; i++ )  {
+        address = fragment->code[i].address;
+        if ( fragment->reloc[i] == RELOC_INTERNAL )  address += base;
+        else if ( fragment->reloc[i] >= 0 )
+            address = addresses[fragment->reloc[i]];
+        Emit( cg, fragment->code[i].opcode, address );
+    }
+    return 1;
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      MoveFragments                                                        */
+/*                                                                           */
+/*      Moves every fragment of one cache into another, as if each had just  */
+/*      been stored there, leaving the first empty. This is how fragments    */
+/*      compiled by a worker's COMPILER reach the COMPILER which will place  */
+/*      them (see CompileInParallel in comp2.c).                             */
+/*                                                                           */
+/*      Input(s):      cache, the cache to add the fragments to.             */
+/*                                                                           */
+/*                     from, the cache to take them from.                    */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*      Returns:       Nothing                                               */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PUBLIC void   MoveFragments( FRAGMENTCACHE *cache, FRAGMENTCACHE *from )
+{
+    FRAGMENT *fragment, *next;
+    int i;
+
+    for ( i = 0; i < FRAGMENT_BUCKETS; i++ )  {
+        fragment = from->buckets[i];
+        while ( fragment != NULL )  {
+            next = fragment->next;
+            Insert( cache, fragment );
+            fragment = next;
+        }
+        from->buckets[i] = NULL;
+    }
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      Private routines (only accessable within this module).               */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      Bucket                                                               */
+/*                                                                           */
+/*      Returns the hash chain for a procedure name.                         */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE unsigned Bucket( char *name )
+{
+    unsigned h = 0;
+
+    while ( *name != '\0' )  h = 31 * h + (unsigned char) *name++;
+    return h % FRAGMENT_BUCKETS;
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      Insert                                                               */
+/*                                                                           */
+/*      Adds a fragment to a cache, marked as used in this run, replacing    */
+/*      any fragment of the same procedure with the same text.               */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE void  Insert( FRAGMENTCACHE *cache, FRAGMENT *fragment )
+{
+    FRAGMENT **link, *old;
+
+    link = &cache->buckets[Bucket( fragment->name )];
+    while ( NULL != ( old = *link ) )  {
+        if ( old->scope == fragment->scope && old->length == fragment->length &&
+             strcmp( old->name, fragment->name ) == 0 &&
+             memcmp( old->text, fragment->text, old->length ) == 0 )  {
+            *link = old->next;
+            FreeFragment( old );
+        }
+        else  link = &old->next;
+    }
+    fragment->used = cache->run;
+    fragment->next = *link;
+    *link = fragment;
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      Classify                                                             */
+/*                                                                           */
+/*      Fills in the relocation of each instruction of a new fragment,       */
+/*      which was generated at addresses start .. end-1, and makes its       */
+/*      internal addresses relative.                                         */
+/*                                                                           */
+/*      Returns:       1 if successful, 0 if the code branches out of the    */
+/*                     fragment or calls a procedure not among its refs.     */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE int   Classify( FRAGMENT *fragment, int start, int end )
+{
+    INSTRUCTION *inst;
+    int i, n;
+
+    for ( i = 0; i < fragment->size; i++ )  {
+        inst = &fragment->code[i];
+        fragment->reloc[i] = RELOC_ABSOLUTE;
+        if ( inst->opcode < I_BR || inst->opcode > I_CALL )  continue;
+        if ( inst->address >= start && inst->address < end )  {
+            fragment->reloc[i] = RELOC_INTERNAL;
+            inst->address -= start;
+            continue;
+        }
+        if ( inst->opcode != I_CALL )  return 0;
+        for ( n = 0; n < fragment->RefCount; n++ )
+            if ( fragment->refs[n].type == STYPE_PROCEDURE &&
+                 fragment->refs[n].address == inst->address )  break;
+        if ( n == fragment->RefCount )  return 0;
+        fragment->reloc[i] = n;
+    }
+    return 1;
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      CopyOf                                                               */
+/*                                                                           */
+/*      Returns a malloc'd, null-terminated copy of "length" characters, or  */
+/*      NULL if out of memory.                                               */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE char *CopyOf( char *s, size_t length )
+{
+    char *copy;
+
+    if ( NULL != ( copy = malloc( length + 1 ) ) )  {
+        memcpy( copy, s, length );
+        copy[length] = '\0';
+    }
+    return copy;
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      FreeFragment                                                         */
+/*                                                                           */
+/*      Releases a fragment and everything it owns.                          */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE void  FreeFragment( FRAGMENT *fragment )
+{
+    int i;
+
+    if ( fragment->refs != NULL )
+        for ( i = 0; i < fragment->RefCount; i++ )
+            free( fragment->refs[i].name );
+    free( fragment->refs );
+    free( fragment->name );
+    free( fragment->text );
+    free( fragment->depths );
+    free( fragment->code );
+    free( fragment->reloc );
+    free( fragment );
+}
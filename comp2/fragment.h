@@ -0,0 +1,76 @@
+#ifndef  FRAGMENTHEADER
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      fragment.h                                                           */
+/*                                                                           */
+/*      Header file for "fragment.c", containing type definitions and        */
+/*      function prototypes for the cache of compiled procedures which lets  */
+/*      a COMPILER reuse the code of procedures unchanged since its last     */
+/*      run.                                                                 */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+#define  FRAGMENTHEADER
+
+#include <stddef.h>
+#include "global.h"
+#include "code.h"
+
+#define  FRAGMENT_BUCKETS       211     /* hash chains, on procedure name    */
+#define  FRAGMENT_KEEP_RUNS       4     /* runs an unused fragment is kept   */
+#define  FRAGMENT_MAX_REFS      256     /* outer declarations per fragment   */
+
+#define  RELOC_ABSOLUTE          -1     /* address field used as it is       */
+#define  RELOC_INTERNAL          -2     /* code address within the fragment, */
+                                        /* kept relative to its start        */
+                                        /* 0 .. : "Call" of refs[n]          */
+
+typedef struct  {               /* a declaration outside a procedure which   */
+    char *name;                 /* its code depends on, as it was when the   */
+    int  type;                  /* code was generated.                       */
+    int  scope;
+    int  address;               /* for a procedure, only used to find its    */
+    int  pcount;                /* calls when the fragment is stored         */
+    int  ptypes;
+}
+    FRAGMENTREF;
+
+typedef struct fragment  {      /* the code of one procedure declaration     */
+    char *name;                 /* procedure name                            */
+    int  scope;                 /* scope level it is declared at             */
+    char *text;                 /* source from just after the name to the    */
+    size_t length;              /* closing ";", inclusive                    */
+    INSTRUCTION *code;          /* code, with internal addresses relative    */
+    int  *reloc;                /* RELOC_... per instruction                 */
+    int  size;                  /* instructions                              */
+    int  entry;                 /* entry point, relative to the start        */
+    int  pcount;
+    int  ptypes;
+    int  CseRemoved;            /* optimiser statistic, replayed on reuse    */
+    char *depths;               /* its stack depth report lines, replayed on */
+                                /* reuse, or NULL if they were not kept      */
+    FRAGMENTREF *refs;
+    int  RefCount;
+    int  used;                  /* last run to store or find it              */
+    struct fragment *next;
+}
+    FRAGMENT;
+
+typedef struct  {               /* the fragments of one COMPILER             */
+    FRAGMENT *buckets[FRAGMENT_BUCKETS];
+    int run;
+}
+    FRAGMENTCACHE;
+
+PUBLIC void   InitFragmentCache( FRAGMENTCACHE *cache );
+PUBLIC void   FreeFragmentCache( FRAGMENTCACHE *cache );
+PUBLIC void   AgeFragmentCache( FRAGMENTCACHE *cache );
+PUBLIC FRAGMENT *FindFragment( FRAGMENTCACHE *cache, char *name, int scope,
+                               char *text, size_t available );
+PUBLIC int    StoreFragment( FRAGMENTCACHE *cache, FRAGMENT *proto,
+                             CODEGEN *cg, int start, int end );
+PUBLIC int    PlaceFragment( CODEGEN *cg, FRAGMENT *fragment,
+                             int *addresses );
+PUBLIC void   MoveFragments( FRAGMENTCACHE *cache, FRAGMENTCACHE *from );
+
+#endif
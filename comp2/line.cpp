@@ -18,6 +18,7 @@
 #include <string.h>
 #include <ctype.h>
 #include "line.h"
+#include "memory.h"
 
 /*---------------------------------------------------------------------------*/
 /*                                                                           */
@@ -26,7 +27,6 @@
 /*---------------------------------------------------------------------------*/
 
 #define  DISPLAY_LINE_NUMBER              1     /* see DisplayLine           */
-#define  NO_DISPLAY_LINE_NUMBER           0     /* see DisplayLine           */
 
 #define  DEFAULT_TAB_WIDTH                8     /* Default tab size          */
 
@@ -36,8 +36,22 @@
 /*                                                                           */
 /*      LINE is a data structure which gathers together all the information  */
 /*      pertinent to a line of input, i.e., the text of the line, the        */
-/*      position where the next character is to be inserted, the number of   */
-/*      error messages for the line and their positions and text strings.    */
+/*      position where the next character is to be inserted and the first    */
+/*      and last of the errors reported against it. The text is held in a    */
+/*      buffer which grows to fit the longest line read, so a line of any    */
+/*      length is listed whole, under its own number.                        */
+/*                                                                           */
+/*      LINEERROR is one of those errors, its position in the line and its   */
+/*      message. Few lines have errors, so rather than each line having      */
+/*      room for some, the errors of both buffered lines are kept in one     */
+/*      arena in the CHARPROCESSOR, "Errors", with the messages in           */
+/*      "Messages", each line's errors linked in the order reported. The     */
+/*      arena only ever holds the errors of the lines not yet listed, and    */
+/*      is emptied, or reduced to those of the other line, as each line is   */
+/*      listed (see ClearErrors).                                            */
+/*                                                                           */
+/*      The remaining state lives in the CHARPROCESSOR passed to each        */
+/*      routine (see "line.h"):                                              */
 /*                                                                           */
 /*      CurrentLine is a pointer to the current line being processed,        */
 /*      PreviousLine to the previous one. It is necessary to keep tis line   */
@@ -45,9 +59,30 @@
 /*                                                                           */
 /*      InputFile is the current input, it defaults to stdin (see ReadChar). */
 /*      ListFile is where the listing is being written. If it is NULL, no    */
-/*      listing is being produced. Defaults to NULL.                         */
+/*      listing is being produced. Defaults to NULL. Listing says what goes  */
+/*      into it, LISTING_FULL by default (see SetListingMode).               */
+/*                                                                           */
+/*      ErrorFile is where error messages are echoed as they are reported.   */
+/*      Defaults to stderr, NULL means they are not echoed (see Error).      */
 /*                                                                           */
 /*      CurrentLineNum is the line number of the current line.               */
+/*      It only advances as lines are listed, so the source line of each     */
+/*      LINE is also kept in its "number" field, set from LinesRead when     */
+/*      its first character is read. LastLineNum is the number of the last   */
+/*      line to receive a character.                                         */
+/*                                                                           */
+/*      CharsRead counts the characters taken from InputFile and ErrorCount  */
+/*      the calls of Error (see CurrentCharOffset and ErrorsReported).       */
+/*                                                                           */
+/*      ErrorHandler, if not NULL, is called with ErrorContext for every     */
+/*      error reported (see Error and SetErrorHandler), and ReportHandler    */
+/*      likewise with ReportContext (see ReportError and SetReportHandler).  */
+/*                                                                           */
+/*      ErrorLimit and LineErrorLimit, if not 0, limit the errors shown,     */
+/*      i.e., listed, echoed and passed to the handlers, in all and on one   */
+/*      line. ErrorsShown counts those shown, ErrorsOnLine those shown on    */
+/*      ErrorLine, ErrorsDropped those left out for LineErrorLimit and       */
+/*      ErrorsPastLimit those left out for ErrorLimit (see SetErrorLimits).  */
 /*                                                                           */
 /*      PushBack is a flag which is true when UnReadChar has been called     */
 /*      to push back a character onto the input stream.                      */
@@ -55,29 +90,36 @@
 /*      ReadEOF is a flag which is set once EOF has been read from the       */
 /*      input stream. It ensures that no further reads take place.           */
 /*                                                                           */
+/*      Journal, if not NULL, is given each line in place of the listing     */
+/*      (see SetJournal), and Writer, if not NULL, is given the listing in   */
+/*      place of ListFile (see SetListWriter).                               */
+/*                                                                           */
+/*      Timer, if not NULL, is charged with the time taken to end and list   */
+/*      each line as PHASE_READ (see SetPhaseTimer).                         */
+/*                                                                           */
+/*      Trap, if not NULL, is sprung when there is no store for a line or    */
+/*      an error (see SetCharTrap).                                          */
+/*                                                                           */
 /*---------------------------------------------------------------------------*/
 
-typedef struct  {
+typedef struct line  {
     int  valid;                 /* =1 if the line contains meaningful data   */
     int  cpos;                  /* current character position                */
-    char s[M_LINE_WIDTH+2];     /* text of line                              */
-    int  cerrs;                 /* number of errors in line                  */
-    int  epos[M_ERRS_LINE];     /* positions of the errors                   */
-    char e[M_ERRS_LINE][M_LINE_WIDTH+2];        /* array of error message    */
-}                                               /* strings                   */
+    char *s;                    /* text of line                              */
+    int  size;                  /* bytes allocated to it                     */
+    int  errors;                /* index in Errors of the first error and    */
+    int  LastError;             /* the last, or -1 if there are none         */
+    int  number;                /* source line number, from 1                */
+    long id;                    /* see CurrentLineId                         */
+}
     LINE;
 
-PRIVATE LINE *CurrentLine  = NULL,
-             *PreviousLine = NULL;
-
-PRIVATE FILE *InputFile = NULL,
-             *ListFile  = NULL;
-
-PRIVATE int  CurrentLineNum = 1;
-PRIVATE int  PushBack       = 0;
-PRIVATE int  ReadEOF        = 0;
-
-PRIVATE int  TabWidth       = DEFAULT_TAB_WIDTH;
+typedef struct lineerror  {
+    int  pos;                   /* position of the error in the line         */
+    int  message;               /* offset of its message in Messages         */
+    int  next;                  /* index of the line's next error, or -1     */
+}
+    LINEERROR;
 
 /*---------------------------------------------------------------------------*/
 /*                                                                           */
@@ -85,10 +127,22 @@ PRIVATE int  TabWidth       = DEFAULT_TAB_WIDTH;
 /*                                                                           */
 /*---------------------------------------------------------------------------*/
 
-PRIVATE void DisplayLine( int number, LINE *line );
-PRIVATE LINE *NewLine( void );
+PRIVATE void DisplayLine( CHARPROCESSOR *cp, int number, LINE *line );
+PRIVATE void ListText( CHARPROCESSOR *cp, int kind, int value, char *text );
+PRIVATE LINE *NewLine( CHARPROCESSOR *cp );
+PRIVATE void GrowLine( CHARPROCESSOR *cp, LINE *line, int length );
+PRIVATE void FreeLine( LINE *line );
 PRIVATE void SwapLines( LINE **a, LINE **b );
-PRIVATE void DisplayErrorMessage( int indent, char *message );
+PRIVATE void DisplayErrorMessage( CHARPROCESSOR *cp, int indent,
+                                  char *message );
+PRIVATE void AddError( CHARPROCESSOR *cp, LINE *line, int pos,
+                       char *message );
+PRIVATE void ListErrors( CHARPROCESSOR *cp, LINE *line );
+PRIVATE void ClearErrors( CHARPROCESSOR *cp, LINE *line );
+PRIVATE void *Reserve( CHARPROCESSOR *cp, void *block, int *space,
+                       int needed, size_t size );
+PRIVATE int  ErrorLineNum( CHARPROCESSOR *cp );
+PRIVATE int  Dropping( CHARPROCESSOR *cp, int line );
 
 /*---------------------------------------------------------------------------*/
 /*                                                                           */
@@ -98,10 +152,13 @@ PRIVATE void DisplayErrorMessage( int indent, char *message );
 /*                                                                           */
 /*      InitCharProcessor                                                    */
 /*                                                                           */
-/*      Establishes the input and listing files.                             */
+/*      Establishes the input and listing files and resets the rest of the   */
+/*      character processor's state.                                         */
 /*                                                                           */
 /*      Input(s):                                                            */
 /*                                                                           */
+/*          cp         pointer to the character processor to initialise.     */
+/*                                                                           */
 /*          inputfile  pointer to a FILE structure which must be opened on   */
 /*                     the file to be used for input. This argument MUST     */
 /*                     represent a valid open file, NULL is not acceptable.  */
@@ -117,25 +174,87 @@ PRIVATE void DisplayErrorMessage( int indent, char *message );
 /*                                                                           */
 /*---------------------------------------------------------------------------*/
 
-PUBLIC void   InitCharProcessor( FILE *inputfile, FILE *listfile )
+PUBLIC void   InitCharProcessor( CHARPROCESSOR *cp, FILE *inputfile,
+                                 FILE *listfile )
 {
     if ( inputfile == NULL ) {
 	fprintf( stderr, "Fatal Error: InitCharProcessor: attempt to\n");
 	fprintf( stderr, "use an invalid file handle (NULL) for input\n");
 	exit( EXIT_FAILURE );
     }
-    else InputFile = inputfile;
-    ListFile  = listfile;
+    else cp->InputFile = inputfile;
+    cp->ListFile  = listfile;
+    cp->ErrorFile = stderr;
+    cp->CurrentLine    = NULL;
+    cp->PreviousLine   = NULL;
+    cp->CurrentLineNum = 1;
+    cp->LinesRead      = 0;
+    cp->LastLineNum    = 1;
+    cp->CharsRead      = 0;
+    cp->ErrorCount     = 0;
+    cp->ErrorHandler   = NULL;
+    cp->ErrorContext   = NULL;
+    cp->ReportHandler  = NULL;
+    cp->ReportContext  = NULL;
+    cp->PushBack       = 0;
+    cp->ReadEOF        = 0;
+    cp->TabWidth       = DEFAULT_TAB_WIDTH;
+    cp->Journal        = NULL;
+    cp->JournalContext = NULL;
+    cp->Writer         = NULL;
+    cp->WriterContext  = NULL;
+    cp->Listing        = LISTING_FULL;
+    cp->Errors         = NULL;
+    cp->ErrorsUsed     = 0;
+    cp->ErrorsSpace    = 0;
+    cp->Messages       = NULL;
+    cp->MessagesUsed   = 0;
+    cp->MessagesSpace  = 0;
+    cp->ErrorLimit     = 0;
+    cp->LineErrorLimit = 0;
+    cp->ErrorsShown    = 0;
+    cp->ErrorLine      = 0;
+    cp->ErrorsOnLine   = 0;
+    cp->ErrorsDropped  = 0;
+    cp->ErrorsPastLimit = 0;
+    cp->Timer          = NULL;
+    cp->Trap           = NULL;
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      FreeCharProcessor                                                    */
+/*                                                                           */
+/*      Releases the line buffers and error arena owned by a character       */
+/*      processor. The files are not closed, they belong to the caller.      */
+/*                                                                           */
+/*      Input(s):      cp, the character processor to release.               */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*      Returns:       Nothing                                               */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PUBLIC void   FreeCharProcessor( CHARPROCESSOR *cp )
+{
+    FreeLine( cp->CurrentLine );
+    FreeLine( cp->PreviousLine );
+    MemFree( MEM_LINES, cp->Errors, cp->ErrorsSpace * sizeof(LINEERROR) );
+    MemFree( MEM_LINES, cp->Messages, cp->MessagesSpace );
+    cp->CurrentLine = cp->PreviousLine = NULL;
+    cp->Errors = NULL;
+    cp->Messages = NULL;
+    cp->ErrorsUsed = cp->ErrorsSpace = 0;
+    cp->MessagesUsed = cp->MessagesSpace = 0;
 }
 
 /*---------------------------------------------------------------------------*/
 /*                                                                           */
 /*      Error                                                                */
 /*                                                                           */
-/*      Places an error message in the current error buffer of the current   */
-/*      line. If the line already contains M_ERRS_LINE error messages the    */
-/*      message is ignored. If the listing file is other than stderr or      */
-/*      stdin, the error is reported to stderr also.                         */
+/*      Reports an error which the caller has not classified, see            */
+/*      "ReportError".                                                       */
 /*                                                                           */
 /*      Input(s):                                                            */
 /*                                                                           */
@@ -151,22 +270,203 @@ PUBLIC void   InitCharProcessor( FILE *inputfile, FILE *listfile )
 /*                                                                           */
 /*---------------------------------------------------------------------------*/
 
-PUBLIC void   Error( char *ErrorString, int PositionInLine )
+PUBLIC void   Error( CHARPROCESSOR *cp, char *ErrorString, int PositionInLine )
+{
+    ERRORREPORT report;
+
+    report.code = 0;
+    report.got = report.expected = -1;
+    report.expects = NULL;
+    ReportError( cp, &report, ErrorString, PositionInLine );
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      ReportError                                                          */
+/*                                                                           */
+/*      Adds an error message to the errors of the current line, to be       */
+/*      listed after it, however many it already has. If there is no         */
+/*      current line the message is listed at once. If the listing file is   */
+/*      other than stderr or stdin, the error is also reported to the error  */
+/*      file (see SetErrorFile). Every error, even one left out of the       */
+/*      listing, is passed to the error handler if there is one (see         */
+/*      SetErrorHandler), and to the report handler if there is one (see     */
+/*      SetReportHandler), which is given "report" with its line, column     */
+/*      and message filled in. Once the limits set by "SetErrorLimits" are   */
+/*      reached the error is only counted.                                   */
+/*                                                                           */
+/*      Input(s):                                                            */
+/*                                                                           */
+/*          report       what kind of error it is (see "line.h").            */
+/*                                                                           */
+/*          ErrorString  pointer to a error message string, which may be     */
+/*                       NULL if "WantsMessage" is false, so that a caller   */
+/*                       need not format a message nobody will read.         */
+/*                                                                           */
+/*          PositionInLine                                                   */
+/*                       position in the current input line where the        */
+/*                       error occurred.                                     */
+/*                                                                           */
+/*      Output(s):       None                                                */
+/*                                                                           */
+/*      Returns:         Nothing                                             */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PUBLIC void   ReportError( CHARPROCESSOR *cp, ERRORREPORT *report,
+                           char *ErrorString, int PositionInLine )
 {
-    if ( CurrentLine == NULL || !(CurrentLine->valid) )  {
-        if ( ListFile != NULL ) 
-            DisplayErrorMessage( PositionInLine, ErrorString );
+    int line = ErrorLineNum( cp );
+
+    cp->ErrorCount++;
+    if ( Dropping( cp, line ) )  {
+        if ( ErrorLimitReached( cp ) )  cp->ErrorsPastLimit++;
+        else  cp->ErrorsDropped++;
+        return;
+    }
+    if ( line != cp->ErrorLine )  {
+        cp->ErrorLine = line;
+        cp->ErrorsOnLine = 0;
+    }
+    cp->ErrorsOnLine++;
+    cp->ErrorsShown++;
+
+    if ( cp->CurrentLine == NULL || !(cp->CurrentLine->valid) )  {
+        if ( cp->ListFile != NULL && cp->Listing != LISTING_NONE )
+            DisplayErrorMessage( cp, PositionInLine, ErrorString );
     }
     else  {
-        if ( CurrentLine->cerrs < M_ERRS_LINE && ListFile != NULL )  {
-            strncpy( CurrentLine->e[CurrentLine->cerrs], ErrorString, 
-                     M_LINE_WIDTH );
-            CurrentLine->epos[CurrentLine->cerrs] = PositionInLine;
-            (CurrentLine->cerrs)++;
-        }
+        if ( cp->ListFile != NULL && cp->Listing != LISTING_NONE )
+            AddError( cp, cp->CurrentLine, PositionInLine, ErrorString );
     }
-    if ( ListFile != stderr && ListFile != stdin )
-        fprintf( stderr, "Error: %s\n", ErrorString );
+    if ( cp->ErrorFile != NULL &&
+         cp->ListFile != stderr && cp->ListFile != stdin )
+        fprintf( cp->ErrorFile, "Error: %s\n", ErrorString );
+    if ( cp->ErrorHandler != NULL )
+        cp->ErrorHandler( cp->ErrorContext, line, PositionInLine + 1,
+                          ErrorString );
+    if ( cp->ReportHandler != NULL )  {
+        report->line = line;
+        report->column = PositionInLine + 1;
+        report->message = ErrorString;
+        cp->ReportHandler( cp->ReportContext, report );
+    }
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      WantsMessage                                                         */
+/*                                                                           */
+/*      Says whether the message of an error reported now would be used,     */
+/*      i.e., listed, echoed to the error file or passed to the error        */
+/*      handler. A report handler alone does not need it, and nor does an    */
+/*      error which will not be shown (see SetErrorLimits).                  */
+/*                                                                           */
+/*      Input(s):      cp, the character processor.                          */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*      Returns:       1 if the message is needed, 0 if "ReportError" may    */
+/*                     be given NULL.                                        */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PUBLIC int    WantsMessage( CHARPROCESSOR *cp )
+{
+    if ( Dropping( cp, ErrorLineNum( cp ) ) )  return 0;
+    return ( cp->ListFile != NULL && cp->Listing != LISTING_NONE ) ||
+           ( cp->ErrorFile != NULL &&
+             cp->ListFile != stderr && cp->ListFile != stdin ) ||
+           cp->ErrorHandler != NULL;
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      SetErrorLimits                                                       */
+/*                                                                           */
+/*      Limits the errors shown, so that a badly broken program costs no     */
+/*      more to list than a correct one. Once "errors" have been shown no    */
+/*      more are (see ErrorLimitReached), and once "PerLine" have been       */
+/*      shown on one line no more are shown on that line (see ErrorsDropped  */
+/*      and ErrorsPastLimit). All of them are still counted by               */
+/*      "ErrorsReported".                                                    */
+/*                                                                           */
+/*      Input(s):      "errors": the most errors to show, 0 for no limit.    */
+/*                                                                           */
+/*                     "PerLine": the most to show on one line, 0 for no     */
+/*                     limit.                                                */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*      Returns:       Nothing.                                              */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PUBLIC void   SetErrorLimits( CHARPROCESSOR *cp, int errors, int PerLine )
+{
+    cp->ErrorLimit = errors > 0 ? errors : 0;
+    cp->LineErrorLimit = PerLine > 0 ? PerLine : 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      ErrorLimitReached                                                    */
+/*                                                                           */
+/*      Says whether as many errors have been shown as "SetErrorLimits"      */
+/*      allows, when there is no point in looking for more.                  */
+/*                                                                           */
+/*      Input(s):      cp, the character processor.                          */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*      Returns:       1 if no more errors will be shown, 0 otherwise.       */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PUBLIC int    ErrorLimitReached( CHARPROCESSOR *cp )
+{
+    return cp->ErrorLimit > 0 && cp->ErrorsShown >= cp->ErrorLimit;
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      ErrorsDropped                                                        */
+/*                                                                           */
+/*      Returns the number of errors not shown because their line already    */
+/*      had as many as "SetErrorLimits" allows. Those after the limit on     */
+/*      all errors was reached are counted by "ErrorsPastLimit" instead.     */
+/*                                                                           */
+/*      Input(s):      cp, the character processor.                          */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*      Returns:       The number of errors dropped.                         */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PUBLIC int    ErrorsDropped( CHARPROCESSOR *cp )
+{
+    return cp->ErrorsDropped;
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      ErrorsPastLimit                                                      */
+/*                                                                           */
+/*      Returns the number of errors not shown because as many errors had    */
+/*      been shown as "SetErrorLimits" allows.                               */
+/*                                                                           */
+/*      Input(s):      cp, the character processor.                          */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*      Returns:       The number of errors past the limit.                  */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PUBLIC int    ErrorsPastLimit( CHARPROCESSOR *cp )
+{
+    return cp->ErrorsPastLimit;
 }
 
 /*---------------------------------------------------------------------------*/
@@ -179,7 +479,13 @@ PUBLIC void   Error( char *ErrorString, int PositionInLine )
 /*      If the character is a tab, expand it as spaces in the listing file.  */
 /*      The amount of expansion is controlled by the "TabWidth" module       */
 /*      variable, this is normally 8 (setting tabs every 8 characters), but  */
-/*      may be changed by the user.                                          */
+/*      may be changed by the user. The line buffer grows as needed, so a    */
+/*      line of any length is kept whole.                                    */
+/*                                                                           */
+/*      The input is only ever read by the thread using this character       */
+/*      processor, so it is read without locking the stream, which would     */
+/*      otherwise be done for every character once the process has more      */
+/*      than one thread, e.g., a listing writer (see lister.c).              */
 /*                                                                           */
 /*      Input(s):      None                                                  */
 /*                                                                           */
@@ -189,63 +495,69 @@ PUBLIC void   Error( char *ErrorString, int PositionInLine )
 /*                                                                           */
 /*---------------------------------------------------------------------------*/
 
-PUBLIC int  ReadChar( void )
+PUBLIC int  ReadChar( CHARPROCESSOR *cp )
 {
-    int ch, i, j;
+    int ch, i, j, phase;
 
-    if ( ReadEOF )  return EOF;
+    if ( cp->ReadEOF )  return EOF;
 
-    if ( PushBack )  {
-        if ( CurrentLine == NULL )  {
+    if ( cp->PushBack )  {
+        if ( cp->CurrentLine == NULL )  {
             fprintf( stderr, "No current line, but PushBack true\n" );
             exit( EXIT_FAILURE );
         }
-        ch = *(CurrentLine->s+CurrentLine->cpos);
-        PushBack = 0;
-        (CurrentLine->cpos)++;
+        ch = *(cp->CurrentLine->s+cp->CurrentLine->cpos);
+        cp->PushBack = 0;
+        (cp->CurrentLine->cpos)++;
     }
     else  {
-        if ( CurrentLine == NULL )  CurrentLine = NewLine();
-	if ( InputFile == NULL ) InputFile = stdin;
-	ch = fgetc( InputFile );
+        if ( cp->CurrentLine == NULL )  cp->CurrentLine = NewLine( cp );
+	if ( cp->InputFile == NULL ) cp->InputFile = stdin;
+	ch = getc_unlocked( cp->InputFile );
+        if ( ch != EOF )  cp->CharsRead++;
+        if ( ch != EOF && !cp->CurrentLine->valid )  {
+            cp->LastLineNum = cp->CurrentLine->number = cp->LinesRead + 1;
+            cp->CurrentLine->id = cp->CharsRead;
+        }
 	if ( ch == '\t' ) {
-            CurrentLine->valid = 1;
-	    i = CurrentLine->cpos;
-            for ( j = TabWidth; j <= i; j += TabWidth ) ;
-	    for ( ; i < j && i < M_LINE_WIDTH; i++ )
-                *(CurrentLine->s+i) = ' ';
-	    CurrentLine->cpos = i;
+            cp->CurrentLine->valid = 1;
+	    i = cp->CurrentLine->cpos;
+            for ( j = cp->TabWidth; j <= i; j += cp->TabWidth ) ;
+            GrowLine( cp, cp->CurrentLine, j );
+	    for ( ; i < j; i++ )
+                *(cp->CurrentLine->s+i) = ' ';
+	    cp->CurrentLine->cpos = i;
 	    ch = ' ';
 	}
         else if ( ch != EOF )  {
-            CurrentLine->valid = 1;
-            *(CurrentLine->s+CurrentLine->cpos) = (char)ch;
-            (CurrentLine->cpos)++;
+            cp->CurrentLine->valid = 1;
+            if ( cp->CurrentLine->cpos + 3 > cp->CurrentLine->size )
+                GrowLine( cp, cp->CurrentLine, cp->CurrentLine->cpos + 1 );
+            *(cp->CurrentLine->s+cp->CurrentLine->cpos) = (char)ch;
+            (cp->CurrentLine->cpos)++;
         }
     }
 
     if ( ch == '\n' )  {
-        DisplayLine( DISPLAY_LINE_NUMBER, PreviousLine );
-        SwapLines( &CurrentLine, &PreviousLine );
-        if ( CurrentLine != NULL )  {
-            CurrentLine->valid = 0;  CurrentLine->cpos = 0;
-        }
-    }
-    else if ( CurrentLine->cpos > M_LINE_WIDTH )  {
-        DisplayLine( NO_DISPLAY_LINE_NUMBER, PreviousLine );
-        SwapLines( &CurrentLine, &PreviousLine );
-        if ( CurrentLine != NULL )  {
-            CurrentLine->valid = 0;  CurrentLine->cpos = 0;
+        phase = EnterPhase( cp->Timer, PHASE_READ );
+        cp->LinesRead++;
+        DisplayLine( cp, DISPLAY_LINE_NUMBER, cp->PreviousLine );
+        SwapLines( &cp->CurrentLine, &cp->PreviousLine );
+        if ( cp->CurrentLine != NULL )  {
+            cp->CurrentLine->valid = 0;  cp->CurrentLine->cpos = 0;
         }
+        LeavePhase( cp->Timer, phase );
     }
     else if ( ch == EOF )  {
-        if ( CurrentLine->valid && CurrentLine->cpos != 0 )  {
-	    *(CurrentLine->s+(CurrentLine->cpos)) = '\n';
-            (CurrentLine->cpos)++;
+        phase = EnterPhase( cp->Timer, PHASE_READ );
+        if ( cp->CurrentLine->valid && cp->CurrentLine->cpos != 0 )  {
+	    *(cp->CurrentLine->s+(cp->CurrentLine->cpos)) = '\n';
+            (cp->CurrentLine->cpos)++;
 	}
-        DisplayLine( DISPLAY_LINE_NUMBER, PreviousLine );
-        DisplayLine( DISPLAY_LINE_NUMBER, CurrentLine );
-	ReadEOF = 1;
+        DisplayLine( cp, DISPLAY_LINE_NUMBER, cp->PreviousLine );
+        DisplayLine( cp, DISPLAY_LINE_NUMBER, cp->CurrentLine );
+	cp->ReadEOF = 1;
+        LeavePhase( cp->Timer, phase );
     }
 
     return ch;
@@ -267,32 +579,35 @@ PUBLIC int  ReadChar( void )
 /*                                                                           */
 /*---------------------------------------------------------------------------*/
 
-PUBLIC void UnReadChar( void )
+PUBLIC void UnReadChar( CHARPROCESSOR *cp )
 {
-    if ( PushBack )  {
+    if ( cp->PushBack )  {
         fprintf( stderr, "Attempt to unread more than one character\n" );
         exit( EXIT_FAILURE );
     }
     else  {
-	if (!ReadEOF)  {
-            if ( CurrentLine == NULL || !(CurrentLine->valid) || 
-                CurrentLine->cpos == 0 )  {
-                if ( PreviousLine == NULL )  {
+	if (!cp->ReadEOF)  {
+            if ( cp->CurrentLine == NULL || !(cp->CurrentLine->valid) || 
+                cp->CurrentLine->cpos == 0 )  {
+                if ( cp->PreviousLine == NULL )  {
                     fprintf( stderr, "Attempt to push back character " );
                     fprintf( stderr, "before start of file\n" );
                     exit( EXIT_FAILURE );
                 }
                 else  {
-                    SwapLines( &CurrentLine, &PreviousLine );
-                    if ( PreviousLine != NULL )  {
-                        PreviousLine->valid = 0;  PreviousLine->cpos = 0;
-                        PreviousLine->cerrs = 0;
+                    SwapLines( &cp->CurrentLine, &cp->PreviousLine );
+                    if ( cp->PreviousLine != NULL )  {
+                        cp->PreviousLine->valid = 0;
+                        cp->PreviousLine->cpos = 0;
+                        ClearErrors( cp, cp->PreviousLine );
                     }
                 }
             }
-            (CurrentLine->cpos)--;
+            (cp->CurrentLine->cpos)--;
+            if ( *(cp->CurrentLine->s+cp->CurrentLine->cpos) == '\n' )
+                cp->LinesRead--;
 	}
-        PushBack = 1; 
+        cp->PushBack = 1; 
     }
 }
 
@@ -312,16 +627,56 @@ PUBLIC void UnReadChar( void )
 /*                                                                           */
 /*---------------------------------------------------------------------------*/
 
-PUBLIC int  CurrentCharPos( void )
+PUBLIC int  CurrentCharPos( CHARPROCESSOR *cp )
 {
     int i;
 
-    if ( CurrentLine == NULL || !(CurrentLine->valid) )  i = 0;
-    else i = CurrentLine->cpos;
+    if ( cp->CurrentLine == NULL || !(cp->CurrentLine->valid) )  i = 0;
+    else i = cp->CurrentLine->cpos;
 
     return i;
 }
 
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      CurrentCharOffset                                                    */
+/*                                                                           */
+/*      Returns the offset in the input of the next character "ReadChar"     */
+/*      will return, i.e., the number of characters consumed so far.         */
+/*                                                                           */
+/*      Input(s):      None                                                  */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*      Returns:       Long integer, the offset from the start of the input. */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PUBLIC long CurrentCharOffset( CHARPROCESSOR *cp )
+{
+    return cp->CharsRead - ( cp->PushBack ? 1 : 0 );
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      ErrorsReported                                                       */
+/*                                                                           */
+/*      Returns the number of calls of "Error" since the character           */
+/*      processor was initialised, whether or not they were displayed.       */
+/*                                                                           */
+/*      Input(s):      None                                                  */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*      Returns:       Integer, the number of errors reported.               */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PUBLIC int ErrorsReported( CHARPROCESSOR *cp )
+{
+    return cp->ErrorCount;
+}
+
 /*---------------------------------------------------------------------------*/
 /*                                                                           */
 /*      SetTabWidth                                                          */
@@ -340,9 +695,9 @@ PUBLIC int  CurrentCharPos( void )
 /*                                                                           */
 /*---------------------------------------------------------------------------*/
 
-PUBLIC void SetTabWidth( int NewTabWidth )
+PUBLIC void SetTabWidth( CHARPROCESSOR *cp, int NewTabWidth )
 {
-    if ( NewTabWidth >= 3 && NewTabWidth <= 8 )  TabWidth = NewTabWidth;
+    if ( NewTabWidth >= 3 && NewTabWidth <= 8 )  cp->TabWidth = NewTabWidth;
     else {
 	fprintf(stderr,"Fatal Error: SetTabWidth: attempt to set an ");
 	fprintf(stderr,"illegal tab size (%1d).\n", NewTabWidth);
@@ -365,138 +720,852 @@ PUBLIC void SetTabWidth( int NewTabWidth )
 /*                                                                           */
 /*---------------------------------------------------------------------------*/
 
-PUBLIC int GetTabWidth( void )
+PUBLIC int GetTabWidth( CHARPROCESSOR *cp )
 {
-    return TabWidth;
+    return cp->TabWidth;
 }
 
 /*---------------------------------------------------------------------------*/
 /*                                                                           */
-/*      Private routines (only accessable within this module).               */
+/*      SetErrorFile                                                         */
+/*                                                                           */
+/*      Redirects the echo of error messages made by "Error", which goes to  */
+/*      stderr by default.                                                   */
+/*                                                                           */
+/*      Input(s):      "errorfile": file open for output, or NULL to stop    */
+/*                     echoing error messages altogether.                    */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*      Returns:       Nothing.                                              */
 /*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PUBLIC void SetErrorFile( CHARPROCESSOR *cp, FILE *errorfile )
+{
+    cp->ErrorFile = errorfile;
+}
+
 /*---------------------------------------------------------------------------*/
 /*                                                                           */
-/*      NewLine                                                              */
+/*      SetErrorHandler                                                      */
 /*                                                                           */
-/*      Creates a new line and initialises its structures.                   */
+/*      Establishes a routine to be called for every error reported by       */
+/*      "Error", so that a client can collect structured diagnostics.        */
+/*                                                                           */
+/*      Input(s):      "handler": routine called with "context", the source  */
+/*                     line number (from 1), the column (the position in     */
+/*                     the line plus 1) and the message of each error, or    */
+/*                     NULL to remove the handler.                           */
+/*                                                                           */
+/*                     "context": passed unchanged to the handler.           */
 /*                                                                           */
-/*      Input(s):      None                                                  */
-/*                                                                           */ 
 /*      Output(s):     None                                                  */
 /*                                                                           */
-/*      Returns:       Pointer to LINE structure                             */
+/*      Returns:       Nothing.                                              */
 /*                                                                           */
 /*---------------------------------------------------------------------------*/
 
-PRIVATE LINE *NewLine( void )
+PUBLIC void SetErrorHandler( CHARPROCESSOR *cp,
+                             void (*handler)( void *context, int line,
+                                              int column, char *message ),
+                             void *context )
 {
-    LINE *p;
-    
-    if ( NULL == ( p = malloc( sizeof(LINE) ) ) )  {
-        fprintf( stderr, "error, failed to allocate memory for LINE\n" );
-        exit( EXIT_FAILURE );
-    }
-    p->valid = 0;
-    p->cpos = 0;
-    p->cerrs = 0;
-
-    return p;
+    cp->ErrorHandler = handler;
+    cp->ErrorContext = context;
 }
 
 /*---------------------------------------------------------------------------*/
 /*                                                                           */
-/*      SwapLines                                                            */
+/*      SetReportHandler                                                     */
 /*                                                                           */
-/*      Swaps the pointers to two LINE structures.                           */
+/*      Establishes a routine to be called for every error reported, with    */
+/*      an ERRORREPORT saying what kind of error it is and where, so that a  */
+/*      client can write diagnostics for other programs to read without      */
+/*      having to pick apart the messages.                                   */
+/*                                                                           */
+/*      Input(s):      "handler": routine called with "context" and the      */
+/*                     report of each error, which is only valid during the  */
+/*                     call, or NULL to remove the handler.                  */
+/*                                                                           */
+/*                     "context": passed unchanged to the handler.           */
 /*                                                                           */
-/*      Input/Outputs(s):                                                    */
-/*                                                                           */ 
-/*          a, b       both pointers to pointers to LINE structures.E_NUMBER */ 
-/*                                                                           */ 
 /*      Output(s):     None                                                  */
 /*                                                                           */
-/*      Returns:       Nothing                                               */
+/*      Returns:       Nothing.                                              */
 /*                                                                           */
 /*---------------------------------------------------------------------------*/
 
-PRIVATE void SwapLines( LINE **a, LINE **b )
+PUBLIC void SetReportHandler( CHARPROCESSOR *cp,
+                              void (*handler)( void *context,
+                                               ERRORREPORT *report ),
+                              void *context )
 {
-    LINE *temp;
-
-    temp = *a;
-    *a = *b;
-    *b = temp;
+    cp->ReportHandler = handler;
+    cp->ReportContext = context;
 }
 
 /*---------------------------------------------------------------------------*/
 /*                                                                           */
-/*      DisplayLine                                                          */
+/*      SetCharPosition                                                      */
 /*                                                                           */
-/*      Displays the characters of the line passed to it as an argument.     */
-/*      The line is only displayed if the current ListFile is non-NULL and   */
-/*      if the line itself has a "valid" flag associated with it.            */
-/*      This routine has significant side effects, the line becomes          */
-/*      invalid, the character position is reset to zero and the error       */
-/*      count is similarly reset.                                            */
+/*      Tells a character processor that its input starts part way through   */
+/*      a longer text, so that the offsets, line numbers and line ids it     */
+/*      gives are those of the whole text. Must be called before the first   */
+/*      character is read.                                                   */
+/*                                                                           */
+/*      Input(s):      "offset": the offset in the text of the first         */
+/*                     character of the input.                               */
+/*                                                                           */
+/*                     "lines": the number of newlines before it.            */
 /*                                                                           */
-/*      Input(s):                                                            */
-/*                                                                           */ 
-/*          number     integer. if equal to the constant DISPLAY_LINE_NUMBER */ 
-/*                     this is an instruction to display the current line    */ 
-/*                     number and increment it.                              */ 
-/*                                                                           */ 
-/*          line       Pointer to LINE structure                             */ 
-/*                                                                           */ 
 /*      Output(s):     None                                                  */
 /*                                                                           */
-/*      Returns:       Nothing                                               */
+/*      Returns:       Nothing.                                              */
 /*                                                                           */
 /*---------------------------------------------------------------------------*/
 
-PRIVATE void DisplayLine( int number, LINE *line )
+PUBLIC void SetCharPosition( CHARPROCESSOR *cp, long offset, int lines )
 {
-    int i;
+    cp->CharsRead = offset;
+    cp->LinesRead = lines;
+    cp->LastLineNum = cp->CurrentLineNum = lines + 1;
+}
 
-    if ( line != NULL && line->valid && ListFile != NULL )  {
-        i = line->cpos;
-        *((line->s)+i) = '\0';
-        if ( number == DISPLAY_LINE_NUMBER )  {
-            fprintf( ListFile, "%3d ", CurrentLineNum );
-            CurrentLineNum++;
-        }
-        else  fprintf( ListFile, "    " );
-        fputs( line->s, ListFile );
-        for ( i = 0; i < line->cerrs; i++ )
-            DisplayErrorMessage( line->epos[i], line->e[i] );
-        line->valid = 0;
-        line->cpos = 0;
-        line->cerrs = 0;
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      CurrentLineId                                                        */
+/*                                                                           */
+/*      Identifies the line which "Error" would report an error against      */
+/*      now. A line's id is the offset of its first character plus 1, so     */
+/*      the two lines buffered can be told apart from each other and from    */
+/*      the lines before them, and character processors reading the same     */
+/*      text (see SetCharPosition) give each line the same id.               */
+/*                                                                           */
+/*      Input(s):      None                                                  */
+/*                                                                           */
+/*      Output(s):     *line, the source line number an error would be       */
+/*                     reported on, as passed to the error handler.          */
+/*                                                                           */
+/*      Returns:       The id of the current line, or 0 if there is none,    */
+/*                     when an error would be listed at once.                */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PUBLIC long CurrentLineId( CHARPROCESSOR *cp, int *line )
+{
+    if ( cp->CurrentLine != NULL && cp->CurrentLine->valid )  {
+        *line = cp->CurrentLine->number;
+        return cp->CurrentLine->id;
     }
+    *line = cp->LastLineNum;
+    return 0;
 }
 
 /*---------------------------------------------------------------------------*/
 /*                                                                           */
-/*      DisplayErrorMessage                                                  */
+/*      SetJournal                                                           */
 /*                                                                           */
-/*      Displays an error message to the listing file. It is assumed that    */
-/*      the listing file is valid when the routine is called.                */
+/*      Establishes a routine to be given each line when it would be         */
+/*      listed, in place of the listing, so that another thread can list     */
+/*      it with "ReplayDisplay". Errors must not be reported to a            */
+/*      character processor with a journal.                                  */
 /*                                                                           */
-/*      Input(s):                                                            */
-/*                                                                           */ 
-/*          indent     integer, the location of the error on the line        */
-/*                                                                           */ 
-/*          message    pointer to null-terminated character string, the      */
-/*                     error report.                                         */
+/*      Input(s):      "journal": routine called with "context", the id of   */
+/*                     the line (see CurrentLineId), 1 if the line is        */
+/*                     numbered and 0 if it is the rest of a line too long   */
+/*                     to list in one, and the text of the line, which is    */
+/*                     only valid during the call. NULL removes the journal. */
+/*                                                                           */
+/*                     "context": passed unchanged to the journal.           */
 /*                                                                           */
 /*      Output(s):     None                                                  */
 /*                                                                           */
+/*      Returns:       Nothing.                                              */
+/*                                                                           */
 /*---------------------------------------------------------------------------*/
 
-PRIVATE void DisplayErrorMessage( int indent, char *message )
+PUBLIC void SetJournal( CHARPROCESSOR *cp,
+                        void (*journal)( void *context, long id,
+                                         int numbered, char *text ),
+                        void *context )
 {
-    int i;
+    cp->Journal = journal;
+    cp->JournalContext = context;
+}
 
-    fprintf( ListFile, "    " );
-    for ( i = 0; i < indent; i++ )  fputc( ' ', ListFile );
-    fprintf( ListFile, "^\n%s\n", message );
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      ReplayLine                                                           */
+/*                                                                           */
+/*      Brings a character processor which does not read its input itself    */
+/*      to the position reached by one which does, so that errors are        */
+/*      reported against the same line, and "CurrentCharOffset" gives the    */
+/*      same result. As in the one reading, at most two lines are open at    */
+/*      once: a line not seen before replaces the older of the two. When     */
+/*      the one reading has no current line, neither has this one.           */
+/*                                                                           */
+/*      Input(s):      "id" and "line", as returned by "CurrentLineId" on    */
+/*                     the character processor reading the input.            */
+/*                                                                           */
+/*                     "offset", its "CurrentCharOffset".                    */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*      Returns:       Nothing.                                              */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PUBLIC void ReplayLine( CHARPROCESSOR *cp, long id, int line, long offset )
+{
+    cp->CharsRead = offset;
+    cp->PushBack = 0;
+    cp->LastLineNum = line;
+    if ( cp->CurrentLine == NULL )  cp->CurrentLine = NewLine( cp );
+    if ( cp->PreviousLine == NULL )  cp->PreviousLine = NewLine( cp );
+
+    if ( id == 0 )  {
+        if ( cp->CurrentLine->valid )
+            SwapLines( &cp->CurrentLine, &cp->PreviousLine );
+        cp->CurrentLine->valid = 0;
+    }
+    else if ( !cp->CurrentLine->valid || cp->CurrentLine->id != id )  {
+        SwapLines( &cp->CurrentLine, &cp->PreviousLine );
+        if ( !cp->CurrentLine->valid || cp->CurrentLine->id != id )  {
+            cp->CurrentLine->valid = 1;
+            cp->CurrentLine->cpos = 0;
+            ClearErrors( cp, cp->CurrentLine );
+            cp->CurrentLine->number = line;
+            cp->CurrentLine->id = id;
+        }
+    }
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      ReplayDisplay                                                        */
+/*                                                                           */
+/*      Lists a line given to a journal (see SetJournal), with the errors    */
+/*      reported against it since it was made current by "ReplayLine".       */
+/*                                                                           */
+/*      Input(s):      "id", "numbered" and "text", as given to the          */
+/*                     journal.                                              */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*      Returns:       Nothing.                                              */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PUBLIC void ReplayDisplay( CHARPROCESSOR *cp, long id, int numbered,
+                           char *text )
+{
+    LINE *line = NULL;
+
+    if ( cp->CurrentLine != NULL && cp->CurrentLine->valid &&
+         cp->CurrentLine->id == id )
+        line = cp->CurrentLine;
+    else if ( cp->PreviousLine != NULL && cp->PreviousLine->valid &&
+              cp->PreviousLine->id == id )
+        line = cp->PreviousLine;
+
+    if ( cp->ListFile != NULL && cp->Listing != LISTING_NONE )  {
+        if ( cp->Listing == LISTING_ERRORS &&
+             ( line == NULL || line->errors < 0 ) )  {
+            if ( numbered )  cp->CurrentLineNum++;
+        }
+        else if ( numbered )
+            ListText( cp, LIST_LINE, cp->CurrentLineNum++, text );
+        else  ListText( cp, LIST_MORE, 0, text );
+        if ( line != NULL )  ListErrors( cp, line );
+    }
+    if ( line != NULL )  {
+        line->valid = 0;
+        ClearErrors( cp, line );
+    }
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      SetListWriter                                                        */
+/*                                                                           */
+/*      Establishes a routine to be given the listing, piece by piece, in    */
+/*      place of its being written to the listing file, e.g., to have it     */
+/*      written on another thread by "WriteListing". There is still no       */
+/*      listing unless the listing file is not NULL.                         */
+/*                                                                           */
+/*      Input(s):      "writer": routine called with "context" and the       */
+/*                     arguments for "WriteListing" of each piece, the text  */
+/*                     being only valid during the call. NULL removes it.    */
+/*                                                                           */
+/*                     "context": passed unchanged to the writer.            */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*      Returns:       Nothing.                                              */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PUBLIC void SetListWriter( CHARPROCESSOR *cp,
+                           void (*writer)( void *context, int kind,
+                                           int value, char *text ),
+                           void *context )
+{
+    cp->Writer = writer;
+    cp->WriterContext = context;
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      SetListingMode                                                       */
+/*                                                                           */
+/*      Chooses what is written to the listing file. LISTING_FULL lists      */
+/*      every line, with its errors under it. LISTING_ERRORS lists only the  */
+/*      lines with errors, still numbered as in the program, so a program    */
+/*      without errors has an empty listing. A line is dropped as soon as    */
+/*      it is finished with, so nothing more is kept than for a full         */
+/*      listing. LISTING_NONE lists nothing at all, as if there were no      */
+/*      listing file.                                                        */
+/*                                                                           */
+/*      Input(s):      "mode": LISTING_FULL, LISTING_ERRORS or LISTING_NONE. */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*      Returns:       Nothing.                                              */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PUBLIC void SetListingMode( CHARPROCESSOR *cp, int mode )
+{
+    cp->Listing = mode;
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      SetPhaseTimer                                                        */
+/*                                                                           */
+/*      Establishes a timer to be charged, as PHASE_READ, with the time      */
+/*      taken to end and list each line (see timing.c). The timer must only  */
+/*      be used by the thread reading the characters.                        */
+/*                                                                           */
+/*      Input(s):      "timer": the PHASETIMER, or NULL for none.            */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*      Returns:       Nothing.                                              */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PUBLIC void SetPhaseTimer( CHARPROCESSOR *cp, PHASETIMER *timer )
+{
+    cp->Timer = timer;
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      SetCharTrap                                                          */
+/*                                                                           */
+/*      Has running out of store for a line, or for an error, sprung on a    */
+/*      trap (see fatal.c) rather than ending the process, until the         */
+/*      character processor is next initialised. The trap must belong to     */
+/*      the thread reading the characters.                                   */
+/*                                                                           */
+/*      Input(s):      "trap": the FATALTRAP, or NULL for none.              */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*      Returns:       Nothing.                                              */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PUBLIC void SetCharTrap( CHARPROCESSOR *cp, FATALTRAP *trap )
+{
+    cp->Trap = trap;
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      WriteListing                                                         */
+/*                                                                           */
+/*      Writes one piece of a listing.                                       */
+/*                                                                           */
+/*      Input(s):      "listfile": the listing file.                         */
+/*                                                                           */
+/*                     "kind": LIST_LINE for a line of the program, whose    */
+/*                     number in the listing is "value", LIST_MORE for a     */
+/*                     line listed without a number, or LIST_ERROR for an    */
+/*                     error message, pointing at column "value".            */
+/*                                                                           */
+/*                     "text": the line, including its newline, or the       */
+/*                     error message.                                        */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*      Returns:       Nothing.                                              */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PUBLIC void WriteListing( FILE *listfile, int kind, int value, char *text )
+{
+    int i;
+
+    if ( kind == LIST_ERROR )  {
+        fprintf( listfile, "    " );
+        for ( i = 0; i < value; i++ )  fputc( ' ', listfile );
+        fprintf( listfile, "^\n%s\n", text );
+    }
+    else  {
+        if ( kind == LIST_LINE )  fprintf( listfile, "%3d ", value );
+        else  fprintf( listfile, "    " );
+        fputs( text, listfile );
+    }
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      FormatListing                                                        */
+/*                                                                           */
+/*      Places one piece of a listing in memory, exactly as "WriteListing"   */
+/*      would write it, e.g., to be written later in a batch. It writes      */
+/*      nothing beyond "size" bytes, and nothing but a null if the piece     */
+/*      does not fit.                                                        */
+/*                                                                           */
+/*      Input(s):      "buffer" and "size": where the piece is placed.       */
+/*                                                                           */
+/*                     "kind", "value" and "text": as for "WriteListing".    */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*      Returns:       The length of the piece, not counting the null. If    */
+/*                     it is "size" or more, the piece did not fit.          */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PUBLIC int FormatListing( char *buffer, size_t size, int kind, int value,
+                          char *text )
+{
+    char head[16], digits[12];
+    unsigned number;
+    int i = 0, n = 0, length;
+
+    if ( kind == LIST_ERROR )
+        return snprintf( buffer, size, "%*s^\n%s\n", value + 4, "", text );
+
+    /*  Lines are by far the most common piece, and snprintf's overhead    */
+    /*  would be most of the cost of placing them, so "%3d " is done by    */
+    /*  hand.                                                              */
+
+    if ( kind == LIST_LINE )  {
+        number = value < 0 ? -(unsigned) value : (unsigned) value;
+        do  digits[n++] = (char)( '0' + number % 10 );
+        while ( ( number /= 10 ) > 0 );
+        if ( value < 0 )  digits[n++] = '-';
+        for ( ; i + n < 3; i++ )  head[i] = ' ';
+        while ( n > 0 )  head[i++] = digits[--n];
+        head[i++] = ' ';
+    }
+    else  for ( ; i < 4; i++ )  head[i] = ' ';
+
+    length = (int) strlen( text );
+    if ( (size_t)( i + length ) < size )  {
+        memcpy( buffer, head, i );
+        memcpy( buffer + i, text, length + 1 );
+    }
+    else if ( size > 0 )  buffer[0] = '\0';
+    return i + length;
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      Private routines (only accessable within this module).               */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      NewLine                                                              */
+/*                                                                           */
+/*      Creates a new line and initialises its structures.                   */
+/*                                                                           */
+/*      Input(s):      cp, whose trap is sprung if out of memory.            */
+/*                                                                           */ 
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*      Returns:       Pointer to LINE structure                             */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE LINE *NewLine( CHARPROCESSOR *cp )
+{
+    LINE *p;
+    
+    if ( NULL == ( p = MemAlloc( MEM_LINES, sizeof(LINE) ) ) )
+        Fatal( cp->Trap, "error, failed to allocate memory for LINE" );
+    p->s = NULL;
+    p->size = 0;
+    GrowLine( cp, p, M_LINE_WIDTH );
+    p->valid = 0;
+    p->cpos = 0;
+    p->errors = -1;
+    p->LastError = -1;
+    p->number = 0;
+    p->id = 0;
+
+    return p;
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      GrowLine                                                             */
+/*                                                                           */
+/*      Makes room in a line's buffer for "length" characters, and the       */
+/*      newline and terminating null which may follow them.                  */
+/*                                                                           */
+/*      Input(s):      cp, whose trap is sprung if out of memory.            */
+/*                                                                           */
+/*                     line, the line.                                       */
+/*                                                                           */
+/*                     length, the characters it must hold.                  */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE void GrowLine( CHARPROCESSOR *cp, LINE *line, int length )
+{
+    line->s = Reserve( cp, line->s, &line->size, length + 2, 1 );
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      FreeLine                                                             */
+/*                                                                           */
+/*      Releases a line made by NewLine, and its buffer.                     */
+/*                                                                           */
+/*      Input(s):      line, the line, or NULL.                              */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE void FreeLine( LINE *line )
+{
+    if ( line != NULL )  MemFree( MEM_LINES, line->s, line->size );
+    MemFree( MEM_LINES, line, sizeof(LINE) );
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      SwapLines                                                            */
+/*                                                                           */
+/*      Swaps the pointers to two LINE structures.                           */
+/*                                                                           */
+/*      Input/Outputs(s):                                                    */
+/*                                                                           */ 
+/*          a, b       both pointers to pointers to LINE structures.E_NUMBER */ 
+/*                                                                           */ 
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*      Returns:       Nothing                                               */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE void SwapLines( LINE **a, LINE **b )
+{
+    LINE *temp;
+
+    temp = *a;
+    *a = *b;
+    *b = temp;
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      DisplayLine                                                          */
+/*                                                                           */
+/*      Displays the characters of the line passed to it as an argument.     */
+/*      The line is only displayed if the current ListFile is non-NULL and   */
+/*      if the line itself has a "valid" flag associated with it, and, when  */
+/*      only errors are listed (see SetListingMode), if it has errors.       */
+/*      This routine has significant side effects, the line becomes          */
+/*      invalid, the character position is reset to zero and its errors      */
+/*      are cleared.                                                         */
+/*                                                                           */
+/*      Input(s):                                                            */
+/*                                                                           */ 
+/*          number     integer. if equal to the constant DISPLAY_LINE_NUMBER */ 
+/*                     this is an instruction to display the current line    */ 
+/*                     number and increment it.                              */ 
+/*                                                                           */ 
+/*          line       Pointer to LINE structure                             */ 
+/*                                                                           */ 
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*      Returns:       Nothing                                               */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE void DisplayLine( CHARPROCESSOR *cp, int number, LINE *line )
+{
+    int i;
+
+    if ( line != NULL && line->valid && cp->Journal != NULL )  {
+        *((line->s)+line->cpos) = '\0';
+        cp->Journal( cp->JournalContext, line->id,
+                     number == DISPLAY_LINE_NUMBER, line->s );
+        line->valid = 0;
+        line->cpos = 0;
+        ClearErrors( cp, line );
+    }
+    else if ( line != NULL && line->valid && cp->ListFile != NULL &&
+              cp->Listing == LISTING_ERRORS && line->errors < 0 )  {
+        if ( number == DISPLAY_LINE_NUMBER )  cp->CurrentLineNum++;
+        line->valid = 0;
+        line->cpos = 0;
+    }
+    else if ( line != NULL && line->valid && cp->ListFile != NULL &&
+              cp->Listing != LISTING_NONE )  {
+        i = line->cpos;
+        *((line->s)+i) = '\0';
+        if ( number == DISPLAY_LINE_NUMBER )  {
+            ListText( cp, LIST_LINE, cp->CurrentLineNum, line->s );
+            cp->CurrentLineNum++;
+        }
+        else  ListText( cp, LIST_MORE, 0, line->s );
+        ListErrors( cp, line );
+        line->valid = 0;
+        line->cpos = 0;
+        ClearErrors( cp, line );
+    }
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      DisplayErrorMessage                                                  */
+/*                                                                           */
+/*      Displays an error message to the listing file. It is assumed that    */
+/*      the listing file is valid when the routine is called.                */
+/*                                                                           */
+/*      Input(s):                                                            */
+/*                                                                           */ 
+/*          indent     integer, the location of the error on the line        */
+/*                                                                           */ 
+/*          message    pointer to null-terminated character string, the      */
+/*                     error report.                                         */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE void DisplayErrorMessage( CHARPROCESSOR *cp, int indent,
+                                  char *message )
+{
+    ListText( cp, LIST_ERROR, indent, message );
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      AddError                                                             */
+/*                                                                           */
+/*      Adds an error to the end of a line's errors, copying its message,    */
+/*      cut to M_LINE_WIDTH characters, into the arena.                      */
+/*                                                                           */
+/*      Input(s):                                                            */
+/*                                                                           */
+/*          line       the line the error is reported against.               */
+/*                                                                           */
+/*          pos        its position in the line.                             */
+/*                                                                           */
+/*          message    pointer to null-terminated character string, the      */
+/*                     error report.                                         */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE void AddError( CHARPROCESSOR *cp, LINE *line, int pos,
+                       char *message )
+{
+    LINEERROR *error;
+    int length;
+
+    for ( length = 0; length < M_LINE_WIDTH && message[length] != '\0';
+          length++ )  ;
+    cp->Errors = Reserve( cp, cp->Errors, &cp->ErrorsSpace,
+                          cp->ErrorsUsed + 1, sizeof(LINEERROR) );
+    cp->Messages = Reserve( cp, cp->Messages, &cp->MessagesSpace,
+                            cp->MessagesUsed + length + 1, 1 );
+
+    error = &cp->Errors[cp->ErrorsUsed];
+    error->pos = pos;
+    error->message = cp->MessagesUsed;
+    error->next = -1;
+    memcpy( cp->Messages + cp->MessagesUsed, message, length );
+    cp->Messages[cp->MessagesUsed + length] = '\0';
+    cp->MessagesUsed += length + 1;
+
+    if ( line->LastError < 0 )  line->errors = cp->ErrorsUsed;
+    else  cp->Errors[line->LastError].next = cp->ErrorsUsed;
+    line->LastError = cp->ErrorsUsed++;
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      ListErrors                                                           */
+/*                                                                           */
+/*      Displays the errors of a line, in the order they were reported.      */
+/*                                                                           */
+/*      Input(s):      line, the line.                                       */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE void ListErrors( CHARPROCESSOR *cp, LINE *line )
+{
+    int i;
+
+    for ( i = line->errors; i >= 0; i = cp->Errors[i].next )
+        DisplayErrorMessage( cp, cp->Errors[i].pos,
+                             cp->Messages + cp->Errors[i].message );
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      ClearErrors                                                          */
+/*                                                                           */
+/*      Removes the errors of one of the two buffered lines. Only the other  */
+/*      line's errors remain in the arena, and they are moved down to its    */
+/*      start, so it never holds more than the errors of two lines. Each     */
+/*      line's errors are linked in the order they were added to the arena,  */
+/*      so each record and message moves down, if at all.                    */
+/*                                                                           */
+/*      Input(s):      line, the line.                                       */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE void ClearErrors( CHARPROCESSOR *cp, LINE *line )
+{
+    LINE *other;
+    LINEERROR *error;
+    int i, next, length;
+
+    line->errors = line->LastError = -1;
+    other = line == cp->CurrentLine ? cp->PreviousLine : cp->CurrentLine;
+    cp->ErrorsUsed = cp->MessagesUsed = 0;
+    if ( other == NULL || other->errors < 0 )  return;
+
+    for ( i = other->errors; i >= 0; i = next )  {
+        next = cp->Errors[i].next;
+        error = &cp->Errors[cp->ErrorsUsed];
+        *error = cp->Errors[i];
+        length = strlen( cp->Messages + error->message ) + 1;
+        memmove( cp->Messages + cp->MessagesUsed,
+                 cp->Messages + error->message, length );
+        error->message = cp->MessagesUsed;
+        error->next = next >= 0 ? cp->ErrorsUsed + 1 : -1;
+        cp->MessagesUsed += length;
+        cp->ErrorsUsed++;
+    }
+    other->errors = 0;
+    other->LastError = cp->ErrorsUsed - 1;
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      Reserve                                                              */
+/*                                                                           */
+/*      Grows a line's buffer, or an array of the error arena, by doubling,  */
+/*      until it has room for "needed" elements. Running out of memory is    */
+/*      fatal, as for NewLine.                                               */
+/*                                                                           */
+/*      Input(s):      cp, whose trap is sprung if out of memory.            */
+/*                                                                           */
+/*                     block, the array, or NULL.                            */
+/*                                                                           */
+/*                     needed, the elements it must hold, of "size" bytes.   */
+/*                                                                           */
+/*      Input/Output(s):                                                     */
+/*                                                                           */
+/*                     space, the elements it has room for.                  */
+/*                                                                           */
+/*      Returns:       The array, which may have moved.                      */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE void *Reserve( CHARPROCESSOR *cp, void *block, int *space,
+                       int needed, size_t size )
+{
+    int grown;
+
+    if ( needed <= *space )  return block;
+    for ( grown = *space > 0 ? *space : 8; grown < needed; grown *= 2 )  ;
+    if ( NULL == ( block = MemRealloc( MEM_LINES, block, *space * size,
+                                       grown * size ) ) )
+        Fatal( cp->Trap, "error, failed to allocate memory for a line" );
+    *space = grown;
+    return block;
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      ListText                                                             */
+/*                                                                           */
+/*      Passes one piece of the listing to the writer if there is one (see   */
+/*      SetListWriter), and otherwise writes it to the listing file.         */
+/*                                                                           */
+/*      Input(s):      As for "WriteListing".                                */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE void ListText( CHARPROCESSOR *cp, int kind, int value, char *text )
+{
+    if ( cp->Writer != NULL )
+        cp->Writer( cp->WriterContext, kind, value, text );
+    else  WriteListing( cp->ListFile, kind, value, text );
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      ErrorLineNum                                                         */
+/*                                                                           */
+/*      Returns the source line an error reported now is reported against.   */
+/*                                                                           */
+/*      Input(s):      cp, the character processor.                          */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*      Returns:       The line number, from 1.                              */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE int  ErrorLineNum( CHARPROCESSOR *cp )
+{
+    return cp->CurrentLine != NULL && cp->CurrentLine->valid ?
+           cp->CurrentLine->number : cp->LastLineNum;
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      Dropping                                                             */
+/*                                                                           */
+/*      Says whether an error on a line would be left out for the limits     */
+/*      set by "SetErrorLimits".                                             */
+/*                                                                           */
+/*      Input(s):      cp, the character processor.                          */
+/*                     line, the error's line.                               */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*      Returns:       1 if it would not be shown, 0 otherwise.              */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE int  Dropping( CHARPROCESSOR *cp, int line )
+{
+    return ErrorLimitReached( cp ) ||
+           ( cp->LineErrorLimit > 0 && line == cp->ErrorLine &&
+             cp->ErrorsOnLine >= cp->LineErrorLimit );
 }
@@ -12,19 +12,137 @@
 
 #include <stdio.h>
 #include "global.h"
+#include "sets.h"
+#include "timing.h"
+#include "fatal.h"
 
-#define  M_LINE_WIDTH          256              /* maximum line width        */
-                                                /* N.B, changed from 74 on   */
-                                                /* 2020/02/06.               */
-#define  M_ERRS_LINE             5              /* max displayed errors per  */
-                                                /* line                      */
-
-PUBLIC void   InitCharProcessor( FILE *inputfile, FILE *listfile );
-PUBLIC int    ReadChar( void );
-PUBLIC void   UnReadChar( void );
-PUBLIC int    CurrentCharPos( void );
-PUBLIC void   Error( char *ErrorString, int PositionInLine );
-PUBLIC void   SetTabWidth( int NewTabWidth );
-PUBLIC int    GetTabWidth( void );
+#define  M_LINE_WIDTH          256              /* initial line buffer, and  */
+                                                /* widest error message.     */
+                                                /* Lines may be any length.  */
+
+#define  LIST_LINE               0              /* kinds of listing output,  */
+#define  LIST_MORE               1              /* see WriteListing          */
+#define  LIST_ERROR              2
+
+#define  LISTING_NONE            0              /* listing modes, see        */
+#define  LISTING_ERRORS          1              /* SetListingMode            */
+#define  LISTING_FULL            2
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      ERRORREPORT describes one error to a report handler (see             */
+/*      SetReportHandler). The caller of ReportError fills in what kind of   */
+/*      error it is, and the tokens involved if it is a syntax error; the    */
+/*      character processor fills in where it is and the message.            */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+typedef struct  {
+    int  code;                      /* kind of error, 0 if not classified    */
+    int  got;                       /* token read, or -1                     */
+    int  expected;                  /* token expected, or -1                 */
+    SET  *expects;                  /* or any of these, or NULL              */
+    int  line;                      /* source line, from 1                   */
+    int  column;                    /* position in the line, from 1          */
+    char *message;                  /* NULL unless WantsMessage              */
+}
+    ERRORREPORT;
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      CHARPROCESSOR holds the complete state of one character processor.   */
+/*      Each compilation owns its own, so several may be active at once.     */
+/*      The fields are private to "line.c"; clients should only pass a       */
+/*      pointer to it to the routines below.                                 */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+typedef struct  {
+    struct line *CurrentLine;       /* line being assembled                  */
+    struct line *PreviousLine;      /* previous line, kept for UnReadChar    */
+    FILE *InputFile;                /* program text                          */
+    FILE *ListFile;                 /* listing, NULL if none                 */
+    FILE *ErrorFile;                /* echo of error messages, NULL if none  */
+    int  CurrentLineNum;            /* line number of the current line       */
+    int  LinesRead;                 /* newlines read so far                  */
+    int  LastLineNum;               /* source line of the last character     */
+    long CharsRead;                 /* characters read from InputFile        */
+    int  ErrorCount;                /* errors reported so far                */
+    void (*ErrorHandler)( void *context, int line, int column,
+                          char *message );
+    void *ErrorContext;             /* passed to ErrorHandler                */
+    void (*ReportHandler)( void *context, ERRORREPORT *report );
+    void *ReportContext;            /* passed to ReportHandler               */
+    int  PushBack;                  /* true after UnReadChar                 */
+    int  ReadEOF;                   /* true once EOF has been read           */
+    int  TabWidth;                  /* tab expansion width                   */
+    void (*Journal)( void *context, long id, int numbered, char *text );
+    void *JournalContext;           /* passed to Journal                     */
+    void (*Writer)( void *context, int kind, int value, char *text );
+    void *WriterContext;            /* passed to Writer                      */
+    int  Listing;                   /* LISTING_FULL, ERRORS or NONE          */
+    struct lineerror *Errors;       /* errors of the buffered lines, and     */
+    int  ErrorsUsed, ErrorsSpace;   /* their messages, see ClearErrors       */
+    char *Messages;
+    int  MessagesUsed, MessagesSpace;
+    int  ErrorLimit;                /* errors shown before stopping, and     */
+    int  LineErrorLimit;            /* per line, 0 for no limit, see         */
+    int  ErrorsShown;               /* SetErrorLimits                        */
+    int  ErrorLine, ErrorsOnLine;   /* line of the last error shown, and     */
+                                    /* the errors shown on it                */
+    int  ErrorsDropped;             /* not shown for LineErrorLimit          */
+    int  ErrorsPastLimit;           /* not shown for ErrorLimit              */
+    PHASETIMER *Timer;              /* times PHASE_READ, or NULL             */
+    FATALTRAP *Trap;                /* sprung if out of memory, or NULL      */
+}
+    CHARPROCESSOR;
+
+PUBLIC void   InitCharProcessor( CHARPROCESSOR *cp, FILE *inputfile,
+                                 FILE *listfile );
+PUBLIC void   FreeCharProcessor( CHARPROCESSOR *cp );
+PUBLIC int    ReadChar( CHARPROCESSOR *cp );
+PUBLIC void   UnReadChar( CHARPROCESSOR *cp );
+PUBLIC int    CurrentCharPos( CHARPROCESSOR *cp );
+PUBLIC long   CurrentCharOffset( CHARPROCESSOR *cp );
+PUBLIC int    ErrorsReported( CHARPROCESSOR *cp );
+PUBLIC void   Error( CHARPROCESSOR *cp, char *ErrorString,
+                     int PositionInLine );
+PUBLIC void   ReportError( CHARPROCESSOR *cp, ERRORREPORT *report,
+                           char *ErrorString, int PositionInLine );
+PUBLIC int    WantsMessage( CHARPROCESSOR *cp );
+PUBLIC void   SetErrorLimits( CHARPROCESSOR *cp, int errors, int PerLine );
+PUBLIC int    ErrorLimitReached( CHARPROCESSOR *cp );
+PUBLIC int    ErrorsDropped( CHARPROCESSOR *cp );
+PUBLIC int    ErrorsPastLimit( CHARPROCESSOR *cp );
+PUBLIC void   SetTabWidth( CHARPROCESSOR *cp, int NewTabWidth );
+PUBLIC int    GetTabWidth( CHARPROCESSOR *cp );
+PUBLIC void   SetErrorFile( CHARPROCESSOR *cp, FILE *errorfile );
+PUBLIC void   SetErrorHandler( CHARPROCESSOR *cp,
+                               void (*handler)( void *context, int line,
+                                                int column, char *message ),
+                               void *context );
+PUBLIC void   SetReportHandler( CHARPROCESSOR *cp,
+                                void (*handler)( void *context,
+                                                 ERRORREPORT *report ),
+                                void *context );
+PUBLIC void   SetCharPosition( CHARPROCESSOR *cp, long offset, int lines );
+PUBLIC long   CurrentLineId( CHARPROCESSOR *cp, int *line );
+PUBLIC void   SetJournal( CHARPROCESSOR *cp,
+                          void (*journal)( void *context, long id,
+                                           int numbered, char *text ),
+                          void *context );
+PUBLIC void   ReplayLine( CHARPROCESSOR *cp, long id, int line, long offset );
+PUBLIC void   ReplayDisplay( CHARPROCESSOR *cp, long id, int numbered,
+                             char *text );
+PUBLIC void   SetListWriter( CHARPROCESSOR *cp,
+                             void (*writer)( void *context, int kind,
+                                             int value, char *text ),
+                             void *context );
+PUBLIC void   SetListingMode( CHARPROCESSOR *cp, int mode );
+PUBLIC void   WriteListing( FILE *listfile, int kind, int value, char *text );
+PUBLIC void   SetPhaseTimer( CHARPROCESSOR *cp, PHASETIMER *timer );
+PUBLIC void   SetCharTrap( CHARPROCESSOR *cp, FATALTRAP *trap );
+PUBLIC int    FormatListing( char *buffer, size_t size, int kind, int value,
+                             char *text );
 
 #endif
@@ -0,0 +1,308 @@
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      lister.c                                                             */
+/*                                                                           */
+/*      Implementation file for the listing writer, which takes the writing  */
+/*      of the listing off the compiling thread.                             */
+/*                                                                           */
+/*      The compiling thread's character processor is given "ListerText"     */
+/*      as its list writer (see SetListWriter). It formats each piece of     */
+/*      the listing straight into a batch of about LISTER_BATCH bytes, and   */
+/*      when the batch is full queues it for the writer thread, which        */
+/*      writes it with a single fwrite and keeps it as a spare. The next     */
+/*      batch is a spare if there is one, and otherwise a new one, so the    */
+/*      compiling thread never waits for the listing to be written. In the   */
+/*      steady state two batches take turns, one being filled while the      */
+/*      other is written; more are only made while the writer falls          */
+/*      behind. The lock is taken once per batch, not once per line.         */
+/*                                                                           */
+/*      The listing is written in the order it was given, and is the same,   */
+/*      byte for byte, as if it had been written by "WriteListing". If       */
+/*      memory for a batch runs out, the compiling thread's trap is sprung   */
+/*      (see fatal.c) and the rest of the listing is dropped; what was       */
+/*      given before is still written by "StopLister".                       */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "line.h"
+#include "lister.h"
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      Function Prototypes for private routines                             */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE void  *Writer( void *arg );
+PRIVATE LISTBATCH *NextBatch( LISTER *lister, size_t size );
+PRIVATE void  Queue( LISTER *lister, LISTBATCH *batch );
+PRIVATE void  FreeBatches( LISTBATCH *batch );
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      Public routines (globally accessable).                               */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      StartLister                                                          */
+/*                                                                           */
+/*      Starts the writer thread for a listing. Nothing else may be          */
+/*      written to the listing file until "StopLister".                      */
+/*                                                                           */
+/*      Input(s):                                                            */
+/*                                                                           */
+/*          lister     the LISTER to start.                                  */
+/*          listfile   the listing file.                                     */
+/*          trap       the compiling thread's trap, or NULL, sprung by       */
+/*                     "ListerText" if memory runs out.                      */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*      Returns:       1 if the writer was started, 0 if there were not the  */
+/*                     resources, when the caller must write the listing     */
+/*                     itself.                                               */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PUBLIC int    StartLister( LISTER *lister, FILE *listfile, FATALTRAP *trap )
+{
+    memset( lister, 0, sizeof( LISTER ) );
+    lister->listfile = listfile;
+    lister->trap = trap;
+    if ( pthread_mutex_init( &lister->lock, NULL ) != 0 )  return 0;
+    if ( pthread_cond_init( &lister->queued, NULL ) != 0 )  {
+        pthread_mutex_destroy( &lister->lock );
+        return 0;
+    }
+    if ( NULL == ( lister->filling = NextBatch( lister, LISTER_BATCH ) ) ||
+         pthread_create( &lister->writer, NULL, Writer, lister ) != 0 )  {
+        FreeBatches( lister->filling );
+        pthread_cond_destroy( &lister->queued );
+        pthread_mutex_destroy( &lister->lock );
+        return 0;
+    }
+    return 1;
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      ListerText                                                           */
+/*                                                                           */
+/*      The list writer (see SetListWriter) of the compiling thread, which   */
+/*      adds one piece of the listing to the batch being filled, queueing    */
+/*      the batch first if the piece would not fit. A piece longer than a    */
+/*      batch gets a batch of its own. If there is no memory for the next    */
+/*      batch, this piece and every later one are dropped, and the trap is   */
+/*      sprung.                                                              */
+/*                                                                           */
+/*      Input(s):      context, the LISTER.                                  */
+/*                     kind, value and text, as for "WriteListing".          */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*      Returns:       Nothing                                               */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PUBLIC void   ListerText( void *context, int kind, int value, char *text )
+{
+    LISTER *lister = context;
+    LISTBATCH *batch = lister->filling, *next;
+    size_t length;
+
+    if ( lister->failed )  return;
+    length = FormatListing( batch->text + batch->used,
+                            batch->size - batch->used, kind, value, text );
+    if ( length >= batch->size - batch->used )  {
+        if ( NULL == ( next = NextBatch( lister, length + 1 ) ) )  {
+            lister->failed = 1;
+            Fatal( lister->trap,
+                   "error, failed to allocate memory for listing" );
+        }
+        Queue( lister, batch );
+        batch = lister->filling = next;
+        FormatListing( batch->text, batch->size, kind, value, text );
+    }
+    batch->used += length;
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      StopLister                                                           */
+/*                                                                           */
+/*      Queues the last batch, waits for the writer thread to write          */
+/*      everything, and releases the batches.                                */
+/*                                                                           */
+/*      Input(s):      lister, a LISTER started by "StartLister".            */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*      Returns:       Nothing                                               */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PUBLIC void   StopLister( LISTER *lister )
+{
+    Queue( lister, lister->filling );
+    lister->filling = NULL;
+    pthread_mutex_lock( &lister->lock );
+    lister->stopping = 1;
+    pthread_cond_signal( &lister->queued );
+    pthread_mutex_unlock( &lister->lock );
+    pthread_join( lister->writer, NULL );
+
+    FreeBatches( lister->spare );
+    lister->spare = NULL;
+    pthread_cond_destroy( &lister->queued );
+    pthread_mutex_destroy( &lister->lock );
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      Private routines (only accessable within this module).               */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      Writer                                                               */
+/*                                                                           */
+/*      The writer thread. Writes each batch as it is queued, and keeps it   */
+/*      as a spare, until "StopLister" has been called and the queue is      */
+/*      empty.                                                               */
+/*                                                                           */
+/*      Input(s):      arg, the LISTER.                                      */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*      Returns:       NULL                                                  */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE void  *Writer( void *arg )
+{
+    LISTER *lister = arg;
+    LISTBATCH *batch;
+
+    pthread_mutex_lock( &lister->lock );
+    for ( ;; )  {
+        while ( lister->queue == NULL && !lister->stopping )
+            pthread_cond_wait( &lister->queued, &lister->lock );
+        if ( NULL == ( batch = lister->queue ) )  break;
+        lister->queue = batch->next;
+        if ( lister->queue == NULL )  lister->last = NULL;
+        pthread_mutex_unlock( &lister->lock );
+
+        fwrite( batch->text, 1, batch->used, lister->listfile );
+        batch->used = 0;
+
+        pthread_mutex_lock( &lister->lock );
+        batch->next = lister->spare;
+        lister->spare = batch;
+    }
+    pthread_mutex_unlock( &lister->lock );
+    return NULL;
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      NextBatch                                                            */
+/*                                                                           */
+/*      Returns an empty batch of at least "size" bytes, a spare if there    */
+/*      is one.                                                              */
+/*                                                                           */
+/*      Input(s):      lister, the LISTER.                                   */
+/*                     size, the bytes needed.                               */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*      Returns:       The batch, or NULL if memory ran out.                 */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE LISTBATCH *NextBatch( LISTER *lister, size_t size )
+{
+    LISTBATCH *batch;
+
+    pthread_mutex_lock( &lister->lock );
+    if ( NULL != ( batch = lister->spare ) )  lister->spare = batch->next;
+    pthread_mutex_unlock( &lister->lock );
+
+    if ( batch == NULL && NULL != ( batch = malloc( sizeof( LISTBATCH ) ) ) )  {
+        batch->text = NULL;
+        batch->size = 0;
+    }
+    if ( size < LISTER_BATCH )  size = LISTER_BATCH;
+    if ( batch != NULL && batch->size < size )  {
+        free( batch->text );
+        if ( NULL != ( batch->text = malloc( size ) ) )  batch->size = size;
+    }
+    if ( batch != NULL && batch->text == NULL )  {
+        free( batch );
+        batch = NULL;
+    }
+    if ( batch == NULL )  return NULL;
+    batch->used = 0;
+    batch->next = NULL;
+    return batch;
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      Queue                                                                */
+/*                                                                           */
+/*      Passes a batch to the writer thread, or keeps it as a spare if it    */
+/*      is empty.                                                            */
+/*                                                                           */
+/*      Input(s):      lister, the LISTER.                                   */
+/*                     batch, the batch, which the caller gives up.          */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*      Returns:       Nothing                                               */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE void  Queue( LISTER *lister, LISTBATCH *batch )
+{
+    pthread_mutex_lock( &lister->lock );
+    if ( batch->used == 0 )  {
+        batch->next = lister->spare;
+        lister->spare = batch;
+    }
+    else  {
+        batch->next = NULL;
+        if ( lister->last == NULL )  lister->queue = batch;
+        else  lister->last->next = batch;
+        lister->last = batch;
+        pthread_cond_signal( &lister->queued );
+    }
+    pthread_mutex_unlock( &lister->lock );
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      FreeBatches                                                          */
+/*                                                                           */
+/*      Releases a list of batches.                                          */
+/*                                                                           */
+/*      Input(s):      batch, the first, or NULL.                            */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*      Returns:       Nothing                                               */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE void  FreeBatches( LISTBATCH *batch )
+{
+    LISTBATCH *next;
+
+    for ( ; batch != NULL; batch = next )  {
+        next = batch->next;
+        free( batch->text );
+        free( batch );
+    }
+}
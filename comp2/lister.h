@@ -0,0 +1,47 @@
+#ifndef  LISTERHEADER
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      lister.h                                                             */
+/*                                                                           */
+/*      Header file for "lister.c", containing the type definitions and      */
+/*      function prototypes for a listing writer, which writes the listing   */
+/*      in batches on a thread of its own while the program is compiled.     */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+#define  LISTERHEADER
+
+#include <stdio.h>
+#include <pthread.h>
+#include "global.h"
+#include "fatal.h"
+
+#define  LISTER_BATCH     (64 * 1024)   /* bytes handed to the writer at     */
+                                        /* once                              */
+
+typedef struct listbatch  {     /* a batch of the listing                    */
+    struct listbatch *next;     /* in the queue or among the spares          */
+    char *text;                 /* the listing, "used" of "size" bytes       */
+    size_t used, size;
+}
+    LISTBATCH;
+
+typedef struct  {               /* one listing being written                 */
+    FILE *listfile;
+    LISTBATCH *filling;         /* being filled by the compiling thread      */
+    pthread_t writer;           /* the writer thread                         */
+    pthread_mutex_t lock;       /* guards the rest                           */
+    pthread_cond_t queued;      /* signalled when a batch is queued          */
+    LISTBATCH *queue, *last;    /* full batches, oldest first                */
+    LISTBATCH *spare;           /* written batches, to be filled again       */
+    int  stopping;              /* set by StopLister                         */
+    int  failed;                /* out of memory, the rest is dropped        */
+    FATALTRAP *trap;            /* the compiling thread's, or NULL           */
+}
+    LISTER;
+
+PUBLIC int    StartLister( LISTER *lister, FILE *listfile, FATALTRAP *trap );
+PUBLIC void   ListerText( void *context, int kind, int value, char *text );
+PUBLIC void   StopLister( LISTER *lister );
+
+#endif
@@ -0,0 +1,335 @@
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      memory.c                                                             */
+/*                                                                           */
+/*      Implementation file for the memory accounts, which add up the store  */
+/*      taken by each subsystem of the compiler for a memory report.         */
+/*                                                                           */
+/*      The string table, the symbol table, the lines, the sets and the      */
+/*      code table allocate and free their store through "MemAlloc",         */
+/*      "MemRealloc" and "MemFree", naming their subsystem and the size of   */
+/*      each block, so that no header need be kept with the block. Until     */
+/*      "StartMemoryAccounting" is called these are just malloc, realloc     */
+/*      and free; after it every call is counted, under a lock, as threads   */
+/*      of the batch, pipeline and parallel compilers allocate at once.      */
+/*                                                                           */
+/*      The accounts are for the whole process, and whatever is still live   */
+/*      when the report is written, after every compiler has been freed,     */
+/*      has leaked.                                                          */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <sys/resource.h>
+#include "memory.h"
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      Data Structures for this module                                      */
+/*                                                                           */
+/*      "Accounts" holds the figures for each subsystem, "Live" and "Peak"   */
+/*      those for all of them together, and "Strings" what the string        */
+/*      tables have told "NoteStringTable" of how full their chunks were.    */
+/*      All are guarded by "Lock" once "Accounting" is set.                  */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+typedef struct  {
+    long allocs;                /* blocks allocated                          */
+    long frees;                 /* blocks freed                              */
+    long bytes;                 /* bytes allocated, over all blocks          */
+    long live;                  /* bytes allocated and not yet freed         */
+    long peak;                  /* the most live at any one time             */
+}
+    ACCOUNT;
+
+typedef struct  {
+    long tables;                /* string tables emptied                     */
+    long bytes;                 /* bytes in their chunks                     */
+    long held;                  /* bytes holding preserved strings           */
+    long lost;                  /* bytes left unused at the end of a chunk   */
+}                               /* when a string was moved to the next one   */
+    STRINGUSE;
+
+PRIVATE char *Names[MEM_SUBSYSTEMS] =  {
+    "strings", "symbols", "lines", "sets", "code"
+};
+
+PRIVATE int Accounting = 0;
+PRIVATE pthread_mutex_t Lock = PTHREAD_MUTEX_INITIALIZER;
+PRIVATE ACCOUNT Accounts[MEM_SUBSYSTEMS];
+PRIVATE long Live = 0, Peak = 0;
+PRIVATE STRINGUSE Strings;
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      Function Prototypes for private routines                             */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE void   Charge( int subsystem, long allocs, long frees, long bytes,
+                       long change );
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      Public routines (globally accessable).                               */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      StartMemoryAccounting                                                */
+/*                                                                           */
+/*      Starts counting every allocation. Must be called before any store    */
+/*      is allocated, and before any thread is started.                      */
+/*                                                                           */
+/*      Input(s):      None                                                  */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*      Returns:       Nothing                                               */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PUBLIC void   StartMemoryAccounting( void )
+{
+    Accounting = 1;
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      MemAlloc                                                             */
+/*                                                                           */
+/*      Allocates a block for a subsystem.                                   */
+/*                                                                           */
+/*      Input(s):      subsystem, the MEM_ account to charge.                */
+/*                     size, the size of the block in bytes.                 */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*      Returns:       The block, or NULL if there is no store, as malloc.   */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PUBLIC void   *MemAlloc( int subsystem, size_t size )
+{
+    void *block = malloc( size );
+
+    if ( Accounting && block != NULL )
+        Charge( subsystem, 1, 0, (long) size, (long) size );
+    return block;
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      MemRealloc                                                           */
+/*                                                                           */
+/*      Resizes a block allocated for a subsystem, or allocates one, as      */
+/*      realloc. A block which grows counts as one more allocation of its    */
+/*      new size, and the old one as freed.                                  */
+/*                                                                           */
+/*      Input(s):      subsystem, the MEM_ account to charge.                */
+/*                     block, the block, or NULL.                            */
+/*                     old, its size in bytes, 0 if block is NULL.           */
+/*                     size, the size it must become.                        */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*      Returns:       The block, which may have moved, or NULL if there     */
+/*                     is no store, as realloc.                              */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PUBLIC void   *MemRealloc( int subsystem, void *block, size_t old,
+                           size_t size )
+{
+    block = realloc( block, size );
+
+    if ( Accounting && block != NULL )
+        Charge( subsystem, 1, old > 0 ? 1 : 0, (long) size,
+                (long) size - (long) old );
+    return block;
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      MemFree                                                              */
+/*                                                                           */
+/*      Frees a block allocated for a subsystem.                             */
+/*                                                                           */
+/*      Input(s):      subsystem, the MEM_ account it was charged to.        */
+/*                     block, the block, or NULL.                            */
+/*                     size, its size in bytes, as last allocated.           */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*      Returns:       Nothing                                               */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PUBLIC void   MemFree( int subsystem, void *block, size_t size )
+{
+    if ( Accounting && block != NULL )
+        Charge( subsystem, 0, 1, 0, -(long) size );
+    free( block );
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      NoteStringTable                                                      */
+/*                                                                           */
+/*      Records how full the chunks of a string table were when it was       */
+/*      emptied, for the report of the string table's fragmentation.         */
+/*                                                                           */
+/*      Input(s):      bytes, the size of the chunks in use.                 */
+/*                     held, the bytes of them holding preserved strings.    */
+/*                     lost, the bytes left unused at the end of a chunk     */
+/*                     when a string was moved to the next one.              */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*      Returns:       Nothing                                               */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PUBLIC void   NoteStringTable( long bytes, long held, long lost )
+{
+    if ( !Accounting )  return;
+    pthread_mutex_lock( &Lock );
+    Strings.tables++;
+    Strings.bytes += bytes;
+    Strings.held += held;
+    Strings.lost += lost;
+    pthread_mutex_unlock( &Lock );
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      WriteMemoryReport                                                    */
+/*                                                                           */
+/*      Writes the accounts of each subsystem, the peak resident size of     */
+/*      the process, how full the string table's chunks were, and what has   */
+/*      leaked. With MEM_TABLE this is a table for people to read, e.g.,     */
+/*                                                                           */
+/*          Memory report: peak 23456 bytes live, peak resident 1820 KB      */
+/*            subsystem    allocs     frees        bytes       peak   live   */
+/*            strings           3         3         3096       3096      0   */
+/*            ...                                                            */
+/*                                                                           */
+/*      and with MEM_JSON a single line holding a JSON object, e.g.,         */
+/*                                                                           */
+/*          {"peak_bytes":23456,"peak_resident_kb":1820,"subsystems":        */
+/*           {"strings":{"allocs":3,"frees":3,"bytes":3096,"peak":3096,      */
+/*           "live":0},...},"string_table":{...},"leaked_bytes":0,           */
+/*           "leaked_blocks":0}                                              */
+/*                                                                           */
+/*      Input(s):      file, where the report is written.                    */
+/*                     format, MEM_TABLE or MEM_JSON.                        */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*      Returns:       Nothing                                               */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PUBLIC void   WriteMemoryReport( FILE *file, int format )
+{
+    struct rusage usage;
+    ACCOUNT total = { 0, 0, 0, 0, 0 };
+    long resident = 0;
+    int i;
+
+    if ( getrusage( RUSAGE_SELF, &usage ) == 0 )
+        resident = usage.ru_maxrss;             /* kilobytes, on Linux       */
+
+    pthread_mutex_lock( &Lock );
+    for ( i = 0; i < MEM_SUBSYSTEMS; i++ )  {
+        total.allocs += Accounts[i].allocs;
+        total.frees += Accounts[i].frees;
+        total.bytes += Accounts[i].bytes;
+        total.live += Accounts[i].live;
+    }
+    total.peak = Peak;
+
+    if ( format == MEM_JSON )  {
+        fprintf( file, "{\"peak_bytes\":%ld,\"peak_resident_kb\":%ld,"
+                 "\"subsystems\":{", Peak, resident );
+        for ( i = 0; i < MEM_SUBSYSTEMS; i++ )
+            fprintf( file, "%s\"%s\":{\"allocs\":%ld,\"frees\":%ld,"
+                     "\"bytes\":%ld,\"peak\":%ld,\"live\":%ld}",
+                     i == 0 ? "" : ",", Names[i], Accounts[i].allocs,
+                     Accounts[i].frees, Accounts[i].bytes, Accounts[i].peak,
+                     Accounts[i].live );
+        fprintf( file, "},\"string_table\":{\"tables\":%ld,\"bytes\":%ld,"
+                 "\"held\":%ld,\"lost\":%ld},\"leaked_bytes\":%ld,"
+                 "\"leaked_blocks\":%ld}\n", Strings.tables, Strings.bytes,
+                 Strings.held, Strings.lost, total.live,
+                 total.allocs - total.frees );
+        pthread_mutex_unlock( &Lock );
+        return;
+    }
+
+    fprintf( file, "Memory report: peak %ld bytes live, peak resident %ld KB\n",
+             Peak, resident );
+    fprintf( file, "  subsystem    allocs     frees        bytes       peak"
+             "       live\n" );
+    for ( i = 0; i < MEM_SUBSYSTEMS; i++ )
+        fprintf( file, "  %-9s %9ld %9ld %12ld %10ld %10ld\n", Names[i],
+                 Accounts[i].allocs, Accounts[i].frees, Accounts[i].bytes,
+                 Accounts[i].peak, Accounts[i].live );
+    fprintf( file, "  %-9s %9ld %9ld %12ld %10ld %10ld\n", "total",
+             total.allocs, total.frees, total.bytes, total.peak, total.live );
+    if ( Strings.bytes > 0 )
+        fprintf( file, "  string tables: %ld bytes in chunks, %.1f%% strings, "
+                 "%.1f%% lost at chunk ends\n", Strings.bytes,
+                 100.0 * Strings.held / Strings.bytes,
+                 100.0 * Strings.lost / Strings.bytes );
+    if ( total.live == 0 && total.allocs == total.frees )
+        fprintf( file, "  no leaks\n" );
+    else  {
+        fprintf( file, "  leaked %ld bytes in %ld blocks:", total.live,
+                 total.allocs - total.frees );
+        for ( i = 0; i < MEM_SUBSYSTEMS; i++ )
+            if ( Accounts[i].live != 0 )
+                fprintf( file, " %s %ld", Names[i], Accounts[i].live );
+        fprintf( file, "\n" );
+    }
+    pthread_mutex_unlock( &Lock );
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      Private routines (only accessable within this module).               */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      Charge                                                               */
+/*                                                                           */
+/*      Adds to the account of a subsystem, and to the peaks.                */
+/*                                                                           */
+/*      Input(s):      subsystem, the MEM_ account.                          */
+/*                     allocs, frees, blocks allocated and freed.            */
+/*                     bytes, bytes allocated.                               */
+/*                     change, how much the live bytes grow, or shrink.      */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*      Returns:       Nothing                                               */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE void   Charge( int subsystem, long allocs, long frees, long bytes,
+                       long change )
+{
+    ACCOUNT *account = &Accounts[subsystem];
+
+    pthread_mutex_lock( &Lock );
+    account->allocs += allocs;
+    account->frees += frees;
+    account->bytes += bytes;
+    account->live += change;
+    if ( account->live > account->peak )  account->peak = account->live;
+    Live += change;
+    if ( Live > Peak )  Peak = Live;
+    pthread_mutex_unlock( &Lock );
+}
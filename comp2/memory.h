@@ -0,0 +1,36 @@
+#ifndef  MEMORYHEADER
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      memory.h                                                             */
+/*                                                                           */
+/*      Header file for "memory.c", containing the subsystems whose store    */
+/*      is accounted for and the function prototypes for allocating it and   */
+/*      reporting on it.                                                     */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+#define  MEMORYHEADER
+
+#include <stdio.h>
+#include <stddef.h>
+#include "global.h"
+
+#define  MEM_STRINGS             0      /* chunks of the string tables       */
+#define  MEM_SYMBOLS             1      /* SYMBOLs of the symbol tables      */
+#define  MEM_LINES               2      /* LINEs, their text and errors      */
+#define  MEM_SETS                3      /* SETs made by MakeSet              */
+#define  MEM_CODE                4      /* code tables                       */
+#define  MEM_SUBSYSTEMS          5
+
+#define  MEM_TABLE               1      /* formats of "WriteMemoryReport"    */
+#define  MEM_JSON                2
+
+PUBLIC void   StartMemoryAccounting( void );
+PUBLIC void   *MemAlloc( int subsystem, size_t size );
+PUBLIC void   *MemRealloc( int subsystem, void *block, size_t old,
+                           size_t size );
+PUBLIC void   MemFree( int subsystem, void *block, size_t size );
+PUBLIC void   NoteStringTable( long bytes, long held, long lost );
+PUBLIC void   WriteMemoryReport( FILE *file, int format );
+
+#endif
@@ -0,0 +1,441 @@
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      object.c                                                             */
+/*                                                                           */
+/*      Implementation file for relocatable object files. "comp2 --object"   */
+/*      writes one for each program it compiles, and "cpllink" reads them    */
+/*      and combines them into a single machine code program.                */
+/*                                                                           */
+/*      An object file is text. After a header naming the program and        */
+/*      giving the sizes of its code and data, come its symbols:             */
+/*                                                                           */
+/*          global <name> <address>                                          */
+/*          export <name> <address> <pcount> <ptypes>                        */
+/*          import <name> <pcount> <ptypes>                                  */
+/*                                                                           */
+/*      Globals are the program's variables, which the linker shares by      */
+/*      name between the objects declaring them. Exports are its outermost   */
+/*      procedures, imports the procedures it declares EXTERNAL, numbered    */
+/*      from 0 in the order given. Then comes the code, one instruction per  */
+/*      line as opcode, address field and the link which says how the        */
+/*      linker is to relocate the address field:                             */
+/*                                                                           */
+/*          LINK_CODE       a branch or call within the object.              */
+/*                                                                           */
+/*          LINK_DATA       the address of a global or of a main program     */
+/*                          temporary, in a "Load" or "Store <addr>", or     */
+/*                          a "Load #<datum>" passing a global by REF.       */
+/*                                                                           */
+/*          LINK_IMPORT     a "Call" of an EXTERNAL procedure; the address   */
+/*                          field is its import number.                      */
+/*                                                                           */
+/*          LINK_ABSOLUTE   anything else (frame offsets, constants).        */
+/*                                                                           */
+/*      Inside the compiler a call of import n is a "Call" of address        */
+/*      -1-n, which no code address can be mistaken for.                     */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "code.h"
+#include "symbol.h"
+#include "object.h"
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      Definitions of constants local to the module                         */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+#define  OBJECT_LINE    512     /* longest line of an object file            */
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      Function Prototypes for private routines                             */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE int   LinkOf( INSTRUCTION *inst );
+PRIVATE int   ReadLine( FILE *objectfile, char *buffer, int *line );
+PRIVATE int   ReadSymbols( FILE *objectfile, char *keyword, int limit,
+                           int withparameters, OBJECTSYMBOL *symbols,
+                           int count, int *line );
+PRIVATE int   ValidInstruction( OBJECT *object, INSTRUCTION *inst,
+                                int link );
+PRIVATE char *CopyOf( char *s );
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      Public routines (globally accessable).                               */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      WriteObjectFile                                                      */
+/*                                                                           */
+/*      Outputs the contents of the CodeTable as an object file. As for      */
+/*      "WriteCodeFile", only a note is written if errors were found, and    */
+/*      the file is flushed but not closed.                                  */
+/*                                                                           */
+/*      Input(s):                                                            */
+/*                                                                           */
+/*          cg         the code generator, whose imports are calls of        */
+/*                     addresses -1, -2, ...                                 */
+/*          objectfile the file to write.                                    */
+/*          module     the program name.                                     */
+/*          symbols    the program's global variables and outermost          */
+/*                     procedures, EXTERNAL ones having addresses -1, -2,    */
+/*                     ..., "count" in all.                                  */
+/*          DataSize   words of global data the code uses.                   */
+/*          body       code address of the main program's block.             */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*      Returns:       Nothing                                               */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PUBLIC void   WriteObjectFile( CODEGEN *cg, FILE *objectfile, char *module,
+                               SYMBOL **symbols, int count, int DataSize,
+                               int body )
+{
+    SYMBOL *sym;
+    int i, n, link, address, globals = 0, exports = 0, imports = 0;
+
+    if ( cg->ErrorsInProgram )  {
+        fprintf( objectfile, ";; Errors detected in input file, no object\n" );
+        fprintf( objectfile, ";; file generated\n" );
+        fflush( objectfile );
+        return;
+    }
+
+    for ( i = 0; i < count; i++ )
+        if ( symbols[i]->type == STYPE_VARIABLE )  globals++;
+        else if ( symbols[i]->address >= 0 )  exports++;
+        else  imports++;
+
+    fprintf( objectfile, "%s\nmodule %s\n", OBJECT_MAGIC, module );
+    fprintf( objectfile, "code %d data %d body %d\n", cg->CodePosition,
+             DataSize, body );
+    fprintf( objectfile, "globals %d exports %d imports %d\n", globals,
+             exports, imports );
+    for ( i = 0; i < count; i++ )
+        if ( symbols[i]->type == STYPE_VARIABLE )
+            fprintf( objectfile, "global %s %d\n", symbols[i]->s,
+                     symbols[i]->address );
+    for ( i = 0; i < count; i++ )  {
+        sym = symbols[i];
+        if ( sym->type == STYPE_PROCEDURE && sym->address >= 0 )
+            fprintf( objectfile, "export %s %d %d %d\n", sym->s,
+                     sym->address, sym->pcount, sym->ptypes );
+    }
+    for ( n = 0; n < imports; n++ )
+        for ( i = 0; i < count; i++ )  {
+            sym = symbols[i];
+            if ( sym->type == STYPE_PROCEDURE && sym->address == -1 - n )
+                fprintf( objectfile, "import %s %d %d\n", sym->s,
+                         sym->pcount, sym->ptypes );
+        }
+
+    for ( i = 0; i < cg->CodePosition; i++ )  {
+        link = LinkOf( &cg->CodeTable[i] );
+        address = cg->CodeTable[i].address;
+        if ( link == LINK_IMPORT )  address = -1 - address;
+        fprintf( objectfile, "%d %d %c\n", cg->CodeTable[i].opcode, address,
+                 link );
+    }
+    fflush( objectfile );
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      ReadObjectFile                                                       */
+/*                                                                           */
+/*      Reads an object file written by "WriteObjectFile", checking that     */
+/*      every address it holds is within the object.                         */
+/*                                                                           */
+/*      Input(s):      objectfile, open for reading.                         */
+/*                                                                           */
+/*      Output(s):     *object, the contents of the file; release it with    */
+/*                     "FreeObject".                                         */
+/*                     *line, on failure, the number of the offending line,  */
+/*                     or 0 if memory ran out.                               */
+/*                                                                           */
+/*      Returns:       1 if the file was read, 0 if it is not a well formed  */
+/*                     object file, when nothing need be freed.              */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PUBLIC int    ReadObjectFile( FILE *objectfile, OBJECT *object, int *line )
+{
+    char buffer[OBJECT_LINE], name[OBJECT_LINE];
+    int i, link;
+
+    memset( object, 0, sizeof( OBJECT ) );
+    *line = 0;
+
+    if ( !ReadLine( objectfile, buffer, line ) ||
+         strcmp( buffer, OBJECT_MAGIC ) != 0 )  return 0;
+    if ( !ReadLine( objectfile, buffer, line ) ||
+         sscanf( buffer, "module %s", name ) != 1 )  return 0;
+    if ( NULL == ( object->module = CopyOf( name ) ) )  {
+        *line = 0;
+        return 0;
+    }
+    if ( !ReadLine( objectfile, buffer, line ) ||
+         sscanf( buffer, "code %d data %d body %d", &object->CodeSize,
+                 &object->DataSize, &object->body ) != 3 ||
+         !ReadLine( objectfile, buffer, line ) ||
+         sscanf( buffer, "globals %d exports %d imports %d",
+                 &object->GlobalCount, &object->ExportCount,
+                 &object->ImportCount ) != 3 ||
+         object->CodeSize < 0 || object->CodeSize > CODE_LIMIT ||
+         object->body < 0 || object->body >= object->CodeSize ||
+         object->DataSize < 0 || object->GlobalCount < 0 ||
+         object->GlobalCount > object->DataSize ||
+         object->ExportCount < 0 || object->ExportCount > CODE_LIMIT ||
+         object->ImportCount < 0 || object->ImportCount > CODE_LIMIT )  {
+        FreeObject( object );
+        return 0;
+    }
+
+    object->globals = calloc( object->GlobalCount + 1, sizeof( OBJECTSYMBOL ) );
+    object->exports = calloc( object->ExportCount + 1, sizeof( OBJECTSYMBOL ) );
+    object->imports = calloc( object->ImportCount + 1, sizeof( OBJECTSYMBOL ) );
+    object->code = malloc( ( object->CodeSize + 1 ) * sizeof( INSTRUCTION ) );
+    object->link = malloc( object->CodeSize + 1 );
+    if ( object->globals == NULL || object->exports == NULL ||
+         object->imports == NULL || object->code == NULL ||
+         object->link == NULL )  {
+        FreeObject( object );
+        *line = 0;
+        return 0;
+    }
+
+    if ( !ReadSymbols( objectfile, "global", object->DataSize, 0,
+                       object->globals, object->GlobalCount, line ) ||
+         !ReadSymbols( objectfile, "export", object->CodeSize, 1,
+                       object->exports, object->ExportCount, line ) ||
+         !ReadSymbols( objectfile, "import", -1, 1, object->imports,
+                       object->ImportCount, line ) )  {
+        FreeObject( object );
+        return 0;
+    }
+
+    for ( i = 0; i < object->CodeSize; i++ )  {
+        if ( !ReadLine( objectfile, buffer, line ) ||
+             sscanf( buffer, "%d %d %c", &object->code[i].opcode,
+                     &object->code[i].address, name ) != 3 ||
+             !ValidInstruction( object, &object->code[i], name[0] ) )  {
+            FreeObject( object );
+            return 0;
+        }
+        link = object->link[i] = name[0];
+        object->code[i].data = ( link == LINK_DATA &&
+                                 object->code[i].opcode == I_LOADI );
+    }
+    if ( ReadLine( objectfile, buffer, line ) )  {
+        FreeObject( object );
+        return 0;
+    }
+    return 1;
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      FreeObject                                                           */
+/*                                                                           */
+/*      Releases everything "ReadObjectFile" allocated for an object.        */
+/*                                                                           */
+/*      Input(s):      object, filled in by "ReadObjectFile".                */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*      Returns:       Nothing                                               */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PUBLIC void   FreeObject( OBJECT *object )
+{
+    int i;
+
+    if ( object->globals != NULL )
+        for ( i = 0; i < object->GlobalCount; i++ )
+            free( object->globals[i].name );
+    if ( object->exports != NULL )
+        for ( i = 0; i < object->ExportCount; i++ )
+            free( object->exports[i].name );
+    if ( object->imports != NULL )
+        for ( i = 0; i < object->ImportCount; i++ )
+            free( object->imports[i].name );
+    free( object->globals );
+    free( object->exports );
+    free( object->imports );
+    free( object->code );
+    free( object->link );
+    free( object->module );
+    memset( object, 0, sizeof( OBJECT ) );
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      Private routines (only accessable from within this module).          */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      LinkOf                                                               */
+/*                                                                           */
+/*      Determines how the linker must relocate an instruction's address     */
+/*      field.                                                               */
+/*                                                                           */
+/*      Input(s):      inst, the instruction.                                */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*      Returns:       One of the LINK_... codes.                            */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE int   LinkOf( INSTRUCTION *inst )
+{
+    if ( inst->opcode == I_CALL && inst->address < 0 )  return LINK_IMPORT;
+    if ( inst->opcode >= I_BR && inst->opcode <= I_CALL )  return LINK_CODE;
+    if ( inst->opcode == I_LOADA || inst->opcode == I_STOREA || inst->data )
+        return LINK_DATA;
+    return LINK_ABSOLUTE;
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      ReadLine                                                             */
+/*                                                                           */
+/*      Reads the next line of an object file, without its newline.          */
+/*                                                                           */
+/*      Input(s):      objectfile, the file being read.                      */
+/*                                                                           */
+/*      Output(s):     buffer, of OBJECT_LINE characters, the line.          */
+/*                     *line, incremented.                                   */
+/*                                                                           */
+/*      Returns:       1 if a line was read, 0 at the end of the file or if  */
+/*                     the line is too long.                                 */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE int   ReadLine( FILE *objectfile, char *buffer, int *line )
+{
+    char *newline;
+
+    (*line)++;
+    if ( fgets( buffer, OBJECT_LINE, objectfile ) == NULL )  return 0;
+    if ( NULL == ( newline = strchr( buffer, '\n' ) ) )  return 0;
+    *newline = '\0';
+    return 1;
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      ReadSymbols                                                          */
+/*                                                                           */
+/*      Reads "count" symbol lines which start with "keyword".               */
+/*                                                                           */
+/*      Input(s):      objectfile, the file being read.                      */
+/*                     keyword, "global", "export" or "import".              */
+/*                     limit, the addresses the symbols may have are 0 ..    */
+/*                     limit-1, or -1 if the lines give no address.          */
+/*                     withparameters, whether the lines give a parameter    */
+/*                     count and types.                                      */
+/*                                                                           */
+/*      Output(s):     symbols, the "count" symbols read.                    */
+/*                     *line, the number of the last line read.              */
+/*                                                                           */
+/*      Returns:       1 if they were read, 0 if a line was malformed or     */
+/*                     memory ran out (*line 0).                             */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE int   ReadSymbols( FILE *objectfile, char *keyword, int limit,
+                           int withparameters, OBJECTSYMBOL *symbols,
+                           int count, int *line )
+{
+    char buffer[OBJECT_LINE], word[OBJECT_LINE], name[OBJECT_LINE];
+    OBJECTSYMBOL *sym;
+    int i, fields, expected;
+
+    expected = 2 + ( limit >= 0 ) + 2 * withparameters;
+    for ( i = 0; i < count; i++ )  {
+        sym = &symbols[i];
+        if ( !ReadLine( objectfile, buffer, line ) )  return 0;
+        if ( limit >= 0 )
+            fields = sscanf( buffer, "%s %s %d %d %d", word, name,
+                             &sym->address, &sym->pcount, &sym->ptypes );
+        else
+            fields = sscanf( buffer, "%s %s %d %d", word, name,
+                             &sym->pcount, &sym->ptypes );
+        if ( fields != expected || strcmp( word, keyword ) != 0 ||
+             ( limit >= 0 && ( sym->address < 0 || sym->address >= limit ) ) )
+            return 0;
+        if ( NULL == ( sym->name = CopyOf( name ) ) )  {
+            *line = 0;
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      ValidInstruction                                                     */
+/*                                                                           */
+/*      Checks that an instruction of an object has a known opcode and a     */
+/*      link which suits it, and that an address the linker relocates is     */
+/*      within the object.                                                   */
+/*                                                                           */
+/*      Input(s):      object, being read; its sizes and imports are known.  */
+/*                     inst, the instruction, with its link.                 */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*      Returns:       1 if it is valid, else 0.                             */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE int   ValidInstruction( OBJECT *object, INSTRUCTION *inst, int link )
+{
+    int opcode = inst->opcode, address = inst->address;
+
+    switch ( link )  {
+        case LINK_ABSOLUTE :
+            return  opcode >= I_ADD && opcode <= I_STORESP &&
+                    ( opcode < I_BR || opcode > I_CALL ) &&
+                    opcode != I_LOADA && opcode != I_STOREA;
+        case LINK_CODE :
+            return  opcode >= I_BR && opcode <= I_CALL &&
+                    address >= 0 && address < object->CodeSize;
+        case LINK_DATA :
+            return  ( opcode == I_LOADA || opcode == I_STOREA ||
+                      opcode == I_LOADI ) &&
+                    address >= 0 && address < object->DataSize;
+        case LINK_IMPORT :
+            return  opcode == I_CALL && address >= 0 &&
+                    address < object->ImportCount;
+        default :
+            return  0;
+    }
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      CopyOf                                                               */
+/*                                                                           */
+/*      Returns a malloc'd copy of a string, or NULL if out of memory.       */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE char *CopyOf( char *s )
+{
+    char *copy;
+
+    if ( NULL != ( copy = malloc( strlen( s ) + 1 ) ) )  strcpy( copy, s );
+    return copy;
+}
@@ -0,0 +1,56 @@
+#ifndef  OBJECTHEADER
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      object.h                                                             */
+/*                                                                           */
+/*      Header file for "object.c", containing type definitions and          */
+/*      function prototypes for relocatable object files, which hold the     */
+/*      code of one separately compiled program for "cpllink".               */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+#define  OBJECTHEADER
+
+#include <stdio.h>
+#include "global.h"
+#include "code.h"
+#include "symbol.h"
+
+#define  OBJECT_MAGIC   "CPLOBJECT 1"   /* first line of every object file   */
+
+#define  LINK_ABSOLUTE  'a'     /* address field used as it is               */
+#define  LINK_CODE      'c'     /* code address within the object            */
+#define  LINK_DATA      'd'     /* data address within the object            */
+#define  LINK_IMPORT    'i'     /* "Call" of imports[address]                */
+
+typedef struct  {               /* a symbol an object defines or uses        */
+    char *name;
+    int  address;               /* code address of an export, data address   */
+    int  pcount;                /* of a global, unused for an import. The    */
+    int  ptypes;                /* parameters are those of a procedure.      */
+}
+    OBJECTSYMBOL;
+
+typedef struct  {               /* one object file, see ReadObjectFile       */
+    char *module;               /* program name                              */
+    INSTRUCTION *code;          /* addresses as the LINK_... in link[] say   */
+    char *link;
+    int  CodeSize;
+    int  DataSize;              /* globals, then main program temporaries    */
+    int  body;                  /* code address of the main program block    */
+    OBJECTSYMBOL *globals;      /* global variables, shared by name          */
+    int  GlobalCount;
+    OBJECTSYMBOL *exports;      /* procedures declared in the object         */
+    int  ExportCount;
+    OBJECTSYMBOL *imports;      /* EXTERNAL procedures                       */
+    int  ImportCount;
+}
+    OBJECT;
+
+PUBLIC void   WriteObjectFile( CODEGEN *cg, FILE *objectfile, char *module,
+                               SYMBOL **symbols, int count, int DataSize,
+                               int body );
+PUBLIC int    ReadObjectFile( FILE *objectfile, OBJECT *object, int *line );
+PUBLIC void   FreeObject( OBJECT *object );
+
+#endif
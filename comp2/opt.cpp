@@ -0,0 +1,1561 @@
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      opt.c                                                                */
+/*                                                                           */
+/*      Implementation file for the optimiser.                               */
+/*                                                                           */
+/*      The optimisation routines work on code which the parser has already  */
+/*      placed in the code table, using the "GetInstruction", "InsertCode",  */
+/*      "DeleteCode", "RemoveCode" and "RewriteCode" routines of the code    */
+/*      generator.                                                           */
+/*      Since the target is a stack machine, an expression is a contiguous   */
+/*      run of instructions (in postfix order) whose net effect is to push   */
+/*      one value. The passes find such runs by simulating the operand       */
+/*      stack symbolically, each stack entry recording where the             */
+/*      instructions which compute it start and how many of them there are.  */
+/*                                                                           */
+/*          "HoistLoopInvariants" -- moves expressions whose value cannot    */
+/*          change while a WHILE loop runs out of the loop. Each is          */
+/*          computed once, into a temporary, in a "preheader" placed in      */
+/*          front of the loop condition, and its occurrences in the loop     */
+/*          are replaced by a load of the temporary.                         */
+/*                                                                           */
+/*          "EliminateCommonSubexpressions" -- local value numbering. Within */
+/*          each basic block, an expression which computes a value already   */
+/*          computed earlier in the block is replaced by a load of a         */
+/*          temporary, into which the earlier result is spilled.             */
+/*                                                                           */
+/*          "OrderOperands" -- Sethi-Ullman ordering. The operands of "Add"  */
+/*          and "Mult" are swapped where evaluating the one which needs      */
+/*          more stack first lowers the stack depth of the expression.       */
+/*                                                                           */
+/*          "MaxStackDepth" -- the deepest the operand stack gets in a       */
+/*          range of code, found by following every path through it.         */
+/*                                                                           */
+/*          "EmitOperation", "EmitNegation" -- used by the parser in place   */
+/*          of "Emit" for arithmetic. They simplify the operation with the   */
+/*          code of its operands, which has just been emitted: constants     */
+/*          are folded, identities and annihilators removed, and some        */
+/*          operations replaced by cheaper ones. The operands are the last   */
+/*          code in the table, so dropping them relocates nothing.           */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+#include "code.h"
+#include "opt.h"
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      Definitions of constants local to the module                         */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+#define  MAX_OPERANDS                   256   /* symbolic stack depth        */
+#define  MAX_CANDIDATES                 256   /* expressions per pass        */
+#define  MAX_VALUES                     256   /* value numbers per block     */
+#define  MAX_LOCATIONS                   64   /* stored variables per block  */
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      Data Structures for this module                                      */
+/*                                                                           */
+/*      OPERAND is an entry on the symbolic operand stack: the value is      */
+/*      computed by the "length" instructions starting at "start".           */
+/*      "invariant" is set if none of the values it depends on can change    */
+/*      in the region being examined. "value" is its value number, or -1     */
+/*      if not known.                                                        */
+/*                                                                           */
+/*      CANDIDATE is an expression which is to be replaced by a load of      */
+/*      temporary "temp".                                                    */
+/*                                                                           */
+/*      "Clobbered" is set if the region contains a call or a store through  */
+/*      a computed address ("Store [SP]"), either of which may write any     */
+/*      variable, e.g., a global written by a procedure, or the variable a   */
+/*      REF parameter refers to.                                             */
+/*                                                                           */
+/*      Value numbering: VALUE maps an operation on operands (themselves     */
+/*      value numbers, or an address and its version) to a value number.     */
+/*      A variable's version changes whenever it may have been written, so   */
+/*      a load after a store gets a new value number. Versions come from     */
+/*      "MemoryGen", which counts writes: a direct store records the count   */
+/*      in LOCATION, while a call or "Store [SP]" sets "LastClobber", which  */
+/*      every variable then takes as its version. Loads through a computed   */
+/*      address use "MemoryGen" itself, so any store at all changes them.    */
+/*                                                                           */
+/*      NODE is an expression of two or more instructions found while        */
+/*      numbering, EDIT a change to be made to the code: either a "Load" of  */
+/*      a temporary replacing an expression, or a "Store"/"Load" pair after  */
+/*      the expression's first occurrence, saving its value for later ones.  */
+/*                                                                           */
+/*      OPTIMISER gathers all of the above for one pass. Each public routine */
+/*      keeps its own on the stack, so passes over different code tables     */
+/*      may run at the same time. "code" is the table being rewritten.       */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+typedef struct  {
+    int start;
+    int length;
+    int invariant;
+    int value;
+}
+    OPERAND;
+
+typedef struct  {
+    int start;
+    int length;
+    int temp;
+}
+    CANDIDATE;
+
+typedef struct  {
+    int opcode;
+    int field;
+    int left;
+    int right;
+    int value;
+}
+    VALUE;
+
+typedef struct  {
+    int opcode;
+    int address;
+    int gen;
+}
+    LOCATION;
+
+typedef struct  {
+    int start;
+    int length;
+    int value;
+}
+    NODE;
+
+typedef struct  {
+    int position;
+    int spill;
+    int length;
+    int value;
+}
+    EDIT;
+
+typedef struct  {
+    CODEGEN   *code;
+
+    OPERAND    Operands[MAX_OPERANDS];
+    int        OperandCount;
+    CANDIDATE  Candidates[MAX_CANDIDATES];
+    int        CandidateCount;
+    int        Clobbered;
+    int        Overflow;
+
+    VALUE      Values[MAX_VALUES];
+    int        ValueCount;
+    int        NextValue;
+    LOCATION   Locations[MAX_LOCATIONS];
+    int        LocationCount;
+    int        MemoryGen;
+    int        LastClobber;
+
+    char      *Leaders;         /* per instruction, starts a block          */
+    NODE      *Nodes;
+    int        NodeCount;
+    int       *Occurrences;     /* per value number                         */
+    int       *Definers;        /* per value number, index in "Nodes"       */
+    int       *Temps;           /* per value number                         */
+    EDIT      *Edits;
+    int        EditCount;
+}
+    OPTIMISER;
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      Function Prototypes for private routines                             */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE void  FindInvariants( OPTIMISER *opt, int LoopStart, int LoopEnd );
+PRIVATE int   IsStoredTo( CODEGEN *cg, int StoreOp, int address,
+                          int start, int end );
+PRIVATE void  PushOperand( OPTIMISER *opt, int start, int length,
+                           int invariant );
+PRIVATE OPERAND PopOperand( OPTIMISER *opt );
+PRIVATE void  Consume( OPTIMISER *opt, OPERAND x );
+PRIVATE void  ConsumeAll( OPTIMISER *opt );
+PRIVATE int   IsNonZeroConst( CODEGEN *cg, OPERAND x );
+PRIVATE int   IsContiguous( OPERAND a, OPERAND b, int codeaddr );
+PRIVATE int   SameCode( CODEGEN *cg, int a, int b, int length );
+PRIVATE int   MayTrap( CODEGEN *cg, int start, int length );
+PRIVATE void  SortCandidates( OPTIMISER *opt );
+PRIVATE void  MarkLeaders( OPTIMISER *opt, int start, int end );
+PRIVATE void  NumberValues( OPTIMISER *opt, int start, int end );
+PRIVATE void  SelectReuses( OPTIMISER *opt );
+PRIVATE void  ResetBlock( OPTIMISER *opt );
+PRIVATE void  PushValue( OPTIMISER *opt, int start, int length, int value );
+PRIVATE void  Combine( OPTIMISER *opt, int codeaddr, int opcode, int field,
+                       OPERAND a, OPERAND b, int right );
+PRIVATE int   ValueNumber( OPTIMISER *opt, int opcode, int field,
+                           int left, int right );
+PRIVATE int   LocationVersion( OPTIMISER *opt, int StoreOp, int address );
+PRIVATE void  StoreLocation( OPTIMISER *opt, int StoreOp, int address );
+PRIVATE int   CompareNodes( const void *a, const void *b );
+PRIVATE int   CompareEdits( const void *a, const void *b );
+PRIVATE void  SwapOperands( CODEGEN *cg, OPERAND a, OPERAND b );
+PRIVATE void  SetEdit( CODEEDIT *edit, int codeaddr, int count, int opcode,
+                       int value );
+PRIVATE int   IsConstant( CODEGEN *cg, int start, int length, int *value );
+PRIVATE int   FoldConstants( int opcode, int a, int b, int *result );
+PRIVATE void  CopyCode( CODEGEN *cg, int start, int length );
+PRIVATE int   StackEffect( int opcode, int value );
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      Public routines (globally accessable).                               */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      HoistLoopInvariants                                                  */
+/*                                                                           */
+/*      Performs loop-invariant code motion on one WHILE loop. The loop      */
+/*      occupies code addresses LoopStart .. LoopEnd-1, starting with the    */
+/*      loop condition and ending with the branch back to it.                */
+/*                                                                           */
+/*      An expression is invariant if it is built only from constants,       */
+/*      "Push FP" and loads of variables which are not stored to anywhere    */
+/*      in the loop. If the loop contains a call or an indirect store,       */
+/*      only constant expressions are invariant, and indirect loads (REF     */
+/*      parameters, variables of enclosing procedures) never are. A          */
+/*      division is only hoisted if its divisor is a non-zero constant,      */
+/*      as the preheader runs even when the loop body does not. Single       */
+/*      instructions are not worth hoisting. Identical expressions share     */
+/*      a temporary.                                                         */
+/*                                                                           */
+/*      Branches from outside the loop to its start are left pointing at     */
+/*      the preheader, the loop's own branch back skips it. The changes are  */
+/*      made together (see "RewriteCode"), and only the code of the block    */
+/*      which holds the loop is searched for branches to it.                 */
+/*                                                                           */
+/*      Input(s):                                                            */
+/*                                                                           */
+/*          cg             pointer to the CODEGEN holding the code.          */
+/*                                                                           */
+/*          BlockStart     integer, address where the block of the main      */
+/*                         program or procedure holding the loop begins,     */
+/*                         which no code before it branches past.            */
+/*                                                                           */
+/*          LoopStart      integer, address of the loop condition.           */
+/*                                                                           */
+/*          LoopEnd        integer, address just beyond the loop's branch    */
+/*                         back to its condition.                            */
+/*                                                                           */
+/*          NewTemporary   routine which allocates a temporary variable      */
+/*                         and returns its address (or FP offset). It is     */
+/*                         passed "context".                                 */
+/*                                                                           */
+/*          InFrame        integer, non-zero if temporaries are FP           */
+/*                         relative, zero if they are absolute addresses.    */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*      Returns:       Number of expressions replaced in the loop.           */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PUBLIC int    HoistLoopInvariants( CODEGEN *cg, int BlockStart,
+                                   int LoopStart, int LoopEnd,
+                                   int (*NewTemporary)( void * ),
+                                   void *context, int InFrame )
+{
+    int i, j, m, n, opcode, value, inserted, LoadOp, StoreOp, target;
+    CODEEDIT *changes;
+    OPTIMISER opt;
+
+    opt.code = cg;
+
+    FindInvariants( &opt, LoopStart, LoopEnd );
+    if ( opt.Overflow || opt.CandidateCount == 0 )  return 0;
+
+    LoadOp = InFrame ? I_LOADFP : I_LOADA;
+    StoreOp = InFrame ? I_STOREFP : I_STOREA;
+
+    /* At most each expression and its store in the preheader, and a load  */
+    /* in place of each occurrence.                                        */
+    for ( i = n = 0; i < opt.CandidateCount; i++ )
+        n += opt.Candidates[i].length + 2;
+    changes = malloc( n * sizeof( CODEEDIT ) );
+    if ( changes == NULL )  return 0;
+
+    /* Give each distinct expression a temporary, and compute it once in   */
+    /* the preheader.                                                      */
+    SortCandidates( &opt );
+    n = inserted = 0;
+    for ( i = 0; i < opt.CandidateCount; i++ )  {
+        for ( j = 0; j < i; j++ )
+            if ( opt.Candidates[j].length == opt.Candidates[i].length &&
+                 SameCode( cg, opt.Candidates[j].start,
+                           opt.Candidates[i].start,
+                           opt.Candidates[i].length ) )  break;
+        if ( j < i )  {
+            opt.Candidates[i].temp = opt.Candidates[j].temp;
+            continue;
+        }
+        opt.Candidates[i].temp = NewTemporary( context );
+        for ( m = 0; m < opt.Candidates[i].length; m++ )  {
+            GetInstruction( cg, opt.Candidates[i].start + m, &opcode, &value );
+            SetEdit( &changes[n++], LoopStart, 0, opcode, value );
+        }
+        SetEdit( &changes[n++], LoopStart, 0, StoreOp,
+                 opt.Candidates[i].temp );
+    }
+    inserted = n;
+
+    /* Replace the occurrences.                                            */
+    for ( i = 0; i < opt.CandidateCount; i++ )
+        SetEdit( &changes[n++], opt.Candidates[i].start,
+                 opt.Candidates[i].length, LoadOp, opt.Candidates[i].temp );
+
+    m = CurrentCodeAddress( cg );
+    if ( !RewriteCode( cg, BlockStart, changes, n ) )  {
+        free( changes );
+        return 0;
+    }
+    free( changes );
+    LoopEnd += CurrentCodeAddress( cg ) - m;
+
+    /* Every branch to LoopStart now skips the preheader. Only the loop's  */
+    /* own branch back should.                                             */
+    for ( i = BlockStart; i < CurrentCodeAddress( cg ); i++ )  {
+        if ( i >= LoopStart + inserted && i < LoopEnd )  continue;
+        GetInstruction( cg, i, &opcode, &target );
+        if ( opcode >= I_BR && opcode <= I_CALL &&
+             target == LoopStart + inserted )
+            BackPatch( cg, i, LoopStart );
+    }
+
+    return opt.CandidateCount;
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      EliminateCommonSubexpressions                                        */
+/*                                                                           */
+/*      Performs local value numbering on a range of code, one basic block   */
+/*      at a time. A block ends at any instruction other than a load,        */
+/*      store, arithmetic, "Read" or "Write", and begins again at each       */
+/*      branch target. Within a block, each expression is given a value      */
+/*      number; an expression whose value number was already computed        */
+/*      earlier in the block is replaced by a load of a temporary, and the   */
+/*      earlier occurrence saves its result there with "Store"/"Load".       */
+/*      Stores invalidate loads of the variable stored to, indirect stores   */
+/*      and calls invalidate all loads, and "Read" always produces a new     */
+/*      value.                                                               */
+/*                                                                           */
+/*      Since the saving costs two instructions, an expression is only       */
+/*      reused if it contains at least one arithmetic operation and the      */
+/*      instructions removed at least pay for the saving. The changes are    */
+/*      made together (see "RewriteCode"), so "start" must be where a        */
+/*      block begins, which no code before it branches past.                 */
+/*                                                                           */
+/*      Input(s):                                                            */
+/*                                                                           */
+/*          cg             pointer to the CODEGEN holding the code.          */
+/*                                                                           */
+/*          start, end     integers, the range of code addresses.            */
+/*                                                                           */
+/*          NewTemporary   routine which allocates a temporary variable      */
+/*                         and returns its address (or FP offset). It is     */
+/*                         passed "context".                                 */
+/*                                                                           */
+/*          InFrame        integer, non-zero if temporaries are FP           */
+/*                         relative, zero if they are absolute addresses.    */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*      Returns:       Number of instructions removed from the range (net    */
+/*                     of those added to save values).                       */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PUBLIC int    EliminateCommonSubexpressions( CODEGEN *cg, int start, int end,
+                                             int (*NewTemporary)( void * ),
+                                             void *context, int InFrame )
+{
+    int i, n, size, removed = 0, LoadOp, StoreOp;
+    EDIT *e;
+    CODEEDIT *changes;
+    OPTIMISER opt;
+
+    opt.code = cg;
+
+    size = end - start;
+    if ( size < 2 )  return 0;
+
+    opt.Leaders = calloc( size, sizeof( char ) );
+    opt.Nodes = malloc( size * sizeof( NODE ) );
+    opt.Occurrences = calloc( size, sizeof( int ) );
+    opt.Definers = malloc( size * sizeof( int ) );
+    opt.Temps = malloc( size * sizeof( int ) );
+    opt.Edits = malloc( size * sizeof( EDIT ) );
+
+    if ( opt.Leaders != NULL && opt.Nodes != NULL && opt.Occurrences != NULL &&
+         opt.Definers != NULL && opt.Temps != NULL && opt.Edits != NULL )  {
+        MarkLeaders( &opt, start, end );
+        NumberValues( &opt, start, end );
+        if ( !opt.Overflow )  {
+            qsort( opt.Nodes, opt.NodeCount, sizeof( NODE ), CompareNodes );
+            SelectReuses( &opt );
+
+            LoadOp = InFrame ? I_LOADFP : I_LOADA;
+            StoreOp = InFrame ? I_STOREFP : I_STOREA;
+
+            for ( i = 0; i < opt.EditCount; i++ )
+                if ( opt.Edits[i].spill )
+                    opt.Temps[opt.Edits[i].value] = NewTemporary( context );
+
+            /* In code order, so that the code is rewritten in one pass.   */
+            qsort( opt.Edits, opt.EditCount, sizeof( EDIT ), CompareEdits );
+            changes = malloc( ( 2 * opt.EditCount + 1 ) * sizeof( CODEEDIT ) );
+            for ( i = n = 0; changes != NULL && i < opt.EditCount; i++ )  {
+                e = &opt.Edits[i];
+                if ( e->spill )  {
+                    SetEdit( &changes[n++], e->position, 0, StoreOp,
+                             opt.Temps[e->value] );
+                    SetEdit( &changes[n++], e->position, 0, LoadOp,
+                             opt.Temps[e->value] );
+                    removed -= 2;
+                }
+                else  {
+                    SetEdit( &changes[n++], e->position, e->length, LoadOp,
+                             opt.Temps[e->value] );
+                    removed += e->length - 1;
+                }
+            }
+            if ( changes == NULL || !RewriteCode( cg, start, changes, n ) )
+                removed = 0;
+            free( changes );
+        }
+    }
+
+    free( opt.Leaders );
+    free( opt.Nodes );
+    free( opt.Occurrences );
+    free( opt.Definers );
+    free( opt.Temps );
+    free( opt.Edits );
+    return removed;
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      OrderOperands                                                        */
+/*                                                                           */
+/*      Sethi-Ullman ordering of commutative operations. Each expression     */
+/*      needs a number of stack slots to evaluate: a single load needs one,  */
+/*      and an operation whose operands need "l" and "r" slots needs         */
+/*      max( l, r+1 ) when the left operand is evaluated first. Where the    */
+/*      right operand of an "Add" or "Mult" needs more than the left, the    */
+/*      two are swapped, giving max( r, l+1 ). Expressions have no side      */
+/*      effects, so the order of evaluation is otherwise free. Operations    */
+/*      are visited innermost first, so operands are already in order when   */
+/*      their parent is considered. As for "EliminateCommonSubexpressions",  */
+/*      "start" must be where a block begins.                                */
+/*                                                                           */
+/*      Input(s):                                                            */
+/*                                                                           */
+/*          cg             pointer to the CODEGEN holding the code.          */
+/*                                                                           */
+/*          start, end     integers, the range of code addresses.            */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*      Returns:       Number of operations whose operands were swapped.     */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PUBLIC int    OrderOperands( CODEGEN *cg, int start, int end )
+{
+    int i, opcode, value, need, swaps = 0;
+    OPERAND a, b;
+    OPTIMISER opt;
+
+    opt.code = cg;
+
+    if ( end - start < 3 )  return 0;
+    opt.Leaders = calloc( end - start, sizeof( char ) );
+    if ( opt.Leaders == NULL )  return 0;
+    MarkLeaders( &opt, start, end );
+
+    opt.OperandCount = opt.Overflow = 0;
+    for ( i = start; i < end && !opt.Overflow; i++ )  {
+        if ( opt.Leaders[i - start] )  opt.OperandCount = 0;
+        GetInstruction( cg, i, &opcode, &value );
+        switch ( opcode )  {
+            case I_LOADI  :
+            case I_LOADA  :
+            case I_LOADFP :
+            case I_PUSHFP :
+                PushValue( &opt, i, 1, 1 );
+                break;
+            case I_LOADSP :
+            case I_NEG    :
+                a = PopOperand( &opt );
+                if ( a.value < 0 || !IsContiguous( a, a, i ) )
+                    PushOperand( &opt, i, 0, 0 );
+                else  PushValue( &opt, a.start, a.length+1, a.value );
+                break;
+            case I_ADD    :
+            case I_SUB    :
+            case I_MULT   :
+            case I_DIV    :
+                b = PopOperand( &opt );
+                a = PopOperand( &opt );
+                if ( a.value < 0 || b.value < 0 || !IsContiguous( a, b, i ) )  {
+                    PushOperand( &opt, i, 0, 0 );
+                    break;
+                }
+                if ( ( opcode == I_ADD || opcode == I_MULT ) &&
+                     b.value > a.value )  {
+                    SwapOperands( cg, a, b );
+                    swaps++;
+                    need = b.value > a.value+1 ? b.value : a.value+1;
+                }
+                else  need = a.value > b.value+1 ? a.value : b.value+1;
+                PushValue( &opt, a.start, a.length+b.length+1, need );
+                break;
+            case I_STOREA :
+            case I_STOREFP:
+            case I_WRITE  :
+                PopOperand( &opt );
+                break;
+            case I_STORESP:
+                PopOperand( &opt );
+                PopOperand( &opt );
+                break;
+            case I_READ   :
+                PushOperand( &opt, i, 0, 0 );
+                break;
+            default       :
+                opt.OperandCount = 0;
+                break;
+        }
+    }
+
+    free( opt.Leaders );
+    return swaps;
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      MaxStackDepth                                                        */
+/*                                                                           */
+/*      Finds the maximum depth of the operand stack over a range of code    */
+/*      (a procedure body, without the "Inc" and "Dec" of its locals),       */
+/*      relative to the depth on entry. Every path from the start of the     */
+/*      range is followed; branches out of the range, and the code of        */
+/*      called procedures, are not. The words pushed by a call sequence      */
+/*      (parameters, static link and saved FP) count, the callee's return    */
+/*      address and frame do not.                                            */
+/*                                                                           */
+/*      Input(s):                                                            */
+/*                                                                           */
+/*          cg             pointer to the CODEGEN holding the code.          */
+/*                                                                           */
+/*          start, end     integers, the range of code addresses.            */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*      Returns:       Maximum depth in words, or -1 if it could not be      */
+/*                     found (out of memory).                                */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PUBLIC int    MaxStackDepth( CODEGEN *cg, int start, int end )
+{
+    int *depth, *work, count = 0, max = 0, i, d, opcode, target;
+
+    if ( end <= start )  return 0;
+    depth = malloc( ( end - start ) * sizeof( int ) );
+    work = malloc( ( end - start ) * sizeof( int ) );
+    if ( depth == NULL || work == NULL )  {
+        free( depth );
+        free( work );
+        return -1;
+    }
+
+    /*  Code with errors can take the depth below 0, so INT_MIN marks an   */
+    /*  instruction not yet reached.                                       */
+
+    for ( i = 0; i < end - start; i++ )  depth[i] = INT_MIN;
+    depth[0] = 0;
+    work[count++] = start;
+
+    while ( count > 0 )  {
+        i = work[--count];
+        for ( ;; )  {
+            d = depth[i - start];
+            GetInstruction( cg, i, &opcode, &target );
+            d += StackEffect( opcode, target );
+            if ( d > max )  max = d;
+            if ( opcode >= I_BR && opcode <= I_BNZ &&
+                 target >= start && target < end &&
+                 depth[target - start] == INT_MIN )  {
+                depth[target - start] = d;
+                work[count++] = target;
+            }
+            if ( opcode == I_BR || opcode == I_RET || opcode == I_HALT )
+                break;
+            if ( ++i >= end || depth[i - start] != INT_MIN )  break;
+            depth[i - start] = d;
+        }
+    }
+
+    free( depth );
+    free( work );
+    return max;
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      EmitOperation                                                        */
+/*                                                                           */
+/*      Emits a binary arithmetic operation whose operands have just been    */
+/*      emitted, the left one from "LeftStart" and the right one from        */
+/*      "RightStart" up to the current code address, simplifying where it    */
+/*      can. Expressions have no side effects, so operand code may be        */
+/*      dropped, unless it may trap (see "MayTrap"): "x - x" and "x * 0"     */
+/*      are left alone when x contains a division, which may be by zero.     */
+/*      With k, m constants:                                                 */
+/*                                                                           */
+/*          k op m          ->  constant (unless it overflows or divides     */
+/*                              a negative or by zero or less)               */
+/*          x + 0, 0 + x    ->  x                                            */
+/*          x - 0           ->  x                                            */
+/*          0 - x           ->  -x                                           */
+/*          x - x           ->  0          (identical code)                  */
+/*          x + -y          ->  x - y                                        */
+/*          x - -y          ->  x + y                                        */
+/*          x * 1, 1 * x    ->  x                                            */
+/*          x * 0, 0 * x    ->  0                                            */
+/*          x * -1, -1 * x  ->  -x                                           */
+/*          x * 2, 2 * x    ->  x + x      (x a single load)                 */
+/*          x / 1           ->  x                                            */
+/*          x / -1          ->  -x                                           */
+/*                                                                           */
+/*      "0 / x" and "x / x" are left alone, as x may be zero.                */
+/*                                                                           */
+/*      Input(s):                                                            */
+/*                                                                           */
+/*          cg           pointer to the CODEGEN holding the code.            */
+/*                                                                           */
+/*          opcode       integer, I_ADD, I_SUB, I_MULT or I_DIV.             */
+/*                                                                           */
+/*          LeftStart    integer, address of the left operand's code.        */
+/*                                                                           */
+/*          RightStart   integer, address of the right operand's code.       */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*      Returns:       Nothing                                               */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PUBLIC void   EmitOperation( CODEGEN *cg, int opcode, int LeftStart,
+                             int RightStart )
+{
+    int lk, rk, k, lconst, rconst, last, llen, rlen;
+
+    llen = RightStart - LeftStart;
+    rlen = CurrentCodeAddress( cg ) - RightStart;
+    if ( llen < 1 || rlen < 1 )  {
+        _Emit( cg, opcode );
+        return;
+    }
+    lconst = IsConstant( cg, LeftStart, llen, &lk );
+    rconst = IsConstant( cg, RightStart, rlen, &rk );
+
+    if ( lconst && rconst && FoldConstants( opcode, lk, rk, &k ) )  {
+        RemoveCode( cg, LeftStart, 2 );
+        Emit( cg, I_LOADI, k );
+        return;
+    }
+
+    switch ( opcode )  {
+        case I_ADD  :
+        case I_SUB  :
+            if ( rconst && rk == 0 )  {
+                RemoveCode( cg, RightStart, 1 );
+                return;
+            }
+            if ( lconst && lk == 0 )  {
+                RemoveCode( cg, LeftStart, 1 );
+                if ( opcode == I_SUB )  EmitNegation( cg, LeftStart );
+                return;
+            }
+            if ( opcode == I_SUB && llen == rlen &&
+                 SameCode( cg, LeftStart, RightStart, llen ) &&
+                 !MayTrap( cg, LeftStart, llen ) )  {
+                RemoveCode( cg, LeftStart, llen + rlen );
+                Emit( cg, I_LOADI, 0 );
+                return;
+            }
+            GetInstruction( cg, CurrentCodeAddress( cg ) - 1, &last, NULL );
+            if ( last == I_NEG && rlen > 1 )  {
+                RemoveCode( cg, CurrentCodeAddress( cg ) - 1, 1 );
+                _Emit( cg, opcode == I_ADD ? I_SUB : I_ADD );
+                return;
+            }
+            break;
+        case I_MULT :
+            if ( rconst && ( rk == 1 || rk == -1 ||
+                             ( rk == 0 && !MayTrap( cg, LeftStart, llen ) ) ||
+                             ( rk == 2 && llen == 1 ) ) )  {
+                RemoveCode( cg, RightStart, 1 );
+                k = rk;
+            }
+            else if ( lconst && ( lk == 1 || lk == -1 ||
+                                  ( lk == 0 &&
+                                    !MayTrap( cg, RightStart, rlen ) ) ||
+                                  ( lk == 2 && rlen == 1 ) ) )  {
+                RemoveCode( cg, LeftStart, 1 );
+                k = lk;
+            }
+            else  break;
+            if ( k == 0 )  {
+                RemoveCode( cg, LeftStart,
+                            CurrentCodeAddress( cg ) - LeftStart );
+                Emit( cg, I_LOADI, 0 );
+            }
+            else if ( k == -1 )  EmitNegation( cg, LeftStart );
+            else if ( k == 2 )  {
+                CopyCode( cg, LeftStart, 1 );
+                _Emit( cg, I_ADD );
+            }
+            return;
+        case I_DIV  :
+            if ( rconst && ( rk == 1 || rk == -1 ) )  {
+                RemoveCode( cg, RightStart, 1 );
+                if ( rk == -1 )  EmitNegation( cg, LeftStart );
+                return;
+            }
+            break;
+    }
+    _Emit( cg, opcode );
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      EmitNegation                                                         */
+/*                                                                           */
+/*      Emits a "Neg" of the operand just emitted from "OperandStart",       */
+/*      folding it into a constant operand, or cancelling it against a       */
+/*      "Neg" which ends the operand.                                        */
+/*                                                                           */
+/*      Input(s):                                                            */
+/*                                                                           */
+/*          cg             pointer to the CODEGEN holding the code.          */
+/*                                                                           */
+/*          OperandStart   integer, address of the operand's code.           */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*      Returns:       Nothing                                               */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PUBLIC void   EmitNegation( CODEGEN *cg, int OperandStart )
+{
+    int k, last, length = CurrentCodeAddress( cg ) - OperandStart;
+
+    if ( IsConstant( cg, OperandStart, length, &k ) && k != INT_MIN )  {
+        BackPatch( cg, OperandStart, -k );
+        return;
+    }
+    if ( length > 1 )  {
+        GetInstruction( cg, CurrentCodeAddress( cg ) - 1, &last, NULL );
+        if ( last == I_NEG )  {
+            RemoveCode( cg, CurrentCodeAddress( cg ) - 1, 1 );
+            return;
+        }
+    }
+    _Emit( cg, I_NEG );
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      Private routines (only accessable from within this module).          */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      FindInvariants                                                       */
+/*                                                                           */
+/*      Simulates the operand stack over the loop, filling "Candidates"      */
+/*      with the maximal invariant expressions of two or more instructions.  */
+/*      An expression becomes a candidate when it is consumed by something   */
+/*      which is not itself invariant.                                       */
+/*                                                                           */
+/*      Input(s):                                                            */
+/*                                                                           */
+/*          LoopStart, LoopEnd   integers, the loop's code addresses.        */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*      Returns:       Nothing                                               */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE void  FindInvariants( OPTIMISER *opt, int LoopStart, int LoopEnd )
+{
+    int i, opcode, value, invariant;
+    OPERAND a, b;
+
+    opt->OperandCount = opt->CandidateCount = 0;
+    opt->Clobbered = opt->Overflow = 0;
+
+    for ( i = LoopStart; i < LoopEnd; i++ )  {
+        GetInstruction( opt->code, i, &opcode, NULL );
+        if ( opcode == I_CALL || opcode == I_STORESP )  opt->Clobbered = 1;
+    }
+
+    for ( i = LoopStart; i < LoopEnd && !opt->Overflow; i++ )  {
+        GetInstruction( opt->code, i, &opcode, &value );
+        switch ( opcode )  {
+            case I_LOADI  :
+            case I_PUSHFP :
+                PushOperand( opt, i, 1, 1 );
+                break;
+            case I_LOADA  :
+                invariant = !opt->Clobbered &&
+                            !IsStoredTo( opt->code, I_STOREA, value,
+                                         LoopStart, LoopEnd );
+                PushOperand( opt, i, 1, invariant );
+                break;
+            case I_LOADFP :
+                invariant = !opt->Clobbered &&
+                            !IsStoredTo( opt->code, I_STOREFP, value,
+                                         LoopStart, LoopEnd );
+                PushOperand( opt, i, 1, invariant );
+                break;
+            case I_LOADSP :
+                a = PopOperand( opt );
+                Consume( opt, a );
+                PushOperand( opt, a.start, a.length+1, 0 );
+                break;
+            case I_ADD    :
+            case I_SUB    :
+            case I_MULT   :
+            case I_DIV    :
+                b = PopOperand( opt );
+                a = PopOperand( opt );
+                invariant = a.invariant && b.invariant &&
+                            IsContiguous( a, b, i ) &&
+                            ( opcode != I_DIV ||
+                              IsNonZeroConst( opt->code, b ) );
+                if ( !invariant )  {
+                    Consume( opt, a );
+                    Consume( opt, b );
+                }
+                PushOperand( opt, a.start, a.length+b.length+1, invariant );
+                break;
+            case I_NEG    :
+                a = PopOperand( opt );
+                invariant = a.invariant && IsContiguous( a, a, i );
+                if ( !invariant )  Consume( opt, a );
+                PushOperand( opt, a.start, a.length+1, invariant );
+                break;
+            case I_READ   :
+                PushOperand( opt, i, 1, 0 );
+                break;
+            case I_STOREA :
+            case I_STOREFP:
+            case I_WRITE  :
+            case I_BGZ    :
+            case I_BG     :
+            case I_BLZ    :
+            case I_BL     :
+            case I_BZ     :
+            case I_BNZ    :
+                Consume( opt, PopOperand( opt ) );
+                break;
+            case I_STORESP:
+                Consume( opt, PopOperand( opt ) );
+                Consume( opt, PopOperand( opt ) );
+                break;
+            default       :
+                ConsumeAll( opt );
+                break;
+        }
+    }
+    ConsumeAll( opt );
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      IsStoredTo                                                           */
+/*                                                                           */
+/*      Determines whether a store instruction with a particular address     */
+/*      field appears in a range of code.                                    */
+/*                                                                           */
+/*      Input(s):                                                            */
+/*                                                                           */
+/*          StoreOp    integer, I_STOREA or I_STOREFP.                       */
+/*          address    integer, the address or FP offset stored to.          */
+/*          start, end integers, the range of code addresses.                */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*      Returns:       1 if such a store is present, else 0.                 */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE int   IsStoredTo( CODEGEN *cg, int StoreOp, int address,
+                          int start, int end )
+{
+    int i, opcode, value;
+
+    for ( i = start; i < end; i++ )  {
+        GetInstruction( cg, i, &opcode, &value );
+        if ( opcode == StoreOp && value == address )  return 1;
+    }
+    return 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      PushOperand                                                          */
+/*      PopOperand                                                           */
+/*                                                                           */
+/*      Symbolic operand stack handling. Popping an empty stack (the value   */
+/*      was pushed before the region started) yields a non-invariant         */
+/*      operand of length 0. Pushing onto a full stack sets "Overflow",      */
+/*      which abandons the pass.                                             */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE void  PushOperand( OPTIMISER *opt, int start, int length,
+                           int invariant )
+{
+    if ( opt->OperandCount >= MAX_OPERANDS )  {
+        opt->Overflow = 1;
+        return;
+    }
+    opt->Operands[opt->OperandCount].start = start;
+    opt->Operands[opt->OperandCount].length = length;
+    opt->Operands[opt->OperandCount].invariant = invariant;
+    opt->Operands[opt->OperandCount].value = -1;
+    opt->OperandCount++;
+}
+
+PRIVATE OPERAND PopOperand( OPTIMISER *opt )
+{
+    OPERAND x;
+
+    if ( opt->OperandCount > 0 )  return opt->Operands[--opt->OperandCount];
+
+    x.start = x.length = x.invariant = 0;
+    x.value = -1;
+    return x;
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      Consume                                                              */
+/*      ConsumeAll                                                           */
+/*                                                                           */
+/*      Called when an operand (or every operand on the stack) is used by    */
+/*      an instruction which is not part of an invariant expression. If the  */
+/*      operand is invariant and longer than one instruction, it becomes a   */
+/*      candidate for hoisting.                                              */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE void  Consume( OPTIMISER *opt, OPERAND x )
+{
+    if ( !x.invariant || x.length < 2 )  return;
+    if ( opt->CandidateCount >= MAX_CANDIDATES )  {
+        opt->Overflow = 1;
+        return;
+    }
+    opt->Candidates[opt->CandidateCount].start = x.start;
+    opt->Candidates[opt->CandidateCount].length = x.length;
+    opt->Candidates[opt->CandidateCount].temp = -1;
+    opt->CandidateCount++;
+}
+
+PRIVATE void  ConsumeAll( OPTIMISER *opt )
+{
+    while ( opt->OperandCount > 0 )  Consume( opt, PopOperand( opt ) );
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      IsNonZeroConst                                                       */
+/*                                                                           */
+/*      Returns 1 if an operand is a single "Load #<datum>" with a non-zero  */
+/*      datum, else 0.                                                       */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE int   IsNonZeroConst( CODEGEN *cg, OPERAND x )
+{
+    int opcode, value;
+
+    if ( x.length != 1 )  return 0;
+    GetInstruction( cg, x.start, &opcode, &value );
+    return  opcode == I_LOADI && value != 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      IsContiguous                                                         */
+/*                                                                           */
+/*      Returns 1 if the operands of the operation at "codeaddr" are         */
+/*      computed by the instructions immediately before it, i.e., "a" is     */
+/*      followed by "b" (the same operand for a unary operation), and "b"    */
+/*      ends at "codeaddr". An operand may be separated from its operation   */
+/*      by a statement which leaves the stack as it was, e.g., a "Store"/    */
+/*      "Load" pair saving a common subexpression.                           */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE int   IsContiguous( OPERAND a, OPERAND b, int codeaddr )
+{
+    if ( a.length < 1 || b.length < 1 )  return 0;
+    if ( b.start + b.length != codeaddr )  return 0;
+    return  a.start == b.start || a.start + a.length == b.start;
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      SameCode                                                             */
+/*                                                                           */
+/*      Returns 1 if the "length" instructions starting at "a" are           */
+/*      identical to those starting at "b", else 0.                          */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE int   SameCode( CODEGEN *cg, int a, int b, int length )
+{
+    int i, opa, opb, va, vb;
+
+    for ( i = 0; i < length; i++ )  {
+        GetInstruction( cg, a+i, &opa, &va );
+        GetInstruction( cg, b+i, &opb, &vb );
+        if ( opa != opb || va != vb )  return 0;
+    }
+    return 1;
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      MayTrap                                                              */
+/*                                                                           */
+/*      Returns 1 if the "length" instructions starting at "start" may stop  */
+/*      the program, i.e., contain a "Div", or anything but a load or        */
+/*      arithmetic, else 0. Such code must be run even if its value is not   */
+/*      needed.                                                              */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE int   MayTrap( CODEGEN *cg, int start, int length )
+{
+    int i, opcode;
+
+    for ( i = start; i < start + length; i++ )  {
+        GetInstruction( cg, i, &opcode, NULL );
+        switch ( opcode )  {
+            case I_LOADI  :
+            case I_LOADA  :
+            case I_LOADFP :
+            case I_LOADSP :
+            case I_ADD    :
+            case I_SUB    :
+            case I_MULT   :
+            case I_NEG    :  break;
+            default       :  return 1;
+        }
+    }
+    return 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      SortCandidates                                                       */
+/*                                                                           */
+/*      Sorts "Candidates" into ascending order of code address. Candidates  */
+/*      never overlap. The list is short, so an insertion sort is used.      */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE void  SortCandidates( OPTIMISER *opt )
+{
+    int i, j;
+    CANDIDATE temp;
+
+    for ( i = 1; i < opt->CandidateCount; i++ )  {
+        temp = opt->Candidates[i];
+        for ( j = i; j > 0 && opt->Candidates[j-1].start > temp.start; j-- )
+            opt->Candidates[j] = opt->Candidates[j-1];
+        opt->Candidates[j] = temp;
+    }
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      MarkLeaders                                                          */
+/*                                                                           */
+/*      Sets "Leaders" for every instruction in the range which is the       */
+/*      target of a branch or call. Only the code from "start" on is         */
+/*      searched, as no code before a block branches past its start.         */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE void  MarkLeaders( OPTIMISER *opt, int start, int end )
+{
+    int i, opcode, target;
+
+    for ( i = start; i < CurrentCodeAddress( opt->code ); i++ )  {
+        GetInstruction( opt->code, i, &opcode, &target );
+        if ( opcode >= I_BR && opcode <= I_CALL &&
+             target >= start && target < end )
+            opt->Leaders[target - start] = 1;
+    }
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      NumberValues                                                         */
+/*                                                                           */
+/*      Simulates the operand stack over the range, giving each value a      */
+/*      value number and recording every expression of two or more           */
+/*      instructions in "Nodes", and how often each value number occurs in   */
+/*      "Occurrences".                                                       */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE void  NumberValues( OPTIMISER *opt, int start, int end )
+{
+    int i, opcode, value;
+    OPERAND a, b;
+
+    opt->NextValue = opt->NodeCount = opt->Overflow = 0;
+    opt->MemoryGen = opt->LastClobber = 0;
+    ResetBlock( opt );
+
+    for ( i = start; i < end && !opt->Overflow; i++ )  {
+        if ( opt->Leaders[i - start] )  ResetBlock( opt );
+        GetInstruction( opt->code, i, &opcode, &value );
+        switch ( opcode )  {
+            case I_LOADI  :
+                PushValue( opt, i, 1,
+                           ValueNumber( opt, I_LOADI, value, 0, 0 ) );
+                break;
+            case I_PUSHFP :
+                PushValue( opt, i, 1, ValueNumber( opt, I_PUSHFP, 0, 0, 0 ) );
+                break;
+            case I_LOADA  :
+                PushValue( opt, i, 1, ValueNumber( opt, I_LOADA, value,
+                           LocationVersion( opt, I_STOREA, value ), 0 ) );
+                break;
+            case I_LOADFP :
+                PushValue( opt, i, 1, ValueNumber( opt, I_LOADFP, value,
+                           LocationVersion( opt, I_STOREFP, value ), 0 ) );
+                break;
+            case I_LOADSP :
+                a = PopOperand( opt );
+                Combine( opt, i, opcode, value, a, a, opt->MemoryGen );
+                break;
+            case I_NEG    :
+                a = PopOperand( opt );
+                Combine( opt, i, opcode, 0, a, a, -1 );
+                break;
+            case I_ADD    :
+            case I_SUB    :
+            case I_MULT   :
+            case I_DIV    :
+                b = PopOperand( opt );
+                a = PopOperand( opt );
+                Combine( opt, i, opcode, 0, a, b, b.value );
+                break;
+            case I_READ   :
+                PushValue( opt, i, 1, opt->NextValue++ );
+                break;
+            case I_STOREA :
+            case I_STOREFP:
+                PopOperand( opt );
+                StoreLocation( opt, opcode, value );
+                break;
+            case I_STORESP:
+                PopOperand( opt );
+                PopOperand( opt );
+                opt->LastClobber = ++opt->MemoryGen;
+                break;
+            case I_WRITE  :
+                PopOperand( opt );
+                break;
+            default       :
+                ResetBlock( opt );
+                break;
+        }
+    }
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      SelectReuses                                                         */
+/*                                                                           */
+/*      Walks "Nodes" in code order, outermost expression first, and fills   */
+/*      "Edits". The first occurrence of a value number defines it, later    */
+/*      ones are replaced, together with everything inside them. Value       */
+/*      numbers which are not worth reusing are skipped, so that their       */
+/*      subexpressions are considered instead.                               */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE void  SelectReuses( OPTIMISER *opt )
+{
+    int i, v, CoverEnd = -1;
+    NODE *n;
+
+    opt->EditCount = 0;
+    for ( i = 0; i < opt->NextValue; i++ )
+        opt->Definers[i] = opt->Temps[i] = -1;
+
+    for ( i = 0; i < opt->NodeCount; i++ )  {
+        n = &opt->Nodes[i];
+        v = n->value;
+        if ( n->start < CoverEnd )  continue;
+        if ( n->length < 3 ||
+             ( opt->Occurrences[v] - 1 ) * ( n->length - 1 ) < 2 )  continue;
+        if ( opt->Definers[v] < 0 )  {
+            opt->Definers[v] = i;
+            continue;
+        }
+        if ( opt->Temps[v] < 0 )  {
+            /* First reuse: save the value at the definition.              */
+            opt->Edits[opt->EditCount].position =
+                opt->Nodes[opt->Definers[v]].start +
+                opt->Nodes[opt->Definers[v]].length;
+            opt->Edits[opt->EditCount].spill = 1;
+            opt->Edits[opt->EditCount].length = 0;
+            opt->Edits[opt->EditCount].value = v;
+            opt->EditCount++;
+            opt->Temps[v] = 0;
+        }
+        opt->Edits[opt->EditCount].position = n->start;
+        opt->Edits[opt->EditCount].spill = 0;
+        opt->Edits[opt->EditCount].length = n->length;
+        opt->Edits[opt->EditCount].value = v;
+        opt->EditCount++;
+        CoverEnd = n->start + n->length;
+    }
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      ResetBlock                                                           */
+/*                                                                           */
+/*      Starts a new basic block: nothing computed before it is available.   */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE void  ResetBlock( OPTIMISER *opt )
+{
+    opt->OperandCount = opt->ValueCount = opt->LocationCount = 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      PushValue                                                            */
+/*                                                                           */
+/*      Pushes an operand with a known value number, see "PushOperand".      */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE void  PushValue( OPTIMISER *opt, int start, int length, int value )
+{
+    PushOperand( opt, start, length, 1 );
+    if ( !opt->Overflow )  opt->Operands[opt->OperandCount-1].value = value;
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      Combine                                                              */
+/*                                                                           */
+/*      Pushes the result of an operation at "codeaddr" on operands "a" and  */
+/*      "b" (the same operand for a unary operation), numbering it as        */
+/*      ( opcode, field, a, right ), and records it as a node. If an         */
+/*      operand is unknown (computed in an earlier block), so is the result. */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE void  Combine( OPTIMISER *opt, int codeaddr, int opcode, int field,
+                       OPERAND a, OPERAND b, int right )
+{
+    int value, length;
+
+    if ( a.value < 0 || b.value < 0 || !IsContiguous( a, b, codeaddr ) )  {
+        PushOperand( opt, codeaddr, 0, 0 );
+        return;
+    }
+    value = ValueNumber( opt, opcode, field, a.value, right );
+    length = codeaddr - a.start + 1;
+    opt->Nodes[opt->NodeCount].start = a.start;
+    opt->Nodes[opt->NodeCount].length = length;
+    opt->Nodes[opt->NodeCount].value = value;
+    opt->NodeCount++;
+    opt->Occurrences[value]++;
+    PushValue( opt, a.start, length, value );
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      ValueNumber                                                          */
+/*                                                                           */
+/*      Returns the value number of an operation in the current block,       */
+/*      allocating a new one if it has not been seen before. If the table    */
+/*      is full the new number is not remembered, which only loses reuse.    */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE int   ValueNumber( OPTIMISER *opt, int opcode, int field,
+                           int left, int right )
+{
+    int i;
+    VALUE *v;
+
+    for ( i = 0; i < opt->ValueCount; i++ )  {
+        v = &opt->Values[i];
+        if ( v->opcode == opcode && v->field == field &&
+             v->left == left && v->right == right )  return v->value;
+    }
+    if ( opt->ValueCount < MAX_VALUES )  {
+        v = &opt->Values[opt->ValueCount++];
+        v->opcode = opcode;
+        v->field = field;
+        v->left = left;
+        v->right = right;
+        v->value = opt->NextValue;
+    }
+    return opt->NextValue++;
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      LocationVersion                                                      */
+/*      StoreLocation                                                        */
+/*                                                                           */
+/*      Version of a directly addressed variable ("Load <addr>" or           */
+/*      "Load FP+<offset>"), and the effect of a direct store to one. If     */
+/*      the table of stored variables is full, the store is treated as a     */
+/*      clobber of every variable.                                           */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE int   LocationVersion( OPTIMISER *opt, int StoreOp, int address )
+{
+    int i;
+
+    for ( i = 0; i < opt->LocationCount; i++ )
+        if ( opt->Locations[i].opcode == StoreOp &&
+             opt->Locations[i].address == address )
+            return  opt->Locations[i].gen > opt->LastClobber ?
+                    opt->Locations[i].gen : opt->LastClobber;
+    return opt->LastClobber;
+}
+
+PRIVATE void  StoreLocation( OPTIMISER *opt, int StoreOp, int address )
+{
+    int i;
+
+    opt->MemoryGen++;
+    for ( i = 0; i < opt->LocationCount; i++ )
+        if ( opt->Locations[i].opcode == StoreOp &&
+             opt->Locations[i].address == address )  {
+            opt->Locations[i].gen = opt->MemoryGen;
+            return;
+        }
+    if ( opt->LocationCount < MAX_LOCATIONS )  {
+        opt->Locations[opt->LocationCount].opcode = StoreOp;
+        opt->Locations[opt->LocationCount].address = address;
+        opt->Locations[opt->LocationCount].gen = opt->MemoryGen;
+        opt->LocationCount++;
+    }
+    else  opt->LastClobber = opt->MemoryGen;
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      CompareNodes                                                         */
+/*      CompareEdits                                                         */
+/*                                                                           */
+/*      "qsort" comparison routines. Nodes go in code order with enclosing   */
+/*      expressions before the ones inside them. Edits go in code order;     */
+/*      where a replacement starts at the point a value is saved, the        */
+/*      value is saved first.                                                */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE int   CompareNodes( const void *a, const void *b )
+{
+    const NODE *x = a, *y = b;
+
+    if ( x->start != y->start )  return x->start - y->start;
+    return y->length - x->length;
+}
+
+PRIVATE int   CompareEdits( const void *a, const void *b )
+{
+    const EDIT *x = a, *y = b;
+
+    if ( x->position != y->position )  return x->position - y->position;
+    return y->spill - x->spill;
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      SwapOperands                                                         */
+/*                                                                           */
+/*      Exchanges the code of two adjacent operands, "a" immediately         */
+/*      followed by "b", in place (see "SwapCode"). Neither contains a       */
+/*      branch or a branch target, so nothing needs relocating.              */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE void  SwapOperands( CODEGEN *cg, OPERAND a, OPERAND b )
+{
+    SwapCode( cg, a.start, a.length, b.length );
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      SetEdit                                                              */
+/*                                                                           */
+/*      Fills in a change for "RewriteCode": "count" instructions from       */
+/*      "codeaddr" replaced by "opcode"/"value", or if "count" is 0 the      */
+/*      instruction inserted there.                                          */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE void  SetEdit( CODEEDIT *edit, int codeaddr, int count, int opcode,
+                       int value )
+{
+    edit->codeaddr = codeaddr;
+    edit->count = count;
+    edit->instruction.opcode = opcode;
+    edit->instruction.address = value;
+    edit->instruction.data = 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      StackEffect                                                          */
+/*                                                                           */
+/*      Returns the change in the depth of the operand stack caused by an    */
+/*      instruction. A "Call" returns with the stack as it was.              */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE int   StackEffect( int opcode, int value )
+{
+    switch ( opcode )  {
+        case I_LOADI  :
+        case I_LOADA  :
+        case I_LOADFP :
+        case I_PUSHFP :
+        case I_READ   :
+        case I_BSF    :
+            return 1;
+        case I_ADD    :
+        case I_SUB    :
+        case I_MULT   :
+        case I_DIV    :
+        case I_STOREA :
+        case I_STOREFP:
+        case I_WRITE  :
+        case I_RSF    :
+        case I_BGZ    :
+        case I_BG     :
+        case I_BLZ    :
+        case I_BL     :
+        case I_BZ     :
+        case I_BNZ    :
+            return -1;
+        case I_STORESP:
+            return -2;
+        case I_INC    :
+            return value;
+        case I_DEC    :
+            return -value;
+        default       :
+            return 0;
+    }
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      IsConstant                                                           */
+/*                                                                           */
+/*      Returns 1, and the constant in "value", if the code of an operand    */
+/*      is a single "Load #<datum>", else 0.                                 */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE int   IsConstant( CODEGEN *cg, int start, int length, int *value )
+{
+    int opcode;
+
+    if ( length != 1 )  return 0;
+    GetInstruction( cg, start, &opcode, value );
+    return  opcode == I_LOADI;
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      FoldConstants                                                        */
+/*                                                                           */
+/*      Computes "a <opcode> b" at compile time. Returns 0 if the result     */
+/*      would overflow, or if it is a division which is not of a             */
+/*      non-negative number by a positive one (where the machine's rounding  */
+/*      might differ from C's), else 1 with the result in "result".          */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE int   FoldConstants( int opcode, int a, int b, int *result )
+{
+    double d;
+
+    switch ( opcode )  {
+        case I_ADD  :  d = (double) a + b;  break;
+        case I_SUB  :  d = (double) a - b;  break;
+        case I_MULT :  d = (double) a * b;  break;
+        case I_DIV  :
+            if ( a < 0 || b <= 0 )  return 0;
+            *result = a / b;
+            return 1;
+        default     :  return 0;
+    }
+    if ( d > INT_MAX || d < INT_MIN )  return 0;
+    *result = (int) d;
+    return 1;
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      CopyCode                                                             */
+/*                                                                           */
+/*      Emits a copy of "length" instructions starting at "start".           */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE void  CopyCode( CODEGEN *cg, int start, int length )
+{
+    int i, opcode, value;
+
+    for ( i = 0; i < length; i++ )  {
+        GetInstruction( cg, start + i, &opcode, &value );
+        Emit( cg, opcode, value );
+    }
+}
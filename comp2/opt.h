@@ -0,0 +1,29 @@
+#ifndef  OPTHEADER
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      opt.h                                                                */
+/*                                                                           */
+/*      Header file for "opt.c", containing function prototypes for the      */
+/*      optimisation routines which rewrite code already in the code table.  */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+#define  OPTHEADER
+
+#include "global.h"
+#include "code.h"
+
+PUBLIC int    HoistLoopInvariants( CODEGEN *cg, int BlockStart,
+                                   int LoopStart, int LoopEnd,
+                                   int (*NewTemporary)( void * ),
+                                   void *context, int InFrame );
+PUBLIC int    EliminateCommonSubexpressions( CODEGEN *cg, int start, int end,
+                                             int (*NewTemporary)( void * ),
+                                             void *context, int InFrame );
+PUBLIC int    OrderOperands( CODEGEN *cg, int start, int end );
+PUBLIC int    MaxStackDepth( CODEGEN *cg, int start, int end );
+PUBLIC void   EmitOperation( CODEGEN *cg, int opcode, int LeftStart,
+                             int RightStart );
+PUBLIC void   EmitNegation( CODEGEN *cg, int OperandStart );
+
+#endif
@@ -0,0 +1,934 @@
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      pipeline.c                                                           */
+/*                                                                           */
+/*      Implementation file for pipelined compilation. Three threads share   */
+/*      the work of compiling one program:                                   */
+/*                                                                           */
+/*          The scanner thread reads the program with a SCANNER of its own   */
+/*          and passes each token to the parser through a ring (see          */
+/*          ring.c), running up to PIPE_TOKENS items ahead of it.            */
+/*                                                                           */
+/*          The parser, on the calling thread, takes the tokens with         */
+/*          "PipelineToken" in place of "GetToken".                          */
+/*                                                                           */
+/*          The writer thread writes the listing, and then the code, which   */
+/*          the parser passes to it through a second ring.                   */
+/*                                                                           */
+/*      The listing cannot simply be written by the scanner thread, since    */
+/*      the parser reports its errors against the line the scanner was on    */
+/*      when it read the token in hand, and a line is only listed, with its  */
+/*      errors, when the scanner has read on past the next. So the scanner   */
+/*      thread's character processor has a journal (see SetJournal), which   */
+/*      places each line in the ring at the point the scanner would have     */
+/*      listed it, and each token carries the position the scanner reached.  */
+/*      The parser's own character processor, which never reads the input,   */
+/*      is brought to that position by "ReplayLine" as each token is taken,  */
+/*      and lists the lines from the ring with "ReplayDisplay". Errors are   */
+/*      therefore reported, counted and listed exactly as if the parser's    */
+/*      character processor had read the program itself.                     */
+/*                                                                           */
+/*      Identifiers stay in the scanner thread's string table for the whole  */
+/*      compilation, since the scanner may overwrite a string the parser     */
+/*      has yet to see if it is not preserved.                               */
+/*                                                                           */
+/*      A program held in memory may instead be scanned in chunks of about   */
+/*      PIPE_CHUNK bytes, split at line boundaries, by several lexer         */
+/*      threads at once (see StartChunkedPipeline). Each chunk's tokens and  */
+/*      lines are kept in an array, and the scanner thread passes the        */
+/*      arrays on to the parser in order, just as it would its own tokens.   */
+/*      No token, and no comment, runs past the end of a line, so a lexer    */
+/*      starting at a line boundary finds the same tokens as one reading     */
+/*      from the beginning. But the lines are journalled one line late, so   */
+/*      each lexer starts a line before its chunk and reads one character    */
+/*      past it, and keeps only the tokens ending in the chunk and the       */
+/*      lines journalled while reading it. Line ids are offsets (see         */
+/*      CurrentLineId) and so agree between the lexers, and line numbers     */
+/*      are counted from where each lexer starts and put right as the        */
+/*      arrays are passed on.                                                */
+/*                                                                           */
+/*      A fatal error on the scanner thread or a lexer, such as running out  */
+/*      of memory, springs that thread's own trap (see fatal.c). The end of  */
+/*      the input is then sent to the parser as a PIPE_FAILED item, with     */
+/*      the message, and "PipelineToken" springs the parser's trap, so that  */
+/*      the error is reported on the parser's thread as if it were its own.  */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <setjmp.h>
+#include "line.h"
+#include "scanner.h"
+#include "code.h"
+#include "ring.h"
+#include "pipeline.h"
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      Function Prototypes for private routines                             */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE void  StartWriter( PIPELINE *pipe, int writer );
+PRIVATE void  *Reader( void *arg );
+PRIVATE void  SendFailure( PIPELINE *pipe, PIPEITEM *item, char *message );
+PRIVATE void  Journal( void *context, long id, int numbered, char *text );
+PRIVATE void  *Stitcher( void *arg );
+PRIVATE void  *Lexer( void *arg );
+PRIVATE void  ScanChunk( PIPELINE *pipe, CHUNK *chunk );
+PRIVATE void  ChunkJournal( void *context, long id, int numbered,
+                            char *text );
+PRIVATE void  AddItem( CHUNK *chunk, PIPEITEM *item );
+PRIVATE void  StopLexers( PIPELINE *pipe );
+PRIVATE void  *Writer( void *arg );
+PRIVATE void  ListPiece( void *context, int kind, int value, char *text );
+PRIVATE char  *CopyText( FATALTRAP *trap, char *text );
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      Public routines (globally accessable).                               */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      StartPipeline                                                        */
+/*                                                                           */
+/*      Starts the scanner thread, and the writer thread if wanted.          */
+/*                                                                           */
+/*      Input(s):                                                            */
+/*                                                                           */
+/*          pipe       the PIPELINE to start.                                */
+/*          scanner    a SCANNER initialised to read the program with no     */
+/*                     listing file. It must not be used by the caller       */
+/*                     until "StopPipeline".                                 */
+/*          chars      the parser's character processor, which takes the     */
+/*                     place of the scanner's for reporting errors and       */
+/*                     listing the program. It must not read the input.      */
+/*          listfile   the listing file, or NULL for no listing.             */
+/*          writer     1 if the listing and code may be written on a thread  */
+/*                     of their own, i.e., nothing else is written to the    */
+/*                     listing file until "StopPipeline".                    */
+/*          tracer     given a span for the scanning on each thread and for  */
+/*                     the writing of the code, or NULL (see trace.c).       */
+/*          trap       the parser's FATALTRAP, sprung by "PipelineToken"     */
+/*                     after a fatal error on another thread, or NULL.       */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*      Returns:       1 if the pipeline was started, 0 if there were not    */
+/*                     the resources, when the input has not been touched.   */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PUBLIC int    StartPipeline( PIPELINE *pipe, SCANNER *scanner,
+                             CHARPROCESSOR *chars, FILE *listfile,
+                             int writer, TRACER *tracer, FATALTRAP *trap )
+{
+    memset( pipe, 0, sizeof( PIPELINE ) );
+    pipe->tracer = tracer;
+    pipe->trap = trap;
+    pipe->scanner = scanner;
+    pipe->chars = chars;
+    pipe->listfile = listfile;
+    pipe->last.token.code = ENDOFINPUT;
+    pipe->last.line = 1;
+    if ( !InitRing( &pipe->tokens, sizeof( PIPEITEM ), PIPE_TOKENS ) )
+        return 0;
+
+    if ( listfile != NULL )  SetJournal( &scanner->chars, Journal, pipe );
+    if ( pthread_create( &pipe->reader, NULL, Reader, pipe ) != 0 )  {
+        SetJournal( &scanner->chars, NULL, NULL );
+        FreeRing( &pipe->tokens );
+        return 0;
+    }
+    StartWriter( pipe, writer );
+    return 1;
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      StartChunkedPipeline                                                 */
+/*                                                                           */
+/*      As StartPipeline, but for a program held in memory, which is         */
+/*      split into chunks at line boundaries and scanned by several lexer    */
+/*      threads at once. The scanner thread passes the chunks on to the      */
+/*      parser in order, and the parser sees exactly the tokens, lines and   */
+/*      positions it would with StartPipeline. At most PIPE_AHEAD chunks     */
+/*      per lexer are scanned before the parser reaches them.                */
+/*                                                                           */
+/*      Input(s):                                                            */
+/*                                                                           */
+/*          pipe       the PIPELINE to start, which must be released with    */
+/*                     "FreePipeline" once it has been stopped.              */
+/*          source     the program text, which must not change until         */
+/*                     "StopPipeline".                                       */
+/*          length     its length in bytes.                                  */
+/*          lexers     the number of lexer threads, at least 1. No more are  */
+/*                     started than there are chunks.                        */
+/*          chars, listfile, writer, tracer and trap, as for                 */
+/*                     "StartPipeline".                                      */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*      Returns:       1 if the pipeline was started, 0 if there were not    */
+/*                     the resources.                                        */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PUBLIC int    StartChunkedPipeline( PIPELINE *pipe, char *source,
+                                    size_t length, int lexers,
+                                    CHARPROCESSOR *chars, FILE *listfile,
+                                    int writer, TRACER *tracer,
+                                    FATALTRAP *trap )
+{
+    CHUNK *chunk;
+    char *newline;
+    long start, end;
+    int i;
+
+    memset( pipe, 0, sizeof( PIPELINE ) );
+    pipe->tracer = tracer;
+    pipe->trap = trap;
+    pipe->chars = chars;
+    pipe->listfile = listfile;
+    pipe->source = source;
+    pipe->last.token.code = ENDOFINPUT;
+    pipe->last.line = 1;
+
+    /*  Every chunk but the last is at least PIPE_CHUNK bytes long.          */
+
+    if ( NULL == ( pipe->chunks = calloc( length / PIPE_CHUNK + 1,
+                                          sizeof( CHUNK ) ) ) )
+        return 0;
+    for ( start = 0; start == 0 || start < (long) length; start = end )  {
+        end = length;
+        if ( start + PIPE_CHUNK < (long) length &&
+             NULL != ( newline = memchr( source + start + PIPE_CHUNK - 1,
+                                         '\n',
+                                         length - start - PIPE_CHUNK + 1 ) ) )
+            end = newline - source + 1;
+        chunk = &pipe->chunks[pipe->ChunkCount++];
+        chunk->start = chunk->from = start;
+        chunk->end = end;
+        chunk->last = end == (long) length;
+        if ( start > 0 )
+            for ( chunk->from = start - 1;
+                  chunk->from > 0 && source[chunk->from - 1] != '\n';
+                  chunk->from-- )
+                ;
+    }
+
+    if ( lexers > pipe->ChunkCount )  lexers = pipe->ChunkCount;
+    if ( !InitRing( &pipe->tokens, sizeof( PIPEITEM ), PIPE_TOKENS ) ||
+         NULL == ( pipe->lexers = malloc( lexers * sizeof( pthread_t ) ) ) )  {
+        FreeRing( &pipe->tokens );
+        free( pipe->chunks );
+        pipe->chunks = NULL;
+        return 0;
+    }
+    pthread_mutex_init( &pipe->lock, NULL );
+    pthread_cond_init( &pipe->changed, NULL );
+
+    pthread_mutex_lock( &pipe->lock );
+    for ( i = 0; i < lexers; i++ )
+        if ( pthread_create( &pipe->lexers[i], NULL, Lexer, pipe ) != 0 )
+            break;
+    pipe->LexerCount = i;
+    pthread_mutex_unlock( &pipe->lock );
+    if ( pipe->LexerCount == 0 ||
+         pthread_create( &pipe->reader, NULL, Stitcher, pipe ) != 0 )  {
+        StopLexers( pipe );
+        FreeRing( &pipe->tokens );
+        FreePipeline( pipe );
+        return 0;
+    }
+    StartWriter( pipe, writer );
+    return 1;
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      PipelineToken                                                        */
+/*                                                                           */
+/*      Takes the next token from the scanner thread, first listing the      */
+/*      lines the scanner finished while reading it. Once the end of the     */
+/*      input has been reached, returns the same ENDOFINPUT token as         */
+/*      "GetToken" would. If the scanner thread, or a lexer, failed, the     */
+/*      parser's trap is sprung with its message, once.                      */
+/*                                                                           */
+/*      Input(s):      pipe, the running PIPELINE.                           */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*      Returns:       The token.                                            */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PUBLIC TOKEN  PipelineToken( PIPELINE *pipe )
+{
+    PIPEITEM item;
+    int taken = 0;
+
+    /*  The first ENDOFINPUT may be preceded by whitespace, so the scanner   */
+    /*  sends a second, which every later call of GetToken would repeat.     */
+
+    if ( pipe->ends < 2 )  {
+        while ( ( taken = GetRing( &pipe->tokens, &item ) ) &&
+                item.kind == PIPE_LINE )  {
+            ReplayDisplay( pipe->chars, item.id, item.numbered, item.text );
+            free( item.text );
+        }
+    }
+    if ( taken )  {
+        pipe->last = item;
+        if ( item.token.code == ENDOFINPUT )  pipe->ends++;
+
+        /*  The line being read when the scanner failed is never listed,     */
+        /*  so the error is listed at once rather than held for it.          */
+
+        if ( item.kind == PIPE_FAILED )  pipe->last.id = 0;
+    }
+    ReplayLine( pipe->chars, pipe->last.id, pipe->last.line,
+                pipe->last.offset );
+    if ( taken && item.kind == PIPE_FAILED )  {
+        pipe->ends = 2;
+        Fatal( pipe->trap, "%s", pipe->failure );
+    }
+    return pipe->last.token;
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      PipelineCode                                                         */
+/*                                                                           */
+/*      Writes the code file (see WriteCodeFile), on the writer thread if    */
+/*      there is one, once the listing before it has been written. The code  */
+/*      must not be changed until "StopPipeline".                            */
+/*                                                                           */
+/*      Input(s):      pipe, the running PIPELINE.                           */
+/*                     cg, the finished code.                                */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*      Returns:       Nothing                                               */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PUBLIC void   PipelineCode( PIPELINE *pipe, CODEGEN *cg )
+{
+    WRITEITEM item;
+    double start;
+
+    if ( pipe->writing )  {
+        item.kind = WRITE_CODE;
+        item.value = 0;
+        item.text = NULL;
+        item.cg = cg;
+        PutRing( &pipe->writes, &item );
+    }
+    else  {
+        start = StartSpan( pipe->tracer );
+        WriteCodeFile( cg );
+        EndSpan( pipe->tracer, TRACE_WRITE, start, NULL );
+    }
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      StopPipeline                                                         */
+/*                                                                           */
+/*      Waits for the writer thread to finish, stops the scanner thread,     */
+/*      and any lexers, if the parser did not read to the end of the input,  */
+/*      and releases the pipeline. The scanner and character processor       */
+/*      passed to "StartPipeline" are the caller's again; the identifiers    */
+/*      the parser was given remain valid until the scanner is reset, or     */
+/*      after "StartChunkedPipeline", until "FreePipeline".                  */
+/*                                                                           */
+/*      Input(s):      pipe, the running PIPELINE.                           */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*      Returns:       Nothing                                               */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PUBLIC void   StopPipeline( PIPELINE *pipe )
+{
+    PIPEITEM item;
+
+    CloseRing( &pipe->tokens );
+    if ( pipe->chunks != NULL )  {
+        pthread_mutex_lock( &pipe->lock );
+        pipe->stopping = 1;
+        pthread_cond_broadcast( &pipe->changed );
+        pthread_mutex_unlock( &pipe->lock );
+    }
+    pthread_join( pipe->reader, NULL );
+    while ( GetRing( &pipe->tokens, &item ) )
+        if ( item.kind == PIPE_LINE )  free( item.text );
+    FreeRing( &pipe->tokens );
+    if ( pipe->chunks != NULL )  StopLexers( pipe );
+    else  SetJournal( &pipe->scanner->chars, NULL, NULL );
+
+    if ( pipe->writing )  {
+        CloseRing( &pipe->writes );
+        pthread_join( pipe->writer, NULL );
+        FreeRing( &pipe->writes );
+        SetListWriter( pipe->chars, NULL, NULL );
+        pipe->writing = 0;
+    }
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      FreePipeline                                                         */
+/*                                                                           */
+/*      Releases what a stopped pipeline keeps for the parser, i.e., the     */
+/*      identifiers found by the lexers of a chunked pipeline, which become  */
+/*      invalid. Does nothing for a pipeline with a single scanner thread.   */
+/*                                                                           */
+/*      Input(s):      pipe, a PIPELINE which has been stopped, or whose     */
+/*                     start failed.                                         */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*      Returns:       Nothing                                               */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PUBLIC void   FreePipeline( PIPELINE *pipe )
+{
+    int i;
+
+    if ( pipe->chunks == NULL )  return;
+    for ( i = 0; i < pipe->ChunkCount; i++ )
+        if ( pipe->chunks[i].scanned )
+            FreeStringTable( &pipe->chunks[i].scanner.strings );
+    free( pipe->chunks );
+    free( pipe->lexers );
+    pthread_mutex_destroy( &pipe->lock );
+    pthread_cond_destroy( &pipe->changed );
+    pipe->chunks = NULL;
+    pipe->lexers = NULL;
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      Private routines (only accessable within this module).               */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      StartWriter                                                          */
+/*                                                                           */
+/*      Starts the writer thread if it is wanted and there is a listing.     */
+/*      If it cannot be started the parser writes the listing and code       */
+/*      itself.                                                              */
+/*                                                                           */
+/*      Input(s):      pipe, the PIPELINE being started.                     */
+/*                     writer, as for "StartPipeline".                       */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*      Returns:       Nothing                                               */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE void  StartWriter( PIPELINE *pipe, int writer )
+{
+    if ( writer && pipe->listfile != NULL &&
+         InitRing( &pipe->writes, sizeof( WRITEITEM ), PIPE_WRITES ) )  {
+        if ( pthread_create( &pipe->writer, NULL, Writer, pipe ) == 0 )  {
+            pipe->writing = 1;
+            SetListWriter( pipe->chars, ListPiece, pipe );
+        }
+        else  FreeRing( &pipe->writes );
+    }
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      Reader                                                               */
+/*                                                                           */
+/*      The scanner thread. Reads tokens until the second ENDOFINPUT (see    */
+/*      PipelineToken), or until the parser closes the ring. A fatal error   */
+/*      ends the input early, see "SendFailure".                             */
+/*                                                                           */
+/*      Input(s):      arg, the PIPELINE.                                    */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*      Returns:       NULL                                                  */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE void  *Reader( void *arg )
+{
+    PIPELINE *pipe = arg;
+    CHARPROCESSOR *chars = &pipe->scanner->chars;
+    PIPEITEM item;
+    double start = StartSpan( pipe->tracer );
+    int ends = 0;
+
+    SetScannerTrap( pipe->scanner, &pipe->scanning );
+    ArmTrap( &pipe->scanning );
+    if ( setjmp( pipe->scanning.env ) == 0 )  {
+        memset( &item, 0, sizeof( PIPEITEM ) );
+        item.kind = PIPE_TOKEN;
+        while ( ends < 2 )  {
+            item.token = GetToken( pipe->scanner );
+            if ( item.token.code == IDENTIFIER )
+                PreserveString( &pipe->scanner->strings );
+            else if ( item.token.code == ENDOFINPUT )  ends++;
+            item.offset = CurrentCharOffset( chars );
+            item.id = CurrentLineId( chars, &item.line );
+            if ( !PutRing( &pipe->tokens, &item ) )  break;
+        }
+    }
+    else  {
+        memset( &item, 0, sizeof( PIPEITEM ) );
+        item.offset = CurrentCharOffset( chars );
+        item.id = CurrentLineId( chars, &item.line );
+        SendFailure( pipe, &item, pipe->scanning.message );
+    }
+    DisarmTrap( &pipe->scanning );
+    SetScannerTrap( pipe->scanner, NULL );
+    EndSpan( pipe->tracer, TRACE_SCAN, start, "scanner thread" );
+    return NULL;
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      SendFailure                                                          */
+/*                                                                           */
+/*      Ends the input after a fatal error on the scanner thread or a        */
+/*      lexer, by sending the parser a PIPE_FAILED item, which it takes as   */
+/*      ENDOFINPUT, with the message in the pipeline.                        */
+/*                                                                           */
+/*      Input(s):      pipe, the PIPELINE.                                   */
+/*                     item, the position the input ends at.                 */
+/*                     message, the error.                                   */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*      Returns:       Nothing                                               */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE void  SendFailure( PIPELINE *pipe, PIPEITEM *item, char *message )
+{
+    strcpy( pipe->failure, message );
+    item->kind = PIPE_FAILED;
+    item->token.code = ENDOFINPUT;
+    item->token.s = NULL;
+    item->text = NULL;
+    PutRing( &pipe->tokens, item );
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      Journal                                                              */
+/*                                                                           */
+/*      The scanner's journal (see SetJournal), which passes each line to    */
+/*      the parser to be listed.                                             */
+/*                                                                           */
+/*      Input(s):      context, the PIPELINE.                                */
+/*                     id, numbered and text, the line.                      */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*      Returns:       Nothing                                               */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE void  Journal( void *context, long id, int numbered, char *text )
+{
+    PIPELINE *pipe = context;
+    PIPEITEM item;
+
+    memset( &item, 0, sizeof( PIPEITEM ) );
+    item.kind = PIPE_LINE;
+    item.id = id;
+    item.numbered = numbered;
+    item.text = CopyText( &pipe->scanning, text );
+    if ( !PutRing( &pipe->tokens, &item ) )  free( item.text );
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      Stitcher                                                             */
+/*                                                                           */
+/*      The scanner thread of a chunked pipeline. Passes the tokens and      */
+/*      lines of each chunk on to the parser in order, as soon as the chunk  */
+/*      has been scanned, putting their line numbers right, until the end    */
+/*      of the program, until a chunk whose lexer failed, or until the       */
+/*      parser closes the ring.                                              */
+/*                                                                           */
+/*      Input(s):      arg, the PIPELINE.                                    */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*      Returns:       NULL                                                  */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE void  *Stitcher( void *arg )
+{
+    PIPELINE *pipe = arg;
+    CHUNK *chunk;
+    PIPEITEM *item, end;
+    int i, j, lines = 0, stopped = 0;
+
+    memset( &end, 0, sizeof( PIPEITEM ) );
+    end.line = 1;
+
+    for ( i = 0; i < pipe->ChunkCount && !stopped; i++ )  {
+        chunk = &pipe->chunks[i];
+        pthread_mutex_lock( &pipe->lock );
+        while ( !chunk->scanned && !pipe->stopping )
+            pthread_cond_wait( &pipe->changed, &pipe->lock );
+        stopped = !chunk->scanned;
+        pthread_mutex_unlock( &pipe->lock );
+        if ( stopped )  break;
+
+        /*  The lexer counted lines from the one before the chunk, and       */
+        /*  "lines" is the number of newlines before the chunk.              */
+
+        for ( j = 0; j < chunk->count; j++ )  {
+            item = &chunk->items[j];
+            if ( item->kind == PIPE_TOKEN && i > 0 )  item->line += lines - 1;
+            if ( item->kind == PIPE_TOKEN )  end = *item;
+            if ( stopped || !PutRing( &pipe->tokens, item ) )  {
+                stopped = 1;
+                if ( item->kind == PIPE_LINE )  free( item->text );
+            }
+        }
+        lines += chunk->lines;
+        free( chunk->items );
+        chunk->items = NULL;
+        chunk->count = 0;
+        if ( chunk->failed && !stopped )  {
+            SendFailure( pipe, &end, chunk->trap.message );
+            stopped = 1;
+        }
+
+        pthread_mutex_lock( &pipe->lock );
+        pipe->Stitched++;
+        pthread_cond_broadcast( &pipe->changed );
+        pthread_mutex_unlock( &pipe->lock );
+    }
+    return NULL;
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      Lexer                                                                */
+/*                                                                           */
+/*      A lexer thread of a chunked pipeline. Scans the next chunk no one    */
+/*      has taken, provided it is not too far ahead of the parser, until     */
+/*      there are none left or the pipeline is stopped.                      */
+/*                                                                           */
+/*      Input(s):      arg, the PIPELINE.                                    */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*      Returns:       NULL                                                  */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE void  *Lexer( void *arg )
+{
+    PIPELINE *pipe = arg;
+    int i;
+
+    pthread_mutex_lock( &pipe->lock );
+    for ( ;; )  {
+        while ( !pipe->stopping && pipe->NextChunk < pipe->ChunkCount &&
+                pipe->NextChunk >= pipe->Stitched +
+                                   PIPE_AHEAD * pipe->LexerCount )
+            pthread_cond_wait( &pipe->changed, &pipe->lock );
+        if ( pipe->stopping || pipe->NextChunk == pipe->ChunkCount )  break;
+        i = pipe->NextChunk++;
+        pthread_mutex_unlock( &pipe->lock );
+
+        ScanChunk( pipe, &pipe->chunks[i] );
+
+        pthread_mutex_lock( &pipe->lock );
+        pipe->chunks[i].scanned = 1;
+        pthread_cond_broadcast( &pipe->changed );
+    }
+    pthread_mutex_unlock( &pipe->lock );
+    return NULL;
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      ScanChunk                                                            */
+/*                                                                           */
+/*      Scans a chunk into its array, starting at the beginning of the line  */
+/*      before it and stopping at the first token past its end. The chunk's  */
+/*      scanner keeps the identifiers, but its line buffers are released.    */
+/*      A fatal error stops the scan, and sets "chunk->failed" with the      */
+/*      message in the chunk's trap.                                         */
+/*                                                                           */
+/*      Input(s):      pipe, the PIPELINE.                                   */
+/*                     chunk, the chunk to scan.                             */
+/*                                                                           */
+/*      Output(s):     chunk->items, chunk->count and chunk->lines.          */
+/*                                                                           */
+/*      Returns:       Nothing                                               */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE void  ScanChunk( PIPELINE *pipe, CHUNK *chunk )
+{
+    CHARPROCESSOR *chars = &chunk->scanner.chars;
+    PIPEITEM item;
+    FILE *input;
+    char *p, *end = pipe->source + chunk->end;
+    char detail[TRACE_DETAIL];
+    double start = StartSpan( pipe->tracer );
+    int ends = 0;
+
+    for ( p = pipe->source + chunk->start;
+          NULL != ( p = memchr( p, '\n', end - p ) ); p++ )
+        chunk->lines++;
+
+    /*  One character past the end is enough to have every line of the      */
+    /*  chunk journalled before the end of the input is reached.             */
+
+    input = fmemopen( pipe->source + chunk->from,
+                      chunk->end - chunk->from + ( chunk->last ? 0 : 1 ),
+                      "r" );
+    ArmTrap( &chunk->trap );
+    if ( setjmp( chunk->trap.env ) == 0 )  {
+        if ( input == NULL )
+            Fatal( &chunk->trap,
+                   "error, failed to open a chunk of the program" );
+        InitScanner( &chunk->scanner, input, NULL );
+        SetScannerTrap( &chunk->scanner, &chunk->trap );
+        SetCharPosition( chars, chunk->from, 0 );
+        if ( pipe->listfile != NULL )
+            SetJournal( chars, ChunkJournal, chunk );
+
+        memset( &item, 0, sizeof( PIPEITEM ) );
+        item.kind = PIPE_TOKEN;
+        while ( ends < 2 )  {
+            item.token = GetToken( &chunk->scanner );
+            item.offset = CurrentCharOffset( chars );
+            if ( !chunk->last && item.offset >= chunk->end )  break;
+            if ( item.offset < chunk->start )  continue;
+            if ( item.token.code == IDENTIFIER )
+                PreserveString( &chunk->scanner.strings );
+            else if ( item.token.code == ENDOFINPUT )  ends++;
+            item.id = CurrentLineId( chars, &item.line );
+            AddItem( chunk, &item );
+        }
+    }
+    else  chunk->failed = 1;
+    DisarmTrap( &chunk->trap );
+    SetScannerTrap( &chunk->scanner, NULL );
+    FreeCharProcessor( chars );
+    if ( input != NULL )  fclose( input );
+    snprintf( detail, TRACE_DETAIL, "chunk %d", (int)( chunk - pipe->chunks ) );
+    EndSpan( pipe->tracer, TRACE_SCAN, start, detail );
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      ChunkJournal                                                         */
+/*                                                                           */
+/*      The journal of a chunk's scanner (see SetJournal), which adds each   */
+/*      line journalled while reading the chunk to its array. Lines          */
+/*      journalled before, or at the end of the input, belong to the chunks  */
+/*      either side.                                                         */
+/*                                                                           */
+/*      Input(s):      context, the CHUNK.                                   */
+/*                     id, numbered and text, the line.                      */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*      Returns:       Nothing                                               */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE void  ChunkJournal( void *context, long id, int numbered,
+                            char *text )
+{
+    CHUNK *chunk = context;
+    PIPEITEM item;
+    long at = CurrentCharOffset( &chunk->scanner.chars );
+
+    if ( at > chunk->start && ( chunk->last || at <= chunk->end ) )  {
+        memset( &item, 0, sizeof( PIPEITEM ) );
+        item.kind = PIPE_LINE;
+        item.id = id;
+        item.numbered = numbered;
+        item.text = CopyText( &chunk->trap, text );
+        AddItem( chunk, &item );
+    }
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      AddItem                                                              */
+/*                                                                           */
+/*      Appends an item to a chunk's array, growing it as needed. Running    */
+/*      out of memory springs the chunk's trap, as in "CopyText", and the    */
+/*      item's text is released.                                             */
+/*                                                                           */
+/*      Input(s):      chunk, the CHUNK.                                     */
+/*                     item, the item.                                       */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*      Returns:       Nothing                                               */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE void  AddItem( CHUNK *chunk, PIPEITEM *item )
+{
+    PIPEITEM *items;
+    int space;
+
+    if ( chunk->count == chunk->space )  {
+        space = chunk->space > 0 ? 2 * chunk->space : PIPE_TOKENS;
+        if ( NULL == ( items = realloc( chunk->items,
+                                        space * sizeof( PIPEITEM ) ) ) )  {
+            if ( item->kind == PIPE_LINE )  free( item->text );
+            Fatal( &chunk->trap,
+                   "error, failed to allocate memory for pipeline" );
+        }
+        chunk->items = items;
+        chunk->space = space;
+    }
+    chunk->items[chunk->count++] = *item;
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      StopLexers                                                           */
+/*                                                                           */
+/*      Stops the lexer threads of a chunked pipeline, after the scanner     */
+/*      thread, and discards the chunks they scanned which were not passed   */
+/*      on.                                                                  */
+/*                                                                           */
+/*      Input(s):      pipe, the PIPELINE.                                   */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*      Returns:       Nothing                                               */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE void  StopLexers( PIPELINE *pipe )
+{
+    CHUNK *chunk;
+    int i, j;
+
+    pthread_mutex_lock( &pipe->lock );
+    pipe->stopping = 1;
+    pthread_cond_broadcast( &pipe->changed );
+    pthread_mutex_unlock( &pipe->lock );
+    for ( i = 0; i < pipe->LexerCount; i++ )
+        pthread_join( pipe->lexers[i], NULL );
+
+    for ( i = 0; i < pipe->ChunkCount; i++ )  {
+        chunk = &pipe->chunks[i];
+        for ( j = 0; j < chunk->count; j++ )
+            if ( chunk->items[j].kind == PIPE_LINE )
+                free( chunk->items[j].text );
+        free( chunk->items );
+        chunk->items = NULL;
+        chunk->count = 0;
+    }
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      Writer                                                               */
+/*                                                                           */
+/*      The writer thread. Writes each piece of the listing, and the code,   */
+/*      in the order given, until the ring is closed.                        */
+/*                                                                           */
+/*      Input(s):      arg, the PIPELINE.                                    */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*      Returns:       NULL                                                  */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE void  *Writer( void *arg )
+{
+    PIPELINE *pipe = arg;
+    WRITEITEM item;
+    double start;
+
+    while ( GetRing( &pipe->writes, &item ) )  {
+        if ( item.kind == WRITE_CODE )  {
+            start = StartSpan( pipe->tracer );
+            WriteCodeFile( item.cg );
+            EndSpan( pipe->tracer, TRACE_WRITE, start, NULL );
+        }
+        else  {
+            WriteListing( pipe->listfile, item.kind, item.value, item.text );
+            free( item.text );
+        }
+    }
+    return NULL;
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      ListPiece                                                            */
+/*                                                                           */
+/*      The parser's list writer (see SetListWriter), which passes each      */
+/*      piece of the listing to the writer thread.                           */
+/*                                                                           */
+/*      Input(s):      context, the PIPELINE.                                */
+/*                     kind, value and text, as for "WriteListing".          */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*      Returns:       Nothing                                               */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE void  ListPiece( void *context, int kind, int value, char *text )
+{
+    PIPELINE *pipe = context;
+    WRITEITEM item;
+
+    item.kind = kind;
+    item.value = value;
+    item.text = CopyText( pipe->trap, text );
+    item.cg = NULL;
+    PutRing( &pipe->writes, &item );
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      CopyText                                                             */
+/*                                                                           */
+/*      Returns a malloc'd copy of a string. Running out of memory is        */
+/*      fatal, as it is when the character processor allocates a line.       */
+/*                                                                           */
+/*      Input(s):      trap, the FATALTRAP of the calling thread, or NULL.   */
+/*                     text, the string.                                     */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*      Returns:       The copy.                                             */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE char  *CopyText( FATALTRAP *trap, char *text )
+{
+    char *copy;
+
+    if ( NULL == ( copy = malloc( strlen( text ) + 1 ) ) )
+        Fatal( trap, "error, failed to allocate memory for pipeline" );
+    return strcpy( copy, text );
+}
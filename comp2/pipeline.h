@@ -0,0 +1,110 @@
+#ifndef  PIPELINEHEADER
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      pipeline.h                                                           */
+/*                                                                           */
+/*      Header file for "pipeline.c", containing type definitions and        */
+/*      function prototypes for a pipelined compilation, in which the        */
+/*      program is scanned, and the listing and code written, on threads     */
+/*      of their own while the parser runs. A program in memory may be       */
+/*      scanned in chunks on several threads at once.                        */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+#define  PIPELINEHEADER
+
+#include <stdio.h>
+#include <pthread.h>
+#include "global.h"
+#include "scanner.h"
+#include "code.h"
+#include "ring.h"
+#include "trace.h"
+#include "fatal.h"
+
+#define  PIPE_TOKENS          1024      /* items the scanner may run ahead   */
+#define  PIPE_WRITES           256      /* items the writer may fall behind  */
+#define  PIPE_CHUNK      (1L << 20)     /* bytes of program per chunk        */
+#define  PIPE_AHEAD              2      /* chunks scanned ahead per lexer    */
+
+#define  PIPE_TOKEN              0      /* kinds of PIPEITEM                 */
+#define  PIPE_LINE               1
+#define  PIPE_FAILED             2      /* the end, after a fatal error      */
+#define  WRITE_CODE             -1      /* WRITEITEM kind, besides LIST_...  */
+
+typedef struct  {               /* from the scanner thread to the parser     */
+    int  kind;                  /* PIPE_TOKEN, PIPE_LINE or PIPE_FAILED      */
+    TOKEN token;
+    long offset;                /* the position reached after a PIPE_TOKEN,  */
+    long id;                    /* for ReplayLine, or the line given to the  */
+    int  line;                  /* journal for a PIPE_LINE, for              */
+    int  numbered;              /* ReplayDisplay                             */
+    char *text;                 /* malloc'd                                  */
+}
+    PIPEITEM;
+
+typedef struct  {               /* from the parser to the writer thread      */
+    int  kind;                  /* see WriteListing for the others          */
+    int  value;
+    char *text;                 /* malloc'd                                  */
+    CODEGEN *cg;                /* WRITE_CODE: the code to write             */
+}
+    WRITEITEM;
+
+typedef struct  {               /* a part of the program scanned by a lexer  */
+    long start, end;            /* its text, from "start" up to "end"        */
+    long from;                  /* where the lexer starts, a line earlier    */
+    int  lines;                 /* newlines from "start" to "end"            */
+    int  last;                  /* 1 for the chunk ending the program        */
+    int  scanned;               /* 1 once its items are ready                */
+    SCANNER scanner;            /* holds its identifiers, if "scanned"       */
+    PIPEITEM *items;            /* its tokens and lines, in order            */
+    int  count, space;
+    FATALTRAP trap;             /* its lexer's, and "failed" if it sprang    */
+    int  failed;
+}
+    CHUNK;
+
+typedef struct  {               /* one pipelined compilation                 */
+    SCANNER *scanner;           /* run by the scanner thread                 */
+    CHARPROCESSOR *chars;       /* the parser's, which lists the program     */
+    FILE *listfile;
+    RING tokens;                /* PIPEITEMs                                 */
+    RING writes;                /* WRITEITEMs                                */
+    pthread_t reader;           /* the scanner thread                        */
+    pthread_t writer;
+    int  writing;               /* 1 if the writer thread is running         */
+    int  ends;                  /* ENDOFINPUT tokens taken by the parser     */
+    PIPEITEM last;              /* the last token taken                      */
+    TRACER *tracer;             /* of the scanning and writing, or NULL      */
+    FATALTRAP *trap;            /* the parser's, see PipelineToken           */
+    FATALTRAP scanning;         /* the scanner thread's                      */
+    char failure[FATAL_MESSAGE];                /* sent with a PIPE_FAILED   */
+
+    char *source;               /* the program, when scanned in chunks by    */
+    CHUNK *chunks;              /* the lexer threads, see                    */
+    int  ChunkCount;            /* StartChunkedPipeline                      */
+    pthread_t *lexers;
+    int  LexerCount;
+    pthread_mutex_t lock;       /* guards the rest                           */
+    pthread_cond_t changed;     /* signalled when any of them changes        */
+    int  NextChunk;             /* the next chunk for a lexer to take        */
+    int  Stitched;              /* chunks passed on to the parser            */
+    int  stopping;              /* set by StopPipeline                       */
+}
+    PIPELINE;
+
+PUBLIC int    StartPipeline( PIPELINE *pipe, SCANNER *scanner,
+                             CHARPROCESSOR *chars, FILE *listfile,
+                             int writer, TRACER *tracer, FATALTRAP *trap );
+PUBLIC int    StartChunkedPipeline( PIPELINE *pipe, char *source,
+                                    size_t length, int lexers,
+                                    CHARPROCESSOR *chars, FILE *listfile,
+                                    int writer, TRACER *tracer,
+                                    FATALTRAP *trap );
+PUBLIC TOKEN  PipelineToken( PIPELINE *pipe );
+PUBLIC void   PipelineCode( PIPELINE *pipe, CODEGEN *cg );
+PUBLIC void   StopPipeline( PIPELINE *pipe );
+PUBLIC void   FreePipeline( PIPELINE *pipe );
+
+#endif
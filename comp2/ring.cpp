@@ -0,0 +1,215 @@
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      ring.c                                                               */
+/*                                                                           */
+/*      Implementation file for the ring buffers which connect the threads   */
+/*      of a pipelined compilation (see pipeline.c).                         */
+/*                                                                           */
+/*      A ring has exactly one producer, which calls "PutRing", and one      */
+/*      consumer, which calls "GetRing". No lock is taken: the producer      */
+/*      copies an item into the slot at "tail" and then advances "tail"      */
+/*      with a release store, and the consumer copies it out after seeing    */
+/*      the new "tail" with an acquire load, and frees the slot by           */
+/*      advancing "head" in the same way. The indices only ever grow and     */
+/*      are taken modulo the capacity, so a full ring is one where they      */
+/*      differ by the capacity. Each end keeps its last view of the other    */
+/*      end's index and only reloads it when that view says the ring is      */
+/*      full or empty, so in the steady state the threads share no cache     */
+/*      lines except those holding the items themselves.                     */
+/*                                                                           */
+/*      A thread which finds the ring full or empty spins briefly and then   */
+/*      yields the processor until the other end catches up, or until the    */
+/*      ring is closed.                                                      */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include "ring.h"
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      Definitions of constants local to the module                         */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+#define  RING_SPINS             64      /* polls before yielding, see Wait   */
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      Function Prototypes for private routines                             */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE void  Wait( int *spins );
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      Public routines (globally accessable).                               */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      InitRing                                                             */
+/*                                                                           */
+/*      Prepares an empty ring.                                              */
+/*                                                                           */
+/*      Input(s):      ring, the ring to initialise.                         */
+/*                     size, the size of an item in bytes.                   */
+/*                     capacity, the number of items it can hold, which is   */
+/*                     rounded up to a power of 2.                           */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*      Returns:       1 if successful, 0 if memory ran out.                 */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PUBLIC int    InitRing( RING *ring, size_t size, unsigned capacity )
+{
+    memset( ring, 0, sizeof( RING ) );
+    ring->size = size;
+    for ( ring->capacity = 1; ring->capacity < capacity; ring->capacity *= 2 )
+        ;
+    return NULL != ( ring->items = malloc( ring->capacity * size ) );
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      FreeRing                                                             */
+/*                                                                           */
+/*      Releases the slots of a ring. Neither end may use it afterwards.     */
+/*                                                                           */
+/*      Input(s):      ring, the ring to release.                            */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*      Returns:       Nothing                                               */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PUBLIC void   FreeRing( RING *ring )
+{
+    free( ring->items );
+    ring->items = NULL;
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      PutRing                                                              */
+/*                                                                           */
+/*      Adds an item to a ring, waiting while it is full. Only the ring's    */
+/*      producer may call this.                                              */
+/*                                                                           */
+/*      Input(s):      ring, the ring.                                       */
+/*                     item, "size" bytes to copy in.                        */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*      Returns:       1 if the item was added, 0 if the ring was full and   */
+/*                     has been closed, so that the consumer will never      */
+/*                     take it.                                              */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PUBLIC int    PutRing( RING *ring, void *item )
+{
+    unsigned tail = ring->tail;
+    int spins = 0;
+
+    while ( tail - ring->HeadSeen == ring->capacity )  {
+        ring->HeadSeen = __atomic_load_n( &ring->head, __ATOMIC_ACQUIRE );
+        if ( tail - ring->HeadSeen != ring->capacity )  break;
+        if ( __atomic_load_n( &ring->closed, __ATOMIC_ACQUIRE ) )  return 0;
+        Wait( &spins );
+    }
+    memcpy( ring->items + ( tail & ( ring->capacity - 1 ) ) * ring->size,
+            item, ring->size );
+    __atomic_store_n( &ring->tail, tail + 1, __ATOMIC_RELEASE );
+    return 1;
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      GetRing                                                              */
+/*                                                                           */
+/*      Takes the oldest item from a ring, waiting while it is empty. Only   */
+/*      the ring's consumer may call this.                                   */
+/*                                                                           */
+/*      Input(s):      ring, the ring.                                       */
+/*                                                                           */
+/*      Output(s):     *item, "size" bytes copied out.                       */
+/*                                                                           */
+/*      Returns:       1 if an item was taken, 0 if the ring is empty and    */
+/*                     has been closed, so that no more will come.           */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PUBLIC int    GetRing( RING *ring, void *item )
+{
+    unsigned head = ring->head;
+    int spins = 0;
+
+    while ( head == ring->TailSeen )  {
+        ring->TailSeen = __atomic_load_n( &ring->tail, __ATOMIC_ACQUIRE );
+        if ( head != ring->TailSeen )  break;
+        if ( __atomic_load_n( &ring->closed, __ATOMIC_ACQUIRE ) )  {
+            ring->TailSeen = __atomic_load_n( &ring->tail, __ATOMIC_ACQUIRE );
+            if ( head != ring->TailSeen )  break;
+            return 0;
+        }
+        Wait( &spins );
+    }
+    memcpy( item, ring->items + ( head & ( ring->capacity - 1 ) ) * ring->size,
+            ring->size );
+    __atomic_store_n( &ring->head, head + 1, __ATOMIC_RELEASE );
+    return 1;
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      CloseRing                                                            */
+/*                                                                           */
+/*      Closes a ring. Called by the producer after its last item, so that   */
+/*      the consumer stops once it has taken the rest, or by the consumer    */
+/*      when it will take no more, so that a producer waiting for space      */
+/*      gives up.                                                            */
+/*                                                                           */
+/*      Input(s):      ring, the ring.                                       */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*      Returns:       Nothing                                               */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PUBLIC void   CloseRing( RING *ring )
+{
+    __atomic_store_n( &ring->closed, 1, __ATOMIC_RELEASE );
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      Private routines (only accessable within this module).               */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      Wait                                                                 */
+/*                                                                           */
+/*      Called each time round a loop waiting for the other end of a ring.   */
+/*      Returns at once for the first RING_SPINS calls, in case the other    */
+/*      thread is running on another processor and is about to catch up,     */
+/*      and yields the processor after that.                                 */
+/*                                                                           */
+/*      Input(s):      spins, the number of calls so far in this wait.       */
+/*                                                                           */
+/*      Output(s):     *spins, incremented.                                  */
+/*                                                                           */
+/*      Returns:       Nothing                                               */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE void  Wait( int *spins )
+{
+    if ( ++*spins > RING_SPINS )  sched_yield();
+}
@@ -0,0 +1,49 @@
+#ifndef  RINGHEADER
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      ring.h                                                               */
+/*                                                                           */
+/*      Header file for "ring.c", containing the type definition and         */
+/*      function prototypes for the lock-free ring buffers which carry       */
+/*      items from one thread to another in a pipelined compilation.         */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+#define  RINGHEADER
+
+#include <stddef.h>
+#include "global.h"
+
+#define  RING_CACHE_LINE         64     /* keeps the two ends apart          */
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      A RING is a queue of fixed size items with a single producer and a   */
+/*      single consumer, which may be different threads. Each end owns one   */
+/*      index, and they sit in different cache lines so that the threads     */
+/*      do not contend for them.                                             */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+typedef struct  {
+    char *items;                /* "capacity" items of "size" bytes          */
+    size_t size;
+    unsigned capacity;          /* a power of 2                              */
+    int  closed;                /* set by CloseRing                          */
+    char pad0[RING_CACHE_LINE];
+    unsigned head;              /* next item to take, moved by the consumer  */
+    unsigned TailSeen;          /* consumer's last view of "tail"            */
+    char pad1[RING_CACHE_LINE];
+    unsigned tail;              /* next item to fill, moved by the producer  */
+    unsigned HeadSeen;          /* producer's last view of "head"            */
+    char pad2[RING_CACHE_LINE];
+}
+    RING;
+
+PUBLIC int    InitRing( RING *ring, size_t size, unsigned capacity );
+PUBLIC void   FreeRing( RING *ring );
+PUBLIC int    PutRing( RING *ring, void *item );
+PUBLIC int    GetRing( RING *ring, void *item );
+PUBLIC void   CloseRing( RING *ring );
+
+#endif
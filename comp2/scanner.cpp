@@ -14,6 +14,7 @@
 #include "line.h"
 #include "strtab.h"
 #include "scanner.h"
+#include "diagnose.h"
 
 /*---------------------------------------------------------------------------*/
 /*                                                                           */
@@ -22,7 +23,6 @@
 /*---------------------------------------------------------------------------*/
 
 #define  MAXDISPLAYLENGTH                73 
-#define  MAXERRORSPERLINE                 5
 
 #define  ERRORTOKENSTRING               "Scanner Error"
 #define  ILLEGALCHARTOKENSTRING         "Illegal Character"
@@ -46,6 +46,7 @@
 #define  DOTOKENSTRING                  "DO"
 #define  ELSETOKENSTRING                "ELSE"
 #define  ENDTOKENSTRING                 "END"
+#define  EXTERNALTOKENSTRING            "EXTERNAL"
 #define  IFTOKENSTRING                  "IF"
 #define  PROCEDURETOKENSTRING           "PROCEDURE"
 #define  PROGRAMTOKENSTRING             "PROGRAM"
@@ -85,9 +86,9 @@ PRIVATE char   *Tokens[] =  {
             MULTIPLYTOKENSTRING, DIVIDETOKENSTRING, EQUALITYTOKENSTRING,
             LESSEQUALTOKENSTRING, GREATEREQUALTOKENSTRING, LESSTOKENSTRING,
             GREATERTOKENSTRING, BEGINTOKENSTRING, DOTOKENSTRING,
-            ELSETOKENSTRING, ENDTOKENSTRING, IFTOKENSTRING, 
-            PROCEDURETOKENSTRING, PROGRAMTOKENSTRING, READTOKENSTRING,
-            REFTOKENSTRING, THENTOKENSTRING, VARTOKENSTRING, 
+            ELSETOKENSTRING, ENDTOKENSTRING, EXTERNALTOKENSTRING,
+            IFTOKENSTRING, PROCEDURETOKENSTRING, PROGRAMTOKENSTRING,
+            READTOKENSTRING, REFTOKENSTRING, THENTOKENSTRING, VARTOKENSTRING,
             WHILETOKENSTRING, WRITETOKENSTRING, IDENTIFIERTOKENSTRING,
             INTCONSTTOKENSTRING
        };
@@ -96,6 +97,101 @@ PRIVATE char   *Tokens[] =  {
 /*                                                                           */
 /*      Public routines (globally accessable).                               */
 /*                                                                           */
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      InitScanner                                                          */
+/*                                                                           */
+/*      Prepares a scanner to read a program: establishes the input and      */
+/*      listing files of its character processor and empties its string      */
+/*      table.                                                               */
+/*                                                                           */
+/*      Input(s):                                                            */
+/*                                                                           */
+/*          scanner    pointer to the SCANNER to initialise.                 */
+/*          inputfile  the program text, see "InitCharProcessor".            */
+/*          listfile   the listing file, or NULL for no listing.             */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*      Returns:       Nothing                                               */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PUBLIC void   InitScanner( SCANNER *scanner, FILE *inputfile, FILE *listfile )
+{
+    InitCharProcessor( &scanner->chars, inputfile, listfile );
+    InitStringTable( &scanner->strings );
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      FreeScanner                                                          */
+/*                                                                           */
+/*      Releases the line buffers and string table of a scanner. Any token   */
+/*      strings it returned become invalid.                                  */
+/*                                                                           */
+/*      Input(s):      scanner, the SCANNER to release.                      */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*      Returns:       Nothing                                               */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PUBLIC void   FreeScanner( SCANNER *scanner )
+{
+    FreeCharProcessor( &scanner->chars );
+    FreeStringTable( &scanner->strings );
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      ResetScanner                                                         */
+/*                                                                           */
+/*      Prepares a scanner which has already been used to read another       */
+/*      program. The string table is emptied but keeps its chunks (see       */
+/*      "ResetStringTable"). Any token strings it returned become invalid.   */
+/*                                                                           */
+/*      Input(s):      As for "InitScanner".                                 */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*      Returns:       Nothing                                               */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PUBLIC void   ResetScanner( SCANNER *scanner, FILE *inputfile, FILE *listfile )
+{
+    FreeCharProcessor( &scanner->chars );
+    InitCharProcessor( &scanner->chars, inputfile, listfile );
+    ResetStringTable( &scanner->strings );
+    SetStringTrap( &scanner->strings, NULL );
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      SetScannerTrap                                                       */
+/*                                                                           */
+/*      Has the scanner's character processor and string table spring a      */
+/*      trap if they run out of store (see "SetCharTrap" and                 */
+/*      "SetStringTrap"), until the scanner is next initialised or reset.    */
+/*                                                                           */
+/*      Input(s):      scanner, the SCANNER.                                 */
+/*                     trap, the FATALTRAP of the thread which will read     */
+/*                     with it, or NULL for none.                            */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*      Returns:       Nothing                                               */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PUBLIC void   SetScannerTrap( SCANNER *scanner, FATALTRAP *trap )
+{
+    SetCharTrap( &scanner->chars, trap );
+    SetStringTrap( &scanner->strings, trap );
+}
+
 /*---------------------------------------------------------------------------*/
 /*                                                                           */
 /*      GetToken                                                             */
@@ -217,8 +313,10 @@ PRIVATE char   *Tokens[] =  {
 /*                                                                           */
 /*---------------------------------------------------------------------------*/
 
-PUBLIC TOKEN  GetToken( void )
+PUBLIC TOKEN  GetToken( SCANNER *scanner )
 {
+    CHARPROCESSOR *chars = &scanner->chars;
+    STRINGTABLE   *strings = &scanner->strings;
     int   state = 0, scanning = 1, ch;
     TOKEN token;
 
@@ -236,12 +334,12 @@ PUBLIC TOKEN  GetToken( void )
         switch ( state )  {
             case  0 :  
                 token.value = 0;  
-                NewString();  
+                NewString( strings );  
                 state = 1;         
                 scanning = 1;                                         break;
             case  1 :  
-                token.pos = CurrentCharPos();
-                ch = ReadChar();
+                token.pos = CurrentCharPos( chars );
+                ch = ReadChar( chars );
                 switch ( ch )  {
                     case  '!' :  state =  2;                          break;
                     case  ';' :  state =  3;                          break;
@@ -266,14 +364,15 @@ PUBLIC TOKEN  GetToken( void )
                             state = 23;
                         }
                         else if ( isalpha( ch ) )  {
-                            AddChar( ch );
+                            AddChar( strings, ch );
                             state = 25;
                         }
-                        else  state = 27;                             break;
+                        else  state = 27;
+                        break;
                 }
                 scanning = 1;                                         break;
             case  2 :  
-                ch = ReadChar();
+                ch = ReadChar( chars );
                 if ( ch == '\n' || ch == EOF )  state = 1;  else  state = 2;
                 scanning = 1;                                         break;
             case  3 :  token.code = SEMICOLON;                        break;
@@ -282,31 +381,31 @@ PUBLIC TOKEN  GetToken( void )
             case  6 :  token.code = LEFTPARENTHESIS;                  break; 
             case  7 :  token.code = RIGHTPARENTHESIS;                 break;
             case  8 :
-                ch = ReadChar();
+                ch = ReadChar( chars );
                 if ( ch == '=' )  state = 9;  else  state = 10;
                 scanning = 1;                                         break;
             case  9 :  token.code = ASSIGNMENT;                       break;
-            case 10 :  token.code = ERROR;             UnReadChar();  break;
+            case 10 :  token.code = ERROR;      UnReadChar( chars );  break;
             case 11 :  token.code = ADD;                              break; 
             case 12 :  token.code = SUBTRACT;                         break; 
             case 13 :  token.code = MULTIPLY;                         break; 
             case 14 :  token.code = DIVIDE;                           break; 
             case 15 :  token.code = EQUALITY;                         break; 
             case 16 :
-                ch = ReadChar();
+                ch = ReadChar( chars );
                 if ( ch == '=' )  state = 17;  else  state = 18;
                 scanning = 1;                                         break;
             case 17 :  token.code = LESSEQUAL;                        break; 
-            case 18 :  token.code = LESS;              UnReadChar();  break; 
+            case 18 :  token.code = LESS;       UnReadChar( chars );  break; 
             case 19 :
-                ch = ReadChar();
+                ch = ReadChar( chars );
                 if ( ch == '=' )  state = 20;  else  state = 21;
                 scanning = 1;                                         break;
             case 20 :  token.code = GREATEREQUAL;                     break;
-            case 21 :  token.code = GREATER;           UnReadChar();  break;
+            case 21 :  token.code = GREATER;    UnReadChar( chars );  break;
             case 22 :  token.code = ENDOFINPUT;                       break;
             case 23 :
-                ch = ReadChar();
+                ch = ReadChar( chars );
                 if ( isdigit( ch ) )  {
                     token.value *= 10;
                     token.value += ch - '0';
@@ -314,16 +413,16 @@ PUBLIC TOKEN  GetToken( void )
                 }
                 else  state = 24;
                 scanning = 1;                                         break;
-            case 24 :  token.code = INTCONST;          UnReadChar();  break;
+            case 24 :  token.code = INTCONST;   UnReadChar( chars );  break;
             case 25 :
-                ch = ReadChar();
+                ch = ReadChar( chars );
                 if ( isalnum( ch ) )  {
-                    AddChar( ch );
+                    AddChar( strings, ch );
                     state = 25;
                 }
                 else  state = 26;
                 scanning = 1;                                         break;
-            case 26 :  token.code = IDENTIFIER;        UnReadChar();  break;
+            case 26 :  token.code = IDENTIFIER; UnReadChar( chars );  break;
             case 27 :  token.code = ILLEGALCHAR;                      break;
             default :  
                 fprintf(stderr, "Error, GetToken, invalid state %d\n", state);
@@ -332,8 +431,8 @@ PUBLIC TOKEN  GetToken( void )
     }
 
     if ( token.code == IDENTIFIER )  {
-        AddChar( '\0' );                /* null-terminate the string         */
-        token.s = GetString();
+        AddChar( strings, '\0' );       /* null-terminate the string         */
+        token.s = GetString( strings );
         token.code = SearchKeywords( token.s );
         if ( token.code != IDENTIFIER )  token.s = NULL;
     }
@@ -344,10 +443,12 @@ PUBLIC TOKEN  GetToken( void )
 /*                                                                           */
 /*      SyntaxError                                                          */
 /*                                                                           */
-/*      Generates a syntax error report.                                     */
+/*      Generates a syntax error report. The message is only formatted if    */
+/*      it will be read (see WantsMessage).                                  */
 /*                                                                           */
 /*      Input(s):                                                            */
 /*                                                                           */
+/*          scanner    the SCANNER which read the offending token.           */
 /*          Expected   an integer representing the code of the token which   */
 /*                     the parser expected to read.                          */
 /*          CurrentToken                                                     */
@@ -360,13 +461,22 @@ PUBLIC TOKEN  GetToken( void )
 /*                                                                           */
 /*---------------------------------------------------------------------------*/
 
-PUBLIC void   SyntaxError( int Expected, TOKEN CurrentToken )
+PUBLIC void   SyntaxError( SCANNER *scanner, int Expected, TOKEN CurrentToken )
 {
     char s[M_LINE_WIDTH+2];
+    ERRORREPORT report;
 
+    report.code = DIAG_EXPECTED;
+    report.got = CurrentToken.code;
+    report.expected = Expected;
+    report.expects = NULL;
+    if ( !WantsMessage( &scanner->chars ) )  {
+        ReportError( &scanner->chars, &report, NULL, CurrentToken.pos );
+        return;
+    }
     snprintf( s, sizeof(s), "Syntax: Expected %s, got %s\n", 
 	     Tokens[Expected], Tokens[CurrentToken.code] );
-    Error( s, CurrentToken.pos );
+    ReportError( &scanner->chars, &report, s, CurrentToken.pos );
 }
 
 /*---------------------------------------------------------------------------*/
@@ -374,10 +484,12 @@ PUBLIC void   SyntaxError( int Expected, TOKEN CurrentToken )
 /*      SyntaxError2                                                         */
 /*                                                                           */
 /*      Also generates a syntax error report, but one in which any one of a  */
-/*      set of tokens was expected, instead of a single token.               */
+/*      set of tokens was expected, instead of a single token. The message   */
+/*      is only formatted if it will be read (see WantsMessage).             */
 /*                                                                           */
 /*      Input(s):                                                            */
 /*                                                                           */
+/*          scanner    the SCANNER which read the offending token.           */
 /*          Expected   a SET of tokens, any one of which was expected by     */
 /*                     the parser, but not read.                             */
 /*          CurrentToken                                                     */
@@ -390,12 +502,23 @@ PUBLIC void   SyntaxError( int Expected, TOKEN CurrentToken )
 /*                                                                           */
 /*---------------------------------------------------------------------------*/
 
-PUBLIC void   SyntaxError2( SET Expected, TOKEN CurrentToken )
+PUBLIC void   SyntaxError2( SCANNER *scanner, SET Expected,
+                            TOKEN CurrentToken )
 {
     char s[2*M_LINE_WIDTH+2];
     int i, j, pos, w;
+    ERRORREPORT report;
+
+    report.code = DIAG_EXPECTED_ONE_OF;
+    report.got = CurrentToken.code;
+    report.expected = -1;
+    report.expects = &Expected;
+    if ( !WantsMessage( &scanner->chars ) )  {
+        ReportError( &scanner->chars, &report, NULL, CurrentToken.pos );
+        return;
+    }
     snprintf( s, sizeof(s), "Syntax: Expected one of: " );  pos = 25;
-    w = (int)(2*M_LINE_WIDTH - strlen( Tokens[CurrentToken.code] - 8 ));
+    w = (int)(2*M_LINE_WIDTH - strlen( Tokens[CurrentToken.code] ) - 8);
     for ( i = 0; i < SET_SIZE; i++ )  {
 	if ( InSet( &Expected, i ) )  {
 	    j = (int)(strlen( Tokens[i] ) + 1);
@@ -408,7 +531,28 @@ PUBLIC void   SyntaxError2( SET Expected, TOKEN CurrentToken )
     }
     snprintf( s+pos, sizeof(s)-pos, ": got %s\n", 
 	      Tokens[CurrentToken.code] );
-    Error( s, CurrentToken.pos );
+    ReportError( &scanner->chars, &report, s, CurrentToken.pos );
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      TokenName                                                            */
+/*                                                                           */
+/*      Returns the name of a token, as used in syntax error messages.       */
+/*                                                                           */
+/*      Input(s):      code, the token's code.                               */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*      Returns:       The name, or NULL if "code" is not a token.           */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PUBLIC char  *TokenName( int code )
+{
+    if ( code < 0 || code >= (int)( sizeof(Tokens) / sizeof(Tokens[0]) ) )
+        return NULL;
+    return Tokens[code];
 }
 
 /*---------------------------------------------------------------------------*/
@@ -33,21 +33,24 @@
 #define  DO                19   /* "DO"                                      */
 #define  ELSE              20   /* "ELSE"                                    */
 #define  END               21   /* "END"                                     */
-#define  IF                22   /* "IF"                                      */
-#define  PROCEDURE         23   /* "PROCEDURE"                               */
-#define  PROGRAM           24   /* "PROGRAM"                                 */
-#define  READ              25   /* "READ"                                    */
-#define  REF               26   /* "REF"                                     */
-#define  THEN              27   /* "THEN"                                    */
-#define  VAR               28   /* "VAR"                                     */
-#define  WHILE             29   /* "WHILE"                                   */
-#define  WRITE             30   /* "WRITE"                                   */
-#define  IDENTIFIER        31   /* <Identifier>                              */
-#define  INTCONST          32   /* <IntConst>                                */
+#define  EXTERNAL          22   /* "EXTERNAL"                                */
+#define  IF                23   /* "IF"                                      */
+#define  PROCEDURE         24   /* "PROCEDURE"                               */
+#define  PROGRAM           25   /* "PROGRAM"                                 */
+#define  READ              26   /* "READ"                                    */
+#define  REF               27   /* "REF"                                     */
+#define  THEN              28   /* "THEN"                                    */
+#define  VAR               29   /* "VAR"                                     */
+#define  WHILE             30   /* "WHILE"                                   */
+#define  WRITE             31   /* "WRITE"                                   */
+#define  IDENTIFIER        32   /* <Identifier>                              */
+#define  INTCONST          33   /* <IntConst>                                */
 
 #include <stdio.h>
 #include "global.h"
 #include "sets.h"
+#include "line.h"
+#include "strtab.h"
 
 typedef struct  {       /*  Definiton of a TOKEN, the structure which is     */
     int  code;          /*  returned by a call to "GetToken". "code" is the  */
@@ -58,8 +61,20 @@ typedef struct  {       /*  Definiton of a TOKEN, the structure which is     */
     TOKEN;              /*  "s" is always NULL unless the token code is      */
                         /*  IDENTIFIER.                                      */
 
-PUBLIC TOKEN  GetToken( void );
-PUBLIC void   SyntaxError( int Expected, TOKEN CurrentToken );
-PUBLIC void   SyntaxError2( SET Expected, TOKEN CurrentToken );
+typedef struct  {       /*  A SCANNER owns the character processor reading   */
+    CHARPROCESSOR chars;/*  one program and the string table holding its     */
+    STRINGTABLE strings;/*  identifiers. One is needed per compilation.      */
+}
+    SCANNER;
+
+PUBLIC void   InitScanner( SCANNER *scanner, FILE *inputfile, FILE *listfile );
+PUBLIC void   FreeScanner( SCANNER *scanner );
+PUBLIC void   ResetScanner( SCANNER *scanner, FILE *inputfile, FILE *listfile );
+PUBLIC void   SetScannerTrap( SCANNER *scanner, FATALTRAP *trap );
+PUBLIC TOKEN  GetToken( SCANNER *scanner );
+PUBLIC void   SyntaxError( SCANNER *scanner, int Expected, TOKEN CurrentToken );
+PUBLIC void   SyntaxError2( SCANNER *scanner, SET Expected,
+                            TOKEN CurrentToken );
+PUBLIC char  *TokenName( int code );
 
 #endif
@@ -0,0 +1,367 @@
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      server.c                                                             */
+/*                                                                           */
+/*      Implementation file for the compile server, "comp2 --server".        */
+/*                                                                           */
+/*      The server listens on a Unix domain socket and compiles the source   */
+/*      text sent in each request, replying with the listing, the error      */
+/*      messages and the code (see "server.h" for the protocol). Editors     */
+/*      and build tools can then check a program without the fork and exec   */
+/*      of a new comp2 each time.                                            */
+/*                                                                           */
+/*      Connections are served one at a time with a single COMPILER, whose   */
+/*      code table, symbols and string table chunks stay allocated between   */
+/*      requests and are reset before each (see "RunCompiler"). The code of  */
+/*      each procedure is also kept, so a program sent again after an edit   */
+/*      only has its changed procedures parsed (see "CompileText"). Nothing  */
+/*      is written to the filesystem: the source is compiled from memory     */
+/*      and the outputs are collected with open_memstream.                   */
+/*                                                                           */
+/*      As connections are served in turn, a client which stops sending      */
+/*      would hold up every other; reads and writes on a connection time     */
+/*      out after SERVER_TIMEOUT seconds, and the connection is closed.      */
+/*                                                                           */
+/*      The server runs until it receives SIGINT or SIGTERM, when it removes */
+/*      its socket and exits.                                                */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <arpa/inet.h>
+#include "global.h"
+#include "comp2.h"
+#include "server.h"
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      Set by the SIGINT and SIGTERM handler to stop the server.            */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE volatile sig_atomic_t Stopping = 0;
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      Declarations of routines private to this module.                     */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE void   Stop( int signum );
+PRIVATE int    OpenListener( char *socketpath );
+PRIVATE void   ServeClient( COMPILER *compiler, int fd );
+PRIVATE int    CompileRequest( COMPILER *compiler, int fd, char *source,
+                               size_t length );
+PRIVATE int    WriteBlock( int fd, char *text, size_t length );
+PRIVATE int    ReadFully( int fd, void *buffer, size_t length );
+PRIVATE int    WriteFully( int fd, const void *buffer, size_t length );
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      Public routines (globally accessable).                               */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      RunServer                                                            */
+/*                                                                           */
+/*      Serves compile requests on a Unix domain socket until stopped by     */
+/*      SIGINT or SIGTERM.                                                   */
+/*                                                                           */
+/*      Input(s):      socketpath, the filesystem name of the socket. A      */
+/*                     stale socket left by a server which has died is       */
+/*                     replaced, a live one is not.                          */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*      Returns:       1 if the server ran and was stopped, 0 if it could    */
+/*                     not start, in which case a message has been written   */
+/*                     to stderr.                                            */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PUBLIC int RunServer( char *socketpath )
+{
+    COMPILER *compiler;
+    struct sigaction action;
+    struct timeval timeout;
+    int listener, client;
+
+    if ( ( listener = OpenListener( socketpath ) ) < 0 )  return 0;
+    if ( NULL == ( compiler = NewCompiler() ) )  {
+        close( listener );
+        unlink( socketpath );
+        return 0;
+    }
+
+    /*  No SA_RESTART, so that a signal interrupts accept.                 */
+
+    memset( &action, 0, sizeof( action ) );
+    action.sa_handler = Stop;
+    sigemptyset( &action.sa_mask );
+    sigaction( SIGINT, &action, NULL );
+    sigaction( SIGTERM, &action, NULL );
+    signal( SIGPIPE, SIG_IGN );
+
+    memset( &timeout, 0, sizeof( timeout ) );
+    timeout.tv_sec = SERVER_TIMEOUT;
+
+    fprintf( stderr, "comp2: serving on %s\n", socketpath );
+    while ( !Stopping )  {
+        if ( ( client = accept( listener, NULL, NULL ) ) < 0 )  {
+            if ( errno == EINTR || errno == ECONNABORTED )  continue;
+            perror( "comp2: accept" );
+            break;
+        }
+        setsockopt( client, SOL_SOCKET, SO_RCVTIMEO, &timeout,
+                    sizeof( timeout ) );
+        setsockopt( client, SOL_SOCKET, SO_SNDTIMEO, &timeout,
+                    sizeof( timeout ) );
+        ServeClient( compiler, client );
+        close( client );
+    }
+
+    close( listener );
+    unlink( socketpath );
+    FreeCompiler( compiler );
+    return 1;
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      Private routines (only accessable within this module).               */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      Stop                                                                 */
+/*                                                                           */
+/*      Signal handler for SIGINT and SIGTERM.                               */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE void Stop( int signum )
+{
+    (void) signum;
+    Stopping = 1;
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      OpenListener                                                         */
+/*                                                                           */
+/*      Creates, binds and listens on the server's socket.                   */
+/*                                                                           */
+/*      Input(s):      socketpath, the filesystem name of the socket.        */
+/*                                                                           */
+/*      Returns:       The listening socket, or -1 if it could not be        */
+/*                     opened, in which case a message has been written to   */
+/*                     stderr.                                               */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE int OpenListener( char *socketpath )
+{
+    struct sockaddr_un addr;
+    int fd, probe;
+
+    if ( strlen( socketpath ) >= sizeof( addr.sun_path ) )  {
+        fprintf( stderr, "comp2: socket name \"%s\" is too long\n",
+                 socketpath );
+        return -1;
+    }
+    memset( &addr, 0, sizeof( addr ) );
+    addr.sun_family = AF_UNIX;
+    strcpy( addr.sun_path, socketpath );
+
+    /*  If something answers on the socket another server owns it,         */
+    /*  otherwise any file left there is stale and can go.                 */
+
+    if ( ( probe = socket( AF_UNIX, SOCK_STREAM, 0 ) ) >= 0 )  {
+        if ( connect( probe, (struct sockaddr *) &addr, sizeof( addr ) ) == 0 )
+        {
+            fprintf( stderr, "comp2: a server is already running on %s\n",
+                     socketpath );
+            close( probe );
+            return -1;
+        }
+        close( probe );
+        if ( errno == ECONNREFUSED )  unlink( socketpath );
+    }
+
+    if ( ( fd = socket( AF_UNIX, SOCK_STREAM, 0 ) ) < 0 )  {
+        perror( "comp2: socket" );
+        return -1;
+    }
+    if ( bind( fd, (struct sockaddr *) &addr, sizeof( addr ) ) < 0 ||
+         listen( fd, SOMAXCONN ) < 0 )  {
+        fprintf( stderr, "comp2: cannot listen on %s: %s\n", socketpath,
+                 strerror( errno ) );
+        close( fd );
+        return -1;
+    }
+    return fd;
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      ServeClient                                                          */
+/*                                                                           */
+/*      Answers requests on one connection until the client closes it, an    */
+/*      I/O error occurs or a request is refused. The source buffer is       */
+/*      grown as needed and kept for the life of the connection.             */
+/*                                                                           */
+/*      Input(s):      compiler, the server's COMPILER, fd, the connection.  */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE void ServeClient( COMPILER *compiler, int fd )
+{
+    char *source = NULL, *bigger;
+    size_t size = 0, length;
+    uint32_t header;
+
+    while ( !Stopping && ReadFully( fd, &header, sizeof( header ) ) )  {
+        length = ntohl( header );
+        if ( length > SERVER_MAX_SOURCE )  {
+            fprintf( stderr, "comp2: request of %lu bytes refused\n",
+                     (unsigned long) length );
+            break;
+        }
+        if ( length + 1 > size )  {
+            if ( NULL == ( bigger = realloc( source, length + 1 ) ) )  {
+                fprintf( stderr, "comp2: cannot allocate request buffer\n" );
+                break;
+            }
+            source = bigger;
+            size = length + 1;
+        }
+        if ( !ReadFully( fd, source, length ) ||
+             !CompileRequest( compiler, fd, source, length ) )  break;
+    }
+    free( source );
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      CompileRequest                                                       */
+/*                                                                           */
+/*      Compiles one program held in memory and sends the reply.             */
+/*                                                                           */
+/*      Input(s):      compiler, the server's COMPILER, fd, the connection,  */
+/*                     source and length, the program text.                  */
+/*                                                                           */
+/*      Returns:       1 if the reply was sent, 0 if not.                    */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE int CompileRequest( COMPILER *compiler, int fd, char *source,
+                            size_t length )
+{
+    FILE *ListFile, *ErrorFile, *CodeFile;
+    char *listing = NULL, *errors = NULL, *code = NULL;
+    size_t ListLength = 0, ErrorLength = 0, CodeLength = 0;
+    uint32_t status = SERVER_INVALID;
+    int sent = 0;
+
+    ListFile = open_memstream( &listing, &ListLength );
+    ErrorFile = open_memstream( &errors, &ErrorLength );
+    CodeFile = open_memstream( &code, &CodeLength );
+
+    if ( ListFile == NULL || ErrorFile == NULL || CodeFile == NULL )
+        perror( "comp2: cannot open request streams" );
+    else
+        status = CompileText( compiler, source, length, ListFile, CodeFile,
+                              ErrorFile, NULL ) ? SERVER_VALID : SERVER_INVALID;
+
+    if ( ListFile != NULL )  fclose( ListFile );
+    if ( ErrorFile != NULL )  fclose( ErrorFile );
+    if ( CodeFile != NULL )  fclose( CodeFile );
+
+    if ( ListFile != NULL && ErrorFile != NULL && CodeFile != NULL )  {
+        status = htonl( status );
+        sent = WriteFully( fd, &status, sizeof( status ) ) &&
+               WriteBlock( fd, listing, ListLength ) &&
+               WriteBlock( fd, errors, ErrorLength ) &&
+               WriteBlock( fd, code, CodeLength );
+    }
+    free( listing );
+    free( errors );
+    free( code );
+    return sent;
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      WriteBlock                                                           */
+/*                                                                           */
+/*      Sends a length-prefixed block of text.                               */
+/*                                                                           */
+/*      Returns:       1 if successful, 0 if not.                            */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE int WriteBlock( int fd, char *text, size_t length )
+{
+    uint32_t header = htonl( (uint32_t) length );
+
+    return WriteFully( fd, &header, sizeof( header ) ) &&
+           WriteFully( fd, text, length );
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      ReadFully                                                            */
+/*                                                                           */
+/*      Reads exactly "length" bytes from a socket, retrying short reads.    */
+/*                                                                           */
+/*      Returns:       1 if successful, 0 on end of file or error.           */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE int ReadFully( int fd, void *buffer, size_t length )
+{
+    char *p = buffer;
+    ssize_t n;
+
+    while ( length > 0 )  {
+        n = read( fd, p, length );
+        if ( n < 0 && errno == EINTR && !Stopping )  continue;
+        if ( n <= 0 )  return 0;
+        p += n;
+        length -= n;
+    }
+    return 1;
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      WriteFully                                                           */
+/*                                                                           */
+/*      Writes exactly "length" bytes to a socket, retrying short writes.    */
+/*                                                                           */
+/*      Returns:       1 if successful, 0 on error.                          */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE int WriteFully( int fd, const void *buffer, size_t length )
+{
+    const char *p = buffer;
+    ssize_t n;
+
+    while ( length > 0 )  {
+        n = write( fd, p, length );
+        if ( n < 0 && errno == EINTR && !Stopping )  continue;
+        if ( n <= 0 )  return 0;
+        p += n;
+        length -= n;
+    }
+    return 1;
+}
@@ -0,0 +1,41 @@
+#ifndef  SERVERHEADER
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      server.h                                                             */
+/*                                                                           */
+/*      Header file for "server.c", the compile server run by                */
+/*      "comp2 --server", containing the definition of the protocol spoken   */
+/*      over its Unix domain socket, which is shared with the client         */
+/*      "cplclient", and the server's function prototypes.                   */
+/*                                                                           */
+/*      A client connects and sends any number of requests, each answered    */
+/*      before the next is read. All numbers are 32-bit unsigned integers    */
+/*      in network byte order.                                               */
+/*                                                                           */
+/*          request:   length of source, source text                         */
+/*                                                                           */
+/*          reply:     status (SERVER_VALID or SERVER_INVALID),              */
+/*                     length of listing, listing text,                      */
+/*                     length of diagnostics, diagnostics text,              */
+/*                     length of code, code text                             */
+/*                                                                           */
+/*      The diagnostics are the "Error: ..." lines comp2 writes to stderr.   */
+/*      A request longer than SERVER_MAX_SOURCE bytes is refused by closing  */
+/*      the connection, as is a connection which goes silent for             */
+/*      SERVER_TIMEOUT seconds.                                              */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+#define  SERVERHEADER
+
+#include "global.h"
+
+#define  SERVER_VALID            1      /* compiled, no errors detected      */
+#define  SERVER_INVALID          0      /* errors detected, no code          */
+
+#define  SERVER_MAX_SOURCE  (16*1024*1024)   /* largest request accepted     */
+#define  SERVER_TIMEOUT         30      /* seconds a client may stay silent  */
+
+PUBLIC int    RunServer( char *socketpath );
+
+#endif
@@ -36,6 +36,7 @@
 #include <stdlib.h>
 #include <stdarg.h>
 #include "sets.h"
+#include "memory.h"
 
 /*---------------------------------------------------------------------------*/
 /*                                                                           */
@@ -62,7 +63,7 @@ PUBLIC SET   *MakeSet( void )
 {
     SET    *setptr;
 
-    if ( NULL == ( setptr = malloc( sizeof( SET ) ) ) )  {
+    if ( NULL == ( setptr = MemAlloc( MEM_SETS, sizeof( SET ) ) ) )  {
         fprintf( stderr, "MakeSet: malloc failure\n" );
         exit( EXIT_FAILURE );
     }
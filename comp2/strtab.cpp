@@ -10,7 +10,10 @@
 /*      chunk is filled up by strings, a new chunk is dynamically allocated  */ 
 /*      from store.                                                          */
 /*                                                                           */ 
-/*      Four routines are provided by this module.                           */
+/*      Four routines are provided by this module, plus "InitStringTable"    */
+/*      and "FreeStringTable" which set up and release a table, and          */
+/*      "SetStringTrap", which has running out of store sprung on a trap     */
+/*      (see "fatal.c") rather than ending the process.                      */
 /*                                                                           */ 
 /*          "NewString"  -- this is used to prepare the string table to      */
 /*          accept a new string. It must be called before any of the other   */
@@ -39,6 +42,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include "strtab.h"
+#include "memory.h"
 
 /*---------------------------------------------------------------------------*/
 /*                                                                           */
@@ -73,16 +77,127 @@
 /*                                                                           */
 /*                                SpaceLeftInChunk = 12                      */
 /*                                                                           */
+/*      These three live in the STRINGTABLE passed to each routine, which    */
+/*      also links every chunk it has allocated so that they can be freed.   */
+/*      Chunks released by "ResetStringTable" are kept on its "Spare" list   */
+/*      and handed out again by "NewChunk" before any more are allocated.    */
+/*      "Held" and "Lost" count the bytes of the chunks in use which hold    */
+/*      preserved strings, and which were left at the end of a chunk when    */
+/*      "AddChar" moved a string to the next, for the memory report.         */
+/*                                                                           */
 /*---------------------------------------------------------------------------*/
 
-PRIVATE char  *TopOfTable = NULL; 
-PRIVATE char  *InsertionPoint = NULL;
-PRIVATE int   SpaceLeftInChunk = 0;
+typedef struct chunk  {
+    struct chunk *next;
+    char  text[CHUNKSIZE];
+}
+    CHUNK;
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      Function Prototypes for private routines                             */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE char  *NewChunk( STRINGTABLE *st, char *routine );
 
 /*---------------------------------------------------------------------------*/
 /*                                                                           */
 /*      Public routines (globally accessable).                               */
 /*                                                                           */
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      InitStringTable                                                      */
+/*                                                                           */
+/*      Prepares an empty string table. No chunk is allocated until the      */
+/*      first call to "NewString".                                           */
+/*                                                                           */
+/*      Input(s):      st, the table to initialise.                          */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*      Returns:       Nothing                                               */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PUBLIC void   InitStringTable( STRINGTABLE *st )
+{
+    st->Chunks = NULL;
+    st->Spare = NULL;
+    st->TopOfTable = NULL;
+    st->InsertionPoint = NULL;
+    st->SpaceLeftInChunk = 0;
+    st->Held = 0;
+    st->Lost = 0;
+    st->Trap = NULL;
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      FreeStringTable                                                      */
+/*                                                                           */
+/*      Releases every chunk of a string table. Any pointer previously       */
+/*      returned by "GetString" becomes invalid.                             */
+/*                                                                           */
+/*      Input(s):      st, the table to release.                             */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*      Returns:       Nothing                                               */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PUBLIC void   FreeStringTable( STRINGTABLE *st )
+{
+    CHUNK *chunk;
+
+    ResetStringTable( st );
+    while ( st->Spare != NULL )  {
+        chunk = st->Spare;
+        st->Spare = chunk->next;
+        MemFree( MEM_STRINGS, chunk, sizeof(CHUNK) );
+    }
+    InitStringTable( st );
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      ResetStringTable                                                     */
+/*                                                                           */
+/*      Empties a string table but keeps its chunks for reuse, so that a     */
+/*      table used for one compilation after another stops calling malloc    */
+/*      once it has grown to the size of the largest program. Any pointer    */
+/*      previously returned by "GetString" becomes invalid.                  */
+/*                                                                           */
+/*      Input(s):      st, the table to empty.                               */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*      Returns:       Nothing                                               */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PUBLIC void   ResetStringTable( STRINGTABLE *st )
+{
+    CHUNK *chunk;
+    long  chunks = 0;
+
+    while ( st->Chunks != NULL )  {
+        chunk = st->Chunks;
+        st->Chunks = chunk->next;
+        chunk->next = st->Spare;
+        st->Spare = chunk;
+        chunks++;
+    }
+    if ( chunks > 0 )
+        NoteStringTable( chunks * CHUNKSIZE, st->Held, st->Lost );
+    st->TopOfTable = NULL;
+    st->InsertionPoint = NULL;
+    st->SpaceLeftInChunk = 0;
+    st->Held = 0;
+    st->Lost = 0;
+}
+
 /*---------------------------------------------------------------------------*/
 /*                                                                           */
 /*      NewString                                                            */
@@ -97,17 +212,14 @@ PRIVATE int   SpaceLeftInChunk = 0;
 /*                                                                           */
 /*---------------------------------------------------------------------------*/
 
-PUBLIC void   NewString( void )
+PUBLIC void   NewString( STRINGTABLE *st )
 {
-    if ( SpaceLeftInChunk <= 0 )  {
-        if ( NULL == ( TopOfTable = malloc( CHUNKSIZE ) ) )  {
-            fprintf( stderr, "Error, \"NewString\", malloc failure\n" );
-            exit( EXIT_FAILURE );
-        }
-        SpaceLeftInChunk = CHUNKSIZE;
+    if ( st->SpaceLeftInChunk <= 0 )  {
+        st->TopOfTable = NewChunk( st, "NewString" );
+        st->SpaceLeftInChunk = CHUNKSIZE;
     }
-    else  SpaceLeftInChunk += (int)(InsertionPoint-TopOfTable);
-    InsertionPoint = TopOfTable;
+    else  st->SpaceLeftInChunk += (int)(st->InsertionPoint-st->TopOfTable);
+    st->InsertionPoint = st->TopOfTable;
 }
 
 /*---------------------------------------------------------------------------*/
@@ -129,25 +241,24 @@ PUBLIC void   NewString( void )
 /*                                                                           */
 /*---------------------------------------------------------------------------*/
 
-PUBLIC void   AddChar( int ch )
+PUBLIC void   AddChar( STRINGTABLE *st, int ch )
 {
-    char *NewChunk, *p;
+    char *chunk, *p;
 
-    if ( SpaceLeftInChunk <= 1 )  {
-        if ( NULL == ( NewChunk = p  = malloc( CHUNKSIZE ) ) )  {
-            fprintf( stderr, "Error, \"AddChar\", malloc failure\n" );
-            exit( EXIT_FAILURE );
+    if ( st->SpaceLeftInChunk <= 1 )  {
+        chunk = p = NewChunk( st, "AddChar" );
+        st->Lost += st->SpaceLeftInChunk +
+                    (int)(st->InsertionPoint-st->TopOfTable);
+        st->SpaceLeftInChunk = CHUNKSIZE;
+        while ( st->TopOfTable != st->InsertionPoint )  {
+            *p++ = *st->TopOfTable++;
+            st->SpaceLeftInChunk--;
         }
-        SpaceLeftInChunk = CHUNKSIZE;
-        while ( TopOfTable != InsertionPoint )  {
-            *p++ = *TopOfTable++;
-            SpaceLeftInChunk--;
-        }
-        TopOfTable = NewChunk;
-        InsertionPoint = p;
+        st->TopOfTable = chunk;
+        st->InsertionPoint = p;
     }
-    *InsertionPoint++ = (char)( ch & 0x7f );  
-    SpaceLeftInChunk--;
+    *st->InsertionPoint++ = (char)( ch & 0x7f );  
+    st->SpaceLeftInChunk--;
 }
 
 /*---------------------------------------------------------------------------*/
@@ -169,9 +280,9 @@ PUBLIC void   AddChar( int ch )
 /*                                                                           */
 /*---------------------------------------------------------------------------*/
 
-PUBLIC char   *GetString( void )
+PUBLIC char   *GetString( STRINGTABLE *st )
 {
-    return TopOfTable;
+    return st->TopOfTable;
 }
 
 /*---------------------------------------------------------------------------*/
@@ -191,7 +302,64 @@ PUBLIC char   *GetString( void )
 /*                                                                           */
 /*---------------------------------------------------------------------------*/
 
-PUBLIC void   PreserveString( void )
+PUBLIC void   PreserveString( STRINGTABLE *st )
+{
+    st->Held += (long)(st->InsertionPoint-st->TopOfTable);
+    st->TopOfTable = st->InsertionPoint;
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      SetStringTrap                                                        */
+/*                                                                           */
+/*      Has running out of store for a chunk sprung on a trap rather than    */
+/*      ending the process, until the table is next initialised.             */
+/*                                                                           */
+/*      Input(s):      st, the table.                                        */
+/*                     trap, the FATALTRAP, or NULL for none.                */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*      Returns:       Nothing                                               */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PUBLIC void   SetStringTrap( STRINGTABLE *st, FATALTRAP *trap )
+{
+    st->Trap = trap;
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      Private routines (only accessable within this module).               */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      NewChunk                                                             */
+/*                                                                           */
+/*      Allocates a chunk, or takes one from the spare list, and links it    */
+/*      into the table's list of chunks.                                     */
+/*                                                                           */
+/*      Input(s):      st, the table which will own the chunk.               */
+/*                     routine, name of the caller for the error message.    */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*      Returns:       Pointer to the first character of the chunk.          */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE char  *NewChunk( STRINGTABLE *st, char *routine )
 {
-    TopOfTable = InsertionPoint;
+    CHUNK *chunk;
+
+    if ( st->Spare != NULL )  {
+        chunk = st->Spare;
+        st->Spare = chunk->next;
+    }
+    else if ( NULL == ( chunk = MemAlloc( MEM_STRINGS, sizeof(CHUNK) ) ) )
+        Fatal( st->Trap, "Error, \"%s\", malloc failure", routine );
+    chunk->next = st->Chunks;
+    st->Chunks = chunk;
+    return chunk->text;
 }
@@ -12,9 +12,36 @@
 #define  STRINGTABLEHEADER
 
 #include "global.h"
+#include "fatal.h"
 
-PUBLIC void   NewString( void );
-PUBLIC void   AddChar( int ch );
-PUBLIC char   *GetString( void );
-PUBLIC void   PreserveString( void );
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      STRINGTABLE holds the state of one string table (see "strtab.c" for  */
+/*      the meaning of the fields). Each compilation owns its own table and  */
+/*      all the strings in it are released together by "FreeStringTable",    */
+/*      or discarded by "ResetStringTable", which keeps the chunks for       */
+/*      reuse.                                                               */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+typedef struct  {
+    struct chunk *Chunks;           /* every chunk allocated, newest first   */
+    struct chunk *Spare;            /* chunks kept by ResetStringTable       */
+    char  *TopOfTable;
+    char  *InsertionPoint;
+    int   SpaceLeftInChunk;
+    long  Held;                     /* bytes of preserved strings, and bytes */
+    long  Lost;                     /* lost at the ends of chunks            */
+    FATALTRAP *Trap;                /* sprung if out of memory, or NULL      */
+}
+    STRINGTABLE;
+
+PUBLIC void   InitStringTable( STRINGTABLE *st );
+PUBLIC void   FreeStringTable( STRINGTABLE *st );
+PUBLIC void   ResetStringTable( STRINGTABLE *st );
+PUBLIC void   NewString( STRINGTABLE *st );
+PUBLIC void   AddChar( STRINGTABLE *st, int ch );
+PUBLIC char   *GetString( STRINGTABLE *st );
+PUBLIC void   PreserveString( STRINGTABLE *st );
+PUBLIC void   SetStringTrap( STRINGTABLE *st, FATALTRAP *trap );
 #endif
@@ -9,6 +9,14 @@
 /*      Entries which have the same hash value form a chain of structures    */
 /*      from the index entry, linked by the "next" field of the SYMBOL       */
 /*      structure. New entries are placed at the head of the chain.          */
+/*      The table itself is a SYMBOLTABLE owned by the caller, so that       */
+/*      independent compilations do not share symbols.                       */
+/*                                                                           */
+/*      A table given a SYMBOLSTATS by "SetSymbolStats" counts the strings   */
+/*      each lookup compares and the symbols each new one shadows, and is    */
+/*      counted itself, chain by chain, whenever symbols are about to be     */
+/*      removed from it, which is when it is fullest. "WriteSymbolStats"     */
+/*      reports the figures, to find the names which hash badly.             */
 /*                                                                           */ 
 /*---------------------------------------------------------------------------*/
 
@@ -16,6 +24,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include "symbol.h"
+#include "memory.h"
 
 /*---------------------------------------------------------------------------*/
 /*                                                                           */
@@ -36,19 +45,97 @@ PRIVATE int   Hash( char *String );
 PRIVATE void  BubbleSort( SYMBOL *list[], int total_elements );
 PRIVATE void  DisplaySymbol( SYMBOL *s );
 PRIVATE char* LookupType( int symtype );
+PRIVATE void  TakeCensus( SYMBOLTABLE *table );
+PRIVATE void  CountShadows( SYMBOLSTATS *stats, SYMBOL *symbol );
 
 /*---------------------------------------------------------------------------*/
 /*                                                                           */
-/*      Data Structures for this module                                      */
+/*      Public routines (globally accessable).                               */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      InitSymbolTable                                                      */
+/*                                                                           */
+/*      Empties every chain and the free list of a symbol table.             */
+/*                                                                           */
+/*      Input(s):      table, the symbol table to initialise.                */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*      Returns:       Nothing                                               */
 /*                                                                           */
 /*---------------------------------------------------------------------------*/
 
-PRIVATE SYMBOL *HashTable[HASHSIZE];    /* The hash table                    */
+PUBLIC void   InitSymbolTable( SYMBOLTABLE *table )
+{
+    int i;
+
+    for ( i = 0; i < HASHSIZE; i++ )  table->HashTable[i] = NULL;
+    table->FreeList = NULL;
+    table->Stats = NULL;
+}
 
 /*---------------------------------------------------------------------------*/
 /*                                                                           */
-/*      Public routines (globally accessable).                               */
+/*      FreeSymbolTable                                                      */
+/*                                                                           */
+/*      Releases every symbol still in a table, whatever its scope. The      */
+/*      strings belong to the string table and are not freed here.           */
+/*                                                                           */
+/*      Input(s):      table, the symbol table to release.                   */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*      Returns:       Nothing                                               */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PUBLIC void   FreeSymbolTable( SYMBOLTABLE *table )
+{
+    SYMBOL  *temp;
+
+    ResetSymbolTable( table );
+    while ( table->FreeList != NULL )  {
+        temp = table->FreeList;
+        table->FreeList = temp->next;
+        MemFree( MEM_SYMBOLS, temp, sizeof( SYMBOL ) );
+    }
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      ResetSymbolTable                                                     */
+/*                                                                           */
+/*      Removes every symbol from a table, whatever its scope, keeping them  */
+/*      on the free list so that the next compilation using the table can    */
+/*      enter symbols without calling malloc.                                */
+/*                                                                           */
+/*      Input(s):      table, the symbol table to empty.                     */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*      Returns:       Nothing                                               */
 /*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PUBLIC void   ResetSymbolTable( SYMBOLTABLE *table )
+{
+    SYMBOL  *symptr, *temp;
+    int     i;
+
+    if ( table->Stats != NULL )  TakeCensus( table );
+    for ( i = 0; i < HASHSIZE; i++ )  {
+        symptr = table->HashTable[i];
+        while ( symptr != NULL )  {
+            temp = symptr;
+            symptr = symptr->next;
+            temp->next = table->FreeList;
+            table->FreeList = temp;
+        }
+        table->HashTable[i] = NULL;
+    }
+}
+
 /*---------------------------------------------------------------------------*/
 /*                                                                           */
 /*      Probe                                                                */
@@ -85,16 +172,29 @@ PRIVATE SYMBOL *HashTable[HASHSIZE];    /* The hash table                    */
 /*                                                                           */
 /*---------------------------------------------------------------------------*/
 
-PUBLIC SYMBOL *Probe( char *String, int *hashindex )
+PUBLIC SYMBOL *Probe( SYMBOLTABLE *table, char *String, int *hashindex )
 {
     int hash;
+    long misses = 0;
     SYMBOL *symptr;
+    SYMBOLSTATS *stats;
 
     hash = Hash( String );
-    symptr = *(HashTable+hash);
-    while ( symptr != NULL && 0 != strncmp( symptr->s, String, 80 ) )
+    symptr = *(table->HashTable+hash);
+    while ( symptr != NULL && 0 != strncmp( symptr->s, String, 80 ) )  {
         symptr = symptr->next;
+        misses++;
+    }
     if ( hashindex != NULL )  *hashindex = hash;
+    if ( NULL != ( stats = table->Stats ) )  {
+        if ( symptr != NULL )  {
+            stats->found++;
+            misses++;                   /* the comparison which matched      */
+        }
+        stats->lookups++;
+        stats->compares += misses;
+        if ( misses > stats->MostCompares )  stats->MostCompares = misses;
+    }
     return  symptr;
 }
 
@@ -133,19 +233,26 @@ PUBLIC SYMBOL *Probe( char *String, int *hashindex )
 /*                                                                           */
 /*---------------------------------------------------------------------------*/
 
-PUBLIC SYMBOL *EnterSymbol( char *String, int hashindex )
+PUBLIC SYMBOL *EnterSymbol( SYMBOLTABLE *table, char *String, int hashindex )
 {
     SYMBOL *symptr;
 
-    if ( NULL != ( symptr = (SYMBOL *) malloc( sizeof( SYMBOL ) ) ) )  {
+    if ( table->FreeList != NULL )  {
+        symptr = table->FreeList;
+        table->FreeList = symptr->next;
+    }
+    else  symptr = (SYMBOL *) MemAlloc( MEM_SYMBOLS, sizeof( SYMBOL ) );
+
+    if ( symptr != NULL )  {
         symptr->s = String;
         symptr->scope = -1;
         symptr->type = -1;
         symptr->pcount = -1;
         symptr->ptypes = -1;
         symptr->address = -1;
-        symptr->next = *(HashTable+hashindex);
-        *(HashTable+hashindex) = symptr;
+        symptr->next = *(table->HashTable+hashindex);
+        *(table->HashTable+hashindex) = symptr;
+        if ( table->Stats != NULL )  CountShadows( table->Stats, symptr );
     }
     return  symptr;
 }
@@ -173,13 +280,13 @@ PUBLIC SYMBOL *EnterSymbol( char *String, int hashindex )
 /*                                                                           */
 /*---------------------------------------------------------------------------*/
 
-PUBLIC void   DumpSymbols( int scope )
+PUBLIC void   DumpSymbols( SYMBOLTABLE *table, int scope )
 {
     SYMBOL  *symptr, *list[MAX_SYMBOLS_TO_DISPLAY];
     int     i, j;
 
     for ( j = i = 0; i < HASHSIZE && j < MAX_SYMBOLS_TO_DISPLAY; i++ )  {
-        symptr = *(HashTable+i);
+        symptr = *(table->HashTable+i);
         while( symptr != NULL && symptr->scope >= scope )  {
             if ( j >= MAX_SYMBOLS_TO_DISPLAY )  break;
             else  {
@@ -213,7 +320,8 @@ PUBLIC void   DumpSymbols( int scope )
 /*      RemoveSymbols                                                        */
 /*                                                                           */
 /*      Remove all the symbols whose "scope" field is greater than or equal  */
-/*      to the parameter "scope" from the symbol table.                      */
+/*      to the parameter "scope" from the symbol table. They are kept on     */
+/*      the free list for reuse by "EnterSymbol".                            */
 /*                                                                           */
 /*      Input(s):                                                            */
 /*                                                                           */
@@ -226,20 +334,132 @@ PUBLIC void   DumpSymbols( int scope )
 /*                                                                           */
 /*---------------------------------------------------------------------------*/
 
-PUBLIC void   RemoveSymbols( int scope )
+PUBLIC void   RemoveSymbols( SYMBOLTABLE *table, int scope )
 {
     SYMBOL  *symptr, *temp;
     int     i;
 
+    if ( table->Stats != NULL )  TakeCensus( table );
     for ( i = 0; i < HASHSIZE; i++ )  {
-        symptr = *(HashTable+i);
+        symptr = *(table->HashTable+i);
         while( symptr != NULL && symptr->scope >= scope )  {
             temp = symptr;
             symptr = symptr->next;
-            free( temp );
+            temp->next = table->FreeList;
+            table->FreeList = temp;
         }
-        *(HashTable+i) = symptr;
+        *(table->HashTable+i) = symptr;
+    }
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      InitSymbolStats                                                      */
+/*                                                                           */
+/*      Zeroes the statistics of a symbol table.                             */
+/*                                                                           */
+/*      Input(s):      stats, the SYMBOLSTATS to prepare.                    */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*      Returns:       Nothing                                               */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PUBLIC void   InitSymbolStats( SYMBOLSTATS *stats )
+{
+    memset( stats, 0, sizeof( SYMBOLSTATS ) );
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      SetSymbolStats                                                       */
+/*                                                                           */
+/*      Has a symbol table add its lookups, entries and census to a set of   */
+/*      statistics, which may be shared by any number of tables, one at a    */
+/*      time.                                                                */
+/*                                                                           */
+/*      Input(s):      table, the symbol table.                              */
+/*                     stats, prepared by InitSymbolStats, or NULL (the      */
+/*                     default) to count nothing.                            */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*      Returns:       Nothing                                               */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PUBLIC void   SetSymbolStats( SYMBOLTABLE *table, SYMBOLSTATS *stats )
+{
+    table->Stats = stats;
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      WriteSymbolStats                                                     */
+/*                                                                           */
+/*      Writes the statistics of the symbol tables. With STATS_TABLE this    */
+/*      is a table for people to read, e.g.,                                 */
+/*                                                                           */
+/*          Symbol table: 40 symbols at the fullest, load 0.040              */
+/*            38 of 997 chains in use (3.8%), the longest holding 2          */
+/*            123 lookups, 100 found, 1.24 strings compared per lookup,      */
+/*            at most 3                                                      */
+/*            ...                                                            */
+/*                                                                           */
+/*      and with STATS_JSON a single line holding a JSON object, e.g.,       */
+/*                                                                           */
+/*          {"chains":997,"symbols":40,"occupied":38,"load":0.040,           */
+/*           "longest":2,"lookups":123,...,"histogram":[959,36,2,...]}       */
+/*                                                                           */
+/*      Input(s):      stats, the SYMBOLSTATS, from tables no longer in use. */
+/*                     file, where the report is written.                    */
+/*                     format, STATS_TABLE or STATS_JSON.                    */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*      Returns:       Nothing                                               */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PUBLIC void   WriteSymbolStats( SYMBOLSTATS *stats, FILE *file, int format )
+{
+    double load = (double) stats->symbols / HASHSIZE;
+    double average = stats->lookups > 0 ?
+                     (double) stats->compares / stats->lookups : 0.0;
+    int i;
+
+    if ( format == STATS_JSON )  {
+        fprintf( file, "{\"chains\":%d,\"symbols\":%ld,\"occupied\":%ld,"
+                 "\"load\":%.3f,\"longest\":%ld,\"lookups\":%ld,"
+                 "\"found\":%ld,\"compares\":%ld,\"average_compares\":%.3f,"
+                 "\"most_compares\":%ld,\"entered\":%ld,\"shadowing\":%ld,"
+                 "\"shadow_depth\":%ld,\"histogram\":[", HASHSIZE,
+                 stats->symbols, stats->occupied, load, stats->longest,
+                 stats->lookups, stats->found, stats->compares, average,
+                 stats->MostCompares, stats->entered, stats->shadowing,
+                 stats->ShadowDepth );
+        for ( i = 0; i < CHAIN_LENGTHS; i++ )
+            fprintf( file, "%s%ld", i == 0 ? "" : ",", stats->chains[i] );
+        fprintf( file, "]}\n" );
+        return;
     }
+
+    fprintf( file, "Symbol table: %ld symbols at the fullest, load %.3f\n",
+             stats->symbols, load );
+    fprintf( file, "  %ld of %d chains in use (%.1f%%), the longest holding "
+             "%ld\n", stats->occupied, HASHSIZE,
+             100.0 * stats->occupied / HASHSIZE, stats->longest );
+    fprintf( file, "  %ld lookups, %ld found, %.2f strings compared per "
+             "lookup, at most %ld\n", stats->lookups, stats->found, average,
+             stats->MostCompares );
+    fprintf( file, "  %ld entered, %ld shadowing another of the same "
+             "name, at most %ld of one name\n", stats->entered,
+             stats->shadowing, stats->ShadowDepth );
+    fprintf( file, "  chain length      chains\n" );
+    for ( i = 0; i < CHAIN_LENGTHS - 1; i++ )
+        fprintf( file, "  %12d %11ld\n", i, stats->chains[i] );
+    fprintf( file, "  %11d+ %11ld\n", i, stats->chains[i] );
 }
 
 /*---------------------------------------------------------------------------*/
@@ -405,3 +625,78 @@ PRIVATE char *LookupType( int symtype )
 	    snprintf(buffer, 5, "%4d", symtype);  return buffer;
     }
 }
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      TakeCensus                                                           */
+/*                                                                           */
+/*      Counts the symbols in each chain of a table and, if it holds more    */
+/*      symbols than at any census before, keeps the counts in its           */
+/*      statistics.                                                          */
+/*                                                                           */
+/*      Input(s):                                                            */
+/*                                                                           */
+/*          table      the symbol table, which has statistics.               */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*      Returns:       Nothing                                               */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE void  TakeCensus( SYMBOLTABLE *table )
+{
+    SYMBOLSTATS *stats = table->Stats;
+    SYMBOL *symptr;
+    long   chains[CHAIN_LENGTHS], length, longest = 0, occupied = 0;
+    long   symbols = 0;
+    int    i;
+
+    memset( chains, 0, sizeof( chains ) );
+    for ( i = 0; i < HASHSIZE; i++ )  {
+        for ( length = 0, symptr = table->HashTable[i]; symptr != NULL;
+              symptr = symptr->next )
+            length++;
+        chains[length < CHAIN_LENGTHS ? length : CHAIN_LENGTHS - 1]++;
+        if ( length > 0 )  occupied++;
+        if ( length > longest )  longest = length;
+        symbols += length;
+    }
+    if ( symbols > stats->symbols )  {
+        stats->symbols = symbols;
+        stats->occupied = occupied;
+        stats->longest = longest;
+        memcpy( stats->chains, chains, sizeof( chains ) );
+    }
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      CountShadows                                                         */
+/*                                                                           */
+/*      Counts a symbol just entered, and the symbols of the same name it    */
+/*      hides further down its chain.                                        */
+/*                                                                           */
+/*      Input(s):                                                            */
+/*                                                                           */
+/*          stats      the statistics of the symbol's table.                 */
+/*                                                                           */
+/*          symbol     the symbol, at the head of its chain.                 */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*      Returns:       Nothing                                               */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE void  CountShadows( SYMBOLSTATS *stats, SYMBOL *symbol )
+{
+    SYMBOL *symptr;
+    long   depth = 1;
+
+    for ( symptr = symbol->next; symptr != NULL; symptr = symptr->next )
+        if ( 0 == strncmp( symptr->s, symbol->s, 80 ) )  depth++;
+    stats->entered++;
+    if ( depth > 1 )  stats->shadowing++;
+    if ( depth > stats->ShadowDepth )  stats->ShadowDepth = depth;
+}
@@ -11,6 +11,7 @@
 
 #define  SYMBOLHEADER
 
+#include <stdio.h>
 #include "global.h"
 
 #define  HASHSIZE       997     /* Should be a prime for efficient hashing.  */
@@ -38,9 +39,42 @@ typedef struct symboltype  {
 }
     SYMBOL;
 
-PUBLIC SYMBOL *Probe( char *String, int *hashindex );
-PUBLIC SYMBOL *EnterSymbol( char *String, int hashindex );
-PUBLIC void   DumpSymbols( int scope );
-PUBLIC void   RemoveSymbols( int scope );
+#define  CHAIN_LENGTHS    9     /* chains of 0 to 7 symbols, and longer      */
+
+#define  STATS_TABLE      1     /* formats of "WriteSymbolStats"             */
+#define  STATS_JSON       2
+
+typedef struct  {               /* the health of any number of symbol tables */
+    long lookups;               /* calls of Probe                            */
+    long found;                 /* of them which found their string          */
+    long compares;              /* strings compared by them                  */
+    long MostCompares;          /* the most compared by one call             */
+    long entered;               /* calls of EnterSymbol                      */
+    long shadowing;             /* of them hiding a symbol of the same name  */
+    long ShadowDepth;           /* the most symbols of one name at once      */
+    long symbols;               /* symbols in a table at its fullest, and    */
+    long occupied;              /* how many chains held them                 */
+    long longest;               /* the longest of those chains               */
+    long chains[CHAIN_LENGTHS]; /* the number of chains of each length       */
+}
+    SYMBOLSTATS;
+
+typedef struct  {               /* one symbol table, owned by a compilation */
+    SYMBOL *HashTable[HASHSIZE];
+    SYMBOL *FreeList;           /* removed symbols, reused by EnterSymbol    */
+    SYMBOLSTATS *Stats;         /* see SetSymbolStats, NULL if not counted   */
+}
+    SYMBOLTABLE;
+
+PUBLIC void   InitSymbolTable( SYMBOLTABLE *table );
+PUBLIC void   FreeSymbolTable( SYMBOLTABLE *table );
+PUBLIC void   ResetSymbolTable( SYMBOLTABLE *table );
+PUBLIC SYMBOL *Probe( SYMBOLTABLE *table, char *String, int *hashindex );
+PUBLIC SYMBOL *EnterSymbol( SYMBOLTABLE *table, char *String, int hashindex );
+PUBLIC void   DumpSymbols( SYMBOLTABLE *table, int scope );
+PUBLIC void   RemoveSymbols( SYMBOLTABLE *table, int scope );
+PUBLIC void   InitSymbolStats( SYMBOLSTATS *stats );
+PUBLIC void   SetSymbolStats( SYMBOLTABLE *table, SYMBOLSTATS *stats );
+PUBLIC void   WriteSymbolStats( SYMBOLSTATS *stats, FILE *file, int format );
 
 #endif
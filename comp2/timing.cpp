@@ -0,0 +1,253 @@
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      timing.c                                                             */
+/*                                                                           */
+/*      Implementation file for the phase timer, which adds up where the     */
+/*      time of a compilation goes (see SetCompilerTimer).                   */
+/*                                                                           */
+/*      A compilation is always in exactly one phase. Each module enters     */
+/*      its phase with "EnterPhase" as its work begins, and gives the time   */
+/*      back with "LeavePhase" when it is done, so a phase entered within    */
+/*      another, e.g., a line ended while a token is read, is not counted    */
+/*      twice. Only the changes of phase read the clock, so the reading of   */
+/*      each character, which would cost more to time than to do, counts     */
+/*      as part of PHASE_SCAN, while the work done once a line, ending it    */
+/*      and listing it, is PHASE_READ. Whatever is not in another phase is   */
+/*      PHASE_PARSE.                                                         */
+/*                                                                           */
+/*      Each change of phase takes a little time itself, which is measured   */
+/*      when the timer is made and given in the report so that the figures   */
+/*      can be judged, but is not taken off them.                            */
+/*                                                                           */
+/*      A timer must only be used by one thread at a time.                   */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "timing.h"
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      Data Structures for this module                                      */
+/*                                                                           */
+/*      "Phases" gives the name of each phase in the report, and what its    */
+/*      count counts. PHASE_READ is entered at the end of each line and      */
+/*      once more at the end of the input, PHASE_OPTIMISE once for the       */
+/*      passes over each block and once for each WHILE loop hoisted.         */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+#define  CALIBRATION          1000      /* changes of phase timed to find    */
+                                        /* the overhead                      */
+
+typedef struct  {
+    char *name;
+    char *counts;
+}
+    PHASE;
+
+PRIVATE PHASE Phases[PHASES] =  {
+    { "read", "line ends" },
+    { "scan", "tokens" },
+    { "parse", "compilations" },
+    { "symbols", "lookups" },
+    { "emit", "instructions" },
+    { "optimise", "passes" },
+    { "write", "code files" }
+};
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      Function Prototypes for private routines                             */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE double Now( void );
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      Public routines (globally accessable).                               */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      InitPhaseTimer                                                       */
+/*                                                                           */
+/*      Zeroes a timer and measures what a change of phase costs.            */
+/*                                                                           */
+/*      Input(s):      timer, the PHASETIMER to prepare.                     */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*      Returns:       Nothing                                               */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PUBLIC void   InitPhaseTimer( PHASETIMER *timer )
+{
+    double start;
+    int i;
+
+    memset( timer, 0, sizeof( PHASETIMER ) );
+    timer->phase = PHASE_NONE;
+
+    start = Now();
+    for ( i = 0; i < CALIBRATION; i++ )
+        LeavePhase( timer, EnterPhase( timer, PHASE_PARSE ) );
+    timer->overhead = ( Now() - start ) / ( 2.0 * CALIBRATION );
+
+    memset( timer->time, 0, sizeof( timer->time ) );
+    memset( timer->count, 0, sizeof( timer->count ) );
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      EnterPhase                                                           */
+/*                                                                           */
+/*      Charges the time since the last change of phase to the phase being   */
+/*      left, and starts timing another.                                     */
+/*                                                                           */
+/*      Input(s):      timer, a PHASETIMER, or NULL when nothing is timed.   */
+/*                     phase, the PHASE_ being entered.                      */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*      Returns:       The phase left, to be given to "LeavePhase".          */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PUBLIC int    EnterPhase( PHASETIMER *timer, int phase )
+{
+    double now;
+    int previous;
+
+    if ( timer == NULL )  return PHASE_NONE;
+    now = Now();
+    previous = timer->phase;
+    if ( previous != PHASE_NONE )  timer->time[previous] += now - timer->mark;
+    timer->phase = phase;
+    timer->mark = now;
+    if ( phase != PHASE_NONE )  timer->count[phase]++;
+    return previous;
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      LeavePhase                                                           */
+/*                                                                           */
+/*      Charges the time since the last change of phase to the phase being   */
+/*      left, and goes back to the phase it was entered from.                */
+/*                                                                           */
+/*      Input(s):      timer, a PHASETIMER, or NULL when nothing is timed.   */
+/*                     previous, as returned by "EnterPhase".                */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*      Returns:       Nothing                                               */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PUBLIC void   LeavePhase( PHASETIMER *timer, int previous )
+{
+    double now;
+
+    if ( timer == NULL )  return;
+    now = Now();
+    if ( timer->phase != PHASE_NONE )
+        timer->time[timer->phase] += now - timer->mark;
+    timer->phase = previous;
+    timer->mark = now;
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      WriteTimeReport                                                      */
+/*                                                                           */
+/*      Writes the time spent in each phase, how often each was entered,     */
+/*      and how many instructions were removed as common subexpressions      */
+/*      (see opt.c). With TIME_TABLE this is a table for people to read,     */
+/*      e.g.,                                                                */
+/*                                                                           */
+/*          Time report: 1 compilation, 2.345 ms                             */
+/*            phase          ms       %         count                        */
+/*            read        0.412   17.6%          1201 line ends              */
+/*            ...                                                            */
+/*                                                                           */
+/*      and with TIME_JSON a single line holding a JSON object, e.g.,        */
+/*                                                                           */
+/*          {"compilations":1,"seconds":0.002345,"characters":36000,         */
+/*           "cse_removed":12,"overhead_seconds":0.000015,"phases":{"read":  */
+/*           {"seconds":0.000412,"count":1201},...}}                         */
+/*                                                                           */
+/*      for the figures to be kept and compared from run to run.             */
+/*                                                                           */
+/*      Input(s):      timer, the PHASETIMER, not in any phase.              */
+/*                     file, where the report is written.                    */
+/*                     format, TIME_TABLE or TIME_JSON.                      */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*      Returns:       Nothing                                               */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PUBLIC void   WriteTimeReport( PHASETIMER *timer, FILE *file, int format )
+{
+    double total = 0.0, overhead;
+    long runs = timer->count[PHASE_PARSE], changes = 0;
+    int i;
+
+    for ( i = 0; i < PHASES; i++ )  {
+        total += timer->time[i];
+        changes += 2 * timer->count[i];
+    }
+    overhead = changes * timer->overhead;
+
+    if ( format == TIME_JSON )  {
+        fprintf( file, "{\"compilations\":%ld,\"seconds\":%.6f,"
+                 "\"characters\":%ld,\"cse_removed\":%ld,"
+                 "\"overhead_seconds\":%.6f,\"phases\":{", runs, total,
+                 timer->chars, timer->removed, overhead );
+        for ( i = 0; i < PHASES; i++ )
+            fprintf( file, "%s\"%s\":{\"seconds\":%.6f,\"count\":%ld}",
+                     i == 0 ? "" : ",", Phases[i].name, timer->time[i],
+                     timer->count[i] );
+        fprintf( file, "}}\n" );
+        return;
+    }
+
+    fprintf( file, "Time report: %ld compilation%s, %.3f ms\n", runs,
+             runs == 1 ? "" : "s", total * 1e3 );
+    fprintf( file, "  phase          ms       %%         count\n" );
+    for ( i = 0; i < PHASES; i++ )
+        fprintf( file, "  %-8s %9.3f  %5.1f%%  %12ld %s\n", Phases[i].name,
+                 timer->time[i] * 1e3,
+                 total > 0.0 ? 100.0 * timer->time[i] / total : 0.0,
+                 timer->count[i], Phases[i].counts );
+    fprintf( file, "  %ld characters read; %ld changes of phase took about "
+             "%.3f ms of the total\n", timer->chars, changes, overhead * 1e3 );
+    fprintf( file, "  %ld instructions removed as common subexpressions\n",
+             timer->removed );
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      Private routines (only accessable within this module).               */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      Now                                                                  */
+/*                                                                           */
+/*      Returns the time in seconds from an arbitrary start, for measuring   */
+/*      intervals.                                                           */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE double Now( void )
+{
+    struct timespec ts;
+
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
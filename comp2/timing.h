@@ -0,0 +1,47 @@
+#ifndef  TIMINGHEADER
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      timing.h                                                             */
+/*                                                                           */
+/*      Header file for "timing.c", containing the phases of a compilation   */
+/*      and the type definitions and function prototypes for a phase timer,  */
+/*      which adds up the time spent in each phase for a time report.        */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+#define  TIMINGHEADER
+
+#include <stdio.h>
+#include "global.h"
+
+#define  PHASE_NONE             -1      /* not compiling                     */
+#define  PHASE_READ              0      /* ending and listing lines          */
+#define  PHASE_SCAN              1      /* reading tokens                    */
+#define  PHASE_PARSE             2      /* everything else                   */
+#define  PHASE_SYMBOLS           3      /* looking up and entering symbols   */
+#define  PHASE_EMIT              4      /* emitting instructions             */
+#define  PHASE_OPTIMISE          5      /* optimising a block's code         */
+#define  PHASE_WRITE             6      /* writing the code file             */
+#define  PHASES                  7
+
+#define  TIME_TABLE              1      /* formats of "WriteTimeReport"      */
+#define  TIME_JSON               2
+
+typedef struct  {               /* the phases of any number of compilations  */
+    int    phase;               /* being timed, or PHASE_NONE                */
+    double mark;                /* when it was entered, in seconds           */
+    double time[PHASES];        /* seconds spent in each phase               */
+    long   count[PHASES];       /* times each phase was entered              */
+    long   chars;               /* characters read, added by the caller      */
+    long   removed;             /* instructions removed as common            */
+                                /* subexpressions, added by the caller       */
+    double overhead;            /* seconds taken by one change of phase      */
+}
+    PHASETIMER;
+
+PUBLIC void   InitPhaseTimer( PHASETIMER *timer );
+PUBLIC int    EnterPhase( PHASETIMER *timer, int phase );
+PUBLIC void   LeavePhase( PHASETIMER *timer, int previous );
+PUBLIC void   WriteTimeReport( PHASETIMER *timer, FILE *file, int format );
+
+#endif
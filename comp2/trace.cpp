@@ -0,0 +1,322 @@
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      trace.c                                                              */
+/*                                                                           */
+/*      Implementation file for the tracer, which records when each span     */
+/*      of a compilation, e.g., the parsing of a procedure or an             */
+/*      optimisation pass over it, began and ended, and on which thread,     */
+/*      to show where the time of a long run goes (see SetCompilerTracer).   */
+/*                                                                           */
+/*      A span is timed by calling "StartSpan" as it begins and "EndSpan"    */
+/*      as it ends. Both do nothing if given no tracer, so that the cost of  */
+/*      tracing when it is off is that of a test. The spans are kept in      */
+/*      memory, under a lock as any thread may end one, until "WriteTrace"   */
+/*      writes them in the JSON object format of the Chrome trace viewer,    */
+/*      as complete ("X") events in microseconds.                            */
+/*                                                                           */
+/*      A token is usually read in far less time than it takes to record     */
+/*      it, and a program may have millions, so a TRACE_SCAN span shorter    */
+/*      than TRACE_SHORTEST is only added to the totals, which are written   */
+/*      with the trace. The other spans are all kept.                        */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "trace.h"
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      Data Structures for this module                                      */
+/*                                                                           */
+/*      "Kinds" gives the name and category of each kind of span in the      */
+/*      trace.                                                               */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+#define  TRACE_SHORTEST      10e-6      /* seconds, see above                */
+#define  TRACE_EVENTS         1024      /* spans room is first made for      */
+
+typedef struct  {
+    char *name;
+    char *category;
+}
+    KIND;
+
+PRIVATE KIND Kinds[TRACE_KINDS] =  {
+    { "compile", "compile" },
+    { "open", "io" },
+    { "scan", "scan" },
+    { "procedure", "parse" },
+    { "tail calls", "optimise" },
+    { "common subexpressions", "optimise" },
+    { "operand order", "optimise" },
+    { "loop invariants", "optimise" },
+    { "write", "io" }
+};
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      Function Prototypes for private routines                             */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE double Now( void );
+PRIVATE int    ThreadIndex( TRACER *tracer );
+PRIVATE void   WriteString( FILE *file, char *s );
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      Public routines (globally accessable).                               */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      InitTracer                                                           */
+/*                                                                           */
+/*      Prepares an empty tracer, whose time starts now. The thread which    */
+/*      calls this is the first in the trace.                                */
+/*                                                                           */
+/*      Input(s):      tracer, the TRACER to prepare.                        */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*      Returns:       Nothing                                               */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PUBLIC void   InitTracer( TRACER *tracer )
+{
+    memset( tracer, 0, sizeof( TRACER ) );
+    pthread_mutex_init( &tracer->lock, NULL );
+    tracer->origin = Now();
+    tracer->threads[tracer->ThreadCount++] = pthread_self();
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      FreeTracer                                                           */
+/*                                                                           */
+/*      Releases the spans of a tracer.                                      */
+/*                                                                           */
+/*      Input(s):      tracer, the TRACER, no longer in use.                 */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*      Returns:       Nothing                                               */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PUBLIC void   FreeTracer( TRACER *tracer )
+{
+    free( tracer->events );
+    pthread_mutex_destroy( &tracer->lock );
+    memset( tracer, 0, sizeof( TRACER ) );
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      StartSpan                                                            */
+/*                                                                           */
+/*      Reads the clock as a span begins.                                    */
+/*                                                                           */
+/*      Input(s):      tracer, a TRACER, or NULL when nothing is traced.     */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*      Returns:       The time, to be given to "EndSpan".                   */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PUBLIC double StartSpan( TRACER *tracer )
+{
+    if ( tracer == NULL )  return 0.0;
+    return Now() - tracer->origin;
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      EndSpan                                                              */
+/*                                                                           */
+/*      Records a span which ends now, on the calling thread.                */
+/*                                                                           */
+/*      Input(s):      tracer, a TRACER, or NULL when nothing is traced.     */
+/*                     kind, the TRACE_ kind of span.                        */
+/*                     start, as returned by "StartSpan".                    */
+/*                     detail, e.g., the name of the procedure, or NULL.     */
+/*                     Only the first TRACE_DETAIL - 1 characters are kept.  */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*      Returns:       Nothing                                               */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PUBLIC void   EndSpan( TRACER *tracer, int kind, double start, char *detail )
+{
+    TRACEEVENT *event, *events;
+    double end;
+    long space;
+
+    if ( tracer == NULL )  return;
+    end = Now() - tracer->origin;
+
+    pthread_mutex_lock( &tracer->lock );
+    tracer->total[kind] += end - start;
+    tracer->count[kind]++;
+    if ( kind == TRACE_SCAN && end - start < TRACE_SHORTEST )  {
+        pthread_mutex_unlock( &tracer->lock );
+        return;
+    }
+    if ( tracer->used == tracer->space )  {
+        space = tracer->space > 0 ? 2 * tracer->space : TRACE_EVENTS;
+        if ( NULL == ( events = realloc( tracer->events,
+                                         space * sizeof( TRACEEVENT ) ) ) )  {
+            tracer->lost++;
+            pthread_mutex_unlock( &tracer->lock );
+            return;
+        }
+        tracer->events = events;
+        tracer->space = space;
+    }
+    event = &tracer->events[tracer->used++];
+    event->kind = kind;
+    event->thread = ThreadIndex( tracer );
+    event->start = start;
+    event->end = end;
+    event->detail[0] = '\0';
+    if ( detail != NULL )
+        strncat( event->detail, detail, TRACE_DETAIL - 1 );
+    pthread_mutex_unlock( &tracer->lock );
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      WriteTrace                                                           */
+/*                                                                           */
+/*      Writes the spans kept by a tracer as a Chrome trace, e.g.,           */
+/*                                                                           */
+/*          {"traceEvents":[                                                 */
+/*          {"name":"thread_name","ph":"M","pid":1,"tid":1,                  */
+/*           "args":{"name":"main"}},                                        */
+/*          {"name":"procedure","cat":"parse","ph":"X","ts":12.250,          */
+/*           "dur":3.125,"pid":1,"tid":1,"args":{"detail":"q"}},             */
+/*          ...],                                                            */
+/*          "displayTimeUnit":"ms","otherData":{"lost":0,"totals":           */
+/*          {"scan":{"seconds":0.001250,"count":412},...}}}                  */
+/*                                                                           */
+/*      with one event to a line. The totals count every span, including     */
+/*      the short ones not in the trace.                                     */
+/*                                                                           */
+/*      Input(s):      tracer, the TRACER, with no span still open.          */
+/*                     file, where the trace is written.                     */
+/*                                                                           */
+/*      Output(s):     None                                                  */
+/*                                                                           */
+/*      Returns:       1 if the trace was written, 0 on a write error.       */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PUBLIC int    WriteTrace( TRACER *tracer, FILE *file )
+{
+    TRACEEVENT *event;
+    long i;
+
+    pthread_mutex_lock( &tracer->lock );
+    fprintf( file, "{\"traceEvents\":[\n" );
+    fprintf( file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,"
+             "\"args\":{\"name\":\"comp2\"}}" );
+    for ( i = 0; i < tracer->ThreadCount; i++ )  {
+        fprintf( file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+                 "\"tid\":%ld,\"args\":{\"name\":", i + 1 );
+        if ( i == 0 )  fprintf( file, "\"main\"}}" );
+        else  fprintf( file, "\"thread %ld\"}}", i + 1 );
+    }
+    for ( i = 0; i < tracer->used; i++ )  {
+        event = &tracer->events[i];
+        fprintf( file, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\","
+                 "\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%d",
+                 Kinds[event->kind].name, Kinds[event->kind].category,
+                 event->start * 1e6, ( event->end - event->start ) * 1e6,
+                 event->thread + 1 );
+        if ( event->detail[0] != '\0' )  {
+            fprintf( file, ",\"args\":{\"detail\":" );
+            WriteString( file, event->detail );
+            fprintf( file, "}" );
+        }
+        fprintf( file, "}" );
+    }
+    fprintf( file, "\n],\n\"displayTimeUnit\":\"ms\",\"otherData\":"
+             "{\"lost\":%ld,\"totals\":{", tracer->lost );
+    for ( i = 0; i < TRACE_KINDS; i++ )
+        fprintf( file, "%s\"%s\":{\"seconds\":%.6f,\"count\":%ld}",
+                 i == 0 ? "" : ",", Kinds[i].name, tracer->total[i],
+                 tracer->count[i] );
+    fprintf( file, "}}}\n" );
+    pthread_mutex_unlock( &tracer->lock );
+    return !ferror( file );
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      Private routines (only accessable within this module).               */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      Now                                                                  */
+/*                                                                           */
+/*      Returns the time in seconds from an arbitrary start, for measuring   */
+/*      intervals.                                                           */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE double Now( void )
+{
+    struct timespec ts;
+
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      ThreadIndex                                                          */
+/*                                                                           */
+/*      Returns the index of the calling thread in the tracer's "threads",   */
+/*      adding it if it is new. Threads beyond TRACE_THREADS share the       */
+/*      last index. The tracer must be locked.                               */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE int    ThreadIndex( TRACER *tracer )
+{
+    pthread_t self = pthread_self();
+    int i;
+
+    for ( i = 0; i < tracer->ThreadCount; i++ )
+        if ( pthread_equal( tracer->threads[i], self ) )  return i;
+    if ( tracer->ThreadCount == TRACE_THREADS )  return TRACE_THREADS - 1;
+    tracer->threads[tracer->ThreadCount] = self;
+    return tracer->ThreadCount++;
+}
+
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      WriteString                                                          */
+/*                                                                           */
+/*      Writes a string as a JSON string, escaping what must be escaped.     */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+PRIVATE void   WriteString( FILE *file, char *s )
+{
+    putc( '"', file );
+    for ( ; *s != '\0'; s++ )  {
+        if ( *s == '"' || *s == '\\' )  fprintf( file, "\\%c", *s );
+        else if ( (unsigned char) *s < 0x20 )
+            fprintf( file, "\\u%04x", (unsigned char) *s );
+        else  putc( *s, file );
+    }
+    putc( '"', file );
+}
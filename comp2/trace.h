@@ -0,0 +1,61 @@
+#ifndef  TRACEHEADER
+/*---------------------------------------------------------------------------*/
+/*                                                                           */
+/*      trace.h                                                              */
+/*                                                                           */
+/*      Header file for "trace.c", containing the kinds of span traced and   */
+/*      the type definitions and function prototypes for a tracer, which     */
+/*      keeps the spans of a compilation in memory and writes them as a      */
+/*      Chrome trace, to be viewed in Perfetto or chrome://tracing.          */
+/*                                                                           */
+/*---------------------------------------------------------------------------*/
+
+#define  TRACEHEADER
+
+#include <stdio.h>
+#include <pthread.h>
+#include "global.h"
+
+#define  TRACE_COMPILE           0      /* a whole run of a compiler         */
+#define  TRACE_OPEN              1      /* opening the files                 */
+#define  TRACE_SCAN              2      /* reading a token, or scanning on   */
+                                        /* a thread of the pipeline          */
+#define  TRACE_PROCEDURE         3      /* ParseProcDeclaration              */
+#define  TRACE_TAIL_CALLS        4      /* the optimisation passes           */
+#define  TRACE_SUBEXPRESSIONS    5
+#define  TRACE_OPERANDS          6
+#define  TRACE_INVARIANTS        7
+#define  TRACE_WRITE             8      /* writing the code or object file   */
+#define  TRACE_KINDS             9
+
+#define  TRACE_DETAIL           32      /* characters kept of a span's name  */
+#define  TRACE_THREADS          64      /* threads told apart in the trace   */
+
+typedef struct  {
+    int    kind;                /* TRACE_                                    */
+    int    thread;              /* index in the tracer's "threads"           */
+    double start, end;          /* seconds since the tracer was made         */
+    char   detail[TRACE_DETAIL];/* e.g., the procedure's name, or empty      */
+}
+    TRACEEVENT;
+
+typedef struct  {               /* the spans of any number of compilations   */
+    pthread_mutex_t lock;       /* guards the rest, as any thread may trace  */
+    double origin;              /* when the tracer was made                  */
+    TRACEEVENT *events;         /* the spans kept, in the order they ended   */
+    long   used, space;
+    long   lost;                /* spans not kept for want of store          */
+    double total[TRACE_KINDS];  /* seconds in each kind of span, and the     */
+    long   count[TRACE_KINDS];  /* number of them, whether kept or not       */
+    pthread_t threads[TRACE_THREADS];
+    int    ThreadCount;
+}
+    TRACER;
+
+PUBLIC void   InitTracer( TRACER *tracer );
+PUBLIC void   FreeTracer( TRACER *tracer );
+PUBLIC double StartSpan( TRACER *tracer );
+PUBLIC void   EndSpan( TRACER *tracer, int kind, double start, char *detail );
+PUBLIC int    WriteTrace( TRACER *tracer, FILE *file );
+
+#endif
@@ -0,0 +1,442 @@
+/*--------------------------------------------------------------------------*/
+/*                                                                          */
+/*       cplclient.c                                                        */
+/*                                                                          */
+/*       Client for the comp2 compile server ("comp2 --server", see         */
+/*       comp2/server.c).                                                   */
+/*                                                                          */
+/*           cplclient <socket> <source> <listing> <code>                   */
+/*                                                                          */
+/*       sends the program in <source> to the server listening on           */
+/*       <socket> and writes the listing and code it returns, just as       */
+/*       "comp2 <source> <listing> <code>" would.  The error messages go    */
+/*       to stderr and the exit status is non-zero if errors were found.    */
+/*                                                                          */
+/*           cplclient --bench <socket> <source> [<count>]                  */
+/*                                                                          */
+/*       sends the same program <count> times (default 1000) over one       */
+/*       connection and reports the 50th and 99th percentile and maximum    */
+/*       round trip times and the number of requests served per second.     */
+/*                                                                          */
+/*       There is no makefile; the client needs only comp2/server.h, so     */
+/*       build it from the top directory with                               */
+/*                                                                          */
+/*           gcc -x c -O2 -o cplclient cplclient/cplclient.cpp              */
+/*                                                                          */
+/*--------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <arpa/inet.h>
+#include "../comp2/server.h"
+
+#define  DEFAULT_BENCH_COUNT  1000
+
+/*--------------------------------------------------------------------------*/
+/*                                                                          */
+/*  REPLY:  One reply from the server, see comp2/server.h.                  */
+/*                                                                          */
+/*--------------------------------------------------------------------------*/
+
+typedef struct  {
+    uint32_t status;
+    char *listing;
+    uint32_t ListLength;
+    char *errors;
+    uint32_t ErrorLength;
+    char *code;
+    uint32_t CodeLength;
+}
+    REPLY;
+
+/*--------------------------------------------------------------------------*/
+/*                                                                          */
+/*  Function prototypes                                                     */
+/*                                                                          */
+/*--------------------------------------------------------------------------*/
+
+PRIVATE int    CompileFile( char *socketpath, char *source, char *listing,
+                            char *code );
+PRIVATE int    Bench( char *socketpath, char *source, int count );
+PRIVATE int    Connect( char *socketpath );
+PRIVATE char  *ReadSource( char *source, uint32_t *length );
+PRIVATE int    Request( int fd, char *text, uint32_t length, REPLY *reply );
+PRIVATE int    ReadBlock( int fd, char **text, uint32_t *length );
+PRIVATE void   FreeReply( REPLY *reply );
+PRIVATE int    WriteOutput( char *name, char *text, uint32_t length );
+PRIVATE int    ReadFully( int fd, void *buffer, size_t length );
+PRIVATE int    WriteFully( int fd, const void *buffer, size_t length );
+PRIVATE double Now( void );
+PRIVATE int    CompareTimes( const void *a, const void *b );
+
+/*--------------------------------------------------------------------------*/
+/*                                                                          */
+/*  Main: Client entry point.                                               */
+/*                                                                          */
+/*--------------------------------------------------------------------------*/
+
+PUBLIC int main( int argc, char *argv[] )
+{
+    int ok;
+
+    signal( SIGPIPE, SIG_IGN );   /*  A dead server is reported, not fatal. */
+    if ( argc >= 2 && strcmp( argv[1], "--bench" ) == 0 &&
+         ( argc == 4 || argc == 5 ) )
+        ok = Bench( argv[2], argv[3],
+                    argc == 5 ? atoi( argv[4] ) : DEFAULT_BENCH_COUNT );
+    else if ( argc == 5 && strcmp( argv[1], "--bench" ) != 0 )
+        ok = CompileFile( argv[1], argv[2], argv[3], argv[4] );
+    else
+    {
+        fprintf( stderr, "%s <socket> <source> <listing> <code>\n", argv[0] );
+        fprintf( stderr, "%s --bench <socket> <source> [<count>]\n",
+                 argv[0] );
+        ok = 0;
+    }
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/*--------------------------------------------------------------------------*/
+/*                                                                          */
+/*  CompileFile: Compiles one program on the server and writes the          */
+/*               listing and code files.                                    */
+/*                                                                          */
+/*    Inputs:       socketpath, the server's socket                         */
+/*                  source, listing, code, the file names                   */
+/*                                                                          */
+/*    Returns:      1 if the program compiled without errors, 0 otherwise   */
+/*                                                                          */
+/*--------------------------------------------------------------------------*/
+
+PRIVATE int CompileFile( char *socketpath, char *source, char *listing,
+                         char *code )
+{
+    REPLY reply;
+    char *text;
+    uint32_t length;
+    int fd, ok;
+
+    if ( NULL == ( text = ReadSource( source, &length ) ) )  return 0;
+    if ( ( fd = Connect( socketpath ) ) < 0 )
+    {
+        free( text );
+        return 0;
+    }
+    ok = Request( fd, text, length, &reply );
+    close( fd );
+    free( text );
+    if ( !ok )  return 0;
+
+    fwrite( reply.errors, 1, reply.ErrorLength, stderr );
+    ok = WriteOutput( listing, reply.listing, reply.ListLength ) &&
+         WriteOutput( code, reply.code, reply.CodeLength );
+    if ( reply.status == SERVER_VALID )
+        printf( "Valid, No Errors Detected\n" );
+    else
+    {
+        printf( "Syntax Error Detected\n" );
+        ok = 0;
+    }
+    FreeReply( &reply );
+    return ok;
+}
+
+/*--------------------------------------------------------------------------*/
+/*                                                                          */
+/*  Bench: Measures the server's round trip time for one program.           */
+/*                                                                          */
+/*    Inputs:       socketpath, the server's socket                         */
+/*                  source, the program to send                             */
+/*                  count, the number of requests                           */
+/*                                                                          */
+/*    Returns:      1 if every request was answered, 0 otherwise            */
+/*                                                                          */
+/*--------------------------------------------------------------------------*/
+
+PRIVATE int Bench( char *socketpath, char *source, int count )
+{
+    REPLY reply;
+    char *text;
+    double *times, start, elapsed;
+    uint32_t length;
+    int fd, i, ok = 1;
+
+    if ( count <= 0 )  count = DEFAULT_BENCH_COUNT;
+    if ( NULL == ( text = ReadSource( source, &length ) ) )  return 0;
+    if ( NULL == ( times = malloc( count * sizeof( double ) ) ) ||
+         ( fd = Connect( socketpath ) ) < 0 )
+    {
+        free( times );
+        free( text );
+        return 0;
+    }
+
+    elapsed = Now();
+    for ( i = 0; i < count && ok; i++ )
+    {
+        start = Now();
+        if ( ( ok = Request( fd, text, length, &reply ) ) )
+            FreeReply( &reply );
+        times[i] = ( Now() - start ) * 1e6;
+    }
+    elapsed = Now() - elapsed;
+    close( fd );
+
+    if ( ok )
+    {
+        qsort( times, count, sizeof( double ), CompareTimes );
+        printf( "%d requests, %.1f requests/sec\n", count,
+                elapsed > 0.0 ? count / elapsed : 0.0 );
+        printf( "round trip (us) p50 %.1f, p99 %.1f, max %.1f\n",
+                times[( count * 50 + 99 ) / 100 - 1],
+                times[( count * 99 + 99 ) / 100 - 1], times[count - 1] );
+    }
+    else  fprintf( stderr, "request %d failed\n", i );
+    free( times );
+    free( text );
+    return ok;
+}
+
+/*--------------------------------------------------------------------------*/
+/*                                                                          */
+/*  Connect: Opens a connection to the server.                              */
+/*                                                                          */
+/*    Returns:      The connected socket, or -1 after writing a message     */
+/*                  to stderr                                               */
+/*                                                                          */
+/*--------------------------------------------------------------------------*/
+
+PRIVATE int Connect( char *socketpath )
+{
+    struct sockaddr_un addr;
+    int fd;
+
+    if ( strlen( socketpath ) >= sizeof( addr.sun_path ) )
+    {
+        fprintf( stderr, "socket name \"%s\" is too long\n", socketpath );
+        return -1;
+    }
+    memset( &addr, 0, sizeof( addr ) );
+    addr.sun_family = AF_UNIX;
+    strcpy( addr.sun_path, socketpath );
+
+    if ( ( fd = socket( AF_UNIX, SOCK_STREAM, 0 ) ) < 0 ||
+         connect( fd, (struct sockaddr *) &addr, sizeof( addr ) ) < 0 )
+    {
+        fprintf( stderr, "cannot connect to \"%s\": %s\n", socketpath,
+                 strerror( errno ) );
+        if ( fd >= 0 )  close( fd );
+        return -1;
+    }
+    return fd;
+}
+
+/*--------------------------------------------------------------------------*/
+/*                                                                          */
+/*  ReadSource: Reads a whole source file into memory.                      */
+/*                                                                          */
+/*    Outputs:      *length, the number of bytes read                       */
+/*                                                                          */
+/*    Returns:      The malloc'd text, or NULL after writing a message to   */
+/*                  stderr                                                  */
+/*                                                                          */
+/*--------------------------------------------------------------------------*/
+
+PRIVATE char *ReadSource( char *source, uint32_t *length )
+{
+    FILE *fp;
+    char *text = NULL, *bigger;
+    size_t size = 0, used = 0, n;
+
+    if ( NULL == ( fp = fopen( source, "r" ) ) )
+    {
+        fprintf( stderr, "cannot open \"%s\" for input\n", source );
+        return NULL;
+    }
+    do
+    {
+        if ( used == size )
+        {
+            size = size ? 2 * size : 4096;
+            if ( size > SERVER_MAX_SOURCE ||
+                 NULL == ( bigger = realloc( text, size ) ) )
+            {
+                fprintf( stderr, "\"%s\" is too large\n", source );
+                free( text );
+                fclose( fp );
+                return NULL;
+            }
+            text = bigger;
+        }
+        n = fread( text + used, 1, size - used, fp );
+        used += n;
+    }
+    while ( n > 0 );
+    fclose( fp );
+    *length = (uint32_t) used;
+    return text;
+}
+
+/*--------------------------------------------------------------------------*/
+/*                                                                          */
+/*  Request: Sends one program and reads the reply.                         */
+/*                                                                          */
+/*    Outputs:      *reply, which must be released with FreeReply           */
+/*                                                                          */
+/*    Returns:      1 if successful, 0 after writing a message to stderr    */
+/*                                                                          */
+/*--------------------------------------------------------------------------*/
+
+PRIVATE int Request( int fd, char *text, uint32_t length, REPLY *reply )
+{
+    uint32_t header = htonl( length );
+
+    reply->listing = reply->errors = reply->code = NULL;
+    if ( WriteFully( fd, &header, sizeof( header ) ) &&
+         WriteFully( fd, text, length ) &&
+         ReadFully( fd, &reply->status, sizeof( reply->status ) ) &&
+         ReadBlock( fd, &reply->listing, &reply->ListLength ) &&
+         ReadBlock( fd, &reply->errors, &reply->ErrorLength ) &&
+         ReadBlock( fd, &reply->code, &reply->CodeLength ) )
+    {
+        reply->status = ntohl( reply->status );
+        return 1;
+    }
+    fprintf( stderr, "server closed the connection\n" );
+    FreeReply( reply );
+    return 0;
+}
+
+/*--------------------------------------------------------------------------*/
+/*                                                                          */
+/*  ReadBlock: Reads a length-prefixed block of text into malloc'd memory.  */
+/*                                                                          */
+/*    Returns:      1 if successful, 0 if not                               */
+/*                                                                          */
+/*--------------------------------------------------------------------------*/
+
+PRIVATE int ReadBlock( int fd, char **text, uint32_t *length )
+{
+    uint32_t header;
+
+    if ( !ReadFully( fd, &header, sizeof( header ) ) )  return 0;
+    *length = ntohl( header );
+    if ( NULL == ( *text = malloc( *length + 1 ) ) )  return 0;
+    return ReadFully( fd, *text, *length );
+}
+
+/*--------------------------------------------------------------------------*/
+/*                                                                          */
+/*  FreeReply: Releases the text of a reply.                                */
+/*                                                                          */
+/*--------------------------------------------------------------------------*/
+
+PRIVATE void FreeReply( REPLY *reply )
+{
+    free( reply->listing );
+    free( reply->errors );
+    free( reply->code );
+    reply->listing = reply->errors = reply->code = NULL;
+}
+
+/*--------------------------------------------------------------------------*/
+/*                                                                          */
+/*  WriteOutput: Writes a block of text to a file.                          */
+/*                                                                          */
+/*    Returns:      1 if successful, 0 after writing a message to stderr    */
+/*                                                                          */
+/*--------------------------------------------------------------------------*/
+
+PRIVATE int WriteOutput( char *name, char *text, uint32_t length )
+{
+    FILE *fp;
+    int ok;
+
+    if ( NULL == ( fp = fopen( name, "w" ) ) )
+    {
+        fprintf( stderr, "cannot open \"%s\" for output\n", name );
+        return 0;
+    }
+    ok = fwrite( text, 1, length, fp ) == length;
+    if ( fclose( fp ) != 0 || !ok )
+    {
+        fprintf( stderr, "cannot write \"%s\"\n", name );
+        return 0;
+    }
+    return 1;
+}
+
+/*--------------------------------------------------------------------------*/
+/*                                                                          */
+/*  ReadFully, WriteFully: Transfer exactly "length" bytes, retrying short  */
+/*                         reads and writes.  Return 1 if successful, 0 on  */
+/*                         end of file or error.                            */
+/*                                                                          */
+/*--------------------------------------------------------------------------*/
+
+PRIVATE int ReadFully( int fd, void *buffer, size_t length )
+{
+    char *p = buffer;
+    ssize_t n;
+
+    while ( length > 0 )
+    {
+        n = read( fd, p, length );
+        if ( n < 0 && errno == EINTR )  continue;
+        if ( n <= 0 )  return 0;
+        p += n;
+        length -= n;
+    }
+    return 1;
+}
+
+PRIVATE int WriteFully( int fd, const void *buffer, size_t length )
+{
+    const char *p = buffer;
+    ssize_t n;
+
+    while ( length > 0 )
+    {
+        n = write( fd, p, length );
+        if ( n < 0 && errno == EINTR )  continue;
+        if ( n <= 0 )  return 0;
+        p += n;
+        length -= n;
+    }
+    return 1;
+}
+
+/*--------------------------------------------------------------------------*/
+/*                                                                          */
+/*  Now: The time in seconds on the monotonic clock.                        */
+/*                                                                          */
+/*--------------------------------------------------------------------------*/
+
+PRIVATE double Now( void )
+{
+    struct timespec ts;
+
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*--------------------------------------------------------------------------*/
+/*                                                                          */
+/*  CompareTimes: qsort comparison function for an array of doubles.        */
+/*                                                                          */
+/*--------------------------------------------------------------------------*/
+
+PRIVATE int CompareTimes( const void *a, const void *b )
+{
+    double x = *(const double *) a, y = *(const double *) b;
+
+    return ( x > y ) - ( x < y );
+}
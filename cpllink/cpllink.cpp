@@ -0,0 +1,432 @@
+/*--------------------------------------------------------------------------*/
+/*                                                                          */
+/*       cpllink.c                                                          */
+/*                                                                          */
+/*       Linker for separately compiled CPL programs.                       */
+/*                                                                          */
+/*           cpllink <code> <object> ...                                    */
+/*                                                                          */
+/*       combines the object files written by "comp2 --object" (see         */
+/*       comp2/object.c) into one machine code program in <code>, in the    */
+/*       same form as comp2 writes.  The programs' global variables are     */
+/*       shared by name, so each program declares the globals it uses, and  */
+/*       a procedure one program declares EXTERNAL is found among the       */
+/*       outermost procedures of the others.  The main blocks are run in    */
+/*       the order the objects are named, each like a procedure called      */
+/*       from startup code which reserves the globals and finally halts.    */
+/*                                                                          */
+/*       Memory is laid out as:                                             */
+/*                                                                          */
+/*           code    startup code, then each object's code in turn          */
+/*           data    the named globals, in the order first declared, then   */
+/*                   each object's main program temporaries                 */
+/*                                                                          */
+/*       Errors are reported on stderr and leave <code> unwritten.          */
+/*                                                                          */
+/*       There is no makefile; the linker shares comp2's code and object    */
+/*       file modules and what they use, so build it from comp2/ with       */
+/*                                                                          */
+/*           gcc -x c -O2 -I. -o cpllink ../cpllink/cpllink.cpp code.cpp    */
+/*               object.cpp memory.cpp timing.cpp trace.cpp fatal.cpp       */
+/*               -lpthread                                                  */
+/*                                                                          */
+/*--------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../comp2/code.h"
+#include "../comp2/object.h"
+
+/*--------------------------------------------------------------------------*/
+/*                                                                          */
+/*  MODULE:  One object file and where the linker puts it.                  */
+/*                                                                          */
+/*--------------------------------------------------------------------------*/
+
+typedef struct  {
+    char *file;                    /*  Object file name, for messages.      */
+    OBJECT object;
+    int base;                      /*  Code address of its first            */
+                                   /*  instruction.                         */
+    int *data;                     /*  Final address of each data word.     */
+    int *imports;                  /*  Final address of each import.        */
+}
+    MODULE;
+
+/*--------------------------------------------------------------------------*/
+/*                                                                          */
+/*  Function prototypes                                                     */
+/*                                                                          */
+/*--------------------------------------------------------------------------*/
+
+PRIVATE int    ReadModule( MODULE *module, char *file );
+PRIVATE int    LayoutData( MODULE *modules, int count, int *DataSize );
+PRIVATE int    ResolveImports( MODULE *modules, int count, int DataSize );
+PRIVATE int    FindExport( MODULE *modules, int count, char *name,
+                           int *which );
+PRIVATE void   Link( MODULE *modules, int count, int DataSize,
+                     FILE *codefile );
+PRIVATE void   FreeModules( MODULE *modules, int count );
+
+/*--------------------------------------------------------------------------*/
+/*                                                                          */
+/*  Main: Linker entry point.                                               */
+/*                                                                          */
+/*--------------------------------------------------------------------------*/
+
+PUBLIC int main( int argc, char *argv[] )
+{
+    MODULE *modules;
+    FILE *CodeFile;
+    int i, count, DataSize, ok = 1;
+
+    if ( argc < 3 )
+    {
+        fprintf( stderr, "%s <code> <object> ...\n", argv[0] );
+        return EXIT_FAILURE;
+    }
+    count = argc - 2;
+    if ( NULL == ( modules = calloc( count, sizeof( MODULE ) ) ) )
+    {
+        fprintf( stderr, "Fatal error, cannot allocate module table\n" );
+        return EXIT_FAILURE;
+    }
+
+    for ( i = 0; i < count; i++ )
+        ok = ReadModule( &modules[i], argv[i+2] ) && ok;
+    ok = ok && LayoutData( modules, count, &DataSize );
+    ok = ok && ResolveImports( modules, count, DataSize );
+
+    if ( ok )
+    {
+        if ( NULL == ( CodeFile = fopen( argv[1], "w" ) ) )
+        {
+            fprintf( stderr, "cannot open \"%s\" for output\n", argv[1] );
+            ok = 0;
+        }
+        else
+        {
+            Link( modules, count, DataSize, CodeFile );
+            ok = !ferror( CodeFile );
+            if ( fclose( CodeFile ) != 0 )  ok = 0;
+            if ( !ok )  fprintf( stderr, "error writing \"%s\"\n", argv[1] );
+        }
+    }
+    FreeModules( modules, count );
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/*--------------------------------------------------------------------------*/
+/*                                                                          */
+/*  ReadModule: Reads an object file.                                       */
+/*                                                                          */
+/*    Inputs:       file, its name                                          */
+/*                                                                          */
+/*    Outputs:      *module, the object read, with no layout yet            */
+/*                                                                          */
+/*    Returns:      1 if it was read, 0 if not, when a message has been     */
+/*                  written to stderr                                       */
+/*                                                                          */
+/*--------------------------------------------------------------------------*/
+
+PRIVATE int ReadModule( MODULE *module, char *file )
+{
+    FILE *fp;
+    int line, ok;
+
+    module->file = file;
+    if ( NULL == ( fp = fopen( file, "r" ) ) )
+    {
+        fprintf( stderr, "cannot open \"%s\" for input\n", file );
+        return 0;
+    }
+    ok = ReadObjectFile( fp, &module->object, &line );
+    fclose( fp );
+    if ( !ok && line == 0 )
+        fprintf( stderr, "%s: out of memory reading object file\n", file );
+    else if ( !ok && line == 1 )
+        fprintf( stderr, "%s: not an object file (or it had errors)\n",
+                 file );
+    else if ( !ok )
+        fprintf( stderr, "%s:%d: malformed object file\n", file, line );
+    return ok;
+}
+
+/*--------------------------------------------------------------------------*/
+/*                                                                          */
+/*  LayoutData: Gives every data word of every object its final address.    */
+/*              Globals of the same name share a word; a name may not be    */
+/*              both a global and a procedure.                              */
+/*                                                                          */
+/*    Inputs:       modules, count, the objects                             */
+/*                                                                          */
+/*    Outputs:      each module's data[], and *DataSize, the words of data  */
+/*                  in the whole program                                    */
+/*                                                                          */
+/*    Returns:      1 if all is well, 0 if not, when a message has been     */
+/*                  written to stderr                                       */
+/*                                                                          */
+/*--------------------------------------------------------------------------*/
+
+PRIVATE int LayoutData( MODULE *modules, int count, int *DataSize )
+{
+    OBJECTSYMBOL *global, *other = NULL;
+    OBJECT *object;
+    int m, n, i, j, next = 0, which, ok = 1;
+
+    for ( m = 0; m < count; m++ )
+    {
+        object = &modules[m].object;
+        if ( NULL == ( modules[m].data =
+                       malloc( ( object->DataSize + 1 ) * sizeof( int ) ) ) )
+        {
+            fprintf( stderr, "Fatal error, cannot allocate data map\n" );
+            return 0;
+        }
+        for ( i = 0; i < object->DataSize; i++ )  modules[m].data[i] = -1;
+    }
+
+    /*  Named globals first, each at the address given it by the first     */
+    /*  object to declare it.                                              */
+
+    for ( m = 0; m < count; m++ )
+    {
+        object = &modules[m].object;
+        for ( i = 0; i < object->GlobalCount; i++ )
+        {
+            global = &object->globals[i];
+            if ( FindExport( modules, count, global->name, &which ) >= 0 )
+            {
+                fprintf( stderr, "%s: \"%s\" is a variable here but a "
+                         "procedure in %s\n", modules[m].file, global->name,
+                         modules[which].file );
+                ok = 0;
+            }
+            for ( n = 0; n <= m; n++ )
+            {
+                for ( j = 0; j < modules[n].object.GlobalCount; j++ )
+                {
+                    other = &modules[n].object.globals[j];
+                    if ( other != global &&
+                         strcmp( other->name, global->name ) == 0 )  break;
+                }
+                if ( j < modules[n].object.GlobalCount )  break;
+            }
+            if ( n <= m )
+                modules[m].data[global->address] =
+                    modules[n].data[other->address];
+            else
+                modules[m].data[global->address] = next++;
+        }
+    }
+
+    /*  Then each object's temporaries.                                    */
+
+    for ( m = 0; m < count; m++ )
+        for ( i = 0; i < modules[m].object.DataSize; i++ )
+            if ( modules[m].data[i] < 0 )  modules[m].data[i] = next++;
+
+    *DataSize = next;
+    return ok;
+}
+
+/*--------------------------------------------------------------------------*/
+/*                                                                          */
+/*  ResolveImports: Places each object's code and finds the procedure       */
+/*                  each of its imports names, checking that it has the     */
+/*                  same parameters and is declared only once.              */
+/*                                                                          */
+/*    Inputs:       modules, count, the objects, with their data laid out   */
+/*                  DataSize, the words of data in the program              */
+/*                                                                          */
+/*    Outputs:      each module's base and imports[]                        */
+/*                                                                          */
+/*    Returns:      1 if all is well, 0 if not, when a message has been     */
+/*                  written to stderr                                       */
+/*                                                                          */
+/*--------------------------------------------------------------------------*/
+
+PRIVATE int ResolveImports( MODULE *modules, int count, int DataSize )
+{
+    OBJECTSYMBOL *import, *export;
+    OBJECT *object;
+    int m, n = 0, i, e, address, ok = 1;
+
+    address = ( DataSize > 0 ) + 3 * count + 1;    /*  startup, see Link   */
+    for ( m = 0; m < count && address <= CODE_LIMIT; m++ )
+    {
+        modules[m].base = address;
+        address += modules[m].object.CodeSize;
+    }
+    if ( address > CODE_LIMIT )
+    {
+        fprintf( stderr, "program too large, %d instructions (the limit is "
+                 "%d)\n", address, CODE_LIMIT );
+        return 0;
+    }
+
+    for ( m = 0; m < count; m++ )
+    {
+        object = &modules[m].object;
+        for ( i = 0; i < object->ExportCount; i++ )
+            if ( FindExport( modules, count, object->exports[i].name, &n ) !=
+                 i || n != m )
+            {
+                fprintf( stderr, "%s: procedure \"%s\" is also declared in "
+                         "%s\n", modules[m].file, object->exports[i].name,
+                         modules[n].file );
+                ok = 0;
+            }
+    }
+
+    for ( m = 0; m < count; m++ )
+    {
+        object = &modules[m].object;
+        if ( NULL == ( modules[m].imports =
+                       malloc( ( object->ImportCount + 1 ) * sizeof( int ) ) ) )
+        {
+            fprintf( stderr, "Fatal error, cannot allocate import map\n" );
+            return 0;
+        }
+        for ( i = 0; i < object->ImportCount; i++ )
+        {
+            import = &object->imports[i];
+            if ( ( e = FindExport( modules, count, import->name, &n ) ) < 0 )
+            {
+                fprintf( stderr, "%s: EXTERNAL procedure \"%s\" is not "
+                         "declared in any object\n", modules[m].file,
+                         import->name );
+                ok = 0;
+                continue;
+            }
+            export = &modules[n].object.exports[e];
+            if ( export->pcount != import->pcount ||
+                 export->ptypes != import->ptypes )
+            {
+                fprintf( stderr, "%s: EXTERNAL procedure \"%s\" has "
+                         "different parameters in %s\n", modules[m].file,
+                         import->name, modules[n].file );
+                ok = 0;
+            }
+            modules[m].imports[i] = modules[n].base + export->address;
+        }
+    }
+    return ok;
+}
+
+/*--------------------------------------------------------------------------*/
+/*                                                                          */
+/*  FindExport: Finds the first object to declare a procedure.              */
+/*                                                                          */
+/*    Inputs:       modules, count, the objects                             */
+/*                  name, the procedure's name                              */
+/*                                                                          */
+/*    Outputs:      *which, the index of the object declaring it            */
+/*                                                                          */
+/*    Returns:      The index of the procedure among that object's          */
+/*                  exports, or -1 if no object declares it                 */
+/*                                                                          */
+/*--------------------------------------------------------------------------*/
+
+PRIVATE int FindExport( MODULE *modules, int count, char *name, int *which )
+{
+    OBJECT *object;
+    int m, i;
+
+    for ( m = 0; m < count; m++ )
+    {
+        object = &modules[m].object;
+        for ( i = 0; i < object->ExportCount; i++ )
+            if ( strcmp( object->exports[i].name, name ) == 0 )
+            {
+                *which = m;
+                return i;
+            }
+    }
+    return -1;
+}
+
+/*--------------------------------------------------------------------------*/
+/*                                                                          */
+/*  Link: Writes the program: startup code which reserves the data and      */
+/*        runs each object's main block, then the objects' code with its    */
+/*        addresses relocated.                                              */
+/*                                                                          */
+/*    Inputs:       modules, count, the objects, laid out and resolved      */
+/*                  DataSize, the words of data in the program              */
+/*                  codefile, where the machine code is written             */
+/*                                                                          */
+/*    Outputs:      None.  The file is written but not closed.              */
+/*                                                                          */
+/*    Returns:      Nothing                                                 */
+/*                                                                          */
+/*--------------------------------------------------------------------------*/
+
+PRIVATE void Link( MODULE *modules, int count, int DataSize, FILE *codefile )
+{
+    CODEGEN cg;
+    INSTRUCTION *inst;
+    MODULE *module;
+    int m, i, address;
+
+    InitCodeGenerator( &cg, codefile );
+    if ( DataSize > 0 )  Emit( &cg, I_INC, DataSize );
+    for ( m = 0; m < count; m++ )
+    {
+        _Emit( &cg, I_BSF );
+        Emit( &cg, I_CALL, modules[m].base + modules[m].object.body );
+        _Emit( &cg, I_RSF );
+    }
+    _Emit( &cg, I_HALT );
+
+    for ( m = 0; m < count; m++ )
+    {
+        module = &modules[m];
+        for ( i = 0; i < module->object.CodeSize; i++ )
+        {
+            inst = &module->object.code[i];
+            switch ( module->object.link[i] )
+            {
+                case LINK_CODE :
+                    address = module->base + inst->address;
+                    break;
+                case LINK_DATA :
+                    address = module->data[inst->address];
+                    break;
+                case LINK_IMPORT :
+                    address = module->imports[inst->address];
+                    break;
+                default :
+                    address = inst->address;
+                    break;
+            }
+            Emit( &cg, inst->opcode, address );
+        }
+    }
+    WriteCodeFile( &cg );
+    FreeCodeGenerator( &cg );
+}
+
+/*--------------------------------------------------------------------------*/
+/*                                                                          */
+/*  FreeModules: Releases the module table and everything it holds.         */
+/*                                                                          */
+/*    Inputs:       modules, count, the table                               */
+/*                                                                          */
+/*    Returns:      Nothing                                                 */
+/*                                                                          */
+/*--------------------------------------------------------------------------*/
+
+PRIVATE void FreeModules( MODULE *modules, int count )
+{
+    int m;
+
+    for ( m = 0; m < count; m++ )
+    {
+        FreeObject( &modules[m].object );
+        free( modules[m].data );
+        free( modules[m].imports );
+    }
+    free( modules );
+}